@@ -1,8 +1,8 @@
-/** 
+/**
  * @Author: running-code-pp 3320996652@qq.com
  * @Date: 2025-10-13 15:39:47
  * @LastEditors: running-code-pp 3320996652@qq.com
- * @LastEditTime: 2025-10-13 15:40:30
+ * @LastEditTime: 2026-10-18 16:35:53
  * @FilePath: \asio-learn-code\include\asio_learn\SessionTimeoutManager.hpp
  * @Description: 带有超时机制的会话管理器，自动断开长时间不活跃的连接，节省系统资源
  * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
@@ -10,14 +10,16 @@
 #ifndef ASIO_LEARN_SESSION_TIMEOUT_MANAGER_HPP
 #define ASIO_LEARN_SESSION_TIMEOUT_MANAGER_HPP
 
-
-#include <array>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
 #include <memory>
 #include <vector>
-#include <chrono>
+
 #include "asio_learn/public.hpp"
 #include "common/Log.hpp"
-#include "common/uuid.hpp"
 /**
  * 合理设置超时间: 太短会导致频繁断开连接，影响用户体验；太长则可能浪费资源。
  * 区分不同类型的会话: 可以区分优先级，设置不同的超时策略
@@ -25,26 +27,216 @@
  * 资源清理： 确保在断开连接后，释放相关资源，防止内存泄漏
  */
 
+/**
+ * 粗粒度tick模式(coarse tick)：
+ * - 不给每个会话单独挂一个steady_timer，每个io_context只有一个周期性的清扫定时器
+ * - 清扫定时器每个tick刷新一次缓存的粗粒度时间，会话读写时只把这个缓存值写进自己的槽位，不产生系统调用
+ * - 最后活跃时间存放在连续的数组里，清扫时顺序扫描，对cache友好
+ * - 每个tick最多扫描 max_sweep_per_tick 个槽位，游标轮转，保证单次清扫耗时有上界，不会卡住reactor
+ *
+ * 精度：超时被发现的最大延迟 = tick + ceil(槽位数 / max_sweep_per_tick) * tick
+ * 线程模型：非线程安全，所有接口都必须在绑定的io_context所在线程调用（每个Worker一个实例）
+ */
+
 namespace asio_learn{
 
     class SessionTimeoutManager{
         public:
-        using Duration = std::chrono::steady_clock::duration; //超时间隔类型
         using Clock = std::chrono::steady_clock; //时钟类型
-        using SessionUid  = common::uuid;
-        using TimeoutHandler = std::function<void(const SessionUid& session_uuid)>; //超时处理方法
-        SessionTimeoutManager(){}
+        using Duration = Clock::duration; //超时间隔类型
+        using SlotId = uint32;
+        using TimeoutHandler = std::function<void()>; //超时处理方法, 一般是关闭socket
+
+        static constexpr SlotId INVALID_SLOT = std::numeric_limits<SlotId>::max();
+
+        SessionTimeoutManager(io_context& ioc,
+                              Duration idle_timeout,
+                              Duration tick = std::chrono::seconds(1),
+                              std::size_t max_sweep_per_tick = 1024)
+            : _timer(ioc)
+            , _idle_timeout(to_ms(idle_timeout))
+            , _tick(tick)
+            , _max_sweep_per_tick(std::max<std::size_t>(max_sweep_per_tick, 1))
+            , _now(coarse_now())
+        {
+        }
         ~SessionTimeoutManager(){}
 
+        SessionTimeoutManager(const SessionTimeoutManager&) = delete;
+        SessionTimeoutManager& operator=(const SessionTimeoutManager&) = delete;
+
+        // 启动周期性清扫
+        void start()
+        {
+            _running = true;
+            schedule_tick();
+        }
+
+        // 停止清扫，需要在io_context销毁之前调用
+        void stop()
+        {
+            _running = false;
+            _timer.cancel();
+        }
+
+        // 注册会话，返回的槽位在会话销毁时通过remove归还
+        SlotId add(TimeoutHandler handler)
+        {
+            SlotId id;
+            if (!_free_slots.empty())
+            {
+                id = _free_slots.back();
+                _free_slots.pop_back();
+                _handlers[id] = std::move(handler);
+                _last_active[id] = _now;
+            }
+            else
+            {
+                id = static_cast<SlotId>(_last_active.size());
+                _last_active.push_back(_now);
+                _handlers.push_back(std::move(handler));
+            }
+            ++_active;
+            return id;
+        }
+
+        // 标记会话活跃，只写缓存的粗粒度时间; 已超时的槽位不再重新计时
+        void touch(SlotId id) noexcept
+        {
+            if (_last_active[id] >= 0)
+            {
+                _last_active[id] = _now;
+            }
+        }
+
+        // 注销会话
+        void remove(SlotId id)
+        {
+            if (id >= _last_active.size() || _last_active[id] == FREE_SLOT)
+            {
+                return;
+            }
+            if (_last_active[id] != EXPIRED_SLOT)
+            {
+                --_active;
+            }
+            _last_active[id] = FREE_SLOT;
+            _handlers[id] = nullptr;
+            _free_slots.push_back(id);
+        }
+
+        // 当前缓存的粗粒度时间(ms)
+        int64_t now() const noexcept
+        {
+            return _now;
+        }
+
+        // 未超时的会话数量
+        std::size_t active_count() const noexcept
+        {
+            return _active;
+        }
+
+        // 累计因空闲被关闭的会话数量
+        uint64 expired_total() const noexcept
+        {
+            return _expired_total;
+        }
+
+        private:
+        // 空闲槽位 / 已超时等待注销的槽位
+        static constexpr int64_t FREE_SLOT = -1;
+        static constexpr int64_t EXPIRED_SLOT = -2;
+
+        static int64_t to_ms(Duration d)
+        {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+        }
+
+        static int64_t coarse_now()
+        {
+            return to_ms(Clock::now().time_since_epoch());
+        }
+
+        void schedule_tick()
+        {
+            _timer.expires_after(_tick);
+            _timer.async_wait(
+                [this](const asio::error_code& ec)
+                {
+                    if (ec || !_running)
+                    {
+                        return;
+                    }
+                    _now = coarse_now();
+                    sweep();
+                    schedule_tick();
+                });
+        }
+
+        // 从游标处开始扫描一批槽位
+        void sweep()
+        {
+            const std::size_t slot_count = _last_active.size();
+            if (slot_count == 0)
+            {
+                return;
+            }
+            const std::size_t batch = std::min(slot_count, _max_sweep_per_tick);
+            const int64_t deadline = _now - _idle_timeout;
+            std::size_t cursor = _cursor < slot_count ? _cursor : 0;
+            for (std::size_t i = 0; i < batch; ++i)
+            {
+                const int64_t last = _last_active[cursor];
+                if (last >= 0 && last < deadline)
+                {
+                    _expired.push_back(static_cast<SlotId>(cursor));
+                }
+                if (++cursor == slot_count)
+                {
+                    cursor = 0;
+                }
+            }
+            _cursor = cursor;
+
+            // 扫描结束后再回调，回调里可能会remove/add，避免扫描过程中修改数组
+            for (SlotId id : _expired)
+            {
+                if (_last_active[id] < 0)
+                {
+                    continue;
+                }
+                // 只撤销计时，槽位等会话析构时remove再归还，防止槽位被复用后误关
+                _last_active[id] = EXPIRED_SLOT;
+                --_active;
+                ++_expired_total;
+                if (_handlers[id])
+                {
+                    _handlers[id]();
+                }
+            }
+            _expired.clear();
+        }
+
         private:
-        io_context _ioc;
-        Duration _duration; // 超时间隔
-        tcp_acceptor _acceptor{_ioc};
-        std::unordered_map<SessionUid,std::shared_ptr<tcp_socket
-    }
+        steady_timer _timer;
+        int64_t _idle_timeout; // 超时间隔(ms)
+        Duration _tick; // 清扫周期
+        std::size_t _max_sweep_per_tick; // 每次tick最多扫描的槽位数
+        int64_t _now; // 缓存的粗粒度时间(ms)
+        bool _running = false;
+
+        std::vector<int64_t> _last_active; // 热数据：每个槽位的最后活跃时间
+        std::vector<TimeoutHandler> _handlers; // 冷数据：只在超时时访问
+        std::vector<SlotId> _free_slots;
+        std::vector<SlotId> _expired;
+        std::size_t _cursor = 0;
+        std::size_t _active = 0;
+        uint64 _expired_total = 0;
+    };
+
 
-    
 } // namespace asio_learn
 
 
-#endif // ASIO_LEARN_SESSION_TIMEOUT_MANAGER_HPP
\ No newline at end of file
+#endif // ASIO_LEARN_SESSION_TIMEOUT_MANAGER_HPP
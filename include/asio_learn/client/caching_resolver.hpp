@@ -0,0 +1,379 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 16:40:03
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 19:31:23
+ * @FilePath: \asio-learn-code\include\asio_learn\client\caching_resolver.hpp
+ * @Description: 带缓存的异步DNS解析：正/负TTL、过期前后台刷新、同名并发查询合并、hosts文件覆盖
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_CLIENT_CACHING_RESOLVER_HPP
+#define ASIO_LEARN_CLIENT_CACHING_RESOLVER_HPP
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "asio_learn/client/completion.hpp"
+#include "asio_learn/public.hpp"
+#include "common/Log.hpp"
+
+/**
+ * - 命中且未到刷新点: 直接返回缓存
+ * - 命中且过了刷新点(refresh_ahead * ttl): 仍然返回缓存，同时在后台发起一次查询，刷新失败时继续用旧结果直到过期
+ * - 未命中/已过期: 发起查询，同一 host:service 的并发请求只查一次，结果一起返回
+ * - 查询失败的结果按 negative_ttl 缓存，避免坏域名把每个请求都拖到getaddrinfo上
+ * - hosts文件/add_override里的名字不走后端，也不过期
+ * 后端可替换，默认用 asio::ip::tcp::resolver (getaddrinfo)，测试里换成假的后端
+ */
+
+namespace asio_learn::client
+{
+  struct CachingResolverOptions
+  {
+    std::chrono::milliseconds positive_ttl{ 30000 };
+    std::chrono::milliseconds negative_ttl{ 5000 };
+    double refresh_ahead = 0.8;   // 过了ttl的这个比例后，命中时触发后台刷新；>=1表示不刷新
+    size_t max_entries = 4096;
+    std::string hosts_file;       // 为空表示不加载，格式同 /etc/hosts
+  };
+
+  struct CachingResolverStats
+  {
+    uint64 hits = 0;
+    uint64 negative_hits = 0;
+    uint64 misses = 0;
+    uint64 coalesced = 0;   // 合并到进行中查询的请求
+    uint64 refreshes = 0;   // 后台刷新次数
+    uint64 overrides = 0;   // hosts覆盖命中
+    uint64 backend_lookups = 0;
+  };
+
+  class CachingResolver : public std::enable_shared_from_this<CachingResolver>
+  {
+   public:
+    using Clock = std::chrono::steady_clock;
+    using Endpoints = std::vector<tcp_endpoint>;
+    using BackendHandler = std::function<void(error_code, Endpoints)>;
+    // 后端: 解析host:service，完成时调用handler(可以在任意线程)
+    using Backend = std::function<void(const std::string& host, const std::string& service, BackendHandler handler)>;
+
+    // 默认后端: getaddrinfo
+    static Backend system_backend(io_context& ioc)
+    {
+      return [&ioc](const std::string& host, const std::string& service, BackendHandler handler)
+      {
+        auto resolver = std::make_shared<asio::ip::tcp::resolver>(ioc);
+        resolver->async_resolve(
+            host,
+            service,
+            [resolver, handler = std::move(handler)](const asio::error_code& ec, asio::ip::tcp::resolver::results_type results)
+            {
+              Endpoints endpoints;
+              for (const auto& entry : results)
+              {
+                endpoints.push_back(entry.endpoint());
+              }
+              handler(ec, std::move(endpoints));
+            });
+      };
+    }
+
+    CachingResolver(io_context& ioc, CachingResolverOptions options = {}, Backend backend = nullptr)
+      : _ioc(ioc)
+      , _strand(asio::make_strand(ioc))
+      , _options(std::move(options))
+      , _backend(backend ? std::move(backend) : system_backend(ioc))
+    {
+      if (!_options.hosts_file.empty())
+      {
+        load_hosts_file(_options.hosts_file);
+      }
+    }
+
+    CachingResolver(const CachingResolver&) = delete;
+    CachingResolver& operator=(const CachingResolver&) = delete;
+
+    // 固定解析结果，优先于缓存和后端；必须在开始解析前调用
+    void add_override(const std::string& host, std::vector<asio::ip::address> addresses)
+    {
+      auto& entry = _overrides[lower(host)];
+      entry.insert(entry.end(), addresses.begin(), addresses.end());
+    }
+
+    // 加载hosts格式文件: "地址 名字 [别名...]"，#后为注释；必须在开始解析前调用
+    bool load_hosts_file(const std::string& path)
+    {
+      std::ifstream in(path);
+      if (!in)
+      {
+        LOG_WARN("caching resolver can not open hosts file {}", path);
+        return false;
+      }
+      std::string line;
+      while (std::getline(in, line))
+      {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string address_text;
+        if (!(fields >> address_text))
+        {
+          continue;
+        }
+        asio::error_code ec;
+        auto address = asio::ip::make_address(address_text, ec);
+        if (ec)
+        {
+          continue;
+        }
+        std::string name;
+        while (fields >> name)
+        {
+          _overrides[lower(name)].push_back(address);
+        }
+      }
+      return true;
+    }
+
+    /**
+     * @brief 解析host:service
+     * @param token 完成签名 void(error_code, std::vector<tcp_endpoint>)
+     */
+    template<typename CompletionToken>
+    auto async_resolve(std::string host, std::string service, CompletionToken&& token)
+    {
+      return asio::async_initiate<CompletionToken, void(error_code, Endpoints)>(
+          [self = shared_from_this()](auto handler, std::string host, std::string service)
+          {
+            auto waiter = make_completion<error_code, Endpoints>(std::move(handler), self->_ioc.get_executor());
+            asio::dispatch(
+                self->_strand,
+                [self, host = std::move(host), service = std::move(service), waiter = std::move(waiter)]() mutable
+                { self->do_resolve(std::move(host), std::move(service), std::move(waiter)); });
+          },
+          token,
+          std::move(host),
+          std::move(service));
+    }
+
+    CachingResolverStats stats() const
+    {
+      CachingResolverStats stats;
+      stats.hits = _hits.load(std::memory_order_relaxed);
+      stats.negative_hits = _negative_hits.load(std::memory_order_relaxed);
+      stats.misses = _misses.load(std::memory_order_relaxed);
+      stats.coalesced = _coalesced.load(std::memory_order_relaxed);
+      stats.refreshes = _refreshes.load(std::memory_order_relaxed);
+      stats.overrides = _override_hits.load(std::memory_order_relaxed);
+      stats.backend_lookups = _backend_lookups.load(std::memory_order_relaxed);
+      return stats;
+    }
+
+   private:
+    using Waiter = std::function<void(error_code, Endpoints)>;
+
+    struct Entry
+    {
+      bool valid = false;  // 是否有可用的结果(包括缓存的失败)
+      error_code ec;
+      Endpoints endpoints;
+      Clock::time_point refresh_at;
+      Clock::time_point expires_at;
+      bool in_flight = false;
+      std::vector<Waiter> waiters;
+    };
+
+    static std::string lower(std::string text)
+    {
+      std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+      return text;
+    }
+
+    // hosts覆盖只支持数字端口
+    bool resolve_override(const std::string& host, const std::string& service, Waiter& waiter)
+    {
+      auto it = _overrides.find(host);
+      if (it == _overrides.end())
+      {
+        return false;
+      }
+      char* end = nullptr;
+      unsigned long port = std::strtoul(service.c_str(), &end, 10);
+      if (service.empty() || *end != '\0' || port > 65535)
+      {
+        return false;
+      }
+      Endpoints endpoints;
+      for (const auto& address : it->second)
+      {
+        endpoints.emplace_back(address, static_cast<uint16>(port));
+      }
+      ++_override_hits;
+      waiter(error_code(), std::move(endpoints));
+      return true;
+    }
+
+    void do_resolve(std::string host, std::string service, Waiter waiter)
+    {
+      host = lower(std::move(host));
+      if (resolve_override(host, service, waiter))
+      {
+        return;
+      }
+
+      std::string key = host + ":" + service;
+      auto now = Clock::now();
+      auto it = _entries.find(key);
+      if (it != _entries.end() && it->second.valid && now < it->second.expires_at)
+      {
+        auto& entry = it->second;
+        if (entry.ec)
+        {
+          ++_negative_hits;
+        }
+        else
+        {
+          ++_hits;
+          if (now >= entry.refresh_at && !entry.in_flight)
+          {
+            ++_refreshes;
+            start_lookup(key, host, service, entry);
+          }
+        }
+        waiter(entry.ec, entry.endpoints);
+        return;
+      }
+
+      if (it == _entries.end())
+      {
+        evict_if_full(now);
+        it = _entries.emplace(key, Entry{}).first;
+      }
+      auto& entry = it->second;
+      entry.waiters.push_back(std::move(waiter));
+      if (entry.in_flight)
+      {
+        ++_coalesced;
+        return;
+      }
+      ++_misses;
+      start_lookup(key, host, service, entry);
+    }
+
+    void start_lookup(const std::string& key, const std::string& host, const std::string& service, Entry& entry)
+    {
+      entry.in_flight = true;
+      ++_backend_lookups;
+      _backend(
+          host,
+          service,
+          [self = shared_from_this(), key](error_code ec, Endpoints endpoints)
+          {
+            asio::dispatch(
+                self->_strand,
+                [self, key, ec, endpoints = std::move(endpoints)]() mutable
+                { self->on_lookup_done(key, ec, std::move(endpoints)); });
+          });
+    }
+
+    void on_lookup_done(const std::string& key, error_code ec, Endpoints endpoints)
+    {
+      auto it = _entries.find(key);
+      if (it == _entries.end())
+      {
+        return;
+      }
+      auto& entry = it->second;
+      entry.in_flight = false;
+      auto now = Clock::now();
+      if (!ec && endpoints.empty())
+      {
+        ec = asio::error::host_not_found;
+      }
+
+      if (ec && entry.valid && !entry.ec && now < entry.expires_at)
+      {
+        // 后台刷新失败，继续用旧结果直到过期
+        LOG_WARN("caching resolver refresh of {} failed: {}", key, ec.message());
+      }
+      else
+      {
+        auto ttl = ec ? _options.negative_ttl : _options.positive_ttl;
+        entry.valid = true;
+        entry.ec = ec;
+        entry.endpoints = std::move(endpoints);
+        entry.expires_at = now + ttl;
+        entry.refresh_at = now + std::chrono::duration_cast<Clock::duration>(ttl * std::min(_options.refresh_ahead, 1.0));
+      }
+
+      auto waiters = std::move(entry.waiters);
+      entry.waiters.clear();
+      for (auto& waiter : waiters)
+      {
+        waiter(entry.ec, entry.endpoints);
+      }
+    }
+
+    // 超过上限时先清理过期项，仍然超过就淘汰最早过期的一项
+    void evict_if_full(Clock::time_point now)
+    {
+      if (_entries.size() < _options.max_entries)
+      {
+        return;
+      }
+      for (auto it = _entries.begin(); it != _entries.end();)
+      {
+        if (!it->second.in_flight && (!it->second.valid || now >= it->second.expires_at))
+        {
+          it = _entries.erase(it);
+        }
+        else
+        {
+          ++it;
+        }
+      }
+      if (_entries.size() < _options.max_entries)
+      {
+        return;
+      }
+      auto victim = _entries.end();
+      for (auto it = _entries.begin(); it != _entries.end(); ++it)
+      {
+        if (!it->second.in_flight && (victim == _entries.end() || it->second.expires_at < victim->second.expires_at))
+        {
+          victim = it;
+        }
+      }
+      if (victim != _entries.end())
+      {
+        _entries.erase(victim);
+      }
+    }
+
+    io_context& _ioc;
+    asio::strand<io_context::executor_type> _strand;
+    CachingResolverOptions _options;
+    Backend _backend;
+    std::unordered_map<std::string, std::vector<asio::ip::address>> _overrides;  // 构造后只读
+    std::unordered_map<std::string, Entry> _entries;                               // 只在_strand上访问
+
+    std::atomic<uint64> _hits{ 0 };
+    std::atomic<uint64> _negative_hits{ 0 };
+    std::atomic<uint64> _misses{ 0 };
+    std::atomic<uint64> _coalesced{ 0 };
+    std::atomic<uint64> _refreshes{ 0 };
+    std::atomic<uint64> _override_hits{ 0 };
+    std::atomic<uint64> _backend_lookups{ 0 };
+  };
+}  // namespace asio_learn::client
+
+#endif  // ASIO_LEARN_CLIENT_CACHING_RESOLVER_HPP
@@ -0,0 +1,72 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 19:15:08
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 19:15:08
+ * @FilePath: \asio-learn-code\include\asio_learn\client\completion.hpp
+ * @Description: 把async_initiate拿到的handler包成可拷贝的std::function，结果投递回handler关联的executor
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_CLIENT_COMPLETION_HPP
+#define ASIO_LEARN_CLIENT_COMPLETION_HPP
+#include <functional>
+#include <memory>
+#include <tuple>
+#include <utility>
+
+#include "asio_learn/public.hpp"
+
+/**
+ * 连接池、解析缓存、多路复用客户端都要把等待者放进容器里，稍后在strand上完成，容器里只能放std::function
+ * - std::function要求可拷贝，handler可能只能移动，放进shared_ptr; 用handler关联的allocator分配
+ * - 完成前一直持有executor的outstanding work，等待者排队期间io_context::run不会因为没有活儿提前返回
+ * - 结果投递到handler关联的executor，没有关联时用fallback; 投递时的内存同样走handler的allocator
+ */
+
+namespace asio_learn::client
+{
+  namespace details
+  {
+    template<typename Handler, typename Allocator, typename... Args>
+    struct PostedCompletion
+    {
+      using allocator_type = Allocator;
+
+      allocator_type get_allocator() const noexcept
+      {
+        return allocator;
+      }
+
+      void operator()()
+      {
+        std::apply(std::move(*handler), std::move(args));
+      }
+
+      std::shared_ptr<Handler> handler;
+      Allocator allocator;
+      std::tuple<Args...> args;
+    };
+  }  // namespace details
+
+  /**
+   * @brief 用法: auto waiter = make_completion<error_code, std::string>(std::move(handler), fallback_executor);
+   * @return 只能调用一次
+   */
+  template<typename... Args, typename Handler, typename Executor>
+  std::function<void(Args...)> make_completion(Handler handler, const Executor& fallback)
+  {
+    auto allocator = asio::get_associated_allocator(handler);
+    auto executor = asio::prefer(
+        asio::get_associated_executor(handler, fallback), asio::execution::outstanding_work.tracked);
+    auto shared = std::allocate_shared<Handler>(allocator, std::move(handler));
+    return [shared = std::move(shared), allocator, executor](Args... args)
+    {
+      asio::post(
+          executor,
+          details::PostedCompletion<Handler, decltype(allocator), Args...>{
+              shared, allocator, std::tuple<Args...>(std::move(args)...) });
+    };
+  }
+}  // namespace asio_learn::client
+
+#endif  // ASIO_LEARN_CLIENT_COMPLETION_HPP
@@ -1,12 +1,518 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 19:20:08
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 19:20:08
+ * @FilePath: \asio-learn-code\include\asio_learn\client\connection.hpp
+ * @Description: 异步客户端连接池：按endpoint缓存空闲连接，限制并发，定期健康检查
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
 #ifndef ASIO_LEARN_CLIENT_CONNECTION_HPP
 #define ASIO_LEARN_CLIENT_CONNECTION_HPP
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <utility>
+
+#include "asio_learn/client/completion.hpp"
 #include "asio_learn/public.hpp"
 #include "common/Log.hpp"
 
+/**
+ * 用法:
+ *   auto pool = std::make_shared<client::ConnectionPool>(ioc, options);
+ *   pool->start();
+ *   pool->warm_up(endpoint, 8);
+ *   pool->async_acquire(endpoint, [](error_code ec, client::PooledConnection conn) {
+ *     // conn.socket() 上收发，conn析构时自动归还；协议出错时调用 conn.mark_broken()
+ *   });
+ *
+ * - 空闲连接按后进先出复用，最近用过的连接最"热"(拥塞窗口、路由缓存都还在)
+ * - 每个endpoint的借出+正在建立的连接数不超过 max_in_flight_per_endpoint，超出的请求排队
+ * - 借出前和定时器里都会做一次非阻塞peek，对端已关闭或残留数据的连接直接丢弃
+ * - 所有状态只在内部strand上访问，async_acquire/归还可以在任意线程调用
+ */
+
+namespace asio_learn::client
+{
+  struct ConnectionPoolOptions
+  {
+    size_t max_idle_per_endpoint = 16;
+    size_t max_in_flight_per_endpoint = 64;  // 借出+正在建立的连接上限
+    size_t max_waiters_per_endpoint = 1024;  // 排队超过该值的请求直接以try_again失败
+    std::chrono::milliseconds connect_timeout{ 3000 };
+    std::chrono::milliseconds idle_timeout{ 60000 };           // 空闲超过该时长的连接会被关闭
+    std::chrono::milliseconds health_check_interval{ 5000 };  // 为0表示不做定时检查
+    bool tcp_nodelay = true;
+  };
+
+  struct ConnectionPoolStats
+  {
+    uint64 created = 0;         // 新建的连接
+    uint64 reused = 0;          // 复用空闲连接的次数
+    uint64 connect_failed = 0;  // 建连失败/超时
+    uint64 evicted = 0;         // 健康检查或超时淘汰的空闲连接
+    uint64 discarded = 0;       // 归还时被丢弃(标记损坏或空闲已满)
+    uint64 idle = 0;
+    uint64 in_use = 0;
+    uint64 waiting = 0;
+  };
+
+  class ConnectionPool;
+
+  // 借出的连接，析构时自动归还给连接池，只能移动
+  class PooledConnection
+  {
+   public:
+    PooledConnection() = default;
+    // 移动optional不会清空源对象，这里手动reset，否则源对象仍是"有连接"的状态
+    PooledConnection(PooledConnection&& other) noexcept
+      : _pool(std::move(other._pool))
+      , _endpoint(other._endpoint)
+      , _socket(std::move(other._socket))
+      , _reused(other._reused)
+      , _broken(other._broken)
+    {
+      other._socket.reset();
+    }
+    PooledConnection& operator=(PooledConnection&& other) noexcept
+    {
+      if (this != &other)
+      {
+        release();
+        _pool = std::move(other._pool);
+        _endpoint = other._endpoint;
+        _socket = std::move(other._socket);
+        _reused = other._reused;
+        _broken = other._broken;
+        other._socket.reset();
+      }
+      return *this;
+    }
+    PooledConnection(const PooledConnection&) = delete;
+    PooledConnection& operator=(const PooledConnection&) = delete;
+
+    ~PooledConnection()
+    {
+      release();
+    }
+
+    explicit operator bool() const
+    {
+      return _socket.has_value();
+    }
+
+    tcp_socket& socket()
+    {
+      return *_socket;
+    }
+
+    const tcp_endpoint& endpoint() const
+    {
+      return _endpoint;
+    }
+
+    // 是否是复用的空闲连接(用于统计/判断是否值得重试)
+    bool reused() const
+    {
+      return _reused;
+    }
+
+    // 连接状态未知(读写出错、协议不同步)时调用，归还时直接关闭
+    void mark_broken()
+    {
+      _broken = true;
+    }
+
+    // 提前归还
+    void release();
+
+   private:
+    friend class ConnectionPool;
+    PooledConnection(std::shared_ptr<ConnectionPool> pool, const tcp_endpoint& endpoint, tcp_socket socket, bool reused)
+      : _pool(std::move(pool))
+      , _endpoint(endpoint)
+      , _socket(std::move(socket))
+      , _reused(reused)
+    {
+    }
+
+    std::shared_ptr<ConnectionPool> _pool;
+    tcp_endpoint _endpoint;
+    std::optional<tcp_socket> _socket;
+    bool _reused = false;
+    bool _broken = false;
+  };
+
+  class ConnectionPool : public std::enable_shared_from_this<ConnectionPool>
+  {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit ConnectionPool(io_context& ioc, ConnectionPoolOptions options = {})
+      : _ioc(ioc)
+      , _strand(asio::make_strand(ioc))
+      , _options(options)
+      , _health_timer(_strand)
+    {
+    }
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    // 启动健康检查定时器
+    void start()
+    {
+      if (_options.health_check_interval.count() > 0)
+      {
+        asio::dispatch(_strand, [self = shared_from_this()]() { self->schedule_health_check(); });
+      }
+    }
+
+    // 关闭所有空闲连接，排队中的请求以operation_aborted失败，之后归还的连接直接关闭
+    void close()
+    {
+      asio::dispatch(
+          _strand,
+          [self = shared_from_this()]()
+          {
+            self->_closed = true;
+            self->_health_timer.cancel();
+            for (auto& [endpoint, state] : self->_endpoints)
+            {
+              self->_counters.idle -= state.idle.size();
+              state.idle.clear();
+              while (!state.waiters.empty())
+              {
+                auto waiter = std::move(state.waiters.front());
+                state.waiters.pop_front();
+                --self->_counters.waiting;
+                waiter(asio::error::operation_aborted, PooledConnection());
+              }
+            }
+          });
+    }
+
+    // 预先为endpoint建立count条连接放入空闲列表，避免第一批请求都要付一次握手
+    void warm_up(const tcp_endpoint& endpoint, size_t count)
+    {
+      asio::dispatch(
+          _strand,
+          [self = shared_from_this(), endpoint, count]()
+          {
+            auto& state = self->_endpoints[endpoint];
+            size_t have = state.idle.size() + state.in_use + state.connecting;
+            size_t target = std::min({ count, self->_options.max_idle_per_endpoint, self->_options.max_in_flight_per_endpoint });
+            for (; have < target; ++have)
+            {
+              self->start_connect(endpoint);
+            }
+          });
+    }
+
+    /**
+     * @brief 借一条到endpoint的连接
+     * @param token 完成签名 void(error_code, PooledConnection)，回调在handler关联的executor上执行，
+     *        没有关联executor时在连接池的io_context上执行
+     */
+    template<typename CompletionToken>
+    auto async_acquire(const tcp_endpoint& endpoint, CompletionToken&& token)
+    {
+      return asio::async_initiate<CompletionToken, void(error_code, PooledConnection)>(
+          [self = shared_from_this(), endpoint](auto handler)
+          {
+            auto waiter = make_completion<error_code, PooledConnection>(std::move(handler), self->_ioc.get_executor());
+            asio::dispatch(
+                self->_strand,
+                [self, endpoint, waiter = std::move(waiter)]() mutable { self->do_acquire(endpoint, std::move(waiter)); });
+          },
+          token);
+    }
+
+    ConnectionPoolStats stats() const
+    {
+      ConnectionPoolStats stats;
+      stats.created = _counters.created.load(std::memory_order_relaxed);
+      stats.reused = _counters.reused.load(std::memory_order_relaxed);
+      stats.connect_failed = _counters.connect_failed.load(std::memory_order_relaxed);
+      stats.evicted = _counters.evicted.load(std::memory_order_relaxed);
+      stats.discarded = _counters.discarded.load(std::memory_order_relaxed);
+      stats.idle = _counters.idle.load(std::memory_order_relaxed);
+      stats.in_use = _counters.in_use.load(std::memory_order_relaxed);
+      stats.waiting = _counters.waiting.load(std::memory_order_relaxed);
+      return stats;
+    }
+
+   private:
+    friend class PooledConnection;
+
+    // 类型擦除后的等待者，调用时把结果投递到原handler的executor
+    using Waiter = std::function<void(error_code, PooledConnection)>;
+
+    struct IdleConnection
+    {
+      tcp_socket socket;
+      Clock::time_point since;
+    };
+
+    struct EndpointState
+    {
+      std::deque<IdleConnection> idle;  // 尾部最热
+      std::deque<Waiter> waiters;
+      size_t in_use = 0;
+      size_t connecting = 0;
+    };
+
+    // 只有strand写，其他线程读快照
+    struct Counters
+    {
+      std::atomic<uint64> created{ 0 };
+      std::atomic<uint64> reused{ 0 };
+      std::atomic<uint64> connect_failed{ 0 };
+      std::atomic<uint64> evicted{ 0 };
+      std::atomic<uint64> discarded{ 0 };
+      std::atomic<uint64> idle{ 0 };
+      std::atomic<uint64> in_use{ 0 };
+      std::atomic<uint64> waiting{ 0 };
+    };
+
+    // 非阻塞peek: 对端已关闭、出错或者残留未读数据的连接都不能再用
+    static bool is_alive(tcp_socket& socket)
+    {
+      if (!socket.is_open())
+      {
+        return false;
+      }
+      asio::error_code ec;
+      char byte;
+      socket.non_blocking(true, ec);
+      socket.receive(asio::buffer(&byte, 1), tcp_socket::message_peek, ec);
+      asio::error_code ignored;
+      socket.non_blocking(false, ignored);
+      return ec == asio::error::would_block;
+    }
+
+    void do_acquire(const tcp_endpoint& endpoint, Waiter waiter)
+    {
+      if (_closed)
+      {
+        waiter(asio::error::operation_aborted, PooledConnection());
+        return;
+      }
+      auto& state = _endpoints[endpoint];
+      while (!state.idle.empty())
+      {
+        tcp_socket socket = std::move(state.idle.back().socket);
+        state.idle.pop_back();
+        --_counters.idle;
+        if (!is_alive(socket))
+        {
+          ++_counters.evicted;
+          continue;
+        }
+        ++_counters.reused;
+        hand_out(endpoint, state, std::move(socket), true, waiter);
+        return;
+      }
+      if (state.waiters.size() >= _options.max_waiters_per_endpoint)
+      {
+        waiter(asio::error::try_again, PooledConnection());
+        return;
+      }
+      state.waiters.push_back(std::move(waiter));
+      ++_counters.waiting;
+      maybe_connect(endpoint, state);
+    }
+
+    void hand_out(const tcp_endpoint& endpoint, EndpointState& state, tcp_socket socket, bool reused, Waiter& waiter)
+    {
+      ++state.in_use;
+      ++_counters.in_use;
+      waiter(error_code(), PooledConnection(shared_from_this(), endpoint, std::move(socket), reused));
+    }
+
+    // 每个排队的请求最多对应一个正在建立的连接，总数受max_in_flight限制
+    void maybe_connect(const tcp_endpoint& endpoint, EndpointState& state)
+    {
+      while (state.connecting < state.waiters.size() &&
+             state.in_use + state.connecting < _options.max_in_flight_per_endpoint)
+      {
+        start_connect(endpoint);
+      }
+    }
+
+    void start_connect(const tcp_endpoint& endpoint)
+    {
+      ++_endpoints[endpoint].connecting;
+      auto socket = std::make_shared<tcp_socket>(_ioc);
+      auto timer = std::make_shared<steady_timer>(_strand);
+      auto timed_out = std::make_shared<bool>(false);
+      timer->expires_after(_options.connect_timeout);
+      timer->async_wait(
+          [socket, timed_out](const asio::error_code& ec)
+          {
+            if (!ec)
+            {
+              *timed_out = true;
+              asio::error_code ignored;
+              socket->close(ignored);
+            }
+          });
+      socket->async_connect(
+          endpoint,
+          asio::bind_executor(
+              _strand,
+              [self = shared_from_this(), endpoint, socket, timer, timed_out](const asio::error_code& ec)
+              {
+                timer->cancel();
+                self->on_connected(endpoint, std::move(*socket), *timed_out ? asio::error::timed_out : ec);
+              }));
+    }
+
+    void on_connected(const tcp_endpoint& endpoint, tcp_socket socket, error_code ec)
+    {
+      auto& state = _endpoints[endpoint];
+      --state.connecting;
+      if (ec)
+      {
+        ++_counters.connect_failed;
+        LOG_WARN("connection pool connect to {}:{} failed: {}", endpoint.address().to_string(), endpoint.port(), ec.message());
+        // 让最早排队的请求快速失败，而不是一直等下去
+        if (!state.waiters.empty())
+        {
+          auto waiter = std::move(state.waiters.front());
+          state.waiters.pop_front();
+          --_counters.waiting;
+          waiter(ec, PooledConnection());
+        }
+        maybe_connect(endpoint, state);
+        return;
+      }
+
+      ++_counters.created;
+      if (_options.tcp_nodelay)
+      {
+        asio::error_code ignored;
+        socket.set_option(asio::ip::tcp::no_delay(true), ignored);
+      }
+      if (!state.waiters.empty())
+      {
+        auto waiter = std::move(state.waiters.front());
+        state.waiters.pop_front();
+        --_counters.waiting;
+        hand_out(endpoint, state, std::move(socket), false, waiter);
+        return;
+      }
+      park(state, std::move(socket));
+    }
+
+    // 放回空闲列表，已满则关闭
+    void park(EndpointState& state, tcp_socket socket)
+    {
+      if (_closed || state.idle.size() >= _options.max_idle_per_endpoint)
+      {
+        ++_counters.discarded;
+        return;
+      }
+      state.idle.push_back(IdleConnection{ std::move(socket), Clock::now() });
+      ++_counters.idle;
+    }
+
+    // 由PooledConnection调用，可在任意线程
+    void release(const tcp_endpoint& endpoint, tcp_socket socket, bool broken)
+    {
+      asio::dispatch(
+          _strand,
+          [self = shared_from_this(), endpoint, socket = std::move(socket), broken]() mutable
+          {
+            auto& state = self->_endpoints[endpoint];
+            --state.in_use;
+            --self->_counters.in_use;
+            if (broken || !socket.is_open())
+            {
+              ++self->_counters.discarded;
+            }
+            else if (!self->_closed && !state.waiters.empty())
+            {
+              // 有人在排队就直接转交，不经过空闲列表
+              auto waiter = std::move(state.waiters.front());
+              state.waiters.pop_front();
+              --self->_counters.waiting;
+              ++self->_counters.reused;
+              self->hand_out(endpoint, state, std::move(socket), true, waiter);
+              return;
+            }
+            else
+            {
+              self->park(state, std::move(socket));
+            }
+            self->maybe_connect(endpoint, state);
+          });
+    }
+
+    void schedule_health_check()
+    {
+      if (_closed)
+      {
+        return;
+      }
+      _health_timer.expires_after(_options.health_check_interval);
+      _health_timer.async_wait(
+          [self = shared_from_this()](const asio::error_code& ec)
+          {
+            if (ec)
+            {
+              return;
+            }
+            self->check_idle_connections();
+            self->schedule_health_check();
+          });
+    }
 
-namespace asio_learn::client{
+    void check_idle_connections()
+    {
+      auto now = Clock::now();
+      for (auto& [endpoint, state] : _endpoints)
+      {
+        std::deque<IdleConnection> kept;
+        for (auto& conn : state.idle)
+        {
+          if (now - conn.since < _options.idle_timeout && is_alive(conn.socket))
+          {
+            kept.push_back(std::move(conn));
+          }
+          else
+          {
+            ++_counters.evicted;
+            --_counters.idle;
+          }
+        }
+        state.idle = std::move(kept);
+      }
+    }
 
-}
+    io_context& _ioc;
+    asio::strand<io_context::executor_type> _strand;
+    ConnectionPoolOptions _options;
+    steady_timer _health_timer;  // 绑定在_strand上
+    std::map<tcp_endpoint, EndpointState> _endpoints;
+    bool _closed = false;
+    Counters _counters;
+  };
 
+  inline void PooledConnection::release()
+  {
+    if (_pool && _socket)
+    {
+      _pool->release(_endpoint, std::move(*_socket), _broken);
+    }
+    _socket.reset();
+    _pool.reset();
+  }
+}  // namespace asio_learn::client
 
-#endif // ASIO_LEARN_CLIENT_CONNECTION_HPP
\ No newline at end of file
+#endif  // ASIO_LEARN_CLIENT_CONNECTION_HPP
@@ -0,0 +1,305 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 16:48:27
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 19:33:50
+ * @FilePath: \asio-learn-code\include\asio_learn\client\happy_eyeballs.hpp
+ * @Description: Happy Eyeballs(RFC 8305)并行建连：错开启动多个endpoint的连接，取最先成功的一个
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_CLIENT_HAPPY_EYEBALLS_HPP
+#define ASIO_LEARN_CLIENT_HAPPY_EYEBALLS_HPP
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "asio_learn/client/completion.hpp"
+#include "asio_learn/public.hpp"
+#include "common/Log.hpp"
+
+/**
+ * 逐个connect时，第一个地址不通就要等一个完整的TCP超时才会尝试下一个
+ * async_connect_fast:
+ * - 地址按 RFC 8305 4节 交替排列IPv6/IPv4，首个地址族跟随解析结果的第一个
+ * - 先连第一个，attempt_delay后还没结果就并行连下一个；某个尝试失败则立即开始下一个
+ * - 第一个成功的连接胜出，其余尝试全部取消
+ * - 每次尝试的开始时间、耗时和结果都放在 ConnectResult::attempts 里，方便排查哪个地址慢
+ */
+
+namespace asio_learn::client
+{
+  struct HappyEyeballsOptions
+  {
+    std::chrono::milliseconds attempt_delay{ 250 };  // RFC 8305 推荐的 Connection Attempt Delay
+    std::chrono::milliseconds timeout{ 0 };          // 整体超时，为0表示不限
+    bool interleave_families = true;
+  };
+
+  struct ConnectAttempt
+  {
+    tcp_endpoint endpoint;
+    std::chrono::microseconds started_after{ 0 };  // 相对整个操作开始的时间
+    std::chrono::microseconds elapsed{ 0 };        // 本次尝试耗时
+    error_code ec;                                 // 被取消的尝试为operation_aborted
+    bool winner = false;
+  };
+
+  struct ConnectResult
+  {
+    tcp_socket socket;  // 失败时是未打开的socket
+    std::vector<ConnectAttempt> attempts;
+  };
+
+  // 按 RFC 8305 交替排列地址族，首个地址族跟随原顺序的第一个地址
+  inline std::vector<tcp_endpoint> interleave_address_families(const std::vector<tcp_endpoint>& endpoints)
+  {
+    if (endpoints.empty())
+    {
+      return {};
+    }
+    bool first_v6 = endpoints.front().address().is_v6();
+    std::vector<tcp_endpoint> primary, secondary;
+    for (const auto& endpoint : endpoints)
+    {
+      (endpoint.address().is_v6() == first_v6 ? primary : secondary).push_back(endpoint);
+    }
+    std::vector<tcp_endpoint> result;
+    result.reserve(endpoints.size());
+    for (size_t i = 0; i < primary.size() || i < secondary.size(); ++i)
+    {
+      if (i < primary.size())
+      {
+        result.push_back(primary[i]);
+      }
+      if (i < secondary.size())
+      {
+        result.push_back(secondary[i]);
+      }
+    }
+    return result;
+  }
+
+  namespace details
+  {
+    class HappyEyeballsOp : public std::enable_shared_from_this<HappyEyeballsOp>
+    {
+     public:
+      using Clock = std::chrono::steady_clock;
+      using Completion = std::function<void(error_code, ConnectResult)>;
+
+      HappyEyeballsOp(
+          asio::any_io_executor executor,
+          std::vector<tcp_endpoint> endpoints,
+          HappyEyeballsOptions options,
+          Completion completion)
+        : _executor(executor)
+        , _strand(asio::make_strand(executor))
+        , _endpoints(options.interleave_families ? interleave_address_families(endpoints) : std::move(endpoints))
+        , _options(options)
+        , _completion(std::move(completion))
+        , _delay_timer(_strand)
+        , _deadline_timer(_strand)
+      {
+        _attempts.resize(_endpoints.size());
+        _sockets.resize(_endpoints.size());
+      }
+
+      void start()
+      {
+        asio::dispatch(
+            _strand,
+            [self = shared_from_this()]()
+            {
+              self->_begin = Clock::now();
+              if (self->_endpoints.empty())
+              {
+                self->finish(asio::error::host_not_found, nullptr);
+                return;
+              }
+              if (self->_options.timeout.count() > 0)
+              {
+                self->_deadline_timer.expires_after(self->_options.timeout);
+                self->_deadline_timer.async_wait(
+                    [self](const asio::error_code& ec)
+                    {
+                      if (!ec)
+                      {
+                        self->finish(asio::error::timed_out, nullptr);
+                      }
+                    });
+              }
+              self->start_next();
+            });
+      }
+
+     private:
+      std::chrono::microseconds since_begin() const
+      {
+        return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - _begin);
+      }
+
+      void start_next()
+      {
+        if (_done || _next >= _endpoints.size())
+        {
+          return;
+        }
+        size_t index = _next++;
+        auto& attempt = _attempts[index];
+        attempt.endpoint = _endpoints[index];
+        attempt.started_after = since_begin();
+
+        auto socket = std::make_shared<tcp_socket>(_executor);
+        _sockets[index] = socket;
+        ++_pending;
+        socket->async_connect(
+            _endpoints[index],
+            asio::bind_executor(
+                _strand,
+                [self = shared_from_this(), index](const asio::error_code& ec) { self->on_attempt_done(index, ec); }));
+
+        if (_next < _endpoints.size())
+        {
+          // 定时器可能已经到期、回调已在排队，用代数区分过期的回调
+          uint64 generation = ++_timer_generation;
+          _delay_timer.expires_after(_options.attempt_delay);
+          _delay_timer.async_wait(
+              [self = shared_from_this(), generation](const asio::error_code& ec)
+              {
+                if (!ec && generation == self->_timer_generation)
+                {
+                  self->start_next();
+                }
+              });
+        }
+      }
+
+      void on_attempt_done(size_t index, const error_code& ec)
+      {
+        --_pending;
+        if (_done)
+        {
+          return;
+        }
+        auto& attempt = _attempts[index];
+        attempt.elapsed = since_begin() - attempt.started_after;
+        attempt.ec = ec;
+        if (!ec)
+        {
+          attempt.winner = true;
+          finish(error_code(), _sockets[index]);
+          return;
+        }
+        _last_error = ec;
+        if (_next < _endpoints.size())
+        {
+          // 失败了就不用等attempt_delay
+          ++_timer_generation;
+          _delay_timer.cancel();
+          start_next();
+        }
+        else if (_pending == 0)
+        {
+          finish(_last_error, nullptr);
+        }
+      }
+
+      void finish(const error_code& ec, const std::shared_ptr<tcp_socket>& winner)
+      {
+        if (_done)
+        {
+          return;
+        }
+        _done = true;
+        ++_timer_generation;
+        _delay_timer.cancel();
+        _deadline_timer.cancel();
+
+        auto now = since_begin();
+        for (size_t i = 0; i < _next; ++i)
+        {
+          if (_sockets[i] && _sockets[i] != winner)
+          {
+            if (_attempts[i].elapsed.count() == 0 && !_attempts[i].ec)
+            {
+              // 还在进行中的尝试被取消
+              _attempts[i].elapsed = now - _attempts[i].started_after;
+              _attempts[i].ec = asio::error::operation_aborted;
+            }
+            asio::error_code ignored;
+            _sockets[i]->close(ignored);
+          }
+        }
+        _attempts.resize(_next);
+
+        ConnectResult result{ winner ? std::move(*winner) : tcp_socket(_executor), std::move(_attempts) };
+        auto completion = std::move(_completion);
+        completion(ec, std::move(result));
+      }
+
+      asio::any_io_executor _executor;
+      asio::strand<asio::any_io_executor> _strand;
+      std::vector<tcp_endpoint> _endpoints;
+      HappyEyeballsOptions _options;
+      Completion _completion;
+      steady_timer _delay_timer;
+      steady_timer _deadline_timer;
+
+      // 以下状态只在_strand上访问
+      std::vector<ConnectAttempt> _attempts;
+      std::vector<std::shared_ptr<tcp_socket>> _sockets;
+      Clock::time_point _begin;
+      size_t _next = 0;
+      size_t _pending = 0;
+      uint64 _timer_generation = 0;
+      error_code _last_error = asio::error::host_not_found;
+      bool _done = false;
+    };
+  }  // namespace details
+
+  /**
+   * @brief 并行连接endpoints中最快可达的一个
+   * @param token 完成签名 void(error_code, ConnectResult)，失败时error_code是最后一次尝试的错误
+   */
+  template<typename CompletionToken>
+  auto async_connect_fast(
+      asio::any_io_executor executor,
+      std::vector<tcp_endpoint> endpoints,
+      CompletionToken&& token,
+      HappyEyeballsOptions options = {})
+  {
+    return asio::async_initiate<CompletionToken, void(error_code, ConnectResult)>(
+        [executor, options](auto handler, std::vector<tcp_endpoint> endpoints)
+        {
+          auto op = std::make_shared<details::HappyEyeballsOp>(
+              executor,
+              std::move(endpoints),
+              options,
+              make_completion<error_code, ConnectResult>(std::move(handler), executor));
+          op->start();
+        },
+        token,
+        std::move(endpoints));
+  }
+
+  // 打印每次尝试的耗时，排查慢地址用
+  inline void log_connect_attempts(const std::vector<ConnectAttempt>& attempts)
+  {
+    for (const auto& attempt : attempts)
+    {
+      LOG_INFO(
+          "connect attempt {}:{} started +{}us took {}us result: {}{}",
+          attempt.endpoint.address().to_string(),
+          attempt.endpoint.port(),
+          attempt.started_after.count(),
+          attempt.elapsed.count(),
+          attempt.ec ? attempt.ec.message() : std::string("ok"),
+          attempt.winner ? " (winner)" : "");
+    }
+  }
+}  // namespace asio_learn::client
+
+#endif  // ASIO_LEARN_CLIENT_HAPPY_EYEBALLS_HPP
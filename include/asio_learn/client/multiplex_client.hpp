@@ -0,0 +1,335 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 16:42:27
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:09:22
+ * @FilePath: \asio-learn-code\include\asio_learn\client\multiplex_client.hpp
+ * @Description: 多路复用客户端：一条连接上流水线发送多个请求，按请求id匹配乱序到达的响应
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_CLIENT_MULTIPLEX_CLIENT_HPP
+#define ASIO_LEARN_CLIENT_MULTIPLEX_CLIENT_HPP
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "asio_learn/client/completion.hpp"
+#include "asio_learn/public.hpp"
+#include "common/Log.hpp"
+
+/**
+ * 帧格式(大端): [uint32 payload长度][uint32 请求id][payload]
+ * 服务端原样回显时响应帧和请求帧相同，所以可以直接对着echo服务器压测
+ *
+ * - 多个调用方的请求先进入写队列，当前没有写操作时把队首最多32帧交给async_write，
+ *   每帧两个buffer，asio每次write_some最多聚合64个buffer，一批正好是一次writev/sendmsg
+ * - 读端一次尽量多读，一个buffer里解析出所有完整帧
+ * - 每个请求的完成回调投递到调用方handler关联的executor上，支持回调和use_awaitable
+ */
+
+namespace asio_learn::client
+{
+  struct MultiplexClientOptions
+  {
+    size_t max_outstanding = 4096;          // 未完成请求上限，超过直接以try_again失败
+    size_t max_frame_size = 16 * 1024 * 1024;  // 超过该长度的响应视为协议错误
+    size_t read_buffer_size = 64 * 1024;
+    size_t max_frames_per_write = 32;       // 单次async_write最多合并的帧数，超过MAX_FRAMES_PER_WRITE按它算
+  };
+
+  struct MultiplexClientStats
+  {
+    uint64 requests = 0;
+    uint64 responses = 0;
+    uint64 writes = 0;            // async_write次数，requests/writes即平均合并帧数
+    uint64 max_frames_per_write = 0;
+    uint64 unknown_responses = 0;  // 找不到请求id的响应
+  };
+
+  class MultiplexClient : public std::enable_shared_from_this<MultiplexClient>
+  {
+   public:
+    static constexpr size_t HEADER_SIZE = 8;
+    // asio的consuming_buffers一次最多聚合64个buffer，每帧占两个
+    static constexpr size_t MAX_FRAMES_PER_WRITE = 32;
+
+    // socket必须已经连接，之后由客户端独占
+    explicit MultiplexClient(tcp_socket socket, MultiplexClientOptions options = {})
+      : _socket(std::move(socket))
+      , _strand(asio::make_strand(_socket.get_executor()))
+      , _options(options)
+      , _read_buffer(options.read_buffer_size)
+    {
+    }
+
+    MultiplexClient(const MultiplexClient&) = delete;
+    MultiplexClient& operator=(const MultiplexClient&) = delete;
+
+    // 开始读响应
+    void start()
+    {
+      asio::dispatch(_strand, [self = shared_from_this()]() { self->do_read(); });
+    }
+
+    // 关闭连接，所有未完成请求以operation_aborted失败
+    void close()
+    {
+      asio::dispatch(_strand, [self = shared_from_this()]() { self->fail_all(asio::error::operation_aborted); });
+    }
+
+    /**
+     * @brief 发送一个请求
+     * @param token 完成签名 void(error_code, std::string response)
+     */
+    template<typename CompletionToken>
+    auto async_request(std::string payload, CompletionToken&& token)
+    {
+      return asio::async_initiate<CompletionToken, void(error_code, std::string)>(
+          [self = shared_from_this()](auto handler, std::string payload)
+          {
+            auto waiter = make_completion<error_code, std::string>(std::move(handler), self->_socket.get_executor());
+            asio::dispatch(
+                self->_strand,
+                [self, payload = std::move(payload), waiter = std::move(waiter)]() mutable
+                { self->do_request(std::move(payload), std::move(waiter)); });
+          },
+          token,
+          std::move(payload));
+    }
+
+    MultiplexClientStats stats() const
+    {
+      MultiplexClientStats stats;
+      stats.requests = _requests.load(std::memory_order_relaxed);
+      stats.responses = _responses.load(std::memory_order_relaxed);
+      stats.writes = _writes.load(std::memory_order_relaxed);
+      stats.max_frames_per_write = _max_frames_per_write.load(std::memory_order_relaxed);
+      stats.unknown_responses = _unknown_responses.load(std::memory_order_relaxed);
+      return stats;
+    }
+
+   private:
+    using Waiter = std::function<void(error_code, std::string)>;
+
+    struct Frame
+    {
+      std::array<unsigned char, HEADER_SIZE> header;
+      std::string payload;
+    };
+
+    static void put_u32(unsigned char* out, uint32 value)
+    {
+      out[0] = static_cast<unsigned char>(value >> 24);
+      out[1] = static_cast<unsigned char>(value >> 16);
+      out[2] = static_cast<unsigned char>(value >> 8);
+      out[3] = static_cast<unsigned char>(value);
+    }
+
+    static uint32 get_u32(const unsigned char* in)
+    {
+      return (uint32(in[0]) << 24) | (uint32(in[1]) << 16) | (uint32(in[2]) << 8) | uint32(in[3]);
+    }
+
+    void do_request(std::string payload, Waiter waiter)
+    {
+      if (_closed)
+      {
+        waiter(asio::error::operation_aborted, std::string());
+        return;
+      }
+      if (_pending.size() >= _options.max_outstanding)
+      {
+        waiter(asio::error::try_again, std::string());
+        return;
+      }
+      // 跳过仍在使用的id(回绕后极少出现)
+      uint32 id = _next_id++;
+      while (_pending.count(id))
+      {
+        id = _next_id++;
+      }
+      _pending.emplace(id, std::move(waiter));
+      ++_requests;
+
+      Frame frame;
+      put_u32(frame.header.data(), static_cast<uint32>(payload.size()));
+      put_u32(frame.header.data() + 4, id);
+      frame.payload = std::move(payload);
+      _write_queue.push_back(std::move(frame));
+      if (!_writing)
+      {
+        do_write();
+      }
+    }
+
+    void do_write()
+    {
+      if (_write_queue.empty() || _closed)
+      {
+        _writing = false;
+        return;
+      }
+      _writing = true;
+      // 把排队的帧整体换到发送批次里，写期间新来的请求进入下一批
+      size_t count = std::min(
+          _write_queue.size(), std::clamp<size_t>(_options.max_frames_per_write, 1, MAX_FRAMES_PER_WRITE));
+      _in_flight.assign(
+          std::make_move_iterator(_write_queue.begin()), std::make_move_iterator(_write_queue.begin() + count));
+      _write_queue.erase(_write_queue.begin(), _write_queue.begin() + count);
+
+      _write_buffers.clear();
+      for (auto& frame : _in_flight)
+      {
+        _write_buffers.push_back(asio::buffer(frame.header));
+        _write_buffers.push_back(asio::buffer(frame.payload));
+      }
+      ++_writes;
+      if (count > _max_frames_per_write.load(std::memory_order_relaxed))
+      {
+        _max_frames_per_write.store(count, std::memory_order_relaxed);
+      }
+      asio::async_write(
+          _socket,
+          _write_buffers,
+          asio::bind_executor(
+              _strand,
+              [self = shared_from_this()](const asio::error_code& ec, std::size_t)
+              {
+                self->_in_flight.clear();
+                if (ec)
+                {
+                  self->fail_all(ec);
+                  return;
+                }
+                self->do_write();
+              }));
+    }
+
+    void do_read()
+    {
+      if (_closed)
+      {
+        return;
+      }
+      _socket.async_read_some(
+          asio::buffer(_read_buffer.data() + _read_end, _read_buffer.size() - _read_end),
+          asio::bind_executor(
+              _strand,
+              [self = shared_from_this()](const asio::error_code& ec, std::size_t bytes_read)
+              {
+                if (ec)
+                {
+                  self->fail_all(ec);
+                  return;
+                }
+                self->_read_end += bytes_read;
+                if (!self->parse_frames())
+                {
+                  self->fail_all(asio::error::invalid_argument);
+                  return;
+                }
+                self->do_read();
+              }));
+    }
+
+    // 解析缓冲区中所有完整帧，协议错误返回false
+    bool parse_frames()
+    {
+      size_t pos = 0;
+      while (_read_end - pos >= HEADER_SIZE)
+      {
+        const auto* header = _read_buffer.data() + pos;
+        uint32 len = get_u32(header);
+        uint32 id = get_u32(header + 4);
+        if (len > _options.max_frame_size)
+        {
+          LOG_ERR("multiplex client frame too large: {}", len);
+          return false;
+        }
+        if (_read_end - pos < HEADER_SIZE + len)
+        {
+          // 不完整的大帧需要更大的缓冲区
+          if (HEADER_SIZE + len > _read_buffer.size())
+          {
+            _read_buffer.resize(HEADER_SIZE + len);
+          }
+          break;
+        }
+        std::string payload(reinterpret_cast<const char*>(header + HEADER_SIZE), len);
+        pos += HEADER_SIZE + len;
+
+        auto it = _pending.find(id);
+        if (it == _pending.end())
+        {
+          ++_unknown_responses;
+          LOG_WARN("multiplex client got response for unknown id {}", id);
+          continue;
+        }
+        auto waiter = std::move(it->second);
+        _pending.erase(it);
+        ++_responses;
+        waiter(error_code(), std::move(payload));
+      }
+      // 剩余的半帧挪到缓冲区开头
+      if (pos > 0)
+      {
+        std::memmove(_read_buffer.data(), _read_buffer.data() + pos, _read_end - pos);
+        _read_end -= pos;
+      }
+      return true;
+    }
+
+    void fail_all(const error_code& ec)
+    {
+      if (_closed)
+      {
+        return;
+      }
+      _closed = true;
+      if (ec != asio::error::operation_aborted)
+      {
+        LOG_WARN("multiplex client connection closed: {}", ec.message());
+      }
+      asio::error_code ignored;
+      _socket.close(ignored);
+      auto pending = std::move(_pending);
+      _pending.clear();
+      for (auto& [id, waiter] : pending)
+      {
+        waiter(ec, std::string());
+      }
+      _write_queue.clear();
+    }
+
+    tcp_socket _socket;
+    asio::strand<tcp_socket::executor_type> _strand;
+    MultiplexClientOptions _options;
+
+    // 以下状态只在_strand上访问
+    std::unordered_map<uint32, Waiter> _pending;
+    uint32 _next_id = 1;
+    std::deque<Frame> _write_queue;
+    std::vector<Frame> _in_flight;
+    std::vector<asio::const_buffer> _write_buffers;
+    bool _writing = false;
+    bool _closed = false;
+    std::vector<unsigned char> _read_buffer;
+    size_t _read_end = 0;
+
+    std::atomic<uint64> _requests{ 0 };
+    std::atomic<uint64> _responses{ 0 };
+    std::atomic<uint64> _writes{ 0 };
+    std::atomic<uint64> _max_frames_per_write{ 0 };
+    std::atomic<uint64> _unknown_responses{ 0 };
+  };
+}  // namespace asio_learn::client
+
+#endif  // ASIO_LEARN_CLIENT_MULTIPLEX_CLIENT_HPP
@@ -0,0 +1,160 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 16:29:21
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 19:17:00
+ * @FilePath: \asio-learn-code\include\asio_learn\fd_passing.hpp
+ * @Description: 通过unix域套接字(SCM_RIGHTS)在进程间传递文件描述符
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_FD_PASSING_HPP
+#define ASIO_LEARN_FD_PASSING_HPP
+
+#if !defined(__unix__) && !defined(__APPLE__)
+#error "fd_passing.hpp requires a POSIX platform"
+#endif
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+#include "asio_learn/public.hpp"
+
+namespace asio_learn::ipc
+{
+  // 随fd一起传递的对端地址，定长便于直接按字节收发
+  struct PeerAddress
+  {
+    uint16 family = 4;  // 4 或 6
+    uint16 port = 0;
+    uint8_t address[16] = {};
+  };
+
+  inline PeerAddress encode_peer(const tcp_endpoint& endpoint)
+  {
+    PeerAddress peer;
+    peer.port = endpoint.port();
+    if (endpoint.address().is_v6())
+    {
+      peer.family = 6;
+      auto bytes = endpoint.address().to_v6().to_bytes();
+      std::memcpy(peer.address, bytes.data(), bytes.size());
+    }
+    else
+    {
+      peer.family = 4;
+      auto bytes = endpoint.address().to_v4().to_bytes();
+      std::memcpy(peer.address, bytes.data(), bytes.size());
+    }
+    return peer;
+  }
+
+  inline tcp_endpoint decode_peer(const PeerAddress& peer)
+  {
+    if (peer.family == 6)
+    {
+      asio::ip::address_v6::bytes_type bytes;
+      std::memcpy(bytes.data(), peer.address, bytes.size());
+      return tcp_endpoint(asio::ip::address_v6(bytes), peer.port);
+    }
+    asio::ip::address_v4::bytes_type bytes;
+    std::memcpy(bytes.data(), peer.address, bytes.size());
+    return tcp_endpoint(asio::ip::address_v4(bytes), peer.port);
+  }
+
+  // 加上FD_CLOEXEC，exec出来的子进程不会继承这个描述符
+  inline bool set_cloexec(int fd)
+  {
+    int flags = ::fcntl(fd, F_GETFD);
+    return flags >= 0 && ::fcntl(fd, F_SETFD, flags | FD_CLOEXEC) == 0;
+  }
+
+  /**
+   * @brief 发送一段数据并附带一个文件描述符
+   * @param channel unix域套接字
+   * @param fd 要传递的描述符，发送成功后对端拿到的是一个新的描述符，本进程仍需自行关闭
+   * @param flags 默认不阻塞，传0则按套接字本身的阻塞模式发送
+   * @return 发送的字节数，失败返回-1并设置errno(非阻塞套接字可能是EAGAIN)
+   */
+  inline ssize_t send_fd(int channel, int fd, const void* data, std::size_t len, int flags = MSG_DONTWAIT)
+  {
+    iovec iov{};
+    iov.iov_base = const_cast<void*>(data);
+    iov.iov_len = len;
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    std::memset(control, 0, sizeof(control));
+
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    ssize_t n;
+    do
+    {
+      n = ::sendmsg(channel, &msg, MSG_NOSIGNAL | flags);
+    } while (n < 0 && errno == EINTR);
+    return n;
+  }
+
+  /**
+   * @brief 接收一段数据及其附带的文件描述符
+   * @param fd 输出参数，没有附带描述符时为-1; 收到的描述符带有 FD_CLOEXEC
+   * @param flags 默认不阻塞，传0则按套接字本身的阻塞模式接收
+   * @return 接收的字节数，对端关闭返回0，失败返回-1并设置errno
+   */
+  inline ssize_t recv_fd(int channel, int& fd, void* data, std::size_t len, int flags = MSG_DONTWAIT)
+  {
+    fd = -1;
+    iovec iov{};
+    iov.iov_base = data;
+    iov.iov_len = len;
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n;
+    do
+    {
+#ifdef MSG_CMSG_CLOEXEC
+      n = ::recvmsg(channel, &msg, flags | MSG_CMSG_CLOEXEC);
+#else
+      n = ::recvmsg(channel, &msg, flags);
+#endif
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+    {
+      return n;
+    }
+
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+      {
+        std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+        break;
+      }
+    }
+    return n;
+  }
+}  // namespace asio_learn::ipc
+
+#endif  // ASIO_LEARN_FD_PASSING_HPP
@@ -0,0 +1,353 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 16:28:26
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 19:29:06
+ * @FilePath: \asio-learn-code\include\asio_learn\hot_restart.hpp
+ * @Description: 热重启：新进程通过unix域套接字从旧进程继承监听socket(以及空闲连接)
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_HOT_RESTART_HPP
+#define ASIO_LEARN_HOT_RESTART_HPP
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "asio_learn/fd_passing.hpp"
+#define ASIO_LEARN_HAS_HOT_RESTART 1
+#endif
+
+#include "asio_learn/public.hpp"
+#include "common/Log.hpp"
+
+/**
+ * 热重启流程:
+ * 1. 新进程启动时连接 control_path，发送 REQUEST
+ * 2. 旧进程回复 LISTENER(附带监听fd)，随即关闭自己的acceptor，不再accept
+ * 3. 如果请求了空闲连接，旧进程让各worker取消正在等待读取的会话的读，读回调确认没有读到数据后才释放socket，
+ *    逐个以 CONNECTION 发送; 读回调已经在排队(数据已读进缓冲区)的会话不交出，留在旧进程处理完
+ * 4. 旧进程发送 DONE，新进程接管 control_path 供下一次重启使用
+ * 5. 旧进程等待剩余会话结束(或者超过drain_timeout)后退出
+ * 监听socket在整个过程中一直处于listen状态，backlog里的连接由新进程继续accept，不会出现connection refused
+ * 目前只支持Linux，其他平台 HotRestartOptions 会被忽略
+ */
+
+namespace asio_learn
+{
+  struct HotRestartOptions
+  {
+    std::string control_path;                          // 控制套接字路径，为空表示不启用热重启
+    bool handoff_idle_connections = false;             // 是否把空闲连接也交给新进程
+    std::chrono::milliseconds drain_timeout{ 30000 };  // 旧进程等待剩余会话结束的最长时间
+    std::chrono::milliseconds handshake_timeout{ 5000 };  // 新旧进程交接的最长时间，两边各自计时
+  };
+
+#ifdef ASIO_LEARN_HAS_HOT_RESTART
+  namespace ipc
+  {
+    enum HotRestartMessageType : uint32
+    {
+      HOT_RESTART_REQUEST = 1,
+      HOT_RESTART_LISTENER = 2,
+      HOT_RESTART_CONNECTION = 3,
+      HOT_RESTART_DONE = 4,
+    };
+
+    constexpr uint32 HOT_RESTART_MAGIC = 0x48525354;  // "HRST"
+
+    struct HotRestartMessage
+    {
+      uint32 magic = HOT_RESTART_MAGIC;
+      uint32 type = 0;
+      uint32 want_connections = 0;  // 仅REQUEST使用
+      PeerAddress peer;             // 仅CONNECTION使用
+    };
+
+    // 新进程从旧进程继承到的状态
+    struct InheritedState
+    {
+      int listener_fd = -1;
+      std::vector<std::pair<int, tcp_endpoint>> connections;
+    };
+
+    /**
+     * 旧进程一侧的控制通道: 在master的io_context上异步收发，握手期间照常accept
+     * 从收到连接开始整个交换限时timeout，超时关闭通道，挂起的收发以失败结束
+     */
+    class HotRestartChannel : public std::enable_shared_from_this<HotRestartChannel>
+    {
+     public:
+      using socket_type = asio::local::stream_protocol::socket;
+
+      HotRestartChannel(socket_type socket, std::chrono::milliseconds timeout)
+        : _socket(std::move(socket))
+        , _deadline(_socket.get_executor())
+        , _timeout(timeout)
+      {
+      }
+
+      ~HotRestartChannel()
+      {
+        drop_queue();
+      }
+
+      HotRestartChannel(const HotRestartChannel&) = delete;
+      HotRestartChannel& operator=(const HotRestartChannel&) = delete;
+
+      // 等待新进程的REQUEST，消息不合法时ok为false
+      void async_receive_request(std::function<void(bool ok, const HotRestartMessage& request)> handler)
+      {
+        arm_deadline();
+        auto self = shared_from_this();
+        asio::async_read(
+            _socket,
+            asio::buffer(&_request, sizeof(_request)),
+            [self, handler = std::move(handler)](const asio::error_code& ec, std::size_t /*bytes*/)
+            {
+              bool ok = !ec && self->_request.magic == HOT_RESTART_MAGIC && self->_request.type == HOT_RESTART_REQUEST;
+              handler(ok, self->_request);
+            });
+      }
+
+      // 排队一条消息，fd<0表示不附带描述符; own_fd为true时发送完或者放弃后由通道关闭fd
+      void enqueue(uint32 type, int fd = -1, const tcp_endpoint* peer = nullptr, bool own_fd = false)
+      {
+        Outgoing out;
+        out.msg.type = type;
+        if (peer)
+        {
+          out.msg.peer = encode_peer(*peer);
+        }
+        out.fd = fd;
+        out.own_fd = own_fd;
+        _queue.push_back(out);
+      }
+
+      // 发出队列里的全部消息; 失败时丢弃剩下的消息，handler收到false
+      void async_flush(std::function<void(bool ok)> handler)
+      {
+        _flush_handler = std::move(handler);
+        send_next();
+      }
+
+     private:
+      struct Outgoing
+      {
+        HotRestartMessage msg;
+        int fd = -1;
+        bool own_fd = false;
+      };
+
+      void arm_deadline()
+      {
+        _deadline.expires_after(_timeout);
+        // 只持有弱引用，通道用完释放时定时器随之取消
+        std::weak_ptr<HotRestartChannel> weak_self = shared_from_this();
+        _deadline.async_wait(
+            [weak_self](const asio::error_code& ec)
+            {
+              auto self = weak_self.lock();
+              if (ec || !self)
+              {
+                return;
+              }
+              LOG_ERR("hot restart handshake timed out");
+              asio::error_code ignored;
+              self->_socket.close(ignored);
+            });
+      }
+
+      void send_next()
+      {
+        while (!_queue.empty())
+        {
+          auto& out = _queue.front();
+          int channel = _socket.native_handle();
+          ssize_t n = out.fd >= 0 ? send_fd(channel, out.fd, &out.msg, sizeof(out.msg))
+                                  : ::send(channel, &out.msg, sizeof(out.msg), MSG_NOSIGNAL | MSG_DONTWAIT);
+          if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+          {
+            // 新进程还没读走，等可写再继续
+            auto self = shared_from_this();
+            _socket.async_wait(
+                socket_type::wait_write,
+                [self](const asio::error_code& ec)
+                {
+                  if (ec)
+                  {
+                    self->finish(false);
+                    return;
+                  }
+                  self->send_next();
+                });
+            return;
+          }
+          if (n != static_cast<ssize_t>(sizeof(out.msg)))
+          {
+            LOG_ERR("hot restart send failed: {}", n < 0 ? std::strerror(errno) : "short write");
+            finish(false);
+            return;
+          }
+          if (out.own_fd)
+          {
+            ::close(out.fd);
+          }
+          _queue.pop_front();
+        }
+        finish(true);
+      }
+
+      void finish(bool ok)
+      {
+        if (!ok)
+        {
+          drop_queue();
+        }
+        auto handler = std::move(_flush_handler);
+        _flush_handler = nullptr;
+        if (handler)
+        {
+          handler(ok);
+        }
+      }
+
+      void drop_queue()
+      {
+        for (auto& out : _queue)
+        {
+          if (out.own_fd)
+          {
+            ::close(out.fd);
+          }
+        }
+        _queue.clear();
+      }
+
+      socket_type _socket;
+      steady_timer _deadline;
+      std::chrono::milliseconds _timeout;
+      HotRestartMessage _request;
+      std::deque<Outgoing> _queue;
+      std::function<void(bool)> _flush_handler;
+    };
+
+    /**
+     * @brief 尝试从旧进程继承监听socket
+     * @return 没有旧进程在监听control_path时返回nullopt，调用方按冷启动处理
+     */
+    inline std::optional<InheritedState> hot_restart_inherit(
+        const std::string& control_path,
+        bool want_connections,
+        std::chrono::milliseconds timeout = std::chrono::milliseconds(5000))
+    {
+      sockaddr_un addr{};
+      addr.sun_family = AF_UNIX;
+      if (control_path.size() >= sizeof(addr.sun_path))
+      {
+        LOG_ERR("hot restart control path too long: {}", control_path);
+        return std::nullopt;
+      }
+      std::memcpy(addr.sun_path, control_path.c_str(), control_path.size() + 1);
+
+      int channel = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (channel < 0)
+      {
+        return std::nullopt;
+      }
+      if (::connect(channel, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+      {
+        // ENOENT/ECONNREFUSED: 没有旧进程，冷启动
+        ::close(channel);
+        return std::nullopt;
+      }
+
+      HotRestartMessage request;
+      request.type = HOT_RESTART_REQUEST;
+      request.want_connections = want_connections ? 1 : 0;
+      if (::send(channel, &request, sizeof(request), MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(request)))
+      {
+        ::close(channel);
+        return std::nullopt;
+      }
+
+      InheritedState state;
+      const auto deadline = std::chrono::steady_clock::now() + timeout;
+      for (;;)
+      {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        pollfd pfd{ channel, POLLIN, 0 };
+        if (remaining.count() <= 0 || ::poll(&pfd, 1, static_cast<int>(remaining.count())) <= 0)
+        {
+          LOG_ERR("hot restart handshake timed out");
+          break;
+        }
+
+        HotRestartMessage msg;
+        int fd = -1;
+        // 每条消息最多附带一个fd，按消息长度读取不会跨消息
+        ssize_t n = recv_fd(channel, fd, &msg, sizeof(msg), MSG_WAITALL);
+        if (n != static_cast<ssize_t>(sizeof(msg)) || msg.magic != HOT_RESTART_MAGIC)
+        {
+          if (fd >= 0)
+          {
+            ::close(fd);
+          }
+          LOG_ERR("hot restart handshake broken");
+          break;
+        }
+
+        if (msg.type == HOT_RESTART_LISTENER && fd >= 0)
+        {
+          state.listener_fd = fd;
+        }
+        else if (msg.type == HOT_RESTART_CONNECTION && fd >= 0)
+        {
+          state.connections.emplace_back(fd, decode_peer(msg.peer));
+        }
+        else if (msg.type == HOT_RESTART_DONE)
+        {
+          ::close(channel);
+          if (state.listener_fd < 0)
+          {
+            break;
+          }
+          return state;
+        }
+        else if (fd >= 0)
+        {
+          ::close(fd);
+        }
+      }
+
+      // 握手失败: 已经收到的连接只能关闭，监听fd如果拿到了仍然可以用
+      ::close(channel);
+      for (auto& conn : state.connections)
+      {
+        ::close(conn.first);
+      }
+      state.connections.clear();
+      if (state.listener_fd >= 0)
+      {
+        return state;
+      }
+      return std::nullopt;
+    }
+  }  // namespace ipc
+#endif  // ASIO_LEARN_HAS_HOT_RESTART
+}  // namespace asio_learn
+
+#endif  // ASIO_LEARN_HOT_RESTART_HPP
@@ -0,0 +1,261 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 17:39:17
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:34:15
+ * @FilePath: \asio-learn-code\include\asio_learn\metrics\loop_lag_monitor.hpp
+ * @Description: 事件循环延迟探针：周期定时器测量io_context的拥塞程度
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_METRICS_LOOP_LAG_MONITOR_HPP
+#define ASIO_LEARN_METRICS_LOOP_LAG_MONITOR_HPP
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "asio_learn/metrics/registry.hpp"
+#include "asio_learn/public.hpp"
+#include "common/Log.hpp"
+
+/**
+ * 每个interval触发一次定时器，实际触发时间比到期时间晚多少就是循环延迟(lag):
+ * 回调排在就绪队列里等待的时间加上正在执行的回调还要占用的时间，延迟涨起来时客户端的超时还没发生
+ *
+ * asio没有公开就绪队列长度，这里用标记回调估算: 定时器触发时post一个标记，
+ * 标记真正执行前循环跑了多少个回调，就是当时排在它前面的就绪回调数，post到执行的耗时记为队列延迟
+ * 回调计数要逐个run_one()并对共享计数器原子加一，每个回调都多一次开销，所以默认关闭，只测延迟和队列延迟;
+ * 需要队列长度时打开 LoopLagOptions::count_handlers，并用 LoopLagMonitor::run() 代替 io_context::run()
+ */
+
+namespace asio_learn::metrics
+{
+  struct LoopLagOptions
+  {
+    std::chrono::milliseconds interval{ 100 };
+    // 超过该延迟打印告警，为0表示不告警
+    std::chrono::milliseconds warn_threshold{ 50 };
+    // 告警限频，期间被抑制的次数会在下一条告警里带出
+    std::chrono::milliseconds warn_every{ 1000 };
+    // 统计标记回调前面排队的回调数，需要配合 LoopLagMonitor::run()
+    bool count_handlers = false;
+  };
+
+  struct LoopLagStats
+  {
+    uint64 samples = 0;
+    uint64 lag_ns_last = 0;
+    uint64 lag_ns_max = 0;
+    uint64 pending_handlers_last = 0;  // 未开启count_handlers时恒为0
+    uint64 warnings = 0;
+  };
+
+  class LoopLagMonitor
+  {
+   public:
+    // registry为空时只记录stats()和告警日志
+    LoopLagMonitor(io_context& ioc, std::string loop, LoopLagOptions options = {}, Registry* registry = nullptr)
+      : _ioc(ioc)
+      , _loop(std::move(loop))
+      , _options(options)
+      , _timer(ioc)
+    {
+      if (_options.interval.count() <= 0)
+      {
+        _options.interval = std::chrono::milliseconds(100);
+      }
+      if (registry)
+      {
+        Labels labels{ { "loop", _loop } };
+        _lag = &registry->histogram(
+            "asio_learn_loop_lag_seconds", "How late the loop probe timer fired", lag_bounds(), labels);
+        _queue_delay = &registry->histogram(
+            "asio_learn_loop_queue_delay_seconds", "Post-to-run delay of the probe marker handler", lag_bounds(), labels);
+        if (_options.count_handlers)
+        {
+          _pending = &registry->gauge(
+              "asio_learn_loop_pending_handlers", "Ready handlers queued ahead of the probe marker", labels);
+        }
+        _warnings = &registry->counter(
+            "asio_learn_loop_lag_warnings_total", "Probe samples above the warning threshold", labels);
+      }
+    }
+
+    LoopLagMonitor(const LoopLagMonitor&) = delete;
+    LoopLagMonitor& operator=(const LoopLagMonitor&) = delete;
+
+    // 可在io_context运行前或循环线程里调用
+    void start()
+    {
+      asio::post(
+          _ioc,
+          [this]()
+          {
+            _stopped = false;
+            arm();
+          });
+    }
+
+    // 只能在循环线程调用，或者循环已经停止之后
+    void stop()
+    {
+      _stopped = true;
+      _timer.cancel();
+    }
+
+    // 开启count_handlers时代替io_context::run()，逐个执行回调并计数; 未开启时等同io_context::run()
+    size_t run()
+    {
+      if (!_options.count_handlers)
+      {
+        return _ioc.run();
+      }
+      size_t count = 0;
+      while (_ioc.run_one())
+      {
+        _handlers_run.fetch_add(1, std::memory_order_relaxed);
+        ++count;
+      }
+      return count;
+    }
+
+    // 可在任意线程调用
+    LoopLagStats stats() const
+    {
+      LoopLagStats stats;
+      stats.samples = _samples.load(std::memory_order_relaxed);
+      stats.lag_ns_last = _lag_ns_last.load(std::memory_order_relaxed);
+      stats.lag_ns_max = _lag_ns_max.load(std::memory_order_relaxed);
+      stats.pending_handlers_last = _pending_last.load(std::memory_order_relaxed);
+      stats.warnings = _warning_count.load(std::memory_order_relaxed);
+      return stats;
+    }
+
+    const std::string& loop() const
+    {
+      return _loop;
+    }
+
+   private:
+    static std::vector<double> lag_bounds()
+    {
+      return { 0.0001, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0 };
+    }
+
+    void arm()
+    {
+      _timer.expires_after(_options.interval);
+      _timer.async_wait(
+          [this](const error_code& ec)
+          {
+            if (ec || _stopped)
+            {
+              return;
+            }
+            sample();
+            arm();
+          });
+    }
+
+    void sample()
+    {
+      auto now = std::chrono::steady_clock::now();
+      auto lag = std::max(now - _timer.expiry(), std::chrono::steady_clock::duration::zero());
+      auto lag_ns = static_cast<uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(lag).count());
+      _samples.fetch_add(1, std::memory_order_relaxed);
+      _lag_ns_last.store(lag_ns, std::memory_order_relaxed);
+      if (lag_ns > _lag_ns_max.load(std::memory_order_relaxed))
+      {
+        _lag_ns_max.store(lag_ns, std::memory_order_relaxed);
+      }
+      if (_lag)
+      {
+        _lag->observe(lag);
+      }
+      check_threshold(now, lag);
+
+      // 标记回调排到队尾，执行时数一数前面跑了多少个回调
+      auto handlers_before = _handlers_run.load(std::memory_order_relaxed);
+      asio::post(
+          _ioc,
+          [this, handlers_before, posted_at = now]()
+          {
+            auto delay = std::chrono::steady_clock::now() - posted_at;
+            if (_queue_delay)
+            {
+              _queue_delay->observe(delay);
+            }
+            if (_options.count_handlers)
+            {
+              auto pending = _handlers_run.load(std::memory_order_relaxed) - handlers_before;
+              _pending_last.store(pending, std::memory_order_relaxed);
+              if (_pending)
+              {
+                _pending->set(static_cast<int64_t>(pending));
+              }
+            }
+          });
+    }
+
+    void check_threshold(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::duration lag)
+    {
+      if (_options.warn_threshold.count() <= 0 || lag < _options.warn_threshold)
+      {
+        return;
+      }
+      _warning_count.fetch_add(1, std::memory_order_relaxed);
+      if (_warnings)
+      {
+        _warnings->inc();
+      }
+      if (now - _last_warn < _options.warn_every)
+      {
+        ++_suppressed;
+        return;
+      }
+      auto lag_ms = std::chrono::duration<double, std::milli>(lag).count();
+      if (_options.count_handlers)
+      {
+        LOG_WARN(
+            "{} event loop lag {:.1f}ms (threshold {}ms), {} ready handlers pending at last sample, {} warnings suppressed",
+            _loop,
+            lag_ms,
+            _options.warn_threshold.count(),
+            _pending_last.load(std::memory_order_relaxed),
+            _suppressed);
+      }
+      else
+      {
+        LOG_WARN(
+            "{} event loop lag {:.1f}ms (threshold {}ms), {} warnings suppressed",
+            _loop,
+            lag_ms,
+            _options.warn_threshold.count(),
+            _suppressed);
+      }
+      _last_warn = now;
+      _suppressed = 0;
+    }
+
+    io_context& _ioc;
+    std::string _loop;
+    LoopLagOptions _options;
+    steady_timer _timer;
+    bool _stopped = false;
+    // 多线程跑同一个io_context时也能计数
+    std::atomic<uint64> _handlers_run{ 0 };
+    std::atomic<uint64> _samples{ 0 };
+    std::atomic<uint64> _lag_ns_last{ 0 };
+    std::atomic<uint64> _lag_ns_max{ 0 };
+    std::atomic<uint64> _pending_last{ 0 };
+    std::atomic<uint64> _warning_count{ 0 };
+    std::chrono::steady_clock::time_point _last_warn{};
+    uint64 _suppressed = 0;
+    Histogram* _lag = nullptr;
+    Histogram* _queue_delay = nullptr;
+    Gauge* _pending = nullptr;
+    Counter* _warnings = nullptr;
+  };
+}  // namespace asio_learn::metrics
+#endif  // ASIO_LEARN_METRICS_LOOP_LAG_MONITOR_HPP
@@ -0,0 +1,274 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 17:19:15
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:26:22
+ * @FilePath: \asio-learn-code\include\asio_learn\metrics\metrics_server.hpp
+ * @Description: 指标HTTP端点：GET /metrics 返回Prometheus文本，自带io_context和线程
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_METRICS_METRICS_SERVER_HPP
+#define ASIO_LEARN_METRICS_METRICS_SERVER_HPP
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <istream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "asio_learn/metrics/registry.hpp"
+#include "asio_learn/public.hpp"
+#include "common/Log.hpp"
+
+/**
+ * 抓取在这里的独立线程上完成，渲染文本只读各分片的原子变量，worker线程永远不会因为抓取而等待
+ * 只实现够Prometheus用的最小HTTP/1.1: 一个连接一个请求，响应后关闭
+ * 热重启时新进程起来时旧进程还占着端口，给retry_interval后端口被占用不抛异常，定时重试，旧进程退出后接上
+ */
+
+namespace asio_learn::metrics
+{
+  class MetricsServer
+  {
+   public:
+    /**
+     * @param retry_interval 为0时端口被占用直接抛异常; 否则每隔这么久重试一次，直到绑定成功或stop()
+     */
+    MetricsServer(
+        Registry& registry,
+        const tcp_endpoint& endpoint,
+        std::chrono::milliseconds retry_interval = std::chrono::milliseconds(0))
+      : _registry(registry)
+      , _endpoint(endpoint)
+      , _retry_interval(retry_interval)
+      , _ioc(1)
+      , _acceptor(_ioc)
+      , _retry_timer(_ioc)
+    {
+      error_code ec;
+      listen(ec);
+      if (ec && (ec != asio::error::address_in_use || _retry_interval.count() <= 0))
+      {
+        throw asio::system_error(ec, "metrics endpoint");
+      }
+      if (ec)
+      {
+        LOG_WARN(
+            "metrics endpoint {}:{} in use, retrying every {}ms",
+            endpoint.address().to_string(),
+            endpoint.port(),
+            _retry_interval.count());
+      }
+    }
+
+    ~MetricsServer()
+    {
+      stop();
+    }
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    void start()
+    {
+      if (_acceptor.is_open())
+      {
+        do_accept();
+      }
+      else
+      {
+        retry_listen();
+      }
+      _thread = std::thread([this]() { _ioc.run(); });
+    }
+
+    void stop()
+    {
+      _ioc.stop();
+      if (_thread.joinable())
+      {
+        _thread.join();
+      }
+      // 线程已退出，可以直接关闭; 未完成的连接随_ioc一起析构
+      error_code ec;
+      _acceptor.close(ec);
+    }
+
+    // 还在等端口时返回0
+    uint16 port() const
+    {
+      return _port.load(std::memory_order_acquire);
+    }
+
+   private:
+    static constexpr size_t MAX_REQUEST_BYTES = 8192;
+    static constexpr auto REQUEST_TIMEOUT = std::chrono::seconds(5);
+
+    class Connection : public std::enable_shared_from_this<Connection>
+    {
+     public:
+      Connection(tcp_socket socket, Registry& registry)
+        : _socket(std::move(socket))
+        , _registry(registry)
+        , _request(MAX_REQUEST_BYTES)
+        , _timer(_socket.get_executor())
+      {
+      }
+
+      void start()
+      {
+        auto self = shared_from_this();
+        // 慢速客户端不能一直占着连接
+        _timer.expires_after(REQUEST_TIMEOUT);
+        _timer.async_wait(
+            [self](const error_code& ec)
+            {
+              if (!ec)
+              {
+                error_code ignored;
+                self->_socket.close(ignored);
+              }
+            });
+        asio::async_read_until(
+            _socket,
+            _request,
+            "\r\n\r\n",
+            [self](const error_code& ec, size_t /*bytes*/)
+            {
+              if (ec)
+              {
+                self->_timer.cancel();
+                return;
+              }
+              self->respond();
+            });
+      }
+
+     private:
+      void respond()
+      {
+        std::istream stream(&_request);
+        std::string method, target;
+        stream >> method >> target;
+        if (method != "GET")
+        {
+          _response = reply("405 Method Not Allowed", "text/plain", "method not allowed\n");
+        }
+        else if (target == "/metrics" || target.starts_with("/metrics?"))
+        {
+          _response = reply("200 OK", "text/plain; version=0.0.4; charset=utf-8", _registry.scrape());
+        }
+        else
+        {
+          _response = reply("404 Not Found", "text/plain", "try /metrics\n");
+        }
+        auto self = shared_from_this();
+        asio::async_write(
+            _socket,
+            asio::buffer(_response),
+            [self](const error_code& /*ec*/, size_t /*bytes*/)
+            {
+              error_code ignored;
+              self->_socket.shutdown(tcp_socket::shutdown_both, ignored);
+              self->_socket.close(ignored);
+              self->_timer.cancel();
+            });
+      }
+
+      static std::string reply(const char* status, const char* content_type, const std::string& body)
+      {
+        return std::format(
+            "HTTP/1.1 {}\r\nContent-Type: {}\r\nContent-Length: {}\r\nConnection: close\r\n\r\n{}",
+            status,
+            content_type,
+            body.size(),
+            body);
+      }
+
+      tcp_socket _socket;
+      Registry& _registry;
+      asio::streambuf _request;
+      steady_timer _timer;
+      std::string _response;
+    };
+
+    void listen(error_code& ec)
+    {
+      _acceptor.open(_endpoint.protocol(), ec);
+      if (!ec)
+      {
+        _acceptor.set_option(tcp_acceptor::reuse_address(true), ec);
+      }
+      if (!ec)
+      {
+        _acceptor.bind(_endpoint, ec);
+      }
+      if (!ec)
+      {
+        _acceptor.listen(asio::socket_base::max_listen_connections, ec);
+      }
+      if (ec)
+      {
+        error_code ignored;
+        _acceptor.close(ignored);
+        return;
+      }
+      auto port = _acceptor.local_endpoint().port();
+      _port.store(port, std::memory_order_release);
+      LOG_INFO("metrics endpoint listening on {}:{}", _endpoint.address().to_string(), port);
+    }
+
+    void retry_listen()
+    {
+      _retry_timer.expires_after(_retry_interval);
+      _retry_timer.async_wait(
+          [this](const error_code& ec)
+          {
+            if (ec)
+            {
+              return;
+            }
+            error_code listen_ec;
+            listen(listen_ec);
+            if (listen_ec)
+            {
+              retry_listen();
+              return;
+            }
+            do_accept();
+          });
+    }
+
+    void do_accept()
+    {
+      _acceptor.async_accept(
+          [this](const error_code& ec, tcp_socket socket)
+          {
+            if (ec == asio::error::operation_aborted)
+            {
+              return;
+            }
+            if (!ec)
+            {
+              std::make_shared<Connection>(std::move(socket), _registry)->start();
+            }
+            else
+            {
+              LOG_WARN("metrics accept error: {}", ec.message());
+            }
+            do_accept();
+          });
+    }
+
+    Registry& _registry;
+    tcp_endpoint _endpoint;
+    std::chrono::milliseconds _retry_interval;
+    io_context _ioc;
+    tcp_acceptor _acceptor;
+    steady_timer _retry_timer;
+    std::atomic<uint16> _port{ 0 };
+    std::thread _thread;
+  };
+}  // namespace asio_learn::metrics
+#endif  // ASIO_LEARN_METRICS_METRICS_SERVER_HPP
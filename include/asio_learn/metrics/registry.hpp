@@ -0,0 +1,398 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 17:32:16
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 17:32:16
+ * @FilePath: \asio-learn-code\include\asio_learn\metrics\registry.hpp
+ * @Description: 指标注册表：按线程分片的计数器、仪表和固定桶直方图，输出Prometheus文本格式
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_METRICS_REGISTRY_HPP
+#define ASIO_LEARN_METRICS_REGISTRY_HPP
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * 热路径只做一次relaxed fetch_add：每个线程第一次使用时分到一个分片下标，之后一直写自己的分片
+ * 分片按缓存行对齐，不同线程写同一个指标不会互相踩缓存行；线程数超过分片数时按取模共用，仍然正确
+ * 抓取时把各分片加起来，只读原子变量，不加任何worker线程会碰的锁
+ * 注册(创建指标)要加锁，只应发生在服务器构造阶段；注册表必须比使用它的服务器活得久
+ */
+
+namespace asio_learn::metrics
+{
+  using Labels = std::vector<std::pair<std::string, std::string>>;
+
+  constexpr size_t SHARD_COUNT = 16;
+  constexpr size_t CACHE_LINE = 64;
+
+  // 当前线程的分片下标
+  inline size_t shard_index()
+  {
+    static std::atomic<size_t> next{ 0 };
+    thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT;
+    return index;
+  }
+
+  // 单调递增计数器
+  class Counter
+  {
+   public:
+    void inc(uint64_t value = 1)
+    {
+      _shards[shard_index()].value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    uint64_t value() const
+    {
+      uint64_t total = 0;
+      for (const auto& shard : _shards)
+      {
+        total += shard.value.load(std::memory_order_relaxed);
+      }
+      return total;
+    }
+
+   private:
+    struct alignas(CACHE_LINE) Shard
+    {
+      std::atomic<uint64_t> value{ 0 };
+    };
+    std::array<Shard, SHARD_COUNT> _shards;
+  };
+
+  // 可增可减的仪表，比如当前会话数; 同一会话的inc/dec可以落在不同分片上，只有总和有意义
+  class Gauge
+  {
+   public:
+    void add(int64_t value)
+    {
+      _shards[shard_index()].value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void inc()
+    {
+      add(1);
+    }
+
+    void dec()
+    {
+      add(-1);
+    }
+
+    // 与并发的add同时发生时结果不确定，只用于单写者的仪表
+    void set(int64_t value)
+    {
+      int64_t sharded = 0;
+      for (const auto& shard : _shards)
+      {
+        sharded += shard.value.load(std::memory_order_relaxed);
+      }
+      _base.store(value - sharded, std::memory_order_relaxed);
+    }
+
+    int64_t value() const
+    {
+      int64_t total = _base.load(std::memory_order_relaxed);
+      for (const auto& shard : _shards)
+      {
+        total += shard.value.load(std::memory_order_relaxed);
+      }
+      return total;
+    }
+
+   private:
+    struct alignas(CACHE_LINE) Shard
+    {
+      std::atomic<int64_t> value{ 0 };
+    };
+    std::array<Shard, SHARD_COUNT> _shards;
+    alignas(CACHE_LINE) std::atomic<int64_t> _base{ 0 };
+  };
+
+  // 耗时直方图，桶上界以秒为单位、构造后不变; 内部按纳秒累加总和，避免浮点原子操作
+  class Histogram
+  {
+   public:
+    struct Snapshot
+    {
+      std::vector<double> bounds;
+      std::vector<uint64_t> cumulative;  // 每个桶的累计计数，最后一个是+Inf
+      uint64_t count = 0;
+      double sum_seconds = 0;
+    };
+
+    explicit Histogram(std::vector<double> bounds_seconds) : _bounds(std::move(bounds_seconds))
+    {
+      std::sort(_bounds.begin(), _bounds.end());
+      _bounds.erase(std::unique(_bounds.begin(), _bounds.end()), _bounds.end());
+      _bounds_ns.reserve(_bounds.size());
+      for (double bound : _bounds)
+      {
+        _bounds_ns.push_back(static_cast<uint64_t>(bound * 1e9));
+      }
+      for (auto& shard : _shards)
+      {
+        shard.buckets = std::make_unique<std::atomic<uint64_t>[]>(_bounds.size() + 1);
+      }
+    }
+
+    void observe(std::chrono::nanoseconds elapsed)
+    {
+      auto ns = static_cast<uint64_t>(std::max<int64_t>(elapsed.count(), 0));
+      // 桶数很少，线性查找比二分更省分支预测
+      size_t bucket = 0;
+      while (bucket < _bounds_ns.size() && ns > _bounds_ns[bucket])
+      {
+        ++bucket;
+      }
+      auto& shard = _shards[shard_index()];
+      shard.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+      shard.sum_ns.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    Snapshot snapshot() const
+    {
+      Snapshot snap;
+      snap.bounds = _bounds;
+      snap.cumulative.assign(_bounds.size() + 1, 0);
+      uint64_t sum_ns = 0;
+      for (const auto& shard : _shards)
+      {
+        for (size_t i = 0; i <= _bounds.size(); ++i)
+        {
+          snap.cumulative[i] += shard.buckets[i].load(std::memory_order_relaxed);
+        }
+        sum_ns += shard.sum_ns.load(std::memory_order_relaxed);
+      }
+      for (size_t i = 1; i < snap.cumulative.size(); ++i)
+      {
+        snap.cumulative[i] += snap.cumulative[i - 1];
+      }
+      snap.count = snap.cumulative.back();
+      snap.sum_seconds = static_cast<double>(sum_ns) / 1e9;
+      return snap;
+    }
+
+    // 10us ~ 1s，适合回调处理耗时
+    static std::vector<double> default_latency_bounds()
+    {
+      return { 0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25,
+               0.5,     1.0 };
+    }
+
+   private:
+    struct alignas(CACHE_LINE) Shard
+    {
+      std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+      std::atomic<uint64_t> sum_ns{ 0 };
+    };
+    std::vector<double> _bounds;
+    std::vector<uint64_t> _bounds_ns;
+    std::array<Shard, SHARD_COUNT> _shards;
+  };
+
+  class Registry
+  {
+   public:
+    Registry() = default;
+    Registry(const Registry&) = delete;
+    Registry& operator=(const Registry&) = delete;
+
+    // 同名同标签重复注册返回同一个指标; 同名不同类型抛std::invalid_argument
+    Counter& counter(const std::string& name, const std::string& help, const Labels& labels = {})
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto& entry = find_or_create(name, help, Type::counter, labels);
+      if (!entry.counter)
+      {
+        entry.counter = std::make_unique<Counter>();
+      }
+      return *entry.counter;
+    }
+
+    Gauge& gauge(const std::string& name, const std::string& help, const Labels& labels = {})
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto& entry = find_or_create(name, help, Type::gauge, labels);
+      if (!entry.gauge)
+      {
+        entry.gauge = std::make_unique<Gauge>();
+      }
+      return *entry.gauge;
+    }
+
+    Histogram& histogram(
+        const std::string& name,
+        const std::string& help,
+        std::vector<double> bounds_seconds,
+        const Labels& labels = {})
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto& entry = find_or_create(name, help, Type::histogram, labels);
+      if (!entry.histogram)
+      {
+        entry.histogram = std::make_unique<Histogram>(std::move(bounds_seconds));
+      }
+      return *entry.histogram;
+    }
+
+    // Prometheus文本格式(0.0.4)，在抓取线程调用
+    std::string scrape() const
+    {
+      std::string out;
+      std::lock_guard<std::mutex> lock(_mutex);
+      for (const auto& family : _families)
+      {
+        out += std::format("# HELP {} {}\n# TYPE {} {}\n", family.name, family.help, family.name, type_name(family.type));
+        for (const auto& entry : family.entries)
+        {
+          switch (family.type)
+          {
+            case Type::counter:
+              out += std::format("{}{} {}\n", family.name, entry.labels, entry.counter->value());
+              break;
+            case Type::gauge:
+              out += std::format("{}{} {}\n", family.name, entry.labels, entry.gauge->value());
+              break;
+            case Type::histogram:
+              append_histogram(out, family.name, entry.raw_labels, *entry.histogram);
+              break;
+          }
+        }
+      }
+      return out;
+    }
+
+   private:
+    enum class Type
+    {
+      counter,
+      gauge,
+      histogram
+    };
+
+    struct Entry
+    {
+      Labels raw_labels;
+      std::string labels;  // 已渲染好的 {k="v",...}
+      std::unique_ptr<Counter> counter;
+      std::unique_ptr<Gauge> gauge;
+      std::unique_ptr<Histogram> histogram;
+    };
+
+    struct Family
+    {
+      std::string name;
+      std::string help;
+      Type type;
+      // 指标对象在堆上，vector扩容不会让已返回的引用失效
+      std::vector<Entry> entries;
+    };
+
+    Entry& find_or_create(const std::string& name, const std::string& help, Type type, const Labels& labels)
+    {
+      auto family = std::find_if(_families.begin(), _families.end(), [&](const Family& f) { return f.name == name; });
+      if (family == _families.end())
+      {
+        _families.push_back(Family{ name, help, type, {} });
+        family = std::prev(_families.end());
+      }
+      else if (family->type != type)
+      {
+        throw std::invalid_argument(std::format("metric {} already registered with another type", name));
+      }
+      auto rendered = render_labels(labels);
+      for (auto& entry : family->entries)
+      {
+        if (entry.labels == rendered)
+        {
+          return entry;
+        }
+      }
+      family->entries.push_back(Entry{ labels, std::move(rendered), nullptr, nullptr, nullptr });
+      return family->entries.back();
+    }
+
+    static const char* type_name(Type type)
+    {
+      switch (type)
+      {
+        case Type::counter: return "counter";
+        case Type::gauge: return "gauge";
+        default: return "histogram";
+      }
+    }
+
+    static std::string escape(const std::string& value)
+    {
+      std::string out;
+      out.reserve(value.size());
+      for (char c : value)
+      {
+        switch (c)
+        {
+          case '\\': out += "\\\\"; break;
+          case '"': out += "\\\""; break;
+          case '\n': out += "\\n"; break;
+          default: out += c;
+        }
+      }
+      return out;
+    }
+
+    static std::string render_labels(const Labels& labels, const std::string& extra = {})
+    {
+      if (labels.empty() && extra.empty())
+      {
+        return {};
+      }
+      std::string out = "{";
+      for (const auto& [key, value] : labels)
+      {
+        if (out.size() > 1)
+        {
+          out += ',';
+        }
+        out += std::format("{}=\"{}\"", key, escape(value));
+      }
+      if (!extra.empty())
+      {
+        if (out.size() > 1)
+        {
+          out += ',';
+        }
+        out += extra;
+      }
+      return out + "}";
+    }
+
+    static void append_histogram(std::string& out, const std::string& name, const Labels& labels, const Histogram& histogram)
+    {
+      auto snap = histogram.snapshot();
+      for (size_t i = 0; i < snap.bounds.size(); ++i)
+      {
+        out += std::format(
+            "{}_bucket{} {}\n", name, render_labels(labels, std::format("le=\"{}\"", snap.bounds[i])), snap.cumulative[i]);
+      }
+      out += std::format("{}_bucket{} {}\n", name, render_labels(labels, "le=\"+Inf\""), snap.count);
+      auto plain = render_labels(labels);
+      out += std::format("{}_sum{} {}\n", name, plain, snap.sum_seconds);
+      out += std::format("{}_count{} {}\n", name, plain, snap.count);
+    }
+
+    mutable std::mutex _mutex;
+    std::vector<Family> _families;
+  };
+}  // namespace asio_learn::metrics
+#endif  // ASIO_LEARN_METRICS_REGISTRY_HPP
@@ -0,0 +1,87 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 17:34:28
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 18:08:03
+ * @FilePath: \asio-learn-code\include\asio_learn\metrics\server_metrics.hpp
+ * @Description: 各个tcp服务器共用的一组指标，按server标签区分
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_METRICS_SERVER_METRICS_HPP
+#define ASIO_LEARN_METRICS_SERVER_METRICS_HPP
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "asio_learn/metrics/registry.hpp"
+
+namespace asio_learn::metrics
+{
+  // 指标对象归注册表所有，这里只持有引用
+  struct ServerMetrics
+  {
+    ServerMetrics(Registry& registry, const std::string& server)
+      : registry(registry)
+      , server(server)
+      , accepts(registry.counter("asio_learn_accepts_total", "Accepted connections", { { "server", server } }))
+      , active_sessions(registry.gauge("asio_learn_active_sessions", "Sessions currently alive", { { "server", server } }))
+      , bytes_in(registry.counter("asio_learn_bytes_received_total", "Bytes read from clients", { { "server", server } }))
+      , bytes_out(registry.counter("asio_learn_bytes_sent_total", "Bytes written to clients", { { "server", server } }))
+      , read_errors(registry.counter(
+            "asio_learn_read_errors_total", "Reads failed other than by a clean close", { { "server", server } }))
+      , write_errors(registry.counter("asio_learn_write_errors_total", "Writes failed", { { "server", server } }))
+      , handler_latency(registry.histogram(
+            "asio_learn_handler_duration_seconds",
+            "Time spent inside read completion handlers",
+            Histogram::default_latency_bounds(),
+            { { "server", server } }))
+    {
+    }
+
+    static std::shared_ptr<ServerMetrics> create(Registry& registry, const std::string& server)
+    {
+      return std::make_shared<ServerMetrics>(registry, server);
+    }
+
+    // 服务器内部的其他组件(比如循环延迟探针)也注册到同一个注册表
+    Registry& registry;
+    // server标签的值，组件注册自己的指标时沿用
+    const std::string server;
+    Counter& accepts;
+    Gauge& active_sessions;
+    Counter& bytes_in;
+    Counter& bytes_out;
+    Counter& read_errors;
+    Counter& write_errors;
+    Histogram& handler_latency;
+  };
+
+  // 统计所在作用域的耗时，metrics为空时什么都不做
+  class HandlerTimer
+  {
+   public:
+    explicit HandlerTimer(ServerMetrics* metrics) : _metrics(metrics)
+    {
+      if (_metrics)
+      {
+        _begin = std::chrono::steady_clock::now();
+      }
+    }
+
+    ~HandlerTimer()
+    {
+      if (_metrics)
+      {
+        _metrics->handler_latency.observe(std::chrono::steady_clock::now() - _begin);
+      }
+    }
+
+    HandlerTimer(const HandlerTimer&) = delete;
+    HandlerTimer& operator=(const HandlerTimer&) = delete;
+
+   private:
+    ServerMetrics* _metrics;
+    std::chrono::steady_clock::time_point _begin;
+  };
+}  // namespace asio_learn::metrics
+#endif  // ASIO_LEARN_METRICS_SERVER_METRICS_HPP
@@ -0,0 +1,99 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 16:24:46
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 16:24:46
+ * @FilePath: \asio-learn-code\include\asio_learn\mpsc_queue.hpp
+ * @Description: 无锁多生产者单消费者队列(Vyukov MPSC)
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_MPSC_QUEUE_HPP
+#define ASIO_LEARN_MPSC_QUEUE_HPP
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+namespace asio_learn
+{
+  /**
+   * @brief 无锁MPSC队列
+   *
+   * - push: 任意线程调用，一次原子exchange，wait-free
+   * - pop: 只能由唯一的消费者线程调用
+   * - 生产者push到一半(已exchange头指针但还没链接next)时，pop可能暂时返回空，
+   *   调用方需要配合"唤醒标志"重新检查，见 details::Worker 的收件箱
+   */
+  template<typename T>
+  class MpscQueue
+  {
+   public:
+    MpscQueue() : _head(&_stub), _tail(&_stub)
+    {
+    }
+
+    ~MpscQueue()
+    {
+      while (pop())
+      {
+      }
+      // 最后一个节点作为哨兵留在队列里
+      if (_tail != &_stub)
+      {
+        delete _tail;
+      }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(T value)
+    {
+      auto* node = new Node;
+      node->value.emplace(std::move(value));
+      Node* prev = _head.exchange(node, std::memory_order_seq_cst);
+      // 链接之前消费者看不到该节点
+      prev->next.store(node, std::memory_order_seq_cst);
+    }
+
+    // 只能在消费者线程调用
+    std::optional<T> pop()
+    {
+      Node* tail = _tail;
+      Node* next = tail->next.load(std::memory_order_seq_cst);
+      if (next == nullptr)
+      {
+        return std::nullopt;
+      }
+      // next 成为新的哨兵节点，取出其中的值
+      _tail = next;
+      std::optional<T> value(std::move(next->value));
+      next->value.reset();
+      if (tail != &_stub)
+      {
+        delete tail;
+      }
+      return value;
+    }
+
+    // 只能在消费者线程调用
+    bool empty() const
+    {
+      return _tail->next.load(std::memory_order_seq_cst) == nullptr;
+    }
+
+   private:
+    struct Node
+    {
+      std::atomic<Node*> next{ nullptr };
+      std::optional<T> value;
+    };
+
+    // 生产者和消费者各占一个cache line，避免伪共享
+    alignas(64) std::atomic<Node*> _head;
+    alignas(64) Node* _tail;
+    Node _stub;
+  };
+}  // namespace asio_learn
+
+#endif  // ASIO_LEARN_MPSC_QUEUE_HPP
@@ -0,0 +1,617 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 17:51:14
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 19:43:00
+ * @FilePath: \asio-learn-code\include\asio_learn\profile\handler_profiler.hpp
+ * @Description: 完成回调(handler)剖析数据: 按调用点和因果链汇总执行时间，二进制存取，导出折叠栈给火焰图
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_PROFILE_HANDLER_PROFILER_HPP
+#define ASIO_LEARN_PROFILE_HANDLER_PROFILER_HPP
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "asio_learn/trace/ticks.hpp"
+
+/**
+ * 这里不包含asio: handler_tracking.hpp 会被asio自己的头文件包含，这里也会跟着被包含
+ *
+ * 调用点(site) = 哪类IO对象的哪个异步操作(socket.async_receive)，加上发起它的源码位置
+ * 栈(stack) = 调用点 + 发起它时正在执行的回调所在的栈，也就是"哪个回调里发起的": accept -> read -> write
+ * 回调链会循环(read -> write -> read ...)，链上已经出现过的调用点直接复用祖先的栈，不会无限加深
+ * 每个回调结束时按栈累加次数、自身耗时(去掉嵌套执行的回调)和最大耗时，各线程写自己的表，导出时求和
+ * 调用点的字符串必须是字面量这类静态存储期的字符串，表里只存指针，落盘时才转成字符串
+ */
+
+namespace asio_learn::profile
+{
+  // 不统计的回调(剖析关闭、被排除的io_context、栈表已满)
+  constexpr uint32_t NO_STACK = 0xffffffffu;
+  // 不在任何回调里发起的操作挂在根下
+  constexpr uint32_t ROOT_STACK = 0;
+  constexpr uint32_t NO_SITE = 0xffffffffu;
+  constexpr uint32_t MAX_STACKS = 1u << 16;
+  constexpr uint32_t MAX_DEPTH = 32;
+
+  struct SiteKey
+  {
+    const char* object_type = nullptr;  // socket, io_context, deadline_timer ...
+    const char* op_name = nullptr;      // async_receive, post, async_wait ...
+    // 最外层的源码位置，通常是业务代码里的 ASIO_HANDLER_LOCATION
+    const char* file = nullptr;
+    int line = 0;
+    const char* func = nullptr;
+    // 最内层位置的函数名，通常是asio组合操作(async_write)，和最外层相同时为空
+    const char* inner = nullptr;
+
+    auto tie() const
+    {
+      return std::make_tuple(
+          reinterpret_cast<uintptr_t>(object_type),
+          reinterpret_cast<uintptr_t>(op_name),
+          reinterpret_cast<uintptr_t>(file),
+          line,
+          reinterpret_cast<uintptr_t>(func),
+          reinterpret_cast<uintptr_t>(inner));
+    }
+
+    bool operator==(const SiteKey& other) const
+    {
+      return tie() == other.tie();
+    }
+  };
+
+  // 自包含的剖析结果，可以落盘后在别的机器上转换
+  struct Profile
+  {
+    struct Site
+    {
+      std::string object_type;
+      std::string op_name;
+      std::string file;
+      int32_t line = 0;
+      std::string func;
+      std::string inner;
+
+      // 火焰图的一帧，不能含';'
+      std::string label() const
+      {
+        std::string text;
+        if (!func.empty())
+        {
+          auto slash = file.find_last_of("/\\");
+          text += func + " (" + (slash == std::string::npos ? file : file.substr(slash + 1)) + ":" +
+                  std::to_string(line) + ") ";
+        }
+        text += object_type + "." + op_name;
+        if (!inner.empty())
+        {
+          text += " via " + inner;
+        }
+        std::replace(text.begin(), text.end(), ';', ':');
+        return text;
+      }
+    };
+
+    struct Stack
+    {
+      uint32_t parent = ROOT_STACK;
+      uint32_t site = NO_SITE;  // 根没有调用点
+    };
+
+    struct Stats
+    {
+      uint64_t count = 0;
+      uint64_t self_ticks = 0;
+      uint64_t total_ticks = 0;
+      uint64_t max_ticks = 0;
+    };
+
+    struct SiteSummary
+    {
+      uint32_t site = NO_SITE;
+      uint64_t count = 0;
+      double self_seconds = 0;
+      double max_seconds = 0;
+    };
+
+    static constexpr uint32_t MAGIC = 0x50484c41;  // "ALHP"
+    static constexpr uint32_t VERSION = 1;
+
+    double ticks_per_second = 1e9;
+    std::vector<Site> sites;
+    std::vector<Stack> stacks;  // stacks[0] 是根
+    std::vector<Stats> stats;   // 和stacks一一对应
+
+    double seconds(uint64_t ticks) const
+    {
+      return static_cast<double>(ticks) / ticks_per_second;
+    }
+
+    // 每行 "根帧;...;叶帧 自身耗时纳秒"，flamegraph.pl / speedscope / inferno 都能直接读
+    void write_folded(std::ostream& out) const
+    {
+      for (uint32_t id = 1; id < stacks.size(); ++id)
+      {
+        if (stats[id].count == 0)
+        {
+          continue;
+        }
+        auto ns = static_cast<uint64_t>(seconds(stats[id].self_ticks) * 1e9);
+        if (ns == 0)
+        {
+          continue;
+        }
+        std::vector<uint32_t> frames;
+        for (uint32_t cur = id; cur != ROOT_STACK; cur = stacks[cur].parent)
+        {
+          frames.push_back(stacks[cur].site);
+        }
+        for (auto it = frames.rbegin(); it != frames.rend(); ++it)
+        {
+          out << sites[*it].label() << (std::next(it) == frames.rend() ? " " : ";");
+        }
+        out << ns << '\n';
+      }
+    }
+
+    // 按调用点汇总(不分发起链)，自身耗时降序
+    std::vector<SiteSummary> by_site() const
+    {
+      std::vector<SiteSummary> summary(sites.size());
+      for (uint32_t id = 1; id < stacks.size(); ++id)
+      {
+        auto& entry = summary[stacks[id].site];
+        entry.site = stacks[id].site;
+        entry.count += stats[id].count;
+        entry.self_seconds += seconds(stats[id].self_ticks);
+        entry.max_seconds = std::max(entry.max_seconds, seconds(stats[id].max_ticks));
+      }
+      std::erase_if(summary, [](const SiteSummary& entry) { return entry.count == 0; });
+      std::sort(
+          summary.begin(),
+          summary.end(),
+          [](const SiteSummary& a, const SiteSummary& b) { return a.self_seconds > b.self_seconds; });
+      return summary;
+    }
+
+    // 主机字节序，只在同一种架构之间搬运
+    bool save(const std::string& path) const
+    {
+      std::ofstream out(path, std::ios::binary | std::ios::trunc);
+      if (!out)
+      {
+        return false;
+      }
+      put(out, MAGIC);
+      put(out, VERSION);
+      put(out, ticks_per_second);
+      put(out, static_cast<uint32_t>(sites.size()));
+      for (const auto& site : sites)
+      {
+        put_string(out, site.object_type);
+        put_string(out, site.op_name);
+        put_string(out, site.file);
+        put(out, site.line);
+        put_string(out, site.func);
+        put_string(out, site.inner);
+      }
+      put(out, static_cast<uint32_t>(stacks.size()));
+      for (size_t i = 0; i < stacks.size(); ++i)
+      {
+        put(out, stacks[i].parent);
+        put(out, stacks[i].site);
+        put(out, stats[i].count);
+        put(out, stats[i].self_ticks);
+        put(out, stats[i].total_ticks);
+        put(out, stats[i].max_ticks);
+      }
+      return static_cast<bool>(out.flush());
+    }
+
+    static std::optional<Profile> load(const std::string& path, std::string* error = nullptr)
+    {
+      auto fail = [error](const char* reason) -> std::optional<Profile>
+      {
+        if (error)
+        {
+          *error = reason;
+        }
+        return std::nullopt;
+      };
+      std::ifstream in(path, std::ios::binary);
+      if (!in)
+      {
+        return fail("cannot open file");
+      }
+      uint32_t magic = 0, version = 0, site_count = 0, stack_count = 0;
+      Profile profile;
+      if (!get(in, magic) || magic != MAGIC)
+      {
+        return fail("not a handler profile");
+      }
+      if (!get(in, version) || version != VERSION)
+      {
+        return fail("unsupported profile version");
+      }
+      if (!get(in, profile.ticks_per_second) || !(profile.ticks_per_second > 0) || !get(in, site_count) ||
+          site_count > MAX_STACKS)
+      {
+        return fail("corrupt header");
+      }
+      profile.sites.resize(site_count);
+      for (auto& site : profile.sites)
+      {
+        if (!get_string(in, site.object_type) || !get_string(in, site.op_name) || !get_string(in, site.file) ||
+            !get(in, site.line) || !get_string(in, site.func) || !get_string(in, site.inner))
+        {
+          return fail("truncated site table");
+        }
+      }
+      if (!get(in, stack_count) || stack_count == 0 || stack_count > MAX_STACKS)
+      {
+        return fail("corrupt stack table");
+      }
+      profile.stacks.resize(stack_count);
+      profile.stats.resize(stack_count);
+      for (uint32_t i = 0; i < stack_count; ++i)
+      {
+        auto& stack = profile.stacks[i];
+        auto& stats = profile.stats[i];
+        if (!get(in, stack.parent) || !get(in, stack.site) || !get(in, stats.count) || !get(in, stats.self_ticks) ||
+            !get(in, stats.total_ticks) || !get(in, stats.max_ticks))
+        {
+          return fail("truncated stack table");
+        }
+        // 父栈总是先于子栈创建，编号更小，这样遍历到根一定会结束
+        if (i != ROOT_STACK && (stack.parent >= i || stack.site >= site_count))
+        {
+          return fail("corrupt stack entry");
+        }
+      }
+      return profile;
+    }
+
+   private:
+    template<typename T>
+    static void put(std::ostream& out, const T& value)
+    {
+      out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    static void put_string(std::ostream& out, const std::string& text)
+    {
+      put(out, static_cast<uint32_t>(text.size()));
+      out.write(text.data(), static_cast<std::streamsize>(text.size()));
+    }
+
+    template<typename T>
+    static bool get(std::istream& in, T& value)
+    {
+      return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+    }
+
+    static bool get_string(std::istream& in, std::string& text)
+    {
+      uint32_t size = 0;
+      if (!get(in, size) || size > 4096)
+      {
+        return false;
+      }
+      text.resize(size);
+      return static_cast<bool>(in.read(text.data(), size));
+    }
+  };
+
+  class HandlerProfiler
+  {
+   public:
+    static HandlerProfiler& instance()
+    {
+      static HandlerProfiler profiler;
+      return profiler;
+    }
+
+    HandlerProfiler(const HandlerProfiler&) = delete;
+    HandlerProfiler& operator=(const HandlerProfiler&) = delete;
+
+    // 只影响之后创建的回调，已经在队列里的回调按创建时的状态统计
+    void enable()
+    {
+      _enabled.store(true, std::memory_order_relaxed);
+    }
+
+    void disable()
+    {
+      _enabled.store(false, std::memory_order_relaxed);
+    }
+
+    bool enabled() const
+    {
+      return _enabled.load(std::memory_order_relaxed);
+    }
+
+    // 不统计某个io_context上创建的回调，比如剖析工具自己的压测客户端; 传io_context的地址
+    void exclude(const void* context)
+    {
+      for (auto& slot : _excluded)
+      {
+        const void* expected = nullptr;
+        if (slot.compare_exchange_strong(expected, context, std::memory_order_relaxed))
+        {
+          return;
+        }
+      }
+    }
+
+    bool excluded(const void* context) const
+    {
+      for (const auto& slot : _excluded)
+      {
+        auto value = slot.load(std::memory_order_relaxed);
+        if (!value)
+        {
+          return false;
+        }
+        if (value == context)
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // 创建回调时调用，返回它所在的栈; 命中线程本地缓存时不加锁
+    uint32_t intern(uint32_t parent, const SiteKey& site)
+    {
+      thread_local std::unordered_map<CacheKey, uint32_t, CacheHash> cache;
+      CacheKey key{ parent, site };
+      auto it = cache.find(key);
+      if (it != cache.end())
+      {
+        return it->second;
+      }
+      auto stack = intern_locked(parent, site);
+      cache.emplace(key, stack);
+      return stack;
+    }
+
+    // 回调执行结束时调用，只写本线程的表
+    void record(uint32_t stack, uint64_t self_ticks, uint64_t total_ticks)
+    {
+      thread_local ThreadStats* local = nullptr;
+      if (!local)
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _threads.push_back(std::make_unique<ThreadStats>());
+        local = _threads.back().get();
+      }
+      auto& chunk_slot = local->chunks[stack / CHUNK_SIZE];
+      auto* chunk = chunk_slot.load(std::memory_order_relaxed);
+      if (!chunk)
+      {
+        chunk = new Chunk();
+        chunk_slot.store(chunk, std::memory_order_release);
+      }
+      auto& entry = (*chunk)[stack % CHUNK_SIZE];
+      add(entry.count, 1);
+      add(entry.self_ticks, self_ticks);
+      add(entry.total_ticks, total_ticks);
+      if (total_ticks > entry.max_ticks.load(std::memory_order_relaxed))
+      {
+        entry.max_ticks.store(total_ticks, std::memory_order_relaxed);
+      }
+    }
+
+    // 栈表满了之后丢弃的回调创建次数
+    uint64_t dropped() const
+    {
+      return _dropped.load(std::memory_order_relaxed);
+    }
+
+    // 可在任意线程调用，和记录并发时个别计数可能差一两次
+    Profile snapshot() const
+    {
+      Profile profile;
+      profile.ticks_per_second = calibrate();
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto text = [](const char* value) { return value ? std::string(value) : std::string(); };
+      profile.sites.reserve(_sites.size());
+      for (const auto& site : _sites)
+      {
+        profile.sites.push_back(Profile::Site{ text(site.object_type),
+                                               text(site.op_name),
+                                               text(site.file),
+                                               site.line,
+                                               text(site.func),
+                                               text(site.inner) });
+      }
+      profile.stacks.reserve(_stacks.size());
+      for (const auto& node : _stacks)
+      {
+        profile.stacks.push_back(Profile::Stack{ node.parent, node.site });
+      }
+      profile.stats.resize(_stacks.size());
+      for (const auto& thread : _threads)
+      {
+        for (uint32_t id = 0; id < _stacks.size(); ++id)
+        {
+          auto* chunk = thread->chunks[id / CHUNK_SIZE].load(std::memory_order_acquire);
+          if (!chunk)
+          {
+            id += CHUNK_SIZE - 1 - id % CHUNK_SIZE;
+            continue;
+          }
+          const auto& entry = (*chunk)[id % CHUNK_SIZE];
+          auto& stats = profile.stats[id];
+          stats.count += entry.count.load(std::memory_order_relaxed);
+          stats.self_ticks += entry.self_ticks.load(std::memory_order_relaxed);
+          stats.total_ticks += entry.total_ticks.load(std::memory_order_relaxed);
+          stats.max_ticks = std::max(stats.max_ticks, entry.max_ticks.load(std::memory_order_relaxed));
+        }
+      }
+      return profile;
+    }
+
+    bool dump(const std::string& path) const
+    {
+      return snapshot().save(path);
+    }
+
+   private:
+    static constexpr uint32_t CHUNK_SIZE = 1024;
+
+    struct Entry
+    {
+      std::atomic<uint64_t> count{ 0 };
+      std::atomic<uint64_t> self_ticks{ 0 };
+      std::atomic<uint64_t> total_ticks{ 0 };
+      std::atomic<uint64_t> max_ticks{ 0 };
+    };
+    using Chunk = std::array<Entry, CHUNK_SIZE>;
+
+    // 按需分配的分块表，已分配的块地址不再变化，导出时可以直接读
+    struct ThreadStats
+    {
+      std::array<std::atomic<Chunk*>, MAX_STACKS / CHUNK_SIZE> chunks{};
+
+      ~ThreadStats()
+      {
+        for (auto& chunk : chunks)
+        {
+          delete chunk.load(std::memory_order_relaxed);
+        }
+      }
+    };
+
+    struct Node
+    {
+      uint32_t parent;
+      uint32_t site;
+      uint32_t depth;
+    };
+
+    struct CacheKey
+    {
+      uint32_t parent;
+      SiteKey site;
+
+      bool operator==(const CacheKey& other) const
+      {
+        return parent == other.parent && site == other.site;
+      }
+    };
+
+    struct CacheHash
+    {
+      size_t operator()(const CacheKey& key) const
+      {
+        size_t seed = key.parent;
+        auto mix = [&seed](size_t value) { seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2); };
+        mix(reinterpret_cast<uintptr_t>(key.site.object_type));
+        mix(reinterpret_cast<uintptr_t>(key.site.op_name));
+        mix(reinterpret_cast<uintptr_t>(key.site.file));
+        mix(static_cast<size_t>(key.site.line));
+        mix(reinterpret_cast<uintptr_t>(key.site.func));
+        mix(reinterpret_cast<uintptr_t>(key.site.inner));
+        return seed;
+      }
+    };
+
+    HandlerProfiler() : _origin_ticks(trace::read_ticks()), _origin_time(std::chrono::steady_clock::now())
+    {
+      _stacks.push_back(Node{ ROOT_STACK, NO_SITE, 0 });
+    }
+
+    static void add(std::atomic<uint64_t>& value, uint64_t delta)
+    {
+      // 单写者，不需要原子的读改写
+      value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    uint32_t intern_locked(uint32_t parent, const SiteKey& key)
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto [site_it, site_added] = _site_index.emplace(key.tie(), static_cast<uint32_t>(_sites.size()));
+      if (site_added)
+      {
+        _sites.push_back(key);
+      }
+      auto site = site_it->second;
+
+      // 链上已经有这个调用点就折叠回去: read -> write -> read 记在第一个read上
+      for (auto cur = parent; cur != ROOT_STACK; cur = _stacks[cur].parent)
+      {
+        if (_stacks[cur].site == site)
+        {
+          return cur;
+        }
+      }
+      if (_stacks[parent].depth >= MAX_DEPTH)
+      {
+        return parent;
+      }
+      auto [stack_it, stack_added] =
+          _stack_index.emplace(std::make_pair(parent, site), static_cast<uint32_t>(_stacks.size()));
+      if (stack_added)
+      {
+        if (_stacks.size() >= MAX_STACKS)
+        {
+          _stack_index.erase(stack_it);
+          _dropped.fetch_add(1, std::memory_order_relaxed);
+          return NO_STACK;
+        }
+        _stacks.push_back(Node{ parent, site, _stacks[parent].depth + 1 });
+      }
+      return stack_it->second;
+    }
+
+    // 每秒多少tick，至少积累10ms再算
+    double calibrate() const
+    {
+#ifdef ASIO_LEARN_TRACE_HAS_TSC
+      auto elapsed = std::chrono::steady_clock::now() - _origin_time;
+      if (elapsed < std::chrono::milliseconds(10))
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10) - elapsed);
+      }
+      auto ticks = trace::read_ticks() - _origin_ticks;
+      auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - _origin_time).count();
+      return static_cast<double>(ticks) / seconds;
+#else
+      return 1e9;
+#endif
+    }
+
+    std::atomic<bool> _enabled{ false };
+    std::array<std::atomic<const void*>, 8> _excluded{};
+    const uint64_t _origin_ticks;
+    const std::chrono::steady_clock::time_point _origin_time;
+    mutable std::mutex _mutex;
+    std::vector<SiteKey> _sites;
+    std::map<decltype(std::declval<SiteKey>().tie()), uint32_t> _site_index;
+    std::vector<Node> _stacks;
+    std::map<std::pair<uint32_t, uint32_t>, uint32_t> _stack_index;
+    // 线程退出后统计仍然保留
+    std::vector<std::unique_ptr<ThreadStats>> _threads;
+    std::atomic<uint64_t> _dropped{ 0 };
+  };
+}  // namespace asio_learn::profile
+#endif  // ASIO_LEARN_PROFILE_HANDLER_PROFILER_HPP
@@ -0,0 +1,224 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 17:45:11
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 19:41:34
+ * @FilePath: \asio-learn-code\include\asio_learn\profile\handler_tracking.hpp
+ * @Description: asio自定义handler tracking: 不输出文本，把回调执行时间记进HandlerProfiler
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_PROFILE_HANDLER_TRACKING_HPP
+#define ASIO_LEARN_PROFILE_HANDLER_TRACKING_HPP
+#include <cstdint>
+
+#include "asio_learn/profile/handler_profiler.hpp"
+
+/**
+ * 用法: 编译时定义 ASIO_CUSTOM_HANDLER_TRACKING="asio_learn/profile/handler_tracking.hpp"
+ * (CMake选项 ASIO_LEARN_HANDLER_PROFILE)，asio在 detail/handler_tracking.hpp 里包含本文件
+ * 同一个程序里所有翻译单元必须一致，否则asio操作对象的布局不同，违反ODR
+ *
+ * ASIO_ENABLE_HANDLER_TRACKING 每个事件格式化一行文本写stderr，这里每次创建回调查一次线程本地缓存，
+ * 每次执行读两次TSC、写本线程的计数表，不加锁不分配; HandlerProfiler未启用时只剩一个分支
+ * 发起异步操作的地方加 ASIO_HANDLER_LOCATION((__FILE__, __LINE__, __func__)) 后，调用点能区分到源码行
+ */
+
+namespace asio_learn::profile::tracking
+{
+  // asio的操作对象都继承它，只多一个栈编号
+  class tracked_handler
+  {
+   public:
+    uint32_t _stack = NO_STACK;
+  };
+
+  // ASIO_HANDLER_LOCATION 在栈上构造，串成本线程的位置链
+  class location
+  {
+   public:
+    location(const char* file, int line, const char* func) : _file(file), _line(line), _func(func), _next(top)
+    {
+      top = this;
+    }
+
+    ~location()
+    {
+      top = _next;
+    }
+
+    location(const location&) = delete;
+    location& operator=(const location&) = delete;
+
+    inline static thread_local location* top = nullptr;
+
+   private:
+    friend class completion;
+    template<typename Context>
+    friend void creation(Context&, tracked_handler&, const char*, void*, uintmax_t, const char*);
+
+    const char* _file;
+    int _line;
+    const char* _func;
+    location* _next;
+  };
+
+  class completion;
+
+  // 本线程正在执行的回调，新建的回调以它为父
+  struct ThreadState
+  {
+    uint32_t current_stack = ROOT_STACK;
+    completion* active = nullptr;
+  };
+
+  inline thread_local ThreadState state;
+
+  inline void init()
+  {
+  }
+
+  template<typename Context>
+  void creation(
+      Context& context,
+      tracked_handler& h,
+      const char* object_type,
+      void* /*object*/,
+      uintmax_t /*native_handle*/,
+      const char* op_name)
+  {
+    auto& profiler = HandlerProfiler::instance();
+    if (!profiler.enabled() || profiler.excluded(static_cast<const void*>(&context)))
+    {
+      h._stack = NO_STACK;
+      return;
+    }
+    SiteKey site;
+    site.object_type = object_type;
+    site.op_name = op_name;
+    if (auto* inner = location::top)
+    {
+      auto* outer = inner;
+      while (outer->_next)
+      {
+        outer = outer->_next;
+      }
+      site.file = outer->_file;
+      site.line = outer->_line;
+      site.func = outer->_func;
+      if (inner != outer)
+      {
+        site.inner = inner->_func;
+      }
+    }
+    h._stack = profiler.intern(state.current_stack, site);
+  }
+
+  class completion
+  {
+   public:
+    explicit completion(const tracked_handler& h) : _stack(h._stack)
+    {
+    }
+
+    // 回调抛异常时也要恢复线程状态
+    ~completion()
+    {
+      if (_running)
+      {
+        finish();
+      }
+    }
+
+    completion(const completion&) = delete;
+    completion& operator=(const completion&) = delete;
+
+    // asio按回调签名传不同的参数，这里都不需要
+    template<typename... Args>
+    void invocation_begin(const Args&... /*args*/)
+    {
+      if (_stack == NO_STACK)
+      {
+        return;
+      }
+      _outer = state.active;
+      _outer_stack = state.current_stack;
+      // 回调里发起的操作只看回调自己的位置，不继承外面(dispatch内联执行时)的
+      _outer_location = location::top;
+      location::top = nullptr;
+      state.active = this;
+      state.current_stack = _stack;
+      _running = true;
+      _begin = trace::read_ticks();
+    }
+
+    void invocation_end()
+    {
+      if (_running)
+      {
+        finish();
+      }
+    }
+
+   private:
+    void finish()
+    {
+      auto total = trace::read_ticks() - _begin;
+      HandlerProfiler::instance().record(_stack, total > _children ? total - _children : 0, total);
+      if (_outer)
+      {
+        _outer->_children += total;
+      }
+      state.active = _outer;
+      state.current_stack = _outer_stack;
+      location::top = _outer_location;
+      _running = false;
+    }
+
+    uint32_t _stack;
+    bool _running = false;
+    uint64_t _begin = 0;
+    // 嵌套执行的回调耗时，从自身耗时里扣掉
+    uint64_t _children = 0;
+    completion* _outer = nullptr;
+    uint32_t _outer_stack = ROOT_STACK;
+    location* _outer_location = nullptr;
+  };
+
+  // 取消、reactor事件这些不计时
+  template<typename... Args>
+  void ignore(const Args&... /*args*/)
+  {
+  }
+}  // namespace asio_learn::profile::tracking
+
+#define ASIO_INHERIT_TRACKED_HANDLER : public ::asio_learn::profile::tracking::tracked_handler
+
+#define ASIO_ALSO_INHERIT_TRACKED_HANDLER , public ::asio_learn::profile::tracking::tracked_handler
+
+#define ASIO_HANDLER_TRACKING_INIT ::asio_learn::profile::tracking::init()
+
+#define ASIO_HANDLER_LOCATION(args) ::asio_learn::profile::tracking::location tracked_location args
+
+#define ASIO_HANDLER_CREATION(args) ::asio_learn::profile::tracking::creation args
+
+#define ASIO_HANDLER_COMPLETION(args) ::asio_learn::profile::tracking::completion tracked_completion args
+
+#define ASIO_HANDLER_INVOCATION_BEGIN(args) tracked_completion.invocation_begin args
+
+#define ASIO_HANDLER_INVOCATION_END tracked_completion.invocation_end()
+
+#define ASIO_HANDLER_OPERATION(args) ::asio_learn::profile::tracking::ignore args
+
+#define ASIO_HANDLER_REACTOR_REGISTRATION(args) ::asio_learn::profile::tracking::ignore args
+
+#define ASIO_HANDLER_REACTOR_DEREGISTRATION(args) ::asio_learn::profile::tracking::ignore args
+
+#define ASIO_HANDLER_REACTOR_READ_EVENT 1
+#define ASIO_HANDLER_REACTOR_WRITE_EVENT 2
+#define ASIO_HANDLER_REACTOR_ERROR_EVENT 4
+
+#define ASIO_HANDLER_REACTOR_EVENTS(args) ::asio_learn::profile::tracking::ignore args
+
+#define ASIO_HANDLER_REACTOR_OPERATION(args) ::asio_learn::profile::tracking::ignore args
+
+#endif  // ASIO_LEARN_PROFILE_HANDLER_TRACKING_HPP
@@ -0,0 +1,120 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 18:49:32
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 18:49:32
+ * @FilePath: \asio-learn-code\include\asio_learn\ssl\alpn.hpp
+ * @Description: ALPN协商: 服务器按自己的优先级从客户端提供的协议里选一个，客户端编码自己支持的协议列表
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_SSL_ALPN_HPP_
+#define ASIO_LEARN_SSL_ALPN_HPP_
+#include <openssl/ssl.h>
+
+#include <asio.hpp>
+#include <asio/ssl.hpp>
+#include <string>
+#include <vector>
+
+#include "common/Log.hpp"
+
+/**
+ * 握手时协商应用层协议，省掉连接建立后再协商的一个往返; 复用的会话记着当时选的协议，
+ * 0-RTT要求这次选出的协议和票据里的相同，否则早期数据会被拒绝
+ * 客户端没带ALPN时照常握手; 带了但没有交集时strict为true直接以no_application_protocol告警断开，否则不回ALPN
+ */
+
+namespace asio_learn::ssl
+{
+  class Alpn
+  {
+   public:
+    // protocols按优先级从高到低，每个1~255字节
+    explicit Alpn(std::vector<std::string> protocols, bool strict = false)
+      : _protocols(std::move(protocols))
+      , _wire(encode(_protocols))
+      , _strict(strict)
+    {
+    }
+
+    Alpn(const Alpn&) = delete;
+    Alpn& operator=(const Alpn&) = delete;
+
+    // 服务器: 在context上安装选择回调，Alpn对象要比context活得久
+    void install(asio::ssl::context& ctx)
+    {
+      if (!_protocols.empty())
+      {
+        SSL_CTX_set_alpn_select_cb(ctx.native_handle(), &Alpn::on_select, this);
+      }
+    }
+
+    // 客户端: 设置提供给服务器的协议列表
+    static void offer(asio::ssl::context& ctx, const std::vector<std::string>& protocols)
+    {
+      auto wire = encode(protocols);
+      if (!wire.empty())
+      {
+        SSL_CTX_set_alpn_protos(ctx.native_handle(), wire.data(), static_cast<unsigned int>(wire.size()));
+      }
+    }
+
+    // 握手完成后取协商结果，没有协商返回空串
+    static std::string selected(SSL* ssl)
+    {
+      const unsigned char* data = nullptr;
+      unsigned int size = 0;
+      SSL_get0_alpn_selected(ssl, &data, &size);
+      return std::string(reinterpret_cast<const char*>(data), data ? size : 0);
+    }
+
+    // 协议列表的线上格式: 每项一个字节长度加内容，空的和超长的跳过
+    static std::vector<unsigned char> encode(const std::vector<std::string>& protocols)
+    {
+      std::vector<unsigned char> wire;
+      for (const auto& protocol : protocols)
+      {
+        if (protocol.empty() || protocol.size() > 255)
+        {
+          continue;
+        }
+        wire.push_back(static_cast<unsigned char>(protocol.size()));
+        wire.insert(wire.end(), protocol.begin(), protocol.end());
+      }
+      return wire;
+    }
+
+   private:
+    static int on_select(
+        SSL* /*ssl*/,
+        const unsigned char** out,
+        unsigned char* out_size,
+        const unsigned char* in,
+        unsigned int in_size,
+        void* arg)
+    {
+      auto* self = static_cast<Alpn*>(arg);
+      // SSL_select_next_proto以第一个列表的顺序为准，这里传服务器的列表，按服务器的优先级选
+      unsigned char* selected = nullptr;
+      if (SSL_select_next_proto(
+              &selected,
+              out_size,
+              self->_wire.data(),
+              static_cast<unsigned int>(self->_wire.size()),
+              in,
+              in_size) == OPENSSL_NPN_NEGOTIATED)
+      {
+        *out = selected;
+        return SSL_TLSEXT_ERR_OK;
+      }
+      LOG_DEBUG("SSL no common ALPN protocol");
+      return self->_strict ? SSL_TLSEXT_ERR_ALERT_FATAL : SSL_TLSEXT_ERR_NOACK;
+    }
+
+    std::vector<std::string> _protocols;
+    std::vector<unsigned char> _wire;
+    bool _strict;
+  };
+}  // namespace asio_learn::ssl
+
+#endif  // ASIO_LEARN_SSL_ALPN_HPP_
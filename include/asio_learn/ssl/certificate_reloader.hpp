@@ -0,0 +1,231 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 18:32:00
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 18:32:00
+ * @FilePath: \asio-learn-code\include\asio_learn\ssl\certificate_reloader.hpp
+ * @Description: 证书和私钥热更新: 文件修改或收到信号时重新构建ssl::context并替换到SslTcpServer，不断开已有连接
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_SSL_CERTIFICATE_RELOADER_HPP_
+#define ASIO_LEARN_SSL_CERTIFICATE_RELOADER_HPP_
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include <asio.hpp>
+#include <asio/ssl.hpp>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "asio_learn/metrics/registry.hpp"
+#include "asio_learn/public.hpp"
+#include "asio_learn/ssl/ssl_tcp_server.hpp"
+#include "asio_learn/trace/tracer.hpp"
+#include "common/Log.hpp"
+
+/**
+ * 触发方式: 轮询watch_files的修改时间，或者收到signal_number(默认SIGHUP)
+ * 读文件、解析私钥都在自带的线程上做，I/O和握手线程不受影响; 构建成功并且证书和私钥匹配才替换，
+ * 否则保留当前context，记一次失败
+ * 证书和私钥不是原子替换时(先写证书后写私钥)，中间那次检查会因为不匹配失败，私钥写完后再次触发即可成功;
+ * 部署时最好写临时文件再rename
+ */
+
+namespace asio_learn::ssl
+{
+#ifdef SIGHUP
+  constexpr int DEFAULT_RELOAD_SIGNAL = SIGHUP;
+#else
+  constexpr int DEFAULT_RELOAD_SIGNAL = 0;
+#endif
+
+  struct CertificateReloadOptions
+  {
+    std::vector<std::string> watch_files;  // 任一文件的修改时间变化就重新加载
+    std::chrono::milliseconds poll_interval{ 2000 };  // 0表示不轮询，只响应信号
+    int signal_number = DEFAULT_RELOAD_SIGNAL;  // 0表示不监听信号
+    std::string server = "ssl_tcp_server";  // 指标的server标签
+  };
+
+  struct CertificateReloadStats
+  {
+    uint64 reloads = 0;
+    uint64 failures = 0;
+  };
+
+  class CertificateReloader
+  {
+   public:
+    // 每次重新加载调用一次，返回配置好证书和私钥的新context; 抛异常视为失败
+    using ContextFactory = std::function<asio::ssl::context()>;
+
+    CertificateReloader(
+        SslTcpServer& server,
+        ContextFactory factory,
+        CertificateReloadOptions options = {},
+        metrics::Registry* registry = nullptr)
+      : _server(server)
+      , _factory(std::move(factory))
+      , _options(std::move(options))
+      , _timer(_ioc)
+      , _signals(_ioc)
+    {
+      if (registry)
+      {
+        const char* help = "Certificate reloads by result";
+        _m_reloads = &registry->counter(
+            "asio_learn_tls_context_reloads_total", help, { { "server", _options.server }, { "result", "ok" } });
+        _m_failures = &registry->counter(
+            "asio_learn_tls_context_reloads_total", help, { { "server", _options.server }, { "result", "failed" } });
+      }
+      _mtimes = snapshot();
+      if (_options.signal_number != 0)
+      {
+        _signals.add(_options.signal_number);
+        wait_signal();
+        LOG_INFO("send signal {} to pid {} to reload certificates", _options.signal_number, trace::current_pid());
+      }
+      if (_options.poll_interval.count() > 0 && !_options.watch_files.empty())
+      {
+        wait_poll();
+      }
+      _thread = std::thread(
+          [this]()
+          {
+            trace::Tracer::instance().set_thread_name("ssl-cert-reload");
+            _ioc.run();
+          });
+    }
+
+    ~CertificateReloader()
+    {
+      _ioc.stop();
+      if (_thread.joinable())
+      {
+        _thread.join();
+      }
+    }
+
+    CertificateReloader(const CertificateReloader&) = delete;
+    CertificateReloader& operator=(const CertificateReloader&) = delete;
+
+    // 可在任意线程调用，在重新加载线程上异步执行
+    void reload_now()
+    {
+      asio::post(_ioc, [this]() { reload("manual"); });
+    }
+
+    // 可在任意线程调用
+    CertificateReloadStats stats() const
+    {
+      CertificateReloadStats stats;
+      stats.reloads = _reloads.load(std::memory_order_relaxed);
+      stats.failures = _failures.load(std::memory_order_relaxed);
+      return stats;
+    }
+
+   private:
+    using FileTimes = std::vector<std::filesystem::file_time_type>;
+
+    // 取不到修改时间(文件暂时不存在)记为最小值，文件重新出现时算作变化
+    FileTimes snapshot() const
+    {
+      FileTimes times;
+      for (const auto& file : _options.watch_files)
+      {
+        std::error_code ec;
+        auto time = std::filesystem::last_write_time(file, ec);
+        times.push_back(ec ? std::filesystem::file_time_type::min() : time);
+      }
+      return times;
+    }
+
+    void wait_signal()
+    {
+      _signals.async_wait(
+          [this](const asio::error_code& ec, int /*signal_number*/)
+          {
+            if (ec)
+            {
+              return;
+            }
+            reload("signal");
+            wait_signal();
+          });
+    }
+
+    void wait_poll()
+    {
+      _timer.expires_after(_options.poll_interval);
+      _timer.async_wait(
+          [this](const asio::error_code& ec)
+          {
+            if (ec)
+            {
+              return;
+            }
+            auto times = snapshot();
+            if (times != _mtimes)
+            {
+              // 失败时也记下新的时间，等文件再次变化或收到信号时重试，不在每次轮询时刷错误日志
+              _mtimes = std::move(times);
+              reload("file change");
+            }
+            wait_poll();
+          });
+    }
+
+    void reload(const char* trigger)
+    {
+      try
+      {
+        auto ctx = _factory();
+        if (SSL_CTX_check_private_key(ctx.native_handle()) != 1)
+        {
+          ERR_clear_error();
+          throw std::runtime_error("certificate and private key do not match");
+        }
+        _server.reload_context(std::move(ctx));
+        _reloads.fetch_add(1, std::memory_order_relaxed);
+        if (_m_reloads)
+        {
+          _m_reloads->inc();
+        }
+        LOG_INFO("SSL certificates reloaded ({})", trigger);
+      }
+      catch (const std::exception& e)
+      {
+        _failures.fetch_add(1, std::memory_order_relaxed);
+        if (_m_failures)
+        {
+          _m_failures->inc();
+        }
+        LOG_ERR("SSL certificate reload ({}) failed, keep the current context: {}", trigger, e.what());
+      }
+    }
+
+    SslTcpServer& _server;
+    ContextFactory _factory;
+    CertificateReloadOptions _options;
+    asio::io_context _ioc;
+    asio::steady_timer _timer;
+    asio::signal_set _signals;
+    std::thread _thread;
+    FileTimes _mtimes;  // 只在重新加载线程上访问(构造时除外)
+    std::atomic<uint64> _reloads{ 0 };
+    std::atomic<uint64> _failures{ 0 };
+    metrics::Counter* _m_reloads = nullptr;
+    metrics::Counter* _m_failures = nullptr;
+  };
+}  // namespace asio_learn::ssl
+
+#endif  // ASIO_LEARN_SSL_CERTIFICATE_RELOADER_HPP_
@@ -0,0 +1,527 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 18:28:14
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 19:54:23
+ * @FilePath: \asio-learn-code\include\asio_learn\ssl\early_data.hpp
+ * @Description: TLS1.3早期数据(0-RTT): 复用会话的客户端把第一个请求和ClientHello一起发出，省掉一个往返
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_SSL_EARLY_DATA_HPP_
+#define ASIO_LEARN_SSL_EARLY_DATA_HPP_
+#include <openssl/err.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+
+#include <algorithm>
+#include <array>
+#include <asio.hpp>
+#include <asio/ssl.hpp>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "asio_learn/metrics/registry.hpp"
+#include "asio_learn/public.hpp"
+#include "common/Log.hpp"
+
+/**
+ * 早期数据用票据里的密钥加密，服务器没有机会先发随机数，所以攻击者可以把截获的第一段数据原样重放:
+ *   防重放: 每张票据的早期数据只接受一次，记录在本进程内，保留replay_window(票据有效期); 记录满了就拒绝，
+ *   多个进程/机器之间不共享，部署多实例时要么共享记录，要么只对幂等请求开放(allow钩子)
+ *   被拒绝的早期数据OpenSSL会丢掉，握手照常完成，客户端在握手后重发，只是少了省下的那个往返
+ * 只有复用握手才可能带早期数据; 服务器只在开启后签发的票据里声明max_early_data
+ *
+ * asio的ssl::stream握手用SSL_do_handshake，读不到早期数据(要在握手前调用SSL_read_early_data)，
+ * EarlyDataHandshake在同一个SSL对象上自己驱动握手: 临时换上自己的BIO对，每次只从socket读一条完整的TLS记录，
+ * 握手结束时不会多读走后面的应用数据，再把asio的BIO换回来，之后stream照常读写
+ */
+
+namespace asio_learn::ssl
+{
+  struct EarlyDataOptions
+  {
+    uint32 max_early_data = 0;  // 每条连接最多接受的早期数据字节数，0表示关闭0-RTT
+    bool replay_guard = true;  // 关掉后只剩allow钩子，早期数据可以被重放
+    size_t replay_guard_capacity = 100000;  // 记录满了以后拒绝早期数据，不提前淘汰未过期的记录
+    std::chrono::seconds replay_window{ 300 };  // 不短于SessionResumptionOptions::session_ttl
+    // 应用自己的判断，比如只对幂等请求或者特定ALPN开放; 返回false拒绝，握手线程调用
+    std::function<bool(SSL*)> allow;
+  };
+
+  struct EarlyDataStats
+  {
+    uint64 accepted = 0;
+    uint64 rejected = 0;  // 客户端带了早期数据但被拒绝，包括重放
+    uint64 replays = 0;
+  };
+
+  // 同一张票据只放行一次; 按放行时间顺序过期
+  class ReplayGuard
+  {
+   public:
+    enum class Use
+    {
+      first,
+      replay,
+      full,  // 记录满了，没法判断是不是重放
+    };
+
+    ReplayGuard(size_t capacity, std::chrono::seconds window)
+      : _capacity(std::max<size_t>(1, capacity))
+      , _window(window)
+    {
+    }
+
+    Use first_use(const std::string& id)
+    {
+      auto now = std::chrono::steady_clock::now();
+      std::lock_guard<std::mutex> lock(_mutex);
+      while (!_order.empty() && _order.front().first + _window <= now)
+      {
+        _seen.erase(_order.front().second);
+        _order.pop_front();
+      }
+      if (_seen.count(id))
+      {
+        return Use::replay;
+      }
+      if (_seen.size() >= _capacity)
+      {
+        return Use::full;
+      }
+      _seen.insert(id);
+      _order.emplace_back(now, id);
+      return Use::first;
+    }
+
+   private:
+    size_t _capacity;
+    std::chrono::seconds _window;
+    std::mutex _mutex;
+    std::unordered_set<std::string> _seen;
+    std::deque<std::pair<std::chrono::steady_clock::time_point, std::string>> _order;
+  };
+
+  // 挂到ssl::context上的0-RTT逻辑，必须比context和所有会话活得久
+  class EarlyData
+  {
+   public:
+    // registry为空时只记录stats()
+    EarlyData(
+        EarlyDataOptions options,
+        metrics::Registry* registry = nullptr,
+        const std::string& server = "ssl_tcp_server")
+      : _options(std::move(options))
+      , _guard(_options.replay_guard_capacity, _options.replay_window)
+    {
+      if (registry)
+      {
+        const char* help = "TLS 1.3 early data offered by clients, by outcome";
+        auto labels = [&server](const char* value) -> metrics::Labels
+        { return { { "server", server }, { "result", value } }; };
+        _m_accepted = &registry->counter("asio_learn_tls_early_data_total", help, labels("accepted"));
+        _m_rejected = &registry->counter("asio_learn_tls_early_data_total", help, labels("rejected"));
+        _m_replays = &registry->counter(
+            "asio_learn_tls_early_data_replays_total",
+            "Early data rejected because the ticket was already used",
+            { { "server", server } });
+      }
+    }
+
+    EarlyData(const EarlyData&) = delete;
+    EarlyData& operator=(const EarlyData&) = delete;
+
+    bool enabled() const
+    {
+      return _options.max_early_data > 0;
+    }
+
+    // 在context上设置早期数据上限和放行回调，创建会话之前调用
+    void install(asio::ssl::context& ctx)
+    {
+      if (!enabled())
+      {
+        return;
+      }
+      SSL_CTX* handle = ctx.native_handle();
+      SSL_CTX_set_max_early_data(handle, _options.max_early_data);
+      SSL_CTX_set_recv_max_early_data(handle, _options.max_early_data);
+      // OpenSSL自带的防重放会改发有状态票据并依赖内部会话缓存，和SessionResumption的外部缓存配合不上(实测复用全部失败)，
+      // 始终关掉，由放行回调按票据去重
+      SSL_CTX_set_options(handle, SSL_OP_NO_ANTI_REPLAY);
+      SSL_CTX_set_session_ticket_cb(handle, &EarlyData::on_generate_ticket, &EarlyData::on_decrypt_ticket, this);
+      SSL_CTX_set_allow_early_data_cb(handle, &EarlyData::on_allow, this);
+    }
+
+    // 握手成功后由会话调用
+    void record_handshake(SSL* ssl)
+    {
+      switch (SSL_get_early_data_status(ssl))
+      {
+        case SSL_EARLY_DATA_ACCEPTED:
+          bump(_accepted, _m_accepted);
+          break;
+        case SSL_EARLY_DATA_REJECTED:
+          bump(_rejected, _m_rejected);
+          break;
+        default:
+          break;
+      }
+    }
+
+    EarlyDataStats stats() const
+    {
+      EarlyDataStats stats;
+      stats.accepted = _accepted.load(std::memory_order_relaxed);
+      stats.rejected = _rejected.load(std::memory_order_relaxed);
+      stats.replays = _replays.load(std::memory_order_relaxed);
+      return stats;
+    }
+
+   private:
+    static void bump(std::atomic<uint64>& value, metrics::Counter* counter)
+    {
+      value.fetch_add(1, std::memory_order_relaxed);
+      if (counter)
+      {
+        counter->inc();
+      }
+    }
+
+    static constexpr size_t TICKET_NONCE_SIZE = 16;
+
+    // 复用连接上签发的新票据沿用原来的会话id，不能用它区分票据; 每张票据带一个随机数，防重放按它去重
+    static int on_generate_ticket(SSL* ssl, void* /*arg*/)
+    {
+      std::array<unsigned char, TICKET_NONCE_SIZE> nonce{};
+      if (RAND_bytes(nonce.data(), static_cast<int>(nonce.size())) != 1)
+      {
+        return 0;
+      }
+      return SSL_SESSION_set1_ticket_appdata(SSL_get_session(ssl), nonce.data(), nonce.size());
+    }
+
+    // 装了生成回调就必须有解密回调; TLS1.3的票据应该只用一次(RFC 8446 C.4)，每次复用都补发新票据，
+    // 否则复用连接上不再签发票据，客户端只能反复用同一张，早期数据全被当成重放
+    static SSL_TICKET_RETURN on_decrypt_ticket(
+        SSL* ssl,
+        SSL_SESSION* /*session*/,
+        const unsigned char* /*key_name*/,
+        size_t /*key_name_size*/,
+        SSL_TICKET_STATUS status,
+        void* /*arg*/)
+    {
+      switch (status)
+      {
+        case SSL_TICKET_SUCCESS:
+          return SSL_version(ssl) >= TLS1_3_VERSION ? SSL_TICKET_RETURN_USE_RENEW : SSL_TICKET_RETURN_USE;
+        case SSL_TICKET_SUCCESS_RENEW:
+          return SSL_TICKET_RETURN_USE_RENEW;
+        case SSL_TICKET_EMPTY:
+        case SSL_TICKET_NO_DECRYPT:
+          return SSL_TICKET_RETURN_IGNORE_RENEW;
+        default:
+          return SSL_TICKET_RETURN_ABORT;
+      }
+    }
+
+    // 只在客户端带了早期数据、并且复用了会话时调用
+    static int on_allow(SSL* ssl, void* arg)
+    {
+      auto* self = static_cast<EarlyData*>(arg);
+      if (self->_options.allow && !self->_options.allow(ssl))
+      {
+        return 0;
+      }
+      if (!self->_options.replay_guard)
+      {
+        return 1;
+      }
+      void* nonce = nullptr;
+      size_t nonce_size = 0;
+      if (SSL_SESSION_get0_ticket_appdata(SSL_get_session(ssl), &nonce, &nonce_size) != 1 ||
+          nonce_size != TICKET_NONCE_SIZE)
+      {
+        bump(self->_replays, self->_m_replays);
+        return 0;
+      }
+      // 记录满了只是拒绝，握手后record_handshake计入rejected，不算重放
+      switch (self->_guard.first_use(std::string(static_cast<const char*>(nonce), nonce_size)))
+      {
+        case ReplayGuard::Use::first:
+          return 1;
+        case ReplayGuard::Use::replay:
+          bump(self->_replays, self->_m_replays);
+          return 0;
+        default:
+          return 0;
+      }
+    }
+
+    EarlyDataOptions _options;
+    ReplayGuard _guard;
+    std::atomic<uint64> _accepted{ 0 };
+    std::atomic<uint64> _rejected{ 0 };
+    std::atomic<uint64> _replays{ 0 };
+    metrics::Counter* _m_accepted = nullptr;
+    metrics::Counter* _m_rejected = nullptr;
+    metrics::Counter* _m_replays = nullptr;
+  };
+
+  /**
+   * 在asio::ssl::stream的SSL对象上自己驱动一次握手，服务器和客户端都可以用:
+   *   服务器 async_accept: 握手前先读早期数据，每段交给DataHandler，其中调用write()的数据随服务器的握手消息发出(0.5-RTT)
+   *   客户端 async_connect: 早期数据和ClientHello一起发出; 结果用SSL_get_early_data_status()查，被拒绝时需要握手后重发
+   * 所有回调都在executor上执行; 结束前stream不能有其他读写
+   */
+  class EarlyDataHandshake : public std::enable_shared_from_this<EarlyDataHandshake>
+  {
+   public:
+    using Stream = asio::ssl::stream<asio::ip::tcp::socket>;
+    using DataHandler = std::function<void(const char* data, size_t size)>;
+    using Handler = std::function<void(const asio::error_code& ec)>;
+
+    // TLSCiphertext的最大长度: TLS1.2是2^14+2048(RFC 5246 6.2.3)，TLS1.3收紧到2^14+256，按宽的收
+    static constexpr size_t MAX_RECORD = 16384 + 2048;
+
+    EarlyDataHandshake(Stream& stream, asio::any_io_executor executor)
+      : _stream(stream)
+      , _executor(std::move(executor))
+    {
+    }
+
+    ~EarlyDataHandshake()
+    {
+      restore_bio();
+    }
+
+    EarlyDataHandshake(const EarlyDataHandshake&) = delete;
+    EarlyDataHandshake& operator=(const EarlyDataHandshake&) = delete;
+
+    void async_accept(DataHandler on_data, Handler handler)
+    {
+      _server = true;
+      _on_data = std::move(on_data);
+      _handler = std::move(handler);
+      begin();
+    }
+
+    // early_data为空时就是普通握手
+    void async_connect(std::string early_data, Handler handler)
+    {
+      _server = false;
+      _early_out = std::move(early_data);
+      _handler = std::move(handler);
+      begin();
+    }
+
+    // 服务器在DataHandler里调用; 返回false表示写不下，调用方在握手后照常发送
+    bool write(const char* data, size_t size)
+    {
+      size_t written = 0;
+      return SSL_write_early_data(_stream.native_handle(), data, size, &written) == 1 && written == size;
+    }
+
+   private:
+    void begin()
+    {
+      SSL* ssl = _stream.native_handle();
+      // 自己多持有一份asio的BIO，换下来以后它和asio那一端的配对还在
+      _stream_bio = SSL_get_rbio(ssl);
+      BIO_up_ref(_stream_bio);
+      BIO* internal = nullptr;
+      // 服务器的0.5-RTT回包和握手消息一起积在发送方向，给大一点
+      BIO_new_bio_pair(&internal, 64 * 1024, &_bio, 0);
+      SSL_set_bio(ssl, internal, internal);
+      if (_server)
+      {
+        SSL_set_accept_state(ssl);
+      }
+      else
+      {
+        SSL_set_connect_state(ssl);
+      }
+      step();
+    }
+
+    void step()
+    {
+      SSL* ssl = _stream.native_handle();
+      for (;;)
+      {
+        int ret = 0;
+        ERR_clear_error();
+        if (!_early_done && _server)
+        {
+          size_t size = 0;
+          ret = SSL_read_early_data(ssl, _early_in.data(), _early_in.size(), &size);
+          if (ret == SSL_READ_EARLY_DATA_SUCCESS)
+          {
+            _on_data(_early_in.data(), size);
+            continue;
+          }
+          if (ret == SSL_READ_EARLY_DATA_FINISH)
+          {
+            _early_done = true;
+            continue;
+          }
+        }
+        else if (!_early_done)
+        {
+          _early_done = true;
+          if (_early_out.empty())
+          {
+            continue;
+          }
+          size_t written = 0;
+          ret = SSL_write_early_data(ssl, _early_out.data(), _early_out.size(), &written);
+          if (ret == 1)
+          {
+            continue;
+          }
+        }
+        else
+        {
+          ret = SSL_do_handshake(ssl);
+          if (ret == 1)
+          {
+            flush([self = shared_from_this()]() { self->finish({}); });
+            return;
+          }
+        }
+        int error = SSL_get_error(ssl, ret);
+        if (error == SSL_ERROR_WANT_READ)
+        {
+          flush([self = shared_from_this()]() { self->read_record(); });
+        }
+        else if (error == SSL_ERROR_WANT_WRITE)
+        {
+          flush([self = shared_from_this()]() { self->step(); });
+        }
+        else
+        {
+          auto code = ERR_get_error();
+          finish(code ? asio::error_code(static_cast<int>(code), asio::error::get_ssl_category())
+                      : asio::error_code(asio::error::connection_aborted));
+        }
+        return;
+      }
+    }
+
+    // 把OpenSSL写出的数据全部发到socket
+    template<typename Next>
+    void flush(Next next)
+    {
+      auto pending = BIO_ctrl_pending(_bio);
+      if (pending == 0)
+      {
+        next();
+        return;
+      }
+      _out.resize(pending);
+      BIO_read(_bio, _out.data(), static_cast<int>(pending));
+      asio::async_write(
+          _stream.next_layer(),
+          asio::buffer(_out),
+          asio::bind_executor(
+              _executor,
+              [self = shared_from_this(), next = std::move(next)](const asio::error_code& ec, size_t /*bytes*/)
+              {
+                if (ec)
+                {
+                  self->finish(ec);
+                  return;
+                }
+                next();
+              }));
+    }
+
+    // 先读5字节的记录头，再按长度读记录体，socket里记录之后的数据留给stream
+    void read_record()
+    {
+      asio::async_read(
+          _stream.next_layer(),
+          asio::buffer(_header),
+          asio::bind_executor(
+              _executor,
+              [self = shared_from_this()](const asio::error_code& ec, size_t /*bytes*/)
+              {
+                if (ec)
+                {
+                  self->finish(ec);
+                  return;
+                }
+                size_t length = (static_cast<size_t>(self->_header[3]) << 8) | self->_header[4];
+                if (length == 0 || length > MAX_RECORD)
+                {
+                  self->finish(asio::error::message_size);
+                  return;
+                }
+                self->_record.resize(length);
+                asio::async_read(
+                    self->_stream.next_layer(),
+                    asio::buffer(self->_record),
+                    asio::bind_executor(
+                        self->_executor,
+                        [self](const asio::error_code& ec, size_t /*bytes*/)
+                        {
+                          if (ec)
+                          {
+                            self->finish(ec);
+                            return;
+                          }
+                          BIO_write(self->_bio, self->_header.data(), static_cast<int>(self->_header.size()));
+                          BIO_write(self->_bio, self->_record.data(), static_cast<int>(self->_record.size()));
+                          self->step();
+                        }));
+              }));
+    }
+
+    void finish(const asio::error_code& ec)
+    {
+      restore_bio();
+      auto handler = std::move(_handler);
+      _on_data = nullptr;
+      if (handler)
+      {
+        handler(ec);
+      }
+    }
+
+    // 换回asio的BIO，自己的BIO对随之释放
+    void restore_bio()
+    {
+      if (!_stream_bio)
+      {
+        return;
+      }
+      SSL_set_bio(_stream.native_handle(), _stream_bio, _stream_bio);
+      _stream_bio = nullptr;
+      BIO_free(_bio);
+      _bio = nullptr;
+    }
+
+    Stream& _stream;
+    asio::any_io_executor _executor;
+    bool _server = false;
+    bool _early_done = false;
+    DataHandler _on_data;
+    Handler _handler;
+    BIO* _stream_bio = nullptr;  // asio的BIO，握手期间由这里持有
+    BIO* _bio = nullptr;  // 自己的BIO对的外侧，对接socket
+    std::array<unsigned char, 5> _header{};
+    std::vector<unsigned char> _record;
+    std::vector<unsigned char> _out;
+    std::array<char, 4096> _early_in{};
+    std::string _early_out;
+  };
+}  // namespace asio_learn::ssl
+
+#endif  // ASIO_LEARN_SSL_EARLY_DATA_HPP_
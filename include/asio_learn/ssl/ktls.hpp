@@ -0,0 +1,588 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 18:13:34
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 19:50:45
+ * @FilePath: \asio-learn-code\include\asio_learn\ssl\ktls.hpp
+ * @Description: 内核TLS(kTLS): 握手完成后把协商出的密钥和记录序号交给内核，之后socket上的明文读写由内核加解密
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_SSL_KTLS_HPP_
+#define ASIO_LEARN_SSL_KTLS_HPP_
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <openssl/ssl.h>
+
+#include <array>
+#include <asio.hpp>
+#include <asio/ssl.hpp>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/tls.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#define ASIO_LEARN_HAS_KTLS 1
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#endif
+
+#include "asio_learn/public.hpp"
+
+/**
+ * asio的ssl::stream用内存BIO对接socket，OpenSSL自带的kTLS(SSL_OP_ENABLE_KTLS)要求socket BIO，这里用不上，
+ * 所以自己取密钥:
+ *   TLS1.2 主密钥 + 双方随机数按PRF展开key block
+ *   TLS1.3 从keylog回调拿CLIENT/SERVER_TRAFFIC_SECRET_0，HKDF-Expand-Label得到key和iv
+ * 记录序号OpenSSL没有公开接口，用消息回调数记录头: TLS1.2从ChangeCipherSpec之后的记录开始编号，TLS1.3从Finished之后开始
+ * (TLS1.3握手结束时服务端已经用应用密钥发出了会话票据，所以发送方向的序号一般不是0)
+ *
+ * 开启后:
+ *   发送: 直接write/sendfile/splice明文，内核按记录加密; 非应用数据(告警)用send_alert()
+ *   接收: 用receive()，带出记录类型; 对端发来close_notify等告警、TLS1.3的KeyUpdate时记录类型不是23，
+ *        普通read()遇到这种记录会返回EIO
+ * 只支持AES-128-GCM、AES-256-GCM、ChaCha20-Poly1305; 内核没有tls模块、套件不支持时返回原因，调用方继续走用户态
+ * 对端在握手后立即发来的数据如果已经被OpenSSL读进缓冲区，内核看不到这些记录，此时两个方向都不开
+ * 不会只开发送方向: OpenSSL继续读时，收到KeyUpdate等记录会自己按用户态的序号回一条记录，和内核的序号冲突
+ */
+
+namespace asio_learn::ssl
+{
+  struct KtlsStatus
+  {
+    bool tx = false;
+    // 只有tx开启后才会尝试; tx开了而rx失败时发送序号已经在内核里、无法撤回，调用方只能断开连接
+    bool rx = false;
+    std::string reason;  // 没有全部开启时的原因，写日志和指标标签用
+  };
+
+  class Ktls
+  {
+   public:
+    static constexpr uint8_t RECORD_ALERT = 21;
+    static constexpr uint8_t RECORD_HANDSHAKE = 22;
+    static constexpr uint8_t RECORD_APPLICATION_DATA = 23;
+
+    // 安装keylog回调，创建会话之前调用; 会覆盖context上已有的keylog回调
+    static void install(asio::ssl::context& ctx)
+    {
+      SSL_CTX_set_keylog_callback(ctx.native_handle(), &Ktls::on_keylog);
+    }
+
+    // 握手开始前调用，挂上记录计数和密钥的暂存
+    static void prepare(SSL* ssl)
+    {
+      auto* state = new State();
+      SSL_set_ex_data(ssl, ssl_index(), state);
+      SSL_set_msg_callback(ssl, &Ktls::on_message);
+      SSL_set_msg_callback_arg(ssl, state);
+    }
+
+    // 握手成功后、还没有读写应用数据时调用; fd是底层TCP socket
+    static KtlsStatus enable(SSL* ssl, int fd)
+    {
+      KtlsStatus status;
+#ifndef ASIO_LEARN_HAS_KTLS
+      (void)ssl;
+      (void)fd;
+      status.reason = "platform";
+#else
+      auto* state = static_cast<State*>(SSL_get_ex_data(ssl, ssl_index()));
+      if (!state)
+      {
+        status.reason = "not_prepared";
+        return status;
+      }
+      // 密钥交出去之后不再需要计数
+      SSL_set_msg_callback(ssl, nullptr);
+      if (SSL_has_pending(ssl) || BIO_ctrl_pending(SSL_get_rbio(ssl)) > 0)
+      {
+        status.reason = "pending_input";
+        return status;
+      }
+
+      Keys tx;
+      Keys rx;
+      if (!derive(ssl, *state, tx, rx, status.reason))
+      {
+        return status;
+      }
+      CryptoInfo tx_info;
+      CryptoInfo rx_info;
+      build(SSL_version(ssl), SSL_CIPHER_get_cipher_nid(SSL_get_current_cipher(ssl)), tx, state->tx_records, tx_info);
+      build(SSL_version(ssl), SSL_CIPHER_get_cipher_nid(SSL_get_current_cipher(ssl)), rx, state->rx_records, rx_info);
+      OPENSSL_cleanse(&tx, sizeof(tx));
+      OPENSSL_cleanse(&rx, sizeof(rx));
+
+      if (::setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0)
+      {
+        status.reason = std::string("kernel: ") + std::strerror(errno);
+      }
+      else if (::setsockopt(fd, SOL_TLS, TLS_TX, &tx_info.data, tx_info.size) != 0)
+      {
+        status.reason = std::string("kernel_tx: ") + std::strerror(errno);
+      }
+      else
+      {
+        status.tx = true;
+        if (::setsockopt(fd, SOL_TLS, TLS_RX, &rx_info.data, rx_info.size) != 0)
+        {
+          status.reason = std::string("kernel_rx: ") + std::strerror(errno);
+        }
+        else
+        {
+          status.rx = true;
+        }
+      }
+      OPENSSL_cleanse(&tx_info, sizeof(tx_info));
+      OPENSSL_cleanse(&rx_info, sizeof(rx_info));
+#endif
+      return status;
+    }
+
+    // 开启发送方向后发送告警记录，比如close_notify(1, 0)
+    static void send_alert(int fd, uint8_t level, uint8_t description, asio::error_code& ec)
+    {
+#ifndef ASIO_LEARN_HAS_KTLS
+      (void)fd;
+      (void)level;
+      (void)description;
+      ec = asio::error::operation_not_supported;
+#else
+      unsigned char payload[2] = { level, description };
+      iovec iov{ payload, sizeof(payload) };
+      alignas(cmsghdr) char control[CMSG_SPACE(sizeof(unsigned char))] = {};
+      msghdr msg{};
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      auto* cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_TLS;
+      cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+      *CMSG_DATA(cmsg) = RECORD_ALERT;
+      ec.clear();
+      if (::sendmsg(fd, &msg, MSG_NOSIGNAL) < 0)
+      {
+        ec.assign(errno, asio::error::get_system_category());
+      }
+#endif
+    }
+
+    /**
+     * 开启接收方向后的非阻塞读，一次最多读一条记录的内容
+     * 没有数据时ec为would_block，对端关闭TCP时返回0且ec为eof
+     */
+    static size_t receive(int fd, void* data, size_t size, uint8_t& record_type, asio::error_code& ec)
+    {
+#ifndef ASIO_LEARN_HAS_KTLS
+      (void)fd;
+      (void)data;
+      (void)size;
+      (void)record_type;
+      ec = asio::error::operation_not_supported;
+      return 0;
+#else
+      iovec iov{ data, size };
+      alignas(cmsghdr) char control[CMSG_SPACE(sizeof(unsigned char))] = {};
+      msghdr msg{};
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      ec.clear();
+      auto n = ::recvmsg(fd, &msg, MSG_DONTWAIT);
+      if (n < 0)
+      {
+        ec = (errno == EAGAIN || errno == EWOULDBLOCK)
+                 ? asio::error_code(asio::error::would_block)
+                 : asio::error_code(errno, asio::error::get_system_category());
+        return 0;
+      }
+      if (n == 0)
+      {
+        ec = asio::error::eof;
+        return 0;
+      }
+      record_type = RECORD_APPLICATION_DATA;
+      for (auto* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+      {
+        if (cmsg->cmsg_level == SOL_TLS && cmsg->cmsg_type == TLS_GET_RECORD_TYPE)
+        {
+          record_type = *CMSG_DATA(cmsg);
+        }
+      }
+      return static_cast<size_t>(n);
+#endif
+    }
+
+    // 一个方向的密钥; iv是完整的12字节(TLS1.2 GCM只有前4字节的盐)
+    struct Keys
+    {
+      std::array<unsigned char, 32> key{};
+      std::array<unsigned char, 12> iv{};
+      size_t key_size = 0;
+    };
+
+    // 调用时机和enable()相同，算出enable()会交给内核的密钥和两个方向下一条记录的序号，不碰socket; 测试和排查用
+    static bool export_keys(SSL* ssl, Keys& tx, uint64& tx_records, Keys& rx, uint64& rx_records, std::string& reason)
+    {
+      auto* state = static_cast<State*>(SSL_get_ex_data(ssl, ssl_index()));
+      if (!state)
+      {
+        reason = "not_prepared";
+        return false;
+      }
+      tx_records = state->tx_records;
+      rx_records = state->rx_records;
+      return derive(ssl, *state, tx, rx, reason);
+    }
+
+    // RFC 8446 7.1: HKDF-Expand-Label(secret, label, "", out_size)
+    static bool hkdf_expand_label(
+        const EVP_MD* md,
+        const unsigned char* secret,
+        size_t secret_size,
+        const std::string& label,
+        unsigned char* out,
+        size_t out_size)
+    {
+      // struct { uint16 length; opaque label<7..255> = "tls13 " + label; opaque context<0..255> = ""; }
+      std::string full = "tls13 " + label;
+      std::string info;
+      info.push_back(static_cast<char>(out_size >> 8));
+      info.push_back(static_cast<char>(out_size & 0xff));
+      info.push_back(static_cast<char>(full.size()));
+      info += full;
+      info.push_back('\0');
+
+      EVP_PKEY_CTX* pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+      bool ok = pctx && EVP_PKEY_derive_init(pctx) > 0 &&
+                EVP_PKEY_CTX_hkdf_mode(pctx, EVP_PKEY_HKDEF_MODE_EXPAND_ONLY) > 0 &&
+                EVP_PKEY_CTX_set_hkdf_md(pctx, md) > 0 &&
+                EVP_PKEY_CTX_set1_hkdf_key(pctx, secret, static_cast<int>(secret_size)) > 0 &&
+                EVP_PKEY_CTX_add1_hkdf_info(
+                    pctx, reinterpret_cast<const unsigned char*>(info.data()), static_cast<int>(info.size())) > 0 &&
+                EVP_PKEY_derive(pctx, out, &out_size) > 0;
+      EVP_PKEY_CTX_free(pctx);
+      return ok;
+    }
+
+    // RFC 5246 5: PRF(secret, label, seed) = P_<md>(secret, label + seed)
+    static bool tls12_prf(
+        const EVP_MD* md,
+        const unsigned char* secret,
+        size_t secret_size,
+        const std::string& label,
+        const unsigned char* seed,
+        size_t seed_size,
+        unsigned char* out,
+        size_t out_size)
+    {
+      EVP_PKEY_CTX* pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_TLS1_PRF, nullptr);
+      bool ok = pctx && EVP_PKEY_derive_init(pctx) > 0 && EVP_PKEY_CTX_set_tls1_prf_md(pctx, md) > 0 &&
+                EVP_PKEY_CTX_set1_tls1_prf_secret(pctx, secret, static_cast<int>(secret_size)) > 0 &&
+                EVP_PKEY_CTX_add1_tls1_prf_seed(
+                    pctx, reinterpret_cast<const unsigned char*>(label.data()), static_cast<int>(label.size())) > 0 &&
+                EVP_PKEY_CTX_add1_tls1_prf_seed(pctx, seed, static_cast<int>(seed_size)) > 0 &&
+                EVP_PKEY_derive(pctx, out, &out_size) > 0;
+      EVP_PKEY_CTX_free(pctx);
+      return ok;
+    }
+
+   private:
+    static constexpr size_t MAX_SECRET = EVP_MAX_MD_SIZE;
+
+    // 每个SSL一份，SSL释放时由ex_data的free回调删除
+    struct State
+    {
+      uint64 tx_records = 0;  // 当前密钥下已发送的记录数，也就是下一条记录的序号
+      uint64 rx_records = 0;
+      std::array<unsigned char, MAX_SECRET> client_secret{};
+      std::array<unsigned char, MAX_SECRET> server_secret{};
+      size_t client_secret_size = 0;
+      size_t server_secret_size = 0;
+
+      ~State()
+      {
+        OPENSSL_cleanse(client_secret.data(), client_secret.size());
+        OPENSSL_cleanse(server_secret.data(), server_secret.size());
+      }
+    };
+
+    static int ssl_index()
+    {
+      static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, &Ktls::free_state);
+      return index;
+    }
+
+    static void free_state(
+        void* /*parent*/,
+        void* ptr,
+        CRYPTO_EX_DATA* /*ad*/,
+        int /*idx*/,
+        long /*argl*/,
+        void* /*argp*/)
+    {
+      delete static_cast<State*>(ptr);
+    }
+
+    static void on_message(
+        int write_p,
+        int /*version*/,
+        int content_type,
+        const void* buf,
+        size_t len,
+        SSL* ssl,
+        void* arg)
+    {
+      auto* state = static_cast<State*>(arg);
+      auto& records = write_p ? state->tx_records : state->rx_records;
+      bool tls13 = SSL_version(ssl) == TLS1_3_VERSION;
+      if (content_type == SSL3_RT_HEADER && len > 0)
+      {
+        // TLS1.2的ChangeCipherSpec本身不加密，之后的记录(从Finished开始)用新密钥从0编号;
+        // 读方向不回调ChangeCipherSpec的内容，只能看记录头里的类型
+        if (!tls13 && static_cast<const unsigned char*>(buf)[0] == SSL3_RT_CHANGE_CIPHER_SPEC)
+        {
+          records = 0;
+        }
+        else
+        {
+          ++records;
+        }
+      }
+      // TLS1.3: 记录头的回调先于内容的回调，Finished这条记录本身用的还是握手密钥
+      else if (
+          content_type == SSL3_RT_HANDSHAKE && tls13 && len > 0 &&
+          static_cast<const unsigned char*>(buf)[0] == SSL3_MT_FINISHED)
+      {
+        records = 0;
+      }
+    }
+
+    static void on_keylog(const SSL* ssl, const char* line)
+    {
+      auto* state = static_cast<State*>(SSL_get_ex_data(ssl, ssl_index()));
+      if (!state)
+      {
+        return;
+      }
+      // 格式: <label> <client_random hex> <secret hex>
+      std::string_view text(line);
+      auto first = text.find(' ');
+      auto second = first == std::string_view::npos ? first : text.find(' ', first + 1);
+      if (second == std::string_view::npos)
+      {
+        return;
+      }
+      auto label = text.substr(0, first);
+      auto hex = text.substr(second + 1);
+      if (label == "CLIENT_TRAFFIC_SECRET_0")
+      {
+        state->client_secret_size = from_hex(hex, state->client_secret);
+      }
+      else if (label == "SERVER_TRAFFIC_SECRET_0")
+      {
+        state->server_secret_size = from_hex(hex, state->server_secret);
+      }
+    }
+
+    static size_t from_hex(std::string_view hex, std::array<unsigned char, MAX_SECRET>& out)
+    {
+      auto nibble = [](char c) -> int
+      {
+        if (c >= '0' && c <= '9')
+          return c - '0';
+        if (c >= 'a' && c <= 'f')
+          return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+          return c - 'A' + 10;
+        return -1;
+      };
+      size_t size = hex.size() / 2;
+      if (size > out.size())
+      {
+        return 0;
+      }
+      for (size_t i = 0; i < size; ++i)
+      {
+        int high = nibble(hex[2 * i]);
+        int low = nibble(hex[2 * i + 1]);
+        if (high < 0 || low < 0)
+        {
+          return 0;
+        }
+        out[i] = static_cast<unsigned char>(high << 4 | low);
+      }
+      return size;
+    }
+
+    static bool derive(SSL* ssl, const State& state, Keys& tx, Keys& rx, std::string& reason)
+    {
+      const SSL_CIPHER* cipher = SSL_get_current_cipher(ssl);
+      size_t key_size = 0;
+      size_t fixed_iv_size = 0;  // TLS1.2里由key block给出的iv长度
+      switch (SSL_CIPHER_get_cipher_nid(cipher))
+      {
+        case NID_aes_128_gcm:
+          key_size = 16;
+          fixed_iv_size = 4;
+          break;
+        case NID_aes_256_gcm:
+          key_size = 32;
+          fixed_iv_size = 4;
+          break;
+        case NID_chacha20_poly1305:
+          key_size = 32;
+          fixed_iv_size = 12;
+          break;
+        default:
+          reason = std::string("cipher: ") + SSL_CIPHER_get_name(cipher);
+          return false;
+      }
+      const EVP_MD* md = SSL_CIPHER_get_handshake_digest(cipher);
+      Keys client;
+      Keys server;
+      client.key_size = server.key_size = key_size;
+
+      int version = SSL_version(ssl);
+      if (version == TLS1_3_VERSION)
+      {
+        if (state.client_secret_size == 0 || state.server_secret_size == 0)
+        {
+          reason = "no_traffic_secret";
+          return false;
+        }
+        if (!expand_traffic_secret(md, state.client_secret.data(), state.client_secret_size, client) ||
+            !expand_traffic_secret(md, state.server_secret.data(), state.server_secret_size, server))
+        {
+          reason = "key_derivation";
+          return false;
+        }
+      }
+      else if (version == TLS1_2_VERSION)
+      {
+        // key block = client_key | server_key | client_iv | server_iv (AEAD套件没有MAC密钥)
+        std::array<unsigned char, 2 * 32 + 2 * 12> block{};
+        size_t block_size = 2 * key_size + 2 * fixed_iv_size;
+        if (!tls12_key_block(ssl, md, block.data(), block_size))
+        {
+          reason = "key_derivation";
+          return false;
+        }
+        std::memcpy(client.key.data(), block.data(), key_size);
+        std::memcpy(server.key.data(), block.data() + key_size, key_size);
+        std::memcpy(client.iv.data(), block.data() + 2 * key_size, fixed_iv_size);
+        std::memcpy(server.iv.data(), block.data() + 2 * key_size + fixed_iv_size, fixed_iv_size);
+        OPENSSL_cleanse(block.data(), block.size());
+      }
+      else
+      {
+        reason = std::string("version: ") + SSL_get_version(ssl);
+        return false;
+      }
+      tx = SSL_is_server(ssl) ? server : client;
+      rx = SSL_is_server(ssl) ? client : server;
+      OPENSSL_cleanse(&client, sizeof(client));
+      OPENSSL_cleanse(&server, sizeof(server));
+      return true;
+    }
+
+    // RFC 8446 7.3: key = HKDF-Expand-Label(secret, "key", "", key_size), iv = HKDF-Expand-Label(secret, "iv", "", 12)
+    static bool expand_traffic_secret(const EVP_MD* md, const unsigned char* secret, size_t secret_size, Keys& keys)
+    {
+      return hkdf_expand_label(md, secret, secret_size, "key", keys.key.data(), keys.key_size) &&
+             hkdf_expand_label(md, secret, secret_size, "iv", keys.iv.data(), keys.iv.size());
+    }
+
+    // RFC 5246 6.3: key_block = PRF(master_secret, "key expansion", server_random + client_random)
+    static bool tls12_key_block(SSL* ssl, const EVP_MD* md, unsigned char* out, size_t out_size)
+    {
+      std::array<unsigned char, SSL_MAX_MASTER_KEY_LENGTH> master{};
+      std::array<unsigned char, 2 * SSL3_RANDOM_SIZE> seed{};
+      size_t master_size = SSL_SESSION_get_master_key(SSL_get_session(ssl), master.data(), master.size());
+      SSL_get_server_random(ssl, seed.data(), SSL3_RANDOM_SIZE);
+      SSL_get_client_random(ssl, seed.data() + SSL3_RANDOM_SIZE, SSL3_RANDOM_SIZE);
+      bool ok = master_size > 0 &&
+                tls12_prf(md, master.data(), master_size, "key expansion", seed.data(), seed.size(), out, out_size);
+      OPENSSL_cleanse(master.data(), master.size());
+      return ok;
+    }
+
+#ifdef ASIO_LEARN_HAS_KTLS
+    union CryptoInfoData
+    {
+      tls12_crypto_info_aes_gcm_128 aes_gcm_128;
+      tls12_crypto_info_aes_gcm_256 aes_gcm_256;
+      tls12_crypto_info_chacha20_poly1305 chacha20_poly1305;
+    };
+
+    struct CryptoInfo
+    {
+      CryptoInfoData data{};
+      socklen_t size = 0;
+    };
+
+    template<typename Info>
+    static void fill(uint16_t version, uint16_t cipher_type, const Keys& keys, uint64 records, bool tls13, Info& info)
+    {
+      info.info.version = version;
+      info.info.cipher_type = cipher_type;
+      std::memcpy(info.key, keys.key.data(), sizeof(info.key));
+      for (size_t i = 0; i < sizeof(info.rec_seq); ++i)
+      {
+        info.rec_seq[i] = static_cast<unsigned char>(records >> (8 * (sizeof(info.rec_seq) - 1 - i)));
+      }
+      if constexpr (sizeof(info.salt) > 0)
+      {
+        std::memcpy(info.salt, keys.iv.data(), sizeof(info.salt));
+        // TLS1.3: salt + iv就是12字节的静态iv，内核再和序号异或; TLS1.2 GCM: iv是显式nonce，取序号保证不重复
+        if (tls13)
+        {
+          std::memcpy(info.iv, keys.iv.data() + sizeof(info.salt), sizeof(info.iv));
+        }
+        else
+        {
+          std::memcpy(info.iv, info.rec_seq, sizeof(info.iv));
+        }
+      }
+      else
+      {
+        std::memcpy(info.iv, keys.iv.data(), sizeof(info.iv));
+      }
+    }
+
+    static void build(int ssl_version, int cipher_nid, const Keys& keys, uint64 records, CryptoInfo& out)
+    {
+      bool tls13 = ssl_version == TLS1_3_VERSION;
+      uint16_t version = tls13 ? TLS_1_3_VERSION : TLS_1_2_VERSION;
+      switch (cipher_nid)
+      {
+        case NID_aes_128_gcm:
+          fill(version, TLS_CIPHER_AES_GCM_128, keys, records, tls13, out.data.aes_gcm_128);
+          out.size = sizeof(out.data.aes_gcm_128);
+          break;
+        case NID_aes_256_gcm:
+          fill(version, TLS_CIPHER_AES_GCM_256, keys, records, tls13, out.data.aes_gcm_256);
+          out.size = sizeof(out.data.aes_gcm_256);
+          break;
+        default:
+          fill(version, TLS_CIPHER_CHACHA20_POLY1305, keys, records, tls13, out.data.chacha20_poly1305);
+          out.size = sizeof(out.data.chacha20_poly1305);
+          break;
+      }
+    }
+#endif
+  };
+}  // namespace asio_learn::ssl
+
+#endif  // ASIO_LEARN_SSL_KTLS_HPP_
@@ -0,0 +1,578 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 18:00:27
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 19:44:05
+ * @FilePath: \asio-learn-code\include\asio_learn\ssl\session_resumption.hpp
+ * @Description: TLS会话复用：进程内分片会话缓存(容量+TTL) 和 定期轮换密钥的无状态会话票据
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_SSL_SESSION_RESUMPTION_HPP_
+#define ASIO_LEARN_SSL_SESSION_RESUMPTION_HPP_
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <asio.hpp>
+#include <asio/ssl.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "asio_learn/metrics/registry.hpp"
+#include "asio_learn/public.hpp"
+#include "common/Log.hpp"
+
+/**
+ * 完整握手要做一次非对称运算(签名/密钥交换)，复用握手只做对称运算，客户端频繁重连时差别很大
+ *
+ * 会话缓存: 服务器保存会话，客户端带会话id(TLS1.2)或有状态票据(TLS1.3且关闭票据时)来复用
+ *   关闭OpenSSL内部缓存，由这里的分片表保存序列化后的会话，按分片加锁，LRU淘汰，超过TTL视为未命中
+ * 会话票据: 服务器把会话加密后交给客户端保存，自己不存状态，多个线程/服务器实例不需要共享缓存
+ *   加密密钥每隔 ticket_key_rotation 轮换一次，保留最近 ticket_keys_kept 把用于解密，
+ *   旧密钥解开的票据仍然复用，同时让OpenSSL用新密钥补发票据
+ *   密钥只在本进程内，多进程(prefork)各自的票据不能互通
+ * 只有干净关闭(双方都发了close_notify)的会话才会留在缓存里，异常断开的会话OpenSSL会主动删除
+ */
+
+namespace asio_learn::ssl
+{
+  struct SessionResumptionOptions
+  {
+    bool enable_cache = true;
+    size_t cache_size = 20480;  // 缓存的会话总数，平均分到各分片
+    std::chrono::seconds session_ttl{ 300 };  // 缓存条目和票据的有效期
+    bool enable_tickets = true;
+    std::chrono::seconds ticket_key_rotation{ 3600 };
+    size_t ticket_keys_kept = 2;  // 当前密钥 + 仍可解密的旧密钥
+    std::string session_id_context = "asio_learn";
+  };
+
+  struct SessionResumptionStats
+  {
+    uint64 full_handshakes = 0;
+    uint64 resumed_handshakes = 0;
+    uint64 cache_hits = 0;
+    uint64 cache_misses = 0;
+    uint64 cache_entries = 0;
+    uint64 cache_evictions = 0;
+    uint64 tickets_issued = 0;
+    uint64 tickets_accepted = 0;
+    uint64 tickets_renewed = 0;  // 旧密钥解开的票据
+    uint64 tickets_rejected = 0;  // 密钥已淘汰或未知
+    uint64 ticket_key_rotations = 0;
+
+    double resumption_rate() const
+    {
+      auto total = full_handshakes + resumed_handshakes;
+      return total ? static_cast<double>(resumed_handshakes) / static_cast<double>(total) : 0.0;
+    }
+  };
+
+  // 按会话id分片的LRU缓存，条目保存DER编码的会话
+  class SessionCache
+  {
+   public:
+    static constexpr size_t SHARDS = 16;
+
+    SessionCache(size_t capacity, std::chrono::seconds ttl)
+      : _per_shard(std::max<size_t>(1, (capacity + SHARDS - 1) / SHARDS))
+      , _ttl(ttl)
+    {
+    }
+
+    // 条目数随增删同步加减; 多个握手线程并发修改，不能用Gauge::set
+    void attach_gauge(metrics::Gauge* gauge)
+    {
+      _gauge = gauge;
+    }
+
+    // 返回淘汰的条目数
+    size_t put(const std::string& id, std::string der)
+    {
+      auto& shard = shard_for(id);
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto expires = std::chrono::steady_clock::now() + _ttl;
+      if (auto it = shard.index.find(id); it != shard.index.end())
+      {
+        it->second->der = std::move(der);
+        it->second->expires = expires;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return 0;
+      }
+      shard.lru.push_front(Entry{ id, std::move(der), expires });
+      shard.index.emplace(id, shard.lru.begin());
+      added(1);
+      size_t evicted = 0;
+      while (shard.lru.size() > _per_shard)
+      {
+        shard.index.erase(shard.lru.back().id);
+        shard.lru.pop_back();
+        ++evicted;
+      }
+      if (evicted)
+      {
+        removed(evicted);
+      }
+      return evicted;
+    }
+
+    // 未命中或已过期返回false，过期条目顺便删除
+    bool get(const std::string& id, std::string& der)
+    {
+      auto& shard = shard_for(id);
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto it = shard.index.find(id);
+      if (it == shard.index.end())
+      {
+        return false;
+      }
+      if (it->second->expires <= std::chrono::steady_clock::now())
+      {
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+        removed(1);
+        return false;
+      }
+      shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+      der = it->second->der;
+      return true;
+    }
+
+    void remove(const std::string& id)
+    {
+      auto& shard = shard_for(id);
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      if (auto it = shard.index.find(id); it != shard.index.end())
+      {
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+        removed(1);
+      }
+    }
+
+    size_t size() const
+    {
+      return _entries.load(std::memory_order_relaxed);
+    }
+
+   private:
+    struct Entry
+    {
+      std::string id;
+      std::string der;
+      std::chrono::steady_clock::time_point expires;
+    };
+
+    struct Shard
+    {
+      std::mutex mutex;
+      std::list<Entry> lru;  // 头部最近使用
+      std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    };
+
+    Shard& shard_for(const std::string& id)
+    {
+      return _shards[std::hash<std::string>{}(id) % SHARDS];
+    }
+
+    void added(size_t count)
+    {
+      _entries.fetch_add(count, std::memory_order_relaxed);
+      if (_gauge)
+      {
+        _gauge->add(static_cast<int64_t>(count));
+      }
+    }
+
+    void removed(size_t count)
+    {
+      _entries.fetch_sub(count, std::memory_order_relaxed);
+      if (_gauge)
+      {
+        _gauge->add(-static_cast<int64_t>(count));
+      }
+    }
+
+    const size_t _per_shard;
+    const std::chrono::seconds _ttl;
+    std::array<Shard, SHARDS> _shards;
+    std::atomic<size_t> _entries{ 0 };
+    metrics::Gauge* _gauge = nullptr;
+  };
+
+  // 挂到ssl::context上的复用逻辑，必须比context和所有会话活得久
+  class SessionResumption
+  {
+   public:
+    // registry为空时只记录stats()
+    SessionResumption(
+        SessionResumptionOptions options,
+        metrics::Registry* registry = nullptr,
+        const std::string& server = "ssl_tcp_server")
+      : _options(std::move(options))
+      , _cache(_options.cache_size, _options.session_ttl)
+    {
+      if (_options.ticket_keys_kept == 0)
+      {
+        _options.ticket_keys_kept = 1;
+      }
+      if (registry)
+      {
+        auto labels = [&server](const char* key, const char* value) -> metrics::Labels
+        { return { { "server", server }, { key, value } }; };
+        const char* handshakes_help = "Completed TLS handshakes by whether the session was resumed";
+        _m_full = &registry->counter("asio_learn_tls_handshakes_total", handshakes_help, labels("resumed", "false"));
+        _m_resumed = &registry->counter("asio_learn_tls_handshakes_total", handshakes_help, labels("resumed", "true"));
+        const char* lookups_help = "Server side session cache lookups";
+        _m_hits = &registry->counter("asio_learn_tls_session_cache_lookups_total", lookups_help, labels("result", "hit"));
+        _m_misses =
+            &registry->counter("asio_learn_tls_session_cache_lookups_total", lookups_help, labels("result", "miss"));
+        _m_entries = &registry->gauge(
+            "asio_learn_tls_session_cache_entries", "Sessions held in the server cache", { { "server", server } });
+        _cache.attach_gauge(_m_entries);
+        _m_evictions = &registry->counter(
+            "asio_learn_tls_session_cache_evictions_total",
+            "Sessions evicted because the cache was full",
+            { { "server", server } });
+        const char* tickets_help = "Session tickets by outcome";
+        _m_tickets_issued = &registry->counter("asio_learn_tls_tickets_total", tickets_help, labels("result", "issued"));
+        _m_tickets_accepted =
+            &registry->counter("asio_learn_tls_tickets_total", tickets_help, labels("result", "accepted"));
+        _m_tickets_renewed =
+            &registry->counter("asio_learn_tls_tickets_total", tickets_help, labels("result", "renewed"));
+        _m_tickets_rejected =
+            &registry->counter("asio_learn_tls_tickets_total", tickets_help, labels("result", "rejected"));
+        _m_rotations = &registry->counter(
+            "asio_learn_tls_ticket_key_rotations_total", "Session ticket key rotations", { { "server", server } });
+      }
+    }
+
+    SessionResumption(const SessionResumption&) = delete;
+    SessionResumption& operator=(const SessionResumption&) = delete;
+
+    // 在context上安装回调，创建会话之前调用
+    // 证书热更新时对新context再调用一次，新旧context共用缓存和票据密钥，换证书不影响老客户端复用
+    void install(asio::ssl::context& ctx)
+    {
+      SSL_CTX* handle = ctx.native_handle();
+      SSL_CTX_set_ex_data(handle, ctx_index(), this);
+      const auto& id_context = _options.session_id_context;
+      SSL_CTX_set_session_id_context(
+          handle,
+          reinterpret_cast<const unsigned char*>(id_context.data()),
+          static_cast<unsigned int>(std::min<size_t>(id_context.size(), SSL_MAX_SID_CTX_LENGTH)));
+      SSL_CTX_set_timeout(handle, static_cast<long>(_options.session_ttl.count()));
+
+      if (_options.enable_cache)
+      {
+        SSL_CTX_set_session_cache_mode(handle, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+        SSL_CTX_sess_set_new_cb(handle, &SessionResumption::on_new_session);
+        SSL_CTX_sess_set_get_cb(handle, &SessionResumption::on_get_session);
+        SSL_CTX_sess_set_remove_cb(handle, &SessionResumption::on_remove_session);
+      }
+      else
+      {
+        SSL_CTX_set_session_cache_mode(handle, SSL_SESS_CACHE_OFF);
+      }
+
+      if (_options.enable_tickets)
+      {
+        {
+          std::lock_guard<std::mutex> lock(_keys_mutex);
+          rotate_locked_if_due(std::chrono::steady_clock::now());
+        }
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        SSL_CTX_set_tlsext_ticket_key_evp_cb(handle, &SessionResumption::on_ticket_key);
+#else
+        SSL_CTX_set_tlsext_ticket_key_cb(handle, &SessionResumption::on_ticket_key);
+#endif
+      }
+      else
+      {
+        // TLS1.3关闭无状态票据后改发指向会话缓存的有状态票据; 缓存也关了就不发
+        SSL_CTX_set_options(handle, SSL_OP_NO_TICKET);
+        if (!_options.enable_cache)
+        {
+          SSL_CTX_set_num_tickets(handle, 0);
+        }
+      }
+      LOG_INFO(
+          "TLS session resumption: cache {} (size {}, ttl {}s), tickets {} (rotation {}s)",
+          _options.enable_cache ? "on" : "off",
+          _options.cache_size,
+          _options.session_ttl.count(),
+          _options.enable_tickets ? "on" : "off",
+          _options.ticket_key_rotation.count());
+    }
+
+    // 握手成功后由会话调用
+    void record_handshake(SSL* ssl)
+    {
+      if (SSL_session_reused(ssl))
+      {
+        bump(_resumed, _m_resumed);
+      }
+      else
+      {
+        bump(_full, _m_full);
+      }
+    }
+
+    SessionResumptionStats stats() const
+    {
+      SessionResumptionStats stats;
+      stats.full_handshakes = _full.load(std::memory_order_relaxed);
+      stats.resumed_handshakes = _resumed.load(std::memory_order_relaxed);
+      stats.cache_hits = _hits.load(std::memory_order_relaxed);
+      stats.cache_misses = _misses.load(std::memory_order_relaxed);
+      stats.cache_entries = _cache.size();
+      stats.cache_evictions = _evictions.load(std::memory_order_relaxed);
+      stats.tickets_issued = _tickets_issued.load(std::memory_order_relaxed);
+      stats.tickets_accepted = _tickets_accepted.load(std::memory_order_relaxed);
+      stats.tickets_renewed = _tickets_renewed.load(std::memory_order_relaxed);
+      stats.tickets_rejected = _tickets_rejected.load(std::memory_order_relaxed);
+      stats.ticket_key_rotations = _rotations.load(std::memory_order_relaxed);
+      return stats;
+    }
+
+    const SessionResumptionOptions& options() const
+    {
+      return _options;
+    }
+
+   private:
+    static constexpr size_t KEY_NAME_SIZE = 16;
+
+    struct TicketKey
+    {
+      std::array<unsigned char, KEY_NAME_SIZE> name{};
+      std::array<unsigned char, 32> aes_key{};
+      std::array<unsigned char, 32> hmac_key{};
+    };
+
+    static int ctx_index()
+    {
+      static int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+      return index;
+    }
+
+    static SessionResumption* from(SSL* ssl)
+    {
+      return static_cast<SessionResumption*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ctx_index()));
+    }
+
+    static void bump(std::atomic<uint64>& value, metrics::Counter* counter)
+    {
+      value.fetch_add(1, std::memory_order_relaxed);
+      if (counter)
+      {
+        counter->inc();
+      }
+    }
+
+    // 返回0表示没有保留引用，OpenSSL照常管理会话的生命周期
+    static int on_new_session(SSL* ssl, SSL_SESSION* session)
+    {
+      auto* self = from(ssl);
+      unsigned int id_length = 0;
+      const unsigned char* id = SSL_SESSION_get_id(session, &id_length);
+      int size = i2d_SSL_SESSION(session, nullptr);
+      if (!self || id_length == 0 || size <= 0)
+      {
+        return 0;
+      }
+      std::string der(static_cast<size_t>(size), '\0');
+      auto* out = reinterpret_cast<unsigned char*>(der.data());
+      i2d_SSL_SESSION(session, &out);
+      auto evicted = self->_cache.put(std::string(reinterpret_cast<const char*>(id), id_length), std::move(der));
+      if (evicted)
+      {
+        self->_evictions.fetch_add(evicted, std::memory_order_relaxed);
+        if (self->_m_evictions)
+        {
+          self->_m_evictions->inc(evicted);
+        }
+      }
+      return 0;
+    }
+
+    static SSL_SESSION* on_get_session(SSL* ssl, const unsigned char* id, int length, int* copy)
+    {
+      *copy = 0;  // 返回的是新解码的会话，引用直接交给OpenSSL
+      auto* self = from(ssl);
+      if (!self || length <= 0)
+      {
+        return nullptr;
+      }
+      std::string der;
+      if (!self->_cache.get(std::string(reinterpret_cast<const char*>(id), static_cast<size_t>(length)), der))
+      {
+        bump(self->_misses, self->_m_misses);
+        return nullptr;
+      }
+      bump(self->_hits, self->_m_hits);
+      const auto* in = reinterpret_cast<const unsigned char*>(der.data());
+      return d2i_SSL_SESSION(nullptr, &in, static_cast<long>(der.size()));
+    }
+
+    static void on_remove_session(SSL_CTX* ctx, SSL_SESSION* session)
+    {
+      auto* self = static_cast<SessionResumption*>(SSL_CTX_get_ex_data(ctx, ctx_index()));
+      unsigned int id_length = 0;
+      const unsigned char* id = SSL_SESSION_get_id(session, &id_length);
+      if (self && id_length > 0)
+      {
+        self->_cache.remove(std::string(reinterpret_cast<const char*>(id), id_length));
+      }
+    }
+
+    // 调用方持有_keys_mutex
+    void rotate_locked_if_due(std::chrono::steady_clock::time_point now)
+    {
+      if (!_keys.empty() && now - _key_created < _options.ticket_key_rotation)
+      {
+        return;
+      }
+      TicketKey key;
+      if (RAND_bytes(key.name.data(), static_cast<int>(key.name.size())) != 1 ||
+          RAND_bytes(key.aes_key.data(), static_cast<int>(key.aes_key.size())) != 1 ||
+          RAND_bytes(key.hmac_key.data(), static_cast<int>(key.hmac_key.size())) != 1)
+      {
+        LOG_ERR("failed to generate session ticket key, keep the current one");
+        return;
+      }
+      _keys.push_front(key);
+      while (_keys.size() > _options.ticket_keys_kept)
+      {
+        _keys.pop_back();
+      }
+      if (_key_created != std::chrono::steady_clock::time_point{})
+      {
+        bump(_rotations, _m_rotations);
+      }
+      _key_created = now;
+    }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    using MacContext = EVP_MAC_CTX;
+
+    static bool init_mac(MacContext* hctx, TicketKey& key)
+    {
+      char digest[] = "SHA256";
+      OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmac_key.data(), key.hmac_key.size()),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+        OSSL_PARAM_construct_end(),
+      };
+      return EVP_MAC_CTX_set_params(hctx, params) == 1;
+    }
+#else
+    using MacContext = HMAC_CTX;
+
+    static bool init_mac(MacContext* hctx, TicketKey& key)
+    {
+      return HMAC_Init_ex(hctx, key.hmac_key.data(), static_cast<int>(key.hmac_key.size()), EVP_sha256(), nullptr) ==
+             1;
+    }
+#endif
+
+    // 返回值: 1 使用票据，2 使用票据并用新密钥补发，0 不认识的票据(走完整握手)，-1 出错
+    static int on_ticket_key(
+        SSL* ssl,
+        unsigned char key_name[16],
+        unsigned char* iv,
+        EVP_CIPHER_CTX* cipher_ctx,
+        MacContext* hctx,
+        int encrypt)
+    {
+      auto* self = from(ssl);
+      if (!self)
+      {
+        return -1;
+      }
+      std::lock_guard<std::mutex> lock(self->_keys_mutex);
+      self->rotate_locked_if_due(std::chrono::steady_clock::now());
+      if (encrypt)
+      {
+        auto& key = self->_keys.front();
+        if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1 ||
+            EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, key.aes_key.data(), iv) != 1 ||
+            !init_mac(hctx, key))
+        {
+          return -1;
+        }
+        std::memcpy(key_name, key.name.data(), KEY_NAME_SIZE);
+        bump(self->_tickets_issued, self->_m_tickets_issued);
+        return 1;
+      }
+      for (size_t i = 0; i < self->_keys.size(); ++i)
+      {
+        auto& key = self->_keys[i];
+        if (std::memcmp(key_name, key.name.data(), KEY_NAME_SIZE) != 0)
+        {
+          continue;
+        }
+        if (EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, key.aes_key.data(), iv) != 1 ||
+            !init_mac(hctx, key))
+        {
+          return -1;
+        }
+        if (i == 0)
+        {
+          bump(self->_tickets_accepted, self->_m_tickets_accepted);
+          return 1;
+        }
+        bump(self->_tickets_renewed, self->_m_tickets_renewed);
+        return 2;
+      }
+      bump(self->_tickets_rejected, self->_m_tickets_rejected);
+      return 0;
+    }
+
+    SessionResumptionOptions _options;
+    SessionCache _cache;
+    std::mutex _keys_mutex;
+    std::deque<TicketKey> _keys;  // 头部是当前用于加密的密钥
+    std::chrono::steady_clock::time_point _key_created{};
+
+    std::atomic<uint64> _full{ 0 };
+    std::atomic<uint64> _resumed{ 0 };
+    std::atomic<uint64> _hits{ 0 };
+    std::atomic<uint64> _misses{ 0 };
+    std::atomic<uint64> _evictions{ 0 };
+    std::atomic<uint64> _tickets_issued{ 0 };
+    std::atomic<uint64> _tickets_accepted{ 0 };
+    std::atomic<uint64> _tickets_renewed{ 0 };
+    std::atomic<uint64> _tickets_rejected{ 0 };
+    std::atomic<uint64> _rotations{ 0 };
+
+    metrics::Counter* _m_full = nullptr;
+    metrics::Counter* _m_resumed = nullptr;
+    metrics::Counter* _m_hits = nullptr;
+    metrics::Counter* _m_misses = nullptr;
+    metrics::Gauge* _m_entries = nullptr;
+    metrics::Counter* _m_evictions = nullptr;
+    metrics::Counter* _m_tickets_issued = nullptr;
+    metrics::Counter* _m_tickets_accepted = nullptr;
+    metrics::Counter* _m_tickets_renewed = nullptr;
+    metrics::Counter* _m_tickets_rejected = nullptr;
+    metrics::Counter* _m_rotations = nullptr;
+  };
+}  // namespace asio_learn::ssl
+
+#endif  // ASIO_LEARN_SSL_SESSION_RESUMPTION_HPP_
@@ -9,113 +9,719 @@
  */
 #ifndef ASIO_LEARN_SSL_SSL_TCP_SERVER_HPP_
 #define ASIO_LEARN_SSL_SSL_TCP_SERVER_HPP_
-#include <array>
+#include <algorithm>
 #include <asio.hpp>
 #include <asio/ssl.hpp>
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
+#include "asio_learn/metrics/loop_lag_monitor.hpp"
+#include "asio_learn/metrics/server_metrics.hpp"
+#include "asio_learn/ssl/alpn.hpp"
+#include "asio_learn/ssl/early_data.hpp"
+#include "asio_learn/ssl/ktls.hpp"
+#include "asio_learn/ssl/session_resumption.hpp"
+#include "asio_learn/trace/tracer.hpp"
 #include "common/Log.hpp"
 
 namespace asio_learn::ssl
 {
+  /**
+   * 握手卸载: 握手的完成回调绑定到握手线程池的strand上，asio的组合操作沿用回调的执行器，
+   * 所以每一步SSL_do_handshake(也就是非对称运算)都在握手线程上跑，socket本身仍然注册在I/O worker的io_context
+   * 握手结束后把读写post回socket所在的io_context，之后的回调都在I/O worker上执行，连接不需要搬家
+   */
+  struct HandshakeOffload
+  {
+    asio::any_io_executor executor;  // 为空表示在socket所在的io_context上握手
+    std::chrono::milliseconds timeout{ 0 };  // 超时关闭连接，为0表示不限制
+    std::function<void()> done;  // 握手结束(成功或失败)时调用一次，在握手执行器上
+  };
+
+  /**
+   * 会话的内存(OpenSSL 3.0实测每条空闲连接约90KB堆内存):
+   *   asio ssl::stream自带的两块17KB收发缓冲 + 内存BIO对两个方向各17KB，创建后常驻，这里调不了
+   *   OpenSSL的记录读写缓冲(各约16KB)，release_buffers让它在缓冲空了以后释放，下次收发时再分配(asio默认已开启)
+   *   本会话的读缓冲，以及突发流量时的待发送缓冲(写完后超过读缓冲4倍的容量会被释放)
+   */
+  struct SslSessionOptions
+  {
+    size_t read_buffer_size = 4096;
+    // 待发送的数据超过它时暂停读，写完一批再恢复(背压)
+    size_t max_queued_bytes = 256 * 1024;
+    // SSL_MODE_RELEASE_BUFFERS
+    bool release_buffers = true;
+    // 发送记录的最大明文长度(512~16384)，0为OpenSSL默认的16384; 小记录首字节延迟低，大块传输时开销略高
+    size_t max_send_fragment = 0;
+    // 握手后尝试把密钥交给内核(ktls.hpp)，context上需要先调用Ktls::install(); 失败时照常走用户态
+    bool ktls = false;
+    // kTLS的开启结果，为空不统计
+    metrics::Counter* ktls_full = nullptr;
+    metrics::Counter* ktls_rx_failed = nullptr;  // 只开了发送方向，连接被断开
+    metrics::Counter* ktls_fallback = nullptr;
+    // 由服务器填写: 开启0-RTT时改用EarlyDataHandshake握手; 会话同时持有它们，保证context上的回调对象比会话活得久
+    std::shared_ptr<EarlyData> early_data;
+    std::shared_ptr<Alpn> alpn;
+  };
 
   class SslSession : public std::enable_shared_from_this<SslSession>
   {
    public:
-    SslSession(asio::ip::tcp::socket socket, asio::ssl::context& ctx) : _socket(std::move(socket), ctx)
+    SslSession(
+        asio::ip::tcp::socket socket,
+        std::shared_ptr<asio::ssl::context> ctx,
+        std::shared_ptr<metrics::ServerMetrics> metrics = nullptr,
+        std::shared_ptr<SessionResumption> resumption = nullptr,
+        SslSessionOptions options = {})
+      : _ssl_ctx(std::move(ctx))
+      , _socket(std::move(socket), *_ssl_ctx)
+      , _metrics(std::move(metrics))
+      , _resumption(std::move(resumption))
+      , _options(options)
+      , _trace_id(static_cast<uint64>(_socket.lowest_layer().native_handle()))
+      , _handshake_timer(_socket.get_executor())
+    {
+      _read_buffer.resize(std::max<size_t>(_options.read_buffer_size, 512));
+      SSL* ssl = _socket.native_handle();
+      if (_options.release_buffers)
+      {
+        SSL_set_mode(ssl, SSL_MODE_RELEASE_BUFFERS);
+      }
+      else
+      {
+        SSL_clear_mode(ssl, SSL_MODE_RELEASE_BUFFERS);
+      }
+      if (_options.max_send_fragment > 0)
+      {
+        SSL_set_max_send_fragment(ssl, static_cast<long>(std::clamp<size_t>(_options.max_send_fragment, 512, 16384)));
+      }
+      if (_metrics)
+      {
+        _metrics->active_sessions.inc();
+      }
+    }
+
+    ~SslSession()
     {
+      if (_metrics)
+      {
+        _metrics->active_sessions.dec();
+      }
     }
 
-    void start()
+    void start(HandshakeOffload offload = {})
     {
-      // ssl握手
+      auto self = shared_from_this();
+      _offloaded = static_cast<bool>(offload.executor);
+      _handshake_executor = _offloaded ? asio::any_io_executor(asio::make_strand(offload.executor))
+                                       : asio::any_io_executor(_socket.get_executor());
+      _handshake_done = std::move(offload.done);
+      if (_options.ktls)
+      {
+        Ktls::prepare(_socket.native_handle());
+      }
+      // 发起握手也放到握手执行器上，之后超时回调和握手的每一步都在同一个strand上串行
+      asio::post(
+          _handshake_executor,
+          [this, self, timeout = offload.timeout]()
+          {
+            if (timeout.count() > 0)
+            {
+              _handshake_timer.expires_after(timeout);
+              _handshake_timer.async_wait(asio::bind_executor(
+                  _handshake_executor,
+                  [this, self](const asio::error_code& ec)
+                  {
+                    // 握手完成时到期的回调已经在排队，cancel()拦不住，要看握手是否已经结束
+                    if (!ec && !_handshake_finished)
+                    {
+                      asio::error_code ignored;
+                      _socket.lowest_layer().close(ignored);
+                    }
+                  }));
+            }
+            do_handshake();
+          });
+    }
+
+   protected:
+    void do_handshake()
+    {
+      if (_options.early_data && _options.early_data->enabled())
+      {
+        do_handshake_early_data();
+        return;
+      }
       auto self = shared_from_this();
       _socket.async_handshake(
           asio::ssl::stream_base::server,
-          [this, self](const asio::error_code& ec)
+          asio::bind_executor(_handshake_executor, [this, self](const asio::error_code& ec) { on_handshake(ec); }));
+    }
+
+    // 0-RTT: 早期数据在握手线程上直接回显，随服务器的握手消息发出(0.5-RTT); 写不下的留到握手后照常发送
+    void do_handshake_early_data()
+    {
+      auto self = shared_from_this();
+      auto handshake = std::make_shared<EarlyDataHandshake>(_socket, _handshake_executor);
+      handshake->async_accept(
+          [this, self, raw = handshake.get()](const char* data, size_t size)
           {
-            if (!ec)
+            LOG_INFO("SSL Read {} bytes of early data from client", size);
+            if (_metrics)
             {
-              self->do_read();
+              _metrics->bytes_in.inc(size);
+            }
+            // 前面有没写出去的数据时只能排在后面，保持回显的顺序
+            if (_pending_out.empty() && raw->write(data, size))
+            {
+              if (_metrics)
+              {
+                _metrics->bytes_out.inc(size);
+              }
             }
             else
             {
-              // 处理握手错误
-              LOG_ERR("SLL handshake failed: {}", ec.message());
+              _pending_out.insert(_pending_out.end(), data, data + size);
             }
-          });
+          },
+          [this, self](const asio::error_code& ec) { on_handshake(ec); });
+    }
+
+    // 握手执行器上调用
+    void on_handshake(const asio::error_code& ec)
+    {
+      TRACE_SCOPE("handshake", _trace_id);
+      _handshake_finished = true;
+      _handshake_timer.cancel();
+      if (_handshake_done)
+      {
+        _handshake_done();
+      }
+      if (!ec)
+      {
+        SSL* ssl = _socket.native_handle();
+        if (_resumption)
+        {
+          _resumption->record_handshake(ssl);
+        }
+        if (_options.early_data)
+        {
+          _options.early_data->record_handshake(ssl);
+        }
+        if (_options.alpn)
+        {
+          LOG_DEBUG("SSL ALPN selected '{}'", Alpn::selected(ssl));
+        }
+        if (_options.ktls && !enable_ktls())
+        {
+          return;
+        }
+        if (_offloaded)
+        {
+          // 回到socket所在的I/O worker
+          asio::post(_socket.get_executor(), [self = shared_from_this()]() { self->start_io(); });
+        }
+        else
+        {
+          start_io();
+        }
+      }
+      else
+      {
+        // 处理握手错误，握手失败也算读错误
+        LOG_ERR("SLL handshake failed: {}", ec.message());
+        if (_metrics)
+        {
+          _metrics->read_errors.inc();
+        }
+      }
+    }
+
+    // 早期数据里没来得及回显的部分先发出去
+    void start_io()
+    {
+      if (!_pending_out.empty())
+      {
+        do_write();
+      }
+      do_read();
+    }
+
+    // 返回false时连接已经关闭
+    bool enable_ktls()
+    {
+      auto status = Ktls::enable(_socket.native_handle(), _socket.lowest_layer().native_handle());
+      _ktls_tx = status.tx;
+      _ktls_rx = status.rx;
+      auto* counter = status.rx ? _options.ktls_full : status.tx ? _options.ktls_rx_failed : _options.ktls_fallback;
+      if (counter)
+      {
+        counter->inc();
+      }
+      if (status.rx)
+      {
+        LOG_DEBUG("SSL kTLS enabled");
+      }
+      else if (status.tx)
+      {
+        // 读还得交给OpenSSL，它回应KeyUpdate时用的序号和内核的对不上，不能这样继续
+        LOG_ERR("SSL kTLS rx failed after tx was enabled, closing: {}", status.reason);
+        close();
+        return false;
+      }
+      else
+      {
+        LOG_DEBUG("SSL kTLS fallback: {}", status.reason);
+      }
+      return true;
     }
 
-   protected:
     void do_read()
     {
+      if (_closing)
+      {
+        return;
+      }
+      if (_ktls_rx)
+      {
+        do_read_ktls();
+        return;
+      }
       auto self = shared_from_this();
       _socket.async_read_some(
-          asio::buffer(_buffer.data(), _buffer.size()),
+          asio::buffer(_read_buffer),
           [this, self](const asio::error_code& ec, std::size_t bytes_transferred)
           {
+            TRACE_SCOPE("read", _trace_id);
+            metrics::HandlerTimer timer(_metrics.get());
             if (!ec)
             {
-              LOG_INFO("SSL Read {} bytes from client", bytes_transferred);
-              // echo
-              do_write(bytes_transferred);
+              on_read(bytes_transferred);
             }
             else if (ec == asio::error::eof)
             {
               LOG_INFO("SSL Connection closed by peer.");
+              on_peer_closed();
             }
             else
             {
-              LOG_ERR("SSL Read error: {}", ec.message());
+              on_read_error(ec);
             }
           });
     }
 
-    void do_write(std::size_t bytes_transferred)
+    // 内核接收: 等socket可读后用recvmsg取明文和记录类型
+    void do_read_ktls()
     {
       auto self = shared_from_this();
-      asio::async_write(
-          _socket,
-          asio::buffer(_buffer.data(), bytes_transferred),
-          [self](const asio::error_code& ec, std::size_t bytes_write)
+      _socket.lowest_layer().async_wait(
+          asio::socket_base::wait_read,
+          [this, self](const asio::error_code& ec)
           {
-            if (!ec)
+            TRACE_SCOPE("read", _trace_id);
+            metrics::HandlerTimer timer(_metrics.get());
+            if (ec)
+            {
+              on_read_error(ec);
+              return;
+            }
+            uint8_t record_type = 0;
+            asio::error_code read_ec;
+            auto bytes_transferred = Ktls::receive(
+                _socket.lowest_layer().native_handle(), _read_buffer.data(), _read_buffer.size(), record_type, read_ec);
+            if (read_ec == asio::error::would_block)
+            {
+              do_read_ktls();
+            }
+            else if (read_ec == asio::error::eof)
             {
-              LOG_INFO("SSL Write {} bytes to client", bytes_write);
+              LOG_INFO("SSL Connection closed by peer without close_notify.");
+              on_peer_closed();
+            }
+            else if (read_ec)
+            {
+              on_read_error(read_ec);
+            }
+            else if (record_type == Ktls::RECORD_APPLICATION_DATA)
+            {
+              on_read(bytes_transferred);
+            }
+            else if (record_type == Ktls::RECORD_ALERT && bytes_transferred == 2 && _read_buffer[1] == 0)
+            {
+              LOG_INFO("SSL Connection closed by peer.");
+              on_peer_closed();
             }
             else
             {
-              LOG_ERR("SSL Write error: {}", ec.message());
+              // 其他告警、TLS1.3的KeyUpdate等握手消息内核不处理，直接断开
+              LOG_ERR("SSL unexpected record type {} with kTLS", record_type);
+              on_read_error(asio::error::invalid_argument);
             }
           });
     }
 
+    // 读到的数据追加到待发送缓冲(回显)，写的同时继续读; 待发送的数据太多时暂停读，写完再恢复
+    void on_read(std::size_t bytes_transferred)
+    {
+      LOG_INFO("SSL Read {} bytes from client", bytes_transferred);
+      if (_metrics)
+      {
+        _metrics->bytes_in.inc(bytes_transferred);
+      }
+      _pending_out.insert(_pending_out.end(), _read_buffer.data(), _read_buffer.data() + bytes_transferred);
+      do_write();
+      if (_pending_out.size() + _write_batch.size() < _options.max_queued_bytes)
+      {
+        do_read();
+      }
+      else
+      {
+        _read_paused = true;
+      }
+    }
+
+    void do_write()
+    {
+      if (_writing || _pending_out.empty() || _closing)
+      {
+        return;
+      }
+      _writing = true;
+      // 攒下的数据整体换到发送批次，写期间读到的数据进入下一批; 一次SSL_write得到尽量满的记录
+      _write_batch.swap(_pending_out);
+      auto self = shared_from_this();
+      auto on_write = [this, self](const asio::error_code& ec, std::size_t bytes_write)
+      {
+        TRACE_SCOPE("write", _trace_id);
+        _writing = false;
+        if (ec)
+        {
+          if (!_closing)
+          {
+            LOG_ERR("SSL Write error: {}", ec.message());
+            if (_metrics)
+            {
+              _metrics->write_errors.inc();
+            }
+            close();
+          }
+          return;
+        }
+        LOG_INFO("SSL Write {} bytes to client", bytes_write);
+        if (_metrics)
+        {
+          _metrics->bytes_out.inc(bytes_write);
+        }
+        _write_batch.clear();
+        // 突发流量过后不长期占着大缓冲
+        if (_write_batch.capacity() > _options.read_buffer_size * 4)
+        {
+          std::vector<char>().swap(_write_batch);
+        }
+        if (_read_paused && _pending_out.size() < _options.max_queued_bytes)
+        {
+          _read_paused = false;
+          do_read();
+        }
+        if (!_pending_out.empty())
+        {
+          do_write();
+        }
+        else if (_peer_closed)
+        {
+          shutdown();
+        }
+      };
+      if (_ktls_tx)
+      {
+        // 明文直接写socket，内核加密
+        asio::async_write(_socket.next_layer(), asio::buffer(_write_batch), std::move(on_write));
+      }
+      else
+      {
+        asio::async_write(_socket, asio::buffer(_write_batch), std::move(on_write));
+      }
+    }
+
+    // 对端关闭后不再读，已经读到的数据写完再回应close_notify
+    void on_peer_closed()
+    {
+      _peer_closed = true;
+      if (!_writing && _pending_out.empty())
+      {
+        shutdown();
+      }
+    }
+
+    void on_read_error(const asio::error_code& ec)
+    {
+      if (_closing)
+      {
+        return;
+      }
+      LOG_ERR("SSL Read error: {}", ec.message());
+      if (_metrics)
+      {
+        _metrics->read_errors.inc();
+      }
+      close();
+    }
+
+    // 回应close_notify; 没有双向关闭的会话会被OpenSSL从缓存里删掉，无法复用
+    void shutdown()
+    {
+      if (_closing)
+      {
+        return;
+      }
+      _closing = true;
+      if (_ktls_tx)
+      {
+        // 发送序号已经在内核里，不能再让OpenSSL写记录
+        asio::error_code ignored;
+        Ktls::send_alert(_socket.lowest_layer().native_handle(), 1, 0, ignored);
+        return;
+      }
+      _socket.async_shutdown([self = shared_from_this()](const asio::error_code&) {});
+    }
+
+    // 出错时直接关socket，挂着的读写带operation_aborted返回
+    void close()
+    {
+      _closing = true;
+      asio::error_code ignored;
+      _socket.lowest_layer().close(ignored);
+    }
+
    private:
+    // 会话一直持有创建它的context，证书热更新换掉服务器的context后老连接照常收发
+    std::shared_ptr<asio::ssl::context> _ssl_ctx;
     asio::ssl::stream<asio::ip::tcp::socket> _socket;
-    std::array<char, 1024> _buffer;
+    // 读写只在socket所在的io_context上串行执行; ssl::stream允许一个读和一个写同时挂着
+    std::vector<char> _read_buffer;
+    std::vector<char> _pending_out;  // 等待发送
+    std::vector<char> _write_batch;  // 正在发送
+    bool _writing = false;
+    bool _read_paused = false;
+    bool _peer_closed = false;
+    bool _closing = false;
+    std::shared_ptr<metrics::ServerMetrics> _metrics;
+    std::shared_ptr<SessionResumption> _resumption;
+    SslSessionOptions _options;
+    bool _ktls_tx = false;
+    bool _ktls_rx = false;
+    uint64 _trace_id;  // 追踪事件的id，取socket句柄
+    // 握手阶段只在_handshake_executor上访问
+    bool _offloaded = false;
+    bool _handshake_finished = false;
+    asio::any_io_executor _handshake_executor;
+    asio::steady_timer _handshake_timer;
+    std::function<void()> _handshake_done;
   };
 
 
+  /**
+   * 线程模型: io_threads为0时和原来一样，accept、握手、读写都在传入的io_context上
+   * io_threads大于0时传入的io_context只负责accept，连接直接接受到I/O worker的io_context上(轮询分配)，
+   * 握手交给handshake_threads个线程的握手池，完成后留在I/O worker上读写; 完整握手的几百微秒运算不再堵住已建立连接的读写
+   * max_concurrent_handshakes限制同时进行的握手数，达到上限时暂停accept，多出来的连接留在内核的backlog里，
+   * 握手池不会被握手洪水无限堆积
+   * early_data开启TLS1.3的0-RTT(见early_data.hpp)，alpn按服务器的优先级协商应用层协议，证书热更新后对新context同样生效
+   */
+  struct SslServerOptions
+  {
+    size_t io_threads = 0;
+    size_t handshake_threads = 2;
+    size_t max_concurrent_handshakes = 256;  // 0表示不限制
+    std::chrono::milliseconds handshake_timeout{ 10000 };  // 0表示不限制
+    EarlyDataOptions early_data;  // 默认关闭0-RTT
+    std::vector<std::string> alpn;  // 按优先级排列，为空不协商
+    bool alpn_strict = false;  // 客户端提供的协议都不支持时断开
+    SslSessionOptions session;  // 指标计数器由服务器填写
+  };
+
   class SslTcpServer{
     public:
-    SslTcpServer(asio::io_context& io_ctx, unsigned short port,asio::ssl::context ssl_ctx):
-    _acceptor(io_ctx,asio::ip::tcp::endpoint(asio::ip::tcp::v4(),port)),
-    _ssl_ctx(std::move(ssl_ctx)){}
+    // metrics为空表示不统计; resumption的缓存和票据都关闭时每次都是完整握手
+    SslTcpServer(
+        asio::io_context& io_ctx,
+        unsigned short port,
+        asio::ssl::context ssl_ctx,
+        std::shared_ptr<metrics::ServerMetrics> metrics = nullptr,
+        SessionResumptionOptions resumption = {},
+        SslServerOptions options = {})
+      : _resumption(std::make_shared<SessionResumption>(
+            std::move(resumption),
+            metrics ? &metrics->registry : nullptr,
+            metrics ? metrics->server : "ssl_tcp_server"))
+      , _ssl_ctx(std::make_shared<asio::ssl::context>(std::move(ssl_ctx)))
+      , _acceptor(io_ctx, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port))
+      , _metrics(std::move(metrics))
+      , _options(options)
+      , _admission(std::make_shared<Admission>())
+    {
+      _session_options = _options.session;
+      if (_options.early_data.max_early_data > 0)
+      {
+        _session_options.early_data = std::make_shared<EarlyData>(
+            _options.early_data,
+            _metrics ? &_metrics->registry : nullptr,
+            _metrics ? _metrics->server : "ssl_tcp_server");
+      }
+      if (!_options.alpn.empty())
+      {
+        _session_options.alpn = std::make_shared<Alpn>(_options.alpn, _options.alpn_strict);
+      }
+      prepare_context(*_ssl_ctx);
+      _admission->server = this;
+      if (_metrics)
+      {
+        metrics::Labels labels{ { "server", _metrics->server } };
+        _admission->in_flight_gauge = &_metrics->registry.gauge(
+            "asio_learn_tls_handshakes_in_flight", "TLS handshakes started and not yet finished", labels);
+        _admission->pauses = &_metrics->registry.counter(
+            "asio_learn_tls_accept_pauses_total", "Times accepting stopped at max_concurrent_handshakes", labels);
+        if (_session_options.ktls)
+        {
+          const char* help = "Sessions by kernel TLS offload result after the handshake";
+          auto result = [&](const char* value)
+          {
+            return metrics::Labels{ { "server", _metrics->server }, { "result", value } };
+          };
+          _session_options.ktls_full =
+              &_metrics->registry.counter("asio_learn_tls_ktls_sessions_total", help, result("full"));
+          _session_options.ktls_rx_failed =
+              &_metrics->registry.counter("asio_learn_tls_ktls_sessions_total", help, result("rx_failed"));
+          _session_options.ktls_fallback =
+              &_metrics->registry.counter("asio_learn_tls_ktls_sessions_total", help, result("fallback"));
+        }
+      }
+      if (_options.io_threads > 0)
+      {
+        auto* registry = _metrics ? &_metrics->registry : nullptr;
+        for (size_t i = 0; i < _options.io_threads; ++i)
+        {
+          _io_loops.push_back(std::make_unique<Loop>(std::format("ssl-io-{}", i), 1, registry));
+        }
+        _handshake_loop = std::make_unique<Loop>(
+            "ssl-handshake", std::max<size_t>(1, _options.handshake_threads), registry);
+      }
+    }
+
+    ~SslTcpServer()
+    {
+      stop();
+      // 握手中的会话同时挂在两类io_context上(socket在I/O worker，回调绑定握手池的strand)，
+      // 先把所有循环shutdown，丢弃的回调释放会话时各个服务都还在，再逐个析构
+      for (auto& loop : _io_loops)
+      {
+        loop->ioc.shutdown();
+      }
+      if (_handshake_loop)
+      {
+        _handshake_loop->ioc.shutdown();
+      }
+    }
+
+    SslTcpServer(const SslTcpServer&) = delete;
+    SslTcpServer& operator=(const SslTcpServer&) = delete;
+
+    // 可在任意线程调用
+    SessionResumptionStats resumption_stats() const
+    {
+      return _resumption->stats();
+    }
+
+    /**
+     * 证书热更新，可在任意线程调用: 之后accept的连接用新context握手，已建立和正在握手的连接继续用各自的旧context，
+     * 旧context在最后一个引用它的会话结束时释放
+     * 回调在调用方线程装好后才发布，accept路径上只多一次加锁拷贝shared_ptr; 新旧context共用会话缓存和票据密钥，
+     * 换证书后客户端照常复用会话，不会出现一波完整握手
+     */
+    void reload_context(asio::ssl::context ssl_ctx)
+    {
+      auto next = std::make_shared<asio::ssl::context>(std::move(ssl_ctx));
+      prepare_context(*next);
+      std::shared_ptr<asio::ssl::context> previous;
+      {
+        std::lock_guard<std::mutex> lock(_ssl_ctx_mutex);
+        previous = std::exchange(_ssl_ctx, std::move(next));
+      }
+      LOG_INFO("SSL context reloaded, previous context used by {} sessions", previous.use_count() - 1);
+    }
+
+    // 可在任意线程调用; 没有开启0-RTT时全为0
+    EarlyDataStats early_data_stats() const
+    {
+      return _session_options.early_data ? _session_options.early_data->stats() : EarlyDataStats{};
+    }
+
+    // 可在任意线程调用
+    size_t handshakes_in_flight() const
+    {
+      return _admission->in_flight.load(std::memory_order_relaxed);
+    }
 
 
     void run(){
+        for (auto& loop : _io_loops)
+        {
+          loop->start();
+        }
+        if (_handshake_loop)
+        {
+          _handshake_loop->start();
+        }
         do_accept();
     }
+
+    // 停止并等待自己创建的线程，传入的io_context由调用方停止
+    void stop()
+    {
+      for (auto& loop : _io_loops)
+      {
+        loop->stop();
+      }
+      if (_handshake_loop)
+      {
+        _handshake_loop->stop();
+      }
+    }
     
     protected:
     void do_accept(){
+        // 多线程模式下socket直接注册在I/O worker上，之后不用再迁移
+        auto executor = _io_loops.empty()
+                            ? _acceptor.get_executor()
+                            : asio::any_io_executor(_io_loops[_next_loop++ % _io_loops.size()]->ioc.get_executor());
         _acceptor.async_accept(
+            executor,
             [this](const asio::error_code& ec, asio::ip::tcp::socket socket)
             {
+              TRACE_SCOPE("accept", socket.native_handle());
               if (!ec)
               {
                 LOG_INFO("SSL New connection accepted.");
-                std::make_shared<SslSession>(std::move(socket),_ssl_ctx)->start();
+                if (_metrics)
+                {
+                  _metrics->accepts.inc();
+                }
+                // 握手后的票据和回显是分开的小记录，开着Nagle会和对端的延迟ACK互等几十毫秒
+                asio::error_code ignored;
+                socket.set_option(asio::ip::tcp::no_delay(true), ignored);
+                start_session(std::move(socket));
+                if (!admit_next())
+                {
+                  return;
+                }
               }
               else
               {
@@ -128,8 +734,180 @@ namespace asio_learn::ssl
     }
 
     private:
-      asio::ssl::context _ssl_ctx;
+      // 握手计数由会话和服务器共享，会话用weak_ptr引用，服务器析构后回调不再碰服务器
+      struct Admission
+      {
+        std::atomic<size_t> in_flight{ 0 };
+        std::atomic<bool> paused{ false };
+        SslTcpServer* server = nullptr;
+        metrics::Gauge* in_flight_gauge = nullptr;
+        metrics::Counter* pauses = nullptr;
+      };
+
+      // 公开io_context的shutdown()，见~SslTcpServer
+      class LoopContext : public asio::io_context
+      {
+       public:
+        using asio::io_context::shutdown;
+      };
+
+      // 服务器自己创建的io_context和驱动它的线程
+      struct Loop
+      {
+        Loop(std::string name, size_t thread_count, metrics::Registry* registry)
+          : name(std::move(name))
+          , thread_count(thread_count)
+          , guard(asio::make_work_guard(ioc))
+          , lag_monitor(ioc, this->name, metrics::LoopLagOptions{}, registry)
+        {
+        }
+
+        ~Loop()
+        {
+          stop();
+        }
+
+        void start()
+        {
+          lag_monitor.start();
+          for (size_t i = 0; i < thread_count; ++i)
+          {
+            auto thread_name = thread_count > 1 ? std::format("{}-{}", name, i) : name;
+            threads.emplace_back(
+                [this, thread_name]()
+                {
+                  trace::Tracer::instance().set_thread_name(thread_name);
+                  ioc.run();
+                });
+          }
+        }
+
+        void stop()
+        {
+          guard.reset();
+          ioc.stop();
+          for (auto& thread : threads)
+          {
+            if (thread.joinable())
+            {
+              thread.join();
+            }
+          }
+          threads.clear();
+        }
+
+        std::string name;
+        size_t thread_count;
+        LoopContext ioc;
+        asio::executor_work_guard<asio::io_context::executor_type> guard;
+        metrics::LoopLagMonitor lag_monitor;
+        std::vector<std::thread> threads;
+      };
+
+      // 服务器的回调装到context上，构造时和每次热更新时调用
+      void prepare_context(asio::ssl::context& ctx)
+      {
+        _resumption->install(ctx);
+        if (_session_options.early_data)
+        {
+          _session_options.early_data->install(ctx);
+        }
+        if (_session_options.alpn)
+        {
+          _session_options.alpn->install(ctx);
+        }
+        if (_session_options.ktls)
+        {
+          Ktls::install(ctx);
+        }
+      }
+
+      void start_session(asio::ip::tcp::socket socket)
+      {
+        std::shared_ptr<asio::ssl::context> ctx;
+        {
+          std::lock_guard<std::mutex> lock(_ssl_ctx_mutex);
+          ctx = _ssl_ctx;
+        }
+        auto session = std::make_shared<SslSession>(
+            std::move(socket), std::move(ctx), _metrics, _resumption, _session_options);
+        _admission->in_flight.fetch_add(1, std::memory_order_seq_cst);
+        if (_admission->in_flight_gauge)
+        {
+          _admission->in_flight_gauge->inc();
+        }
+        HandshakeOffload offload;
+        if (_handshake_loop)
+        {
+          offload.executor = _handshake_loop->ioc.get_executor();
+        }
+        offload.timeout = _options.handshake_timeout;
+        offload.done = [weak = std::weak_ptr<Admission>(_admission), accept_executor = _acceptor.get_executor()]()
+        {
+          auto admission = weak.lock();
+          if (!admission)
+          {
+            return;
+          }
+          admission->in_flight.fetch_sub(1, std::memory_order_seq_cst);
+          if (admission->in_flight_gauge)
+          {
+            admission->in_flight_gauge->dec();
+          }
+          // 先减计数再看标志，和admit_next()先置标志再看计数配对，两边至少有一方看到对方，不会漏掉恢复
+          if (admission->paused.load(std::memory_order_seq_cst))
+          {
+            asio::post(
+                accept_executor,
+                [weak]()
+                {
+                  auto admission = weak.lock();
+                  if (admission && admission->paused.exchange(false, std::memory_order_seq_cst))
+                  {
+                    admission->server->do_accept();
+                  }
+                });
+          }
+        };
+        session->start(std::move(offload));
+      }
+
+      // accept线程调用; 返回false表示已暂停，由握手完成的回调恢复accept
+      bool admit_next()
+      {
+        auto limit = _options.max_concurrent_handshakes;
+        if (limit == 0 || _admission->in_flight.load(std::memory_order_seq_cst) < limit)
+        {
+          return true;
+        }
+        _admission->paused.store(true, std::memory_order_seq_cst);
+        // 置标志期间可能有握手刚好完成并且没看到标志，这里再检查一次，抢回标志的一方负责继续accept
+        if (_admission->in_flight.load(std::memory_order_seq_cst) < limit &&
+            _admission->paused.exchange(false, std::memory_order_seq_cst))
+        {
+          return true;
+        }
+        if (_admission->pauses)
+        {
+          _admission->pauses->inc();
+        }
+        LOG_DEBUG("SSL accept paused, {} handshakes in flight", limit);
+        return false;
+      }
+
+      // context的回调引用它，声明在_ssl_ctx之前，析构在后
+      std::shared_ptr<SessionResumption> _resumption;
+      std::shared_ptr<asio::ssl::context> _ssl_ctx;  // 由_ssl_ctx_mutex保护，reload_context()整体替换
+      std::mutex _ssl_ctx_mutex;
       asio::ip::tcp::acceptor _acceptor;
+      std::shared_ptr<metrics::ServerMetrics> _metrics;
+      SslServerOptions _options;
+      SslSessionOptions _session_options;
+      std::shared_ptr<Admission> _admission;
+      // 声明在_ssl_ctx之后，先析构: 挂在这些io_context上的会话先于服务器的回调对象释放
+      std::vector<std::unique_ptr<Loop>> _io_loops;
+      std::unique_ptr<Loop> _handshake_loop;
+      size_t _next_loop = 0;
   };
 }  // namespace asio_learn::ssl
 
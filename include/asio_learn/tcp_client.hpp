@@ -12,9 +12,12 @@
 
 #include <array>
 #include <memory>
+#include <string>
 #include <vector>
 
+#include "asio_learn/metrics/server_metrics.hpp"
 #include "asio_learn/public.hpp"
+#include "asio_learn/trace/tracer.hpp"
 #include "common/Log.hpp"
 namespace asio_learn
 {
@@ -22,13 +25,29 @@ namespace asio_learn
   class Session : public std::enable_shared_from_this<Session>
   {
    public:
-    explicit Session(tcp_socket socket) : _socket(std::move(socket))
+    // metrics为空表示不统计
+    explicit Session(tcp_socket socket, std::shared_ptr<metrics::ServerMetrics> metrics = nullptr)
+      : _socket(std::move(socket))
+      , _metrics(std::move(metrics))
+      , _trace_id(static_cast<uint64>(_socket.native_handle()))
     {
+      // 对端断开后remote_endpoint()会抛异常，先记下地址
+      asio::error_code ec;
+      auto endpoint = _socket.remote_endpoint(ec);
+      _peer = ec ? std::string("unknown") : endpoint.address().to_string();
+      if (_metrics)
+      {
+        _metrics->active_sessions.inc();
+      }
     }
     Session() = delete;
     virtual ~Session()
     {
       _socket.close();
+      if (_metrics)
+      {
+        _metrics->active_sessions.dec();
+      }
     }
     void start()
     {
@@ -41,23 +60,33 @@ namespace asio_learn
     {
       auto self = shared_from_this();
       _socket.async_read_some(
-          asio::buffer(_dynamic_buf),
+          asio::buffer(_buffer),
           [this, self](const asio::error_code& ec, std::size_t bytes_transferred)
           {
             asio::transfer_at_least(1);
+            TRACE_SCOPE("read", _trace_id);
+            metrics::HandlerTimer timer(_metrics.get());
             // 处理读取到的数据
             if (!ec)
             {
               LOG_DEBUG("async_read_some success bytes:{}", bytes_transferred);
+              if (_metrics)
+              {
+                _metrics->bytes_in.inc(bytes_transferred);
+              }
               do_write(bytes_transferred);
             }
             else if (ec == asio::error::eof)
             {  // 断连
-              LOG_INFO("client {} disconnected", _socket.remote_endpoint().address().to_string());
+              LOG_INFO("client {} disconnected", _peer);
             }
             else
             {
-              LOG_ERR("session {} async_read_some err:{}", _socket.remote_endpoint().address().to_string(), ec.message());
+              LOG_ERR("session {} async_read_some err:{}", _peer, ec.message());
+              if (_metrics)
+              {
+                _metrics->read_errors.inc();
+              }
             }
           });
     }
@@ -67,26 +96,38 @@ namespace asio_learn
       auto self = shared_from_this();
       asio::async_write(
           _socket,
-          asio::dynamic_buffer(_dynamic_buf),
+          asio::buffer(_buffer, len),
           [this, self](const asio::error_code& ec, std::size_t bytes_transferred)
           {
             asio::transfer_at_least(1);  // 至少传输一个字节
+            TRACE_SCOPE("write", _trace_id);
             if (!ec)
             {
               LOG_DEBUG("async_write success bytes:{}", bytes_transferred);
+              if (_metrics)
+              {
+                _metrics->bytes_out.inc(bytes_transferred);
+              }
               // 写成功
               do_read();
             }
             else
             {
               LOG_ERR("async_write err: {}", ec.message());
+              if (_metrics)
+              {
+                _metrics->write_errors.inc();
+              }
             }
           });
     }
 
    private:
-    std::vector<char> _dynamic_buf;  // 动态缓冲区
+    std::array<char, DEFAULT_BUFFER_LEN> _buffer;  // 读到多少回写多少
     tcp_socket _socket;
+    std::string _peer;
+    std::shared_ptr<metrics::ServerMetrics> _metrics;
+    uint64 _trace_id;  // 追踪事件的id，取socket句柄
   };
 }  // namespace asio_learn
 
@@ -17,7 +17,13 @@ namespace asio_learn{
   class TcpServer
   {
    public:
-    explicit TcpServer(asio::io_context& ioc, const tcp_endpoint& endpoint) : _acceptor(ioc, endpoint)
+    // metrics为空表示不统计
+    explicit TcpServer(
+        asio::io_context& ioc,
+        const tcp_endpoint& endpoint,
+        std::shared_ptr<metrics::ServerMetrics> metrics = nullptr)
+      : _acceptor(ioc, endpoint)
+      , _metrics(std::move(metrics))
     {
     }
     virtual ~TcpServer()
@@ -35,10 +41,24 @@ namespace asio_learn{
       _acceptor.async_accept(
           [this](const asio::error_code& ec, tcp_socket socket) -> void
           {
+            TRACE_SCOPE("accept", socket.native_handle());
             if (!ec)
             {
-              LOG_INFO("new connection from {}", socket.remote_endpoint().address().to_string());
-              std::make_shared<Session>(std::move(socket))->start();
+              asio::error_code peer_ec;
+              auto peer = socket.remote_endpoint(peer_ec);
+              if (peer_ec)
+              {
+                // 连接在accept之后已被对端重置
+                LOG_ERR("accepted connection already closed: {}", peer_ec.message());
+                do_accept();
+                return;
+              }
+              LOG_INFO("new connection from {}", peer.address().to_string());
+              if (_metrics)
+              {
+                _metrics->accepts.inc();
+              }
+              std::make_shared<Session>(std::move(socket), _metrics)->start();
             }
             else
             {
@@ -51,6 +71,7 @@ namespace asio_learn{
 
    private:
     tcp_acceptor _acceptor;
+    std::shared_ptr<metrics::ServerMetrics> _metrics;
   };
 } // namespace asio_learn
 #endif //ASIO_LEARN_TCP_SERVER_HPP
\ No newline at end of file
@@ -9,48 +9,220 @@
  */
 #ifndef ASIO_LEARN_TCP_SERVER_MASTER_WORKER_HPP
 #define ASIO_LEARN_TCP_SERVER_MASTER_WORKER_HPP
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <exception>
+#include <functional>
+#include <optional>
 #include <vector>
 
+#include "asio_learn/SessionTimeoutManager.hpp"
+#include "asio_learn/hot_restart.hpp"
+#include "asio_learn/metrics/loop_lag_monitor.hpp"
+#include "asio_learn/metrics/server_metrics.hpp"
+#include "asio_learn/mpsc_queue.hpp"
 #include "asio_learn/public.hpp"
+#include "asio_learn/trace/tracer.hpp"
 #include "common/Log.hpp"
 
 namespace asio_learn
 {
   namespace details
   {
+    // worker统计快照
+    struct WorkerStats
+    {
+      uint64 worker_id = 0;
+      uint64 handoffs = 0;                  // 收到的连接数
+      uint64 batches = 0;                   // 被唤醒的批次数，每批只唤醒一次
+      uint64 max_batch = 0;                 // 单批最大连接数
+      uint64 handoff_latency_ns_total = 0;  // master入队到worker取出的累计耗时
+      uint64 handoff_latency_ns_max = 0;
+      uint64 first_reads = 0;               // 完成首次读取的会话数
+      uint64 accept_to_first_read_ns_total = 0;  // accept完成到首次读取完成的累计耗时
+      uint64 accept_to_first_read_ns_max = 0;
+      uint64 active_sessions = 0;           // 当前存活的会话数
+      uint64 loop_lag_ns_last = 0;          // 最近一次循环延迟探针的结果
+      uint64 loop_lag_ns_max = 0;
+      uint64 pending_handlers = 0;          // 最近一次采样时排队的就绪回调数，探针开启count_handlers时才有
+    };
+
+    // worker计数器，只由worker线程写入，其他线程可以随时读取
+    struct WorkerCounters
+    {
+      std::atomic<uint64> handoffs{ 0 };
+      std::atomic<uint64> batches{ 0 };
+      std::atomic<uint64> max_batch{ 0 };
+      std::atomic<uint64> handoff_latency_ns_total{ 0 };
+      std::atomic<uint64> handoff_latency_ns_max{ 0 };
+      std::atomic<uint64> first_reads{ 0 };
+      std::atomic<uint64> accept_to_first_read_ns_total{ 0 };
+      std::atomic<uint64> accept_to_first_read_ns_max{ 0 };
+      std::atomic<uint64> active_sessions{ 0 };
+
+      // 单写者，不需要原子的读-改-写
+      static void add(std::atomic<uint64>& counter, uint64 value)
+      {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+      }
+
+      static void update_max(std::atomic<uint64>& counter, uint64 value)
+      {
+        if (value > counter.load(std::memory_order_relaxed))
+        {
+          counter.store(value, std::memory_order_relaxed);
+        }
+      }
+
+      static uint64 elapsed_ns(std::chrono::steady_clock::time_point since)
+      {
+        return static_cast<uint64>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count());
+      }
+    };
+
     // 会话类 - 管理单个连接的生命周期
     class Session : public std::enable_shared_from_this<Session>
     {
      public:
-      Session(tcp_socket socket, uint64_t worker_id) : _socket(std::move(socket)), _worker_id(worker_id), _buffer(1024)
+      Session(
+          tcp_socket socket,
+          uint64_t worker_id,
+          const tcp_endpoint& peer,
+          std::chrono::steady_clock::time_point accepted_at,
+          WorkerCounters* counters = nullptr,
+          std::shared_ptr<SessionTimeoutManager> timeout_manager = nullptr,
+          metrics::ServerMetrics* metrics = nullptr)
+        : _socket(std::move(socket))
+        , _worker_id(worker_id)
+        , _buffer(1024)
+        , _peer(peer)
+        , _accepted_at(accepted_at)
+        , _counters(counters)
+        , _timeout_manager(std::move(timeout_manager))
+        , _metrics(metrics)
+        , _trace_id(static_cast<uint64>(_socket.native_handle()))
       {
       }
 
+      ~Session()
+      {
+        if (_timeout_manager && _timeout_slot != SessionTimeoutManager::INVALID_SLOT)
+        {
+          _timeout_manager->remove(_timeout_slot);
+        }
+        if (_started && _counters)
+        {
+          WorkerCounters::add(_counters->active_sessions, static_cast<uint64>(-1));
+        }
+        if (_started && _metrics)
+        {
+          _metrics->active_sessions.dec();
+        }
+      }
+
       void start()
       {
-        LOG_INFO("worker {} started session with {}", _worker_id, _socket.remote_endpoint().address().to_string());
+        // 对端地址由accept时一并返回，这里不再调用remote_endpoint()
+        LOG_INFO("worker {} started session with {}", _worker_id, _peer.address().to_string());
+        _started = true;
+        if (_counters)
+        {
+          WorkerCounters::add(_counters->active_sessions, 1);
+        }
+        if (_metrics)
+        {
+          _metrics->active_sessions.inc();
+        }
+        if (_timeout_manager)
+        {
+          // 超时回调只持有弱引用，不延长会话生命周期
+          std::weak_ptr<Session> weak_self = shared_from_this();
+          _timeout_slot = _timeout_manager->add(
+              [weak_self]()
+              {
+                if (auto self = weak_self.lock())
+                {
+                  self->close_idle();
+                }
+              });
+        }
         do_read();
       }
 
+      // 空闲: 正在等待客户端数据，没有未完成的写
+      bool is_idle() const
+      {
+        return _reading && _socket.is_open();
+      }
+
+      const tcp_endpoint& peer() const
+      {
+        return _peer;
+      }
+
+      using HandoffCallback = std::function<void(std::optional<tcp_socket::native_handle_type>)>;
+
+      // 热重启时把空闲连接交出去，只能在worker线程调用
+      // 先取消挂起的读，等读回调执行: 以operation_aborted结束说明没有读走任何数据，这时才释放socket;
+      // 读已经完成、回调还在排队的会话照常处理读到的数据，留在本进程排空
+      // on_released在读回调里调用一次，参数为空表示不交出
+      void handoff(HandoffCallback on_released)
+      {
+        _on_handoff = std::move(on_released);
+        asio::error_code ec;
+        _socket.cancel(ec);
+      }
+
      private:
       void do_read()
       {
         auto self = shared_from_this();  // 保持会话存活
+        _reading = true;
+        // 开启 ASIO_LEARN_HANDLER_PROFILE 时标记调用点，否则展开为空
+        ASIO_HANDLER_LOCATION((__FILE__, __LINE__, __func__));
         _socket.async_read_some(
             asio::buffer(_buffer),
             [self, this](const asio::error_code& ec, std::size_t bytes_read)
             {
+              _reading = false;
+              TRACE_SCOPE("read", _trace_id);
+              metrics::HandlerTimer timer(_metrics);
+              if (_on_handoff && finish_handoff(ec))
+              {
+                return;
+              }
               if (!ec)
               {
                 LOG_INFO("thread{}---worker {} read {} bytes", threadId_to_str(), _worker_id, bytes_read);
+                if (_metrics)
+                {
+                  _metrics->bytes_in.inc(bytes_read);
+                }
+                if (_first_read && _counters)
+                {
+                  _first_read = false;
+                  auto latency = WorkerCounters::elapsed_ns(_accepted_at);
+                  WorkerCounters::add(_counters->first_reads, 1);
+                  WorkerCounters::add(_counters->accept_to_first_read_ns_total, latency);
+                  WorkerCounters::update_max(_counters->accept_to_first_read_ns_max, latency);
+                }
+                touch();
                 process_data(bytes_read);
                 do_write(bytes_read);
               }
+              else if (ec == asio::error::operation_aborted && _idle_closed)
+              {
+                LOG_INFO("worker {} session closed due to idle timeout", _worker_id);
+              }
               else if (ec != asio::error::eof)
               {
                 LOG_ERR("worker {} read error: {}", _worker_id, ec.message());
+                if (_metrics)
+                {
+                  _metrics->read_errors.inc();
+                }
               }
               else
               {
@@ -62,52 +234,142 @@ namespace asio_learn
       void do_write(std::size_t bytes_to_write)
       {
         auto self = shared_from_this();  // 保持会话存活
+        ASIO_HANDLER_LOCATION((__FILE__, __LINE__, __func__));
         asio::async_write(
             _socket,
             asio::buffer(_buffer.data(), bytes_to_write),
-            [self, this](const asio::error_code& ec, std::size_t /*bytes_written*/)
+            [self, this](const asio::error_code& ec, std::size_t bytes_written)
             {
+              TRACE_SCOPE("write", _trace_id);
               if (!ec)
               {
                 LOG_INFO("thread{}---worker {} write completed", threadId_to_str(), _worker_id);
+                if (_metrics)
+                {
+                  _metrics->bytes_out.inc(bytes_written);
+                }
+                touch();
                 do_read();  // 继续读取
               }
               else
               {
                 LOG_ERR("worker {} write error: {}", _worker_id, ec.message());
+                if (_metrics)
+                {
+                  _metrics->write_errors.inc();
+                }
               }
             });
       }
 
       void process_data(std::size_t bytes_read)
       {
+        TRACE_SCOPE("process", _trace_id);
         LOG_INFO("worker {} processed {} bytes: {}", _worker_id, bytes_read, std::string(_buffer.data(), bytes_read));
         // 这里可以添加具体的业务逻辑
       }
 
+      void touch()
+      {
+        if (_timeout_manager)
+        {
+          _timeout_manager->touch(_timeout_slot);
+        }
+      }
+
+      // 返回true表示socket已经交出，会话到此结束
+      bool finish_handoff(const asio::error_code& ec)
+      {
+        auto on_released = std::move(_on_handoff);
+        _on_handoff = nullptr;
+        if (ec != asio::error::operation_aborted || _idle_closed)
+        {
+          on_released(std::nullopt);
+          return false;
+        }
+        asio::error_code release_ec;
+        auto handle = _socket.release(release_ec);
+        if (release_ec)
+        {
+          LOG_ERR("worker {} failed to release session: {}", _worker_id, release_ec.message());
+          on_released(std::nullopt);
+          return true;
+        }
+        LOG_INFO("worker {} session with {} handed off", _worker_id, _peer.address().to_string());
+        on_released(handle);
+        return true;
+      }
+
+      // 空闲超时，关闭socket让挂起的读写以operation_aborted结束
+      void close_idle()
+      {
+        _idle_closed = true;
+        asio::error_code ec;
+        _socket.close(ec);
+      }
+
       tcp_socket _socket;
       uint64_t _worker_id;
       std::vector<char> _buffer;
+      tcp_endpoint _peer;
+      std::chrono::steady_clock::time_point _accepted_at;
+      bool _first_read = true;
+      WorkerCounters* _counters;
+      std::shared_ptr<SessionTimeoutManager> _timeout_manager;
+      metrics::ServerMetrics* _metrics;
+      uint64 _trace_id;  // 追踪事件的id，取socket句柄
+      SessionTimeoutManager::SlotId _timeout_slot = SessionTimeoutManager::INVALID_SLOT;
+      bool _idle_closed = false;
+      bool _started = false;
+      bool _reading = false;
+      HandoffCallback _on_handoff;  // 热重启交接中，等读回调确认
     };
 
     // 工作对象
     class Worker
     {
      public:
-      Worker(uint64 id) : _id(id), _ioc(), _work_guard(asio::make_work_guard(_ioc))
+      Worker(
+          uint64 id,
+          std::chrono::milliseconds idle_timeout = std::chrono::milliseconds::zero(),
+          std::shared_ptr<metrics::ServerMetrics> metrics = nullptr)
+        : _id(id)
+        , _metrics(std::move(metrics))
+        , _ioc()
+        , _work_guard(asio::make_work_guard(_ioc))
       {
+        // 每个worker一个清扫定时器，代替每个会话一个定时器
+        if (idle_timeout.count() > 0)
+        {
+          auto tick = std::clamp<std::chrono::milliseconds>(
+              idle_timeout / 8, std::chrono::milliseconds(10), std::chrono::milliseconds(1000));
+          _timeout_manager = std::make_shared<SessionTimeoutManager>(_ioc, idle_timeout, tick);
+        }
+        _lag_monitor = std::make_unique<metrics::LoopLagMonitor>(
+            _ioc, std::format("worker-{}", _id), metrics::LoopLagOptions{}, _metrics ? &_metrics->registry : nullptr);
         LOG_INFO("worker {} has been created", _id);
       }
 
       ~Worker()
       {
         stop();
+        // 定时器依赖_ioc，必须先于_ioc停止; 管理器本身由会话共享，会话全部销毁后才释放
+        if (_timeout_manager)
+        {
+          _timeout_manager->stop();
+        }
         LOG_INFO("worker {} has been destroyed", _id);
       }
 
       void run()
       {
         LOG_INFO("worker {} is running", _id);
+        if (_timeout_manager)
+        {
+          _timeout_manager->start();
+        }
+        _lag_monitor->start();
+        trace::Tracer::instance().set_thread_name(std::format("worker-{}", _id));
         _ioc.run();
         LOG_INFO("worker {} has stopped", _id);
       }
@@ -117,66 +379,208 @@ namespace asio_learn
         _ioc.stop();
       }
 
-      void handle_new_connection(tcp_socket socket)
+      io_context& get_io_context()
+      {
+        return _ioc;
+      }
+
+      // 由master线程调用; socket在accept时就已绑定到本worker的_ioc，无需release()/assign()重新绑定
+      void handle_new_connection(
+          tcp_socket socket,
+          const tcp_endpoint& peer,
+          std::chrono::steady_clock::time_point accepted_at = std::chrono::steady_clock::now())
+      {
+        // 放入无锁收件箱，一批连接只唤醒worker一次
+        _inbox.push(Handoff{ std::move(socket), peer, accepted_at });
+        if (!_drain_scheduled.exchange(true, std::memory_order_seq_cst))
+        {
+          ASIO_HANDLER_LOCATION((__FILE__, __LINE__, __func__));
+          asio::post(_ioc, [this]() { drain_inbox(); });
+        }
+      }
+
+      // 可在任意线程调用
+      WorkerStats stats() const
+      {
+        WorkerStats stats;
+        stats.worker_id = _id;
+        stats.handoffs = _counters.handoffs.load(std::memory_order_relaxed);
+        stats.batches = _counters.batches.load(std::memory_order_relaxed);
+        stats.max_batch = _counters.max_batch.load(std::memory_order_relaxed);
+        stats.handoff_latency_ns_total = _counters.handoff_latency_ns_total.load(std::memory_order_relaxed);
+        stats.handoff_latency_ns_max = _counters.handoff_latency_ns_max.load(std::memory_order_relaxed);
+        stats.first_reads = _counters.first_reads.load(std::memory_order_relaxed);
+        stats.accept_to_first_read_ns_total = _counters.accept_to_first_read_ns_total.load(std::memory_order_relaxed);
+        stats.accept_to_first_read_ns_max = _counters.accept_to_first_read_ns_max.load(std::memory_order_relaxed);
+        stats.active_sessions = _counters.active_sessions.load(std::memory_order_relaxed);
+        auto lag = _lag_monitor->stats();
+        stats.loop_lag_ns_last = lag.lag_ns_last;
+        stats.loop_lag_ns_max = lag.lag_ns_max;
+        stats.pending_handlers = lag.pending_handlers_last;
+        return stats;
+      }
+
+      // 由master线程调用，接管一个从旧进程继承来的连接
+      void adopt_connection(tcp_socket::native_handle_type handle, const tcp_endpoint& peer)
+      {
+        asio::error_code ec;
+        tcp_socket socket(_ioc);
+        socket.assign(peer.protocol(), handle, ec);
+        if (ec)
+        {
+          LOG_ERR("worker {} failed to adopt connection: {}", _id, ec.message());
+          return;
+        }
+        handle_new_connection(std::move(socket), peer);
+      }
+
+      using ReleasedConnections = std::vector<std::pair<tcp_socket::native_handle_type, tcp_endpoint>>;
+
+      // 只能在worker线程调用: 释放所有空闲会话，所有候选会话的读回调都执行后在worker线程调用done
+      void release_idle_sessions(std::function<void(ReleasedConnections)> done)
+      {
+        struct Collect
+        {
+          size_t pending = 0;
+          ReleasedConnections released;
+          std::function<void(ReleasedConnections)> done;
+        };
+        std::vector<std::shared_ptr<Session>> candidates;
+        for (auto& weak : _sessions)
+        {
+          auto session = weak.lock();
+          if (session && session->is_idle())
+          {
+            candidates.push_back(std::move(session));
+          }
+        }
+        if (candidates.empty())
+        {
+          done({});
+          return;
+        }
+        auto collect = std::make_shared<Collect>();
+        collect->pending = candidates.size();
+        collect->done = std::move(done);
+        for (auto& session : candidates)
+        {
+          session->handoff(
+              [collect, peer = session->peer()](std::optional<tcp_socket::native_handle_type> handle)
+              {
+                if (handle)
+                {
+                  collect->released.emplace_back(*handle, peer);
+                }
+                if (--collect->pending == 0)
+                {
+                  collect->done(std::move(collect->released));
+                }
+              });
+        }
+      }
+
+     private:
+      struct Handoff
+      {
+        tcp_socket socket;
+        tcp_endpoint peer;
+        std::chrono::steady_clock::time_point accepted_at;
+      };
+
+      // 在worker线程中批量取出收件箱里的连接
+      void drain_inbox()
       {
-        // 方法1: 使用原始句柄重新绑定 (适用于需要真正转移执行上下文的情况)
-        try
+        uint64 batch = 0;
+        for (;;)
         {
-          // 获取socket的协议信息
-          bool is_v6 = socket.remote_endpoint().address().is_v6();
-          // win8.1之前不支持
-          auto native_handle = socket.release();
-
-          auto worker_socket = tcp_socket(_ioc);
-          // 根据实际协议类型分配
-          if (is_v6)
+          while (auto handoff = _inbox.pop())
           {
-            worker_socket.assign(tcp_socket::protocol_type::v6(), native_handle);
+            auto latency = WorkerCounters::elapsed_ns(handoff->accepted_at);
+            WorkerCounters::add(_counters.handoff_latency_ns_total, latency);
+            WorkerCounters::update_max(_counters.handoff_latency_ns_max, latency);
+            ++batch;
+            auto session = std::make_shared<Session>(
+                std::move(handoff->socket),
+                _id,
+                handoff->peer,
+                handoff->accepted_at,
+                &_counters,
+                _timeout_manager,
+                _metrics.get());
+            session->start();
+            track_session(session);
           }
-          else
+          // 先清除标志再检查一次，防止与正在push的生产者错过唤醒
+          _drain_scheduled.store(false, std::memory_order_seq_cst);
+          if (_inbox.empty() || _drain_scheduled.exchange(true, std::memory_order_seq_cst))
           {
-            worker_socket.assign(tcp_socket::protocol_type::v4(), native_handle);
+            break;
           }
-
-          // 创建会话并在 worker 的 io_context 中处理
-          auto session = std::make_shared<Session>(std::move(worker_socket), _id);
-          asio::post(_ioc, [session]() { session->start(); });
         }
-        catch (const std::exception& e)
+        WorkerCounters::add(_counters.handoffs, batch);
+        WorkerCounters::add(_counters.batches, 1);
+        WorkerCounters::update_max(_counters.max_batch, batch);
+      }
+
+      // 会话登记表只在热重启时遍历，这里按容量翻倍的节奏清理已结束的会话，均摊O(1)
+      void track_session(const std::shared_ptr<Session>& session)
+      {
+        if (_sessions.size() >= _sessions_prune_threshold)
         {
-          LOG_ERR("worker {} failed to handle new connection: {}", _id, e.what());
+          std::erase_if(_sessions, [](const std::weak_ptr<Session>& s) { return s.expired(); });
+          _sessions_prune_threshold = std::max<size_t>(1024, _sessions.size() * 2);
         }
-
-        /*
-        // 方法2: 简化版本 - 直接使用原socket，但在worker线程中处理
-        // (socket仍绑定到master的io_context，但业务逻辑在worker线程执行)
-        auto session = std::make_shared<Session>(std::move(socket), _id);
-        asio::post(_ioc, [session]() {
-          session->start();
-        });
-        */
+        _sessions.push_back(session);
       }
 
      private:
       uint64 _id;
+      // 会话持有裸指针，必须声明在_ioc之前，保证比会话活得久
+      WorkerCounters _counters;
+      std::shared_ptr<metrics::ServerMetrics> _metrics;
       io_context _ioc;
       // 守护_ioc不退出
       asio::executor_work_guard<asio::io_context::executor_type> _work_guard;
+      // 空闲超时管理，idle_timeout为0时不启用
+      std::shared_ptr<SessionTimeoutManager> _timeout_manager;
+      // 定时器依赖_ioc，声明在_ioc之后
+      std::unique_ptr<metrics::LoopLagMonitor> _lag_monitor;
+      // master -> worker 的连接收件箱
+      MpscQueue<Handoff> _inbox;
+      std::atomic<bool> _drain_scheduled{ false };
+      // 本worker上的会话，只在worker线程访问
+      std::vector<std::weak_ptr<Session>> _sessions;
+      size_t _sessions_prune_threshold = 1024;
     };
   }  // namespace details
 
   class MasterWorkerTcpServer
   {
    public:
-    MasterWorkerTcpServer(const tcp_endpoint& endpoint, size_t worker_count) 
+    // idle_timeout: 会话空闲超时时间，为0表示不启用
+    // hot_restart: 热重启配置，control_path为空表示不启用
+    // metrics: 为空表示不统计
+    MasterWorkerTcpServer(
+        const tcp_endpoint& endpoint,
+        size_t worker_count,
+        std::chrono::milliseconds idle_timeout = std::chrono::milliseconds::zero(),
+        HotRestartOptions hot_restart = {},
+        std::shared_ptr<metrics::ServerMetrics> metrics = nullptr)
       : _ioc()
       , _acceptor(_ioc)  // 只在初始化列表中创建 acceptor
       , _next_worker_id(0)
+      , _idle_timeout(idle_timeout)
+      , _hot_restart(std::move(hot_restart))
+      , _drain_timer(_ioc)
+      , _metrics(std::move(metrics))
     {
       try {
         // 在构造函数体中进行配置，避免初始化列表中的复杂操作
+        _lag_monitor = std::make_unique<metrics::LoopLagMonitor>(
+            _ioc, "master", metrics::LoopLagOptions{}, _metrics ? &_metrics->registry : nullptr);
         initialize_acceptor(endpoint);
         initialize_workers(worker_count);
+        adopt_inherited_connections();
         
         LOG_INFO("MasterWorkerTcpServer initialized successfully");
       }
@@ -197,7 +601,10 @@ namespace asio_learn
     {
       try {
         LOG_INFO("Starting to accept connections...");
+        start_control_listener();
         do_accept();  // 在 run 中启动 accept，而不是构造函数中
+        _lag_monitor->start();
+        trace::Tracer::instance().set_thread_name("master");
         _ioc.run();
       }
       catch (const std::exception& e) {
@@ -205,6 +612,18 @@ namespace asio_learn
         throw;
       }
     }
+    // 各worker收件箱统计，可在任意线程调用
+    std::vector<details::WorkerStats> worker_stats() const
+    {
+      std::vector<details::WorkerStats> stats;
+      stats.reserve(_workers.size());
+      for (const auto& worker : _workers)
+      {
+        stats.push_back(worker->stats());
+      }
+      return stats;
+    }
+
     void stop()
     {
       LOG_INFO("Stopping MasterWorkerTcpServer...");
@@ -215,6 +634,22 @@ namespace asio_learn
    private:
     void initialize_acceptor(const tcp_endpoint& endpoint)
     {
+#ifdef ASIO_LEARN_HAS_HOT_RESTART
+      // 有旧进程在运行时直接继承它的监听socket，不重新bind
+      if (!_hot_restart.control_path.empty())
+      {
+        if (auto inherited = ipc::hot_restart_inherit(
+                _hot_restart.control_path, _hot_restart.handoff_idle_connections, _hot_restart.handshake_timeout))
+        {
+          _acceptor.assign(endpoint.protocol(), inherited->listener_fd);
+          _inherited_connections = std::move(inherited->connections);
+          LOG_INFO(
+              "Acceptor inherited from previous process, {} idle connections handed over",
+              _inherited_connections.size());
+          return;
+        }
+      }
+#endif
       // 分步骤初始化 acceptor，便于错误处理
       _acceptor.open(endpoint.protocol());
       
@@ -240,7 +675,7 @@ namespace asio_learn
       
       for (size_t i = 0; i < worker_count; ++i)
       {
-        auto worker = std::make_shared<details::Worker>(i);
+        auto worker = std::make_shared<details::Worker>(i, _idle_timeout, _metrics);
         _workers.push_back(worker);
         _worker_threads.emplace_back([worker]() { worker->run(); });
       }
@@ -248,6 +683,179 @@ namespace asio_learn
       LOG_INFO("Created {} worker threads", worker_count);
     }
     
+    // 把从旧进程继承来的空闲连接分给各worker
+    void adopt_inherited_connections()
+    {
+      for (auto& [handle, peer] : _inherited_connections)
+      {
+        _workers[_next_worker_id++ % _workers.size()]->adopt_connection(handle, peer);
+      }
+      _inherited_connections.clear();
+    }
+
+    // 监听控制套接字，等待下一个新进程来接管
+    void start_control_listener()
+    {
+#ifdef ASIO_LEARN_HAS_HOT_RESTART
+      if (_hot_restart.control_path.empty())
+      {
+        return;
+      }
+      ::unlink(_hot_restart.control_path.c_str());
+      _control_acceptor = std::make_unique<asio::local::stream_protocol::acceptor>(
+          _ioc, asio::local::stream_protocol::endpoint(_hot_restart.control_path));
+      LOG_INFO("Hot restart control socket listening on {}", _hot_restart.control_path);
+      do_accept_control();
+#else
+      if (!_hot_restart.control_path.empty())
+      {
+        LOG_WARN("hot restart is not supported on this platform, ignore control_path");
+      }
+#endif
+    }
+
+#ifdef ASIO_LEARN_HAS_HOT_RESTART
+    void do_accept_control()
+    {
+      _control_acceptor->async_accept(
+          [this](const asio::error_code& ec, asio::local::stream_protocol::socket socket)
+          {
+            if (ec)
+            {
+              if (!_draining)
+              {
+                LOG_ERR("hot restart control accept error: {}", ec.message());
+                do_accept_control();
+              }
+              return;
+            }
+            handle_restart_request(
+                std::make_shared<ipc::HotRestartChannel>(std::move(socket), _hot_restart.handshake_timeout));
+          });
+    }
+
+    // 旧进程一侧: 交出监听socket(和空闲连接)，然后进入排空阶段
+    // 交接全程异步，新进程慢或者卡住时master照常accept，超过handshake_timeout放弃
+    void handle_restart_request(std::shared_ptr<ipc::HotRestartChannel> channel)
+    {
+      channel->async_receive_request(
+          [this, channel](bool ok, const ipc::HotRestartMessage& request)
+          {
+            if (!ok)
+            {
+              LOG_ERR("invalid hot restart request, ignore it");
+              do_accept_control();
+              return;
+            }
+            bool want_connections = request.want_connections != 0;
+            channel->enqueue(ipc::HOT_RESTART_LISTENER, _acceptor.native_handle());
+            channel->async_flush(
+                [this, channel, want_connections](bool ok)
+                {
+                  if (!ok)
+                  {
+                    LOG_ERR("failed to hand over listener");
+                    do_accept_control();
+                    return;
+                  }
+                  LOG_INFO("Listener handed over to new process, start draining");
+                  _draining = true;
+                  asio::error_code ec;
+                  _control_acceptor->close(ec);
+                  _acceptor.close(ec);
+                  if (want_connections)
+                  {
+                    hand_over_idle_sessions(channel);
+                  }
+                  else
+                  {
+                    finish_restart(channel, 0);
+                  }
+                });
+          });
+    }
+
+    // 让每个worker在自己的线程里释放空闲会话，全部返回后统一发送
+    void hand_over_idle_sessions(std::shared_ptr<ipc::HotRestartChannel> channel)
+    {
+      using Released = details::Worker::ReleasedConnections;
+      auto pending = std::make_shared<size_t>(_workers.size());
+      auto released = std::make_shared<Released>();
+      // 两个acceptor都已关闭，等worker返回期间master的ioc上没有其他任务，需要保持run()不退出
+      auto guard = std::make_shared<asio::executor_work_guard<io_context::executor_type>>(_ioc.get_executor());
+      for (auto& worker : _workers)
+      {
+        asio::post(
+            worker->get_io_context(),
+            [this, worker, pending, released, channel, guard]()
+            {
+              worker->release_idle_sessions(
+                  [this, pending, released, channel, guard](Released mine)
+                  {
+                    asio::post(
+                        _ioc,
+                        [this, mine = std::move(mine), pending, released, channel, guard]() mutable
+                        {
+                          released->insert(released->end(), mine.begin(), mine.end());
+                          if (--*pending != 0)
+                          {
+                            return;
+                          }
+                          for (auto& [handle, peer] : *released)
+                          {
+                            channel->enqueue(ipc::HOT_RESTART_CONNECTION, handle, &peer, true);
+                          }
+                          finish_restart(channel, released->size());
+                        });
+                  });
+            });
+      }
+    }
+
+    void finish_restart(std::shared_ptr<ipc::HotRestartChannel> channel, size_t connections)
+    {
+      channel->enqueue(ipc::HOT_RESTART_DONE);
+      channel->async_flush(
+          [this, channel, connections](bool ok)
+          {
+            if (ok)
+            {
+              LOG_INFO("{} idle connections handed over to new process", connections);
+            }
+            else
+            {
+              LOG_ERR("hot restart handshake broken, connections not yet sent are closed");
+            }
+            wait_drained(std::chrono::steady_clock::now() + _hot_restart.drain_timeout);
+          });
+    }
+
+    // 等待剩余会话结束或超时后退出
+    void wait_drained(std::chrono::steady_clock::time_point deadline)
+    {
+      uint64 active = 0;
+      for (const auto& stats : worker_stats())
+      {
+        active += stats.active_sessions;
+      }
+      if (active == 0 || std::chrono::steady_clock::now() >= deadline)
+      {
+        LOG_INFO("Drain finished with {} sessions left, exiting", active);
+        stop();
+        return;
+      }
+      _drain_timer.expires_after(std::chrono::milliseconds(100));
+      _drain_timer.async_wait(
+          [this, deadline](const asio::error_code& ec)
+          {
+            if (!ec)
+            {
+              wait_drained(deadline);
+            }
+          });
+    }
+#endif
+
     void cleanup()
     {
       // 清理资源
@@ -271,16 +879,30 @@ namespace asio_learn
    
     void do_accept()
     {
+      // 先选好worker，直接在worker的io_context上accept，socket生来就属于worker
+      auto worker = _workers[_next_worker_id++ % _workers.size()];
+      ASIO_HANDLER_LOCATION((__FILE__, __LINE__, __func__));
       _acceptor.async_accept(
-          [this](std::error_code ec, tcp_socket socket)
+          worker->get_io_context(),
+          _peer_endpoint,
+          [this, worker](std::error_code ec, tcp_socket socket)
           {
+            TRACE_SCOPE("accept", socket.native_handle());
             if (!ec)
             {
-                LOG_INFO("thread{}---Accepted connection from {}", threadId_to_str(), socket.remote_endpoint().address().to_string());
-              // 分配给下一个worker
-              auto& worker = _workers[_next_worker_id++ % _workers.size()];
+              auto accepted_at = std::chrono::steady_clock::now();
+              LOG_INFO("thread{}---Accepted connection from {}", threadId_to_str(), _peer_endpoint.address().to_string());
+              if (_metrics)
+              {
+                _metrics->accepts.inc();
+              }
               // 让工作线程去处理
-              worker->handle_new_connection(std::move(socket));
+              worker->handle_new_connection(std::move(socket), _peer_endpoint, accepted_at);
+            }
+            else if (_draining)
+            {
+              // 监听socket已交给新进程
+              return;
             }
             else
             {
@@ -299,6 +921,20 @@ namespace asio_learn
     std::vector<std::shared_ptr<details::Worker>> _workers;
     std::vector<std::thread> _worker_threads;
     std::atomic<uint64> _next_worker_id;
+    std::chrono::milliseconds _idle_timeout;
+    // 同一时刻只有一个accept在进行，对端地址由accept直接填充
+    tcp_endpoint _peer_endpoint;
+    // 热重启
+    HotRestartOptions _hot_restart;
+    std::vector<std::pair<tcp_socket::native_handle_type, tcp_endpoint>> _inherited_connections;
+    steady_timer _drain_timer;
+    bool _draining = false;
+    std::shared_ptr<metrics::ServerMetrics> _metrics;
+    // master循环的延迟探针，worker各自有一个
+    std::unique_ptr<metrics::LoopLagMonitor> _lag_monitor;
+#ifdef ASIO_LEARN_HAS_HOT_RESTART
+    std::unique_ptr<asio::local::stream_protocol::acceptor> _control_acceptor;
+#endif
   };
 }  // namespace asio_learn
 #endif  // ASIO_LEARN_TCP_SERVER_MASTER_WORKER_HPP
\ No newline at end of file
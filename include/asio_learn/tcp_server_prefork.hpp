@@ -0,0 +1,761 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 16:33:13
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:07:59
+ * @FilePath: \asio-learn-code\include\asio_learn\tcp_server_prefork.hpp
+ * @Description: 多进程(prefork)tcp服务器，master进程accept后通过SCM_RIGHTS把连接交给子进程
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_TCP_SERVER_PREFORK_HPP
+#define ASIO_LEARN_TCP_SERVER_PREFORK_HPP
+
+#ifndef __linux__
+#error "PreforkTcpServer is only supported on Linux"
+#endif
+
+#include <signal.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "asio_learn/SessionTimeoutManager.hpp"
+#include "asio_learn/fd_passing.hpp"
+#include "asio_learn/public.hpp"
+#include "asio_learn/tcp_server_master_worker.hpp"
+#include "common/Log.hpp"
+
+extern char** environ;
+
+/**
+ * 进程模型:
+ * - master进程只负责accept，按子进程上报的负载选择最空闲的子进程，通过socketpair(SCM_RIGHTS)把连接fd发过去
+ * - 子进程由 posix_spawn 重新执行当前程序启动(不是裸fork)，日志线程池等状态都是干净的，
+ *   程序入口需要先判断 PreforkTcpServer::is_child() 并调用 run_child()
+ * - 子进程内部就是一个单线程的Worker式reactor，复用 details::Session 和 SessionTimeoutManager
+ * - 子进程每秒上报一次负载；子进程崩溃只影响它自己的连接，master收到SIGCHLD后重新拉起
+ */
+
+namespace asio_learn
+{
+  namespace details
+  {
+    // 子进程端的通道描述符固定为3
+    constexpr int PREFORK_CHANNEL_FD = 3;
+    constexpr const char* PREFORK_CHILD_ENV = "ASIO_LEARN_PREFORK_CHILD";
+    constexpr const char* PREFORK_IDLE_ENV = "ASIO_LEARN_PREFORK_IDLE_MS";
+    constexpr uint32 PREFORK_HANDOFF_MAGIC = 0x50464b48;  // "PFKH"
+    constexpr uint32 PREFORK_REPORT_MAGIC = 0x50464b52;   // "PFKR"
+    // stop()时等子进程退出的宽限期，超过后SIGKILL
+    constexpr std::chrono::seconds PREFORK_STOP_GRACE{ 5 };
+
+    // master -> child, 随连接fd一起发送
+    struct PreforkHandoff
+    {
+      uint32 magic = PREFORK_HANDOFF_MAGIC;
+      ipc::PeerAddress peer;
+      int64_t accepted_at_ns = 0;  // steady_clock(CLOCK_MONOTONIC)，跨进程可比
+    };
+
+    // child -> master, 负载上报
+    struct PreforkReport
+    {
+      uint32 magic = PREFORK_REPORT_MAGIC;
+      uint32 active = 0;          // 当前活跃连接数
+      uint64 accepted_total = 0;  // 累计收到的连接数
+    };
+
+    // 子进程reactor
+    class PreforkChild
+    {
+     public:
+      PreforkChild(uint64 index, int channel_fd, std::chrono::milliseconds idle_timeout)
+        : _index(index)
+        , _ioc()
+        , _channel(_ioc, channel_fd)
+        , _report_timer(_ioc)
+        , _signals(_ioc, SIGINT, SIGTERM)
+      {
+        if (idle_timeout.count() > 0)
+        {
+          auto tick = std::clamp<std::chrono::milliseconds>(
+              idle_timeout / 8, std::chrono::milliseconds(10), std::chrono::milliseconds(1000));
+          _timeout_manager = std::make_shared<SessionTimeoutManager>(_ioc, idle_timeout, tick);
+        }
+      }
+
+      ~PreforkChild()
+      {
+        if (_timeout_manager)
+        {
+          _timeout_manager->stop();
+        }
+      }
+
+      int run()
+      {
+        LOG_INFO("prefork child {} (pid {}) is running", _index, ::getpid());
+        _signals.async_wait([this](const asio::error_code& ec, int) {
+          if (!ec)
+          {
+            stop();
+          }
+        });
+        if (_timeout_manager)
+        {
+          _timeout_manager->start();
+        }
+        wait_channel();
+        schedule_report();
+        _ioc.run();
+        LOG_INFO("prefork child {} (pid {}) has stopped", _index, ::getpid());
+        return 0;
+      }
+
+     private:
+      void stop()
+      {
+        _stopped = true;
+        _ioc.stop();
+      }
+
+      void wait_channel()
+      {
+        _channel.async_wait(
+            asio::posix::stream_descriptor::wait_read,
+            [this](const asio::error_code& ec)
+            {
+              if (ec)
+              {
+                return;
+              }
+              drain_channel();
+              if (!_stopped)
+              {
+                wait_channel();
+              }
+            });
+      }
+
+      // 一次唤醒尽量把通道里的连接都取完
+      void drain_channel()
+      {
+        for (;;)
+        {
+          PreforkHandoff msg;
+          int fd = -1;
+          ssize_t n = ipc::recv_fd(_channel.native_handle(), fd, &msg, sizeof(msg));
+          if (n == 0)
+          {
+            LOG_WARN("prefork child {} lost master, exiting", _index);
+            stop();
+            return;
+          }
+          if (n < 0)
+          {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+              LOG_ERR("prefork child {} recv error: {}", _index, std::strerror(errno));
+              stop();
+            }
+            return;
+          }
+          if (fd < 0)
+          {
+            continue;
+          }
+          if (n != static_cast<ssize_t>(sizeof(msg)) || msg.magic != PREFORK_HANDOFF_MAGIC)
+          {
+            LOG_ERR("prefork child {} received a malformed handoff", _index);
+            ::close(fd);
+            continue;
+          }
+          start_session(fd, msg);
+        }
+      }
+
+      void start_session(int fd, const PreforkHandoff& msg)
+      {
+        tcp_endpoint peer = ipc::decode_peer(msg.peer);
+        asio::error_code ec;
+        tcp_socket socket(_ioc);
+        socket.assign(peer.protocol(), fd, ec);
+        if (ec)
+        {
+          LOG_ERR("prefork child {} failed to assign socket: {}", _index, ec.message());
+          ::close(fd);
+          return;
+        }
+
+        auto accepted_at = std::chrono::steady_clock::time_point(std::chrono::nanoseconds(msg.accepted_at_ns));
+        auto session =
+            std::make_shared<Session>(std::move(socket), _index, peer, accepted_at, &_counters, _timeout_manager);
+        session->start();
+        _sessions.push_back(session);
+        ++_accepted_total;
+      }
+
+      void schedule_report()
+      {
+        _report_timer.expires_after(std::chrono::seconds(1));
+        _report_timer.async_wait(
+            [this](const asio::error_code& ec)
+            {
+              if (ec)
+              {
+                return;
+              }
+              report_load();
+              schedule_report();
+            });
+      }
+
+      void report_load()
+      {
+        // 顺便清理已经结束的会话
+        std::erase_if(_sessions, [](const std::weak_ptr<Session>& s) { return s.expired(); });
+        PreforkReport report;
+        report.active = static_cast<uint32>(_sessions.size());
+        report.accepted_total = _accepted_total;
+        // 上报失败(master繁忙)就等下一次
+        ::send(_channel.native_handle(), &report, sizeof(report), MSG_DONTWAIT | MSG_NOSIGNAL);
+      }
+
+     private:
+      uint64 _index;
+      // 会话持有裸指针，必须声明在_ioc之前
+      WorkerCounters _counters;
+      io_context _ioc;
+      asio::posix::stream_descriptor _channel;
+      steady_timer _report_timer;
+      asio::signal_set _signals;
+      std::shared_ptr<SessionTimeoutManager> _timeout_manager;
+      std::vector<std::weak_ptr<Session>> _sessions;
+      uint64 _accepted_total = 0;
+      bool _stopped = false;
+    };
+  }  // namespace details
+
+  class PreforkTcpServer
+  {
+   public:
+    // master视角的子进程状态
+    struct ChildStats
+    {
+      uint64 index = 0;
+      pid_t pid = -1;
+      bool alive = false;
+      uint64 active = 0;          // 最近一次上报的活跃连接数
+      uint64 dispatched = 0;      // master已派发的连接数
+      uint64 accepted = 0;        // 子进程已确认收到的连接数
+      uint64 restarts = 0;        // 被重新拉起的次数
+    };
+
+    // idle_timeout: 子进程中会话的空闲超时，为0表示不启用
+    PreforkTcpServer(
+        const tcp_endpoint& endpoint,
+        size_t child_count,
+        std::chrono::milliseconds idle_timeout = std::chrono::milliseconds::zero())
+      : _ioc()
+      , _acceptor(_ioc)
+      , _child_signals(_ioc, SIGCHLD)
+      , _stop_signals(_ioc, SIGINT, SIGTERM)
+      , _stats_timer(_ioc)
+      , _idle_timeout(idle_timeout)
+    {
+      if (child_count == 0)
+      {
+        LOG_WARN("param child_count is invalid, use the default value");
+        child_count = std::thread::hardware_concurrency() == 0 ? 4 : std::thread::hardware_concurrency();
+      }
+      _children.resize(child_count);
+
+      _acceptor.open(endpoint.protocol());
+      // 子进程由posix_spawn重新exec，不加FD_CLOEXEC每个子进程都会带着一份监听socket;
+      // accept到的连接在同一个回调里发给子进程后就关闭，期间不会spawn
+      if (!ipc::set_cloexec(_acceptor.native_handle()))
+      {
+        LOG_WARN("failed to set FD_CLOEXEC on prefork acceptor: {}", std::strerror(errno));
+      }
+      _acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+      _acceptor.bind(endpoint);
+      _acceptor.listen();
+      LOG_INFO("Prefork acceptor bound to {}:{}", endpoint.address().to_string(), endpoint.port());
+    }
+
+    ~PreforkTcpServer()
+    {
+      stop();
+    }
+
+    // 程序入口先调用，判断当前进程是否是被master拉起的子进程
+    static bool is_child()
+    {
+      return std::getenv(details::PREFORK_CHILD_ENV) != nullptr;
+    }
+
+    // 子进程入口，日志需要在调用前初始化
+    static int run_child()
+    {
+      uint64 index = std::strtoull(std::getenv(details::PREFORK_CHILD_ENV), nullptr, 10);
+      std::chrono::milliseconds idle_timeout{ 0 };
+      if (const char* idle = std::getenv(details::PREFORK_IDLE_ENV))
+      {
+        idle_timeout = std::chrono::milliseconds(std::strtoll(idle, nullptr, 10));
+      }
+      details::PreforkChild child(index, details::PREFORK_CHANNEL_FD, idle_timeout);
+      return child.run();
+    }
+
+    void run()
+    {
+      for (size_t i = 0; i < _children.size(); ++i)
+      {
+        spawn_child(i);
+      }
+      wait_child_signal();
+      _stop_signals.async_wait([this](const asio::error_code& ec, int) {
+        if (!ec)
+        {
+          stop();
+        }
+      });
+      schedule_stats_log();
+      LOG_INFO("Prefork master (pid {}) starting to accept connections...", ::getpid());
+      do_accept();
+      _ioc.run();
+    }
+
+    void stop()
+    {
+      if (_stopping)
+      {
+        return;
+      }
+      _stopping = true;
+      LOG_INFO("Stopping PreforkTcpServer...");
+      asio::error_code ec;
+      _acceptor.close(ec);
+      for (auto& child : _children)
+      {
+        if (child.pid > 0)
+        {
+          ::kill(child.pid, SIGTERM);
+        }
+      }
+      // 卡住的子进程不能拖住退出: 宽限期内等不到就SIGKILL
+      if (!reap_all_until(std::chrono::steady_clock::now() + details::PREFORK_STOP_GRACE))
+      {
+        for (auto& child : _children)
+        {
+          if (child.pid > 0)
+          {
+            LOG_WARN("prefork child pid {} did not exit in time, kill it", child.pid);
+            ::kill(child.pid, SIGKILL);
+          }
+        }
+        reap_all_until(std::chrono::steady_clock::now() + details::PREFORK_STOP_GRACE);
+      }
+      for (auto& child : _children)
+      {
+        close_channel(child);
+      }
+      _ioc.stop();
+    }
+
+    // 只能在master的io_context线程调用
+    std::vector<ChildStats> child_stats() const
+    {
+      std::vector<ChildStats> stats;
+      stats.reserve(_children.size());
+      for (size_t i = 0; i < _children.size(); ++i)
+      {
+        const auto& child = _children[i];
+        ChildStats s;
+        s.index = i;
+        s.pid = child.pid;
+        s.alive = child.alive;
+        s.active = child.active;
+        s.dispatched = child.dispatched;
+        s.accepted = child.accepted;
+        s.restarts = child.restarts;
+        stats.push_back(s);
+      }
+      return stats;
+    }
+
+   private:
+    struct Child
+    {
+      pid_t pid = -1;
+      bool alive = false;
+      std::unique_ptr<asio::posix::stream_descriptor> channel;
+      std::unique_ptr<steady_timer> respawn_timer;
+      uint64 active = 0;
+      uint64 dispatched = 0;
+      uint64 accepted = 0;
+      uint64 restarts = 0;
+    };
+
+    // 读取/proc/self/cmdline，子进程使用和master相同的参数启动
+    static std::vector<std::string> self_cmdline()
+    {
+      std::vector<std::string> args;
+      std::ifstream in("/proc/self/cmdline", std::ios::binary);
+      std::string arg;
+      while (std::getline(in, arg, '\0'))
+      {
+        args.push_back(arg);
+      }
+      return args;
+    }
+
+    void spawn_child(size_t index)
+    {
+      auto& child = _children[index];
+      int sv[2];
+      if (::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) != 0)
+      {
+        LOG_ERR("socketpair failed: {}", std::strerror(errno));
+        schedule_respawn(index);
+        return;
+      }
+
+      // 子进程端dup2到固定的描述符上，dup2会清除 FD_CLOEXEC
+      posix_spawn_file_actions_t actions;
+      posix_spawn_file_actions_init(&actions);
+      posix_spawn_file_actions_adddup2(&actions, sv[1], details::PREFORK_CHANNEL_FD);
+
+      auto args = self_cmdline();
+      std::vector<char*> argv;
+      for (auto& arg : args)
+      {
+        argv.push_back(arg.data());
+      }
+      argv.push_back(nullptr);
+
+      std::vector<std::string> env_storage;
+      for (char** e = environ; *e != nullptr; ++e)
+      {
+        if (std::strncmp(*e, "ASIO_LEARN_PREFORK_", 19) != 0)
+        {
+          env_storage.emplace_back(*e);
+        }
+      }
+      env_storage.push_back(std::string(details::PREFORK_CHILD_ENV) + "=" + std::to_string(index));
+      env_storage.push_back(std::string(details::PREFORK_IDLE_ENV) + "=" + std::to_string(_idle_timeout.count()));
+      std::vector<char*> envp;
+      for (auto& e : env_storage)
+      {
+        envp.push_back(e.data());
+      }
+      envp.push_back(nullptr);
+
+      pid_t pid = -1;
+      int rc = ::posix_spawn(&pid, "/proc/self/exe", &actions, nullptr, argv.data(), envp.data());
+      posix_spawn_file_actions_destroy(&actions);
+      ::close(sv[1]);
+      if (rc != 0)
+      {
+        LOG_ERR("posix_spawn child {} failed: {}", index, std::strerror(rc));
+        ::close(sv[0]);
+        schedule_respawn(index);
+        return;
+      }
+
+      child.pid = pid;
+      child.alive = true;
+      child.active = 0;
+      child.dispatched = 0;
+      child.accepted = 0;
+      child.channel = std::make_unique<asio::posix::stream_descriptor>(_ioc, sv[0]);
+      child.channel->non_blocking(true);
+      LOG_INFO("prefork child {} spawned with pid {}", index, pid);
+      wait_report(index, pid);
+    }
+
+    void wait_report(size_t index, pid_t pid)
+    {
+      auto& child = _children[index];
+      child.channel->async_wait(
+          asio::posix::stream_descriptor::wait_read,
+          [this, index, pid](const asio::error_code& ec)
+          {
+            auto& child = _children[index];
+            // 子进程已被替换，忽略旧通道的回调
+            if (ec || child.pid != pid || !child.channel)
+            {
+              return;
+            }
+            for (;;)
+            {
+              details::PreforkReport report;
+              ssize_t n = ::recv(child.channel->native_handle(), &report, sizeof(report), MSG_DONTWAIT);
+              if (n < 0 && errno == EINTR)
+              {
+                continue;
+              }
+              if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+              {
+                break;
+              }
+              if (n <= 0)
+              {
+                // 子进程退出，或者通道出错(比如子进程崩溃时的ECONNRESET)，socket会一直可读，不能再等它;
+                // 等SIGCHLD回收并重启
+                if (n < 0)
+                {
+                  LOG_WARN("prefork child {} report channel failed: {}", index, std::strerror(errno));
+                }
+                child.alive = false;
+                close_channel(child);
+                return;
+              }
+              if (n == static_cast<ssize_t>(sizeof(report)) && report.magic == details::PREFORK_REPORT_MAGIC)
+              {
+                child.active = report.active;
+                child.accepted = report.accepted_total;
+              }
+            }
+            wait_report(index, pid);
+          });
+    }
+
+    void wait_child_signal()
+    {
+      _child_signals.async_wait(
+          [this](const asio::error_code& ec, int)
+          {
+            if (ec)
+            {
+              return;
+            }
+            reap_children();
+            wait_child_signal();
+          });
+    }
+
+    void reap_children()
+    {
+      int status = 0;
+      pid_t pid;
+      while ((pid = ::waitpid(-1, &status, WNOHANG)) > 0)
+      {
+        for (size_t i = 0; i < _children.size(); ++i)
+        {
+          auto& child = _children[i];
+          if (child.pid != pid)
+          {
+            continue;
+          }
+          if (WIFSIGNALED(status))
+          {
+            LOG_ERR("prefork child {} (pid {}) killed by signal {}", i, pid, WTERMSIG(status));
+          }
+          else
+          {
+            LOG_WARN("prefork child {} (pid {}) exited with status {}", i, pid, WEXITSTATUS(status));
+          }
+          child.pid = -1;
+          child.alive = false;
+          close_channel(child);
+          schedule_respawn(i);
+        }
+      }
+    }
+
+    // 不阻塞地回收子进程直到全部退出或者超过deadline，返回是否全部回收
+    bool reap_all_until(std::chrono::steady_clock::time_point deadline)
+    {
+      for (;;)
+      {
+        bool remaining = false;
+        for (auto& child : _children)
+        {
+          if (child.pid <= 0)
+          {
+            continue;
+          }
+          pid_t rc = ::waitpid(child.pid, nullptr, WNOHANG);
+          if (rc == child.pid || (rc < 0 && errno == ECHILD))
+          {
+            child.pid = -1;
+            child.alive = false;
+          }
+          else
+          {
+            remaining = true;
+          }
+        }
+        if (!remaining)
+        {
+          return true;
+        }
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+          return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+    }
+
+    // 延迟重启，防止子进程启动即崩溃时疯狂fork
+    void schedule_respawn(size_t index)
+    {
+      if (_stopping)
+      {
+        return;
+      }
+      auto& child = _children[index];
+      ++child.restarts;
+      child.respawn_timer = std::make_unique<steady_timer>(_ioc, std::chrono::milliseconds(200));
+      child.respawn_timer->async_wait(
+          [this, index](const asio::error_code& ec)
+          {
+            if (!ec && !_stopping)
+            {
+              spawn_child(index);
+            }
+          });
+    }
+
+    void close_channel(Child& child)
+    {
+      if (child.channel)
+      {
+        asio::error_code ec;
+        child.channel->close(ec);
+        child.channel.reset();
+      }
+    }
+
+    // 负载 = 上报的活跃连接 + 已派发但子进程还没确认的连接
+    Child* pick_child(const std::vector<bool>& skip)
+    {
+      Child* best = nullptr;
+      uint64 best_load = 0;
+      for (size_t i = 0; i < _children.size(); ++i)
+      {
+        auto& child = _children[i];
+        if (skip[i] || !child.alive || !child.channel)
+        {
+          continue;
+        }
+        uint64 in_flight = child.dispatched > child.accepted ? child.dispatched - child.accepted : 0;
+        uint64 load = child.active + in_flight;
+        if (best == nullptr || load < best_load)
+        {
+          best = &child;
+          best_load = load;
+        }
+      }
+      return best;
+    }
+
+    void do_accept()
+    {
+      _acceptor.async_accept(
+          _peer_endpoint,
+          [this](const asio::error_code& ec, tcp_socket socket)
+          {
+            if (_stopping)
+            {
+              return;
+            }
+            if (!ec)
+            {
+              dispatch(std::move(socket));
+            }
+            else
+            {
+              LOG_ERR("Accept error: {}", ec.message());
+            }
+            do_accept();
+          });
+    }
+
+    void dispatch(tcp_socket socket)
+    {
+      details::PreforkHandoff msg;
+      msg.peer = ipc::encode_peer(_peer_endpoint);
+      msg.accepted_at_ns =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+              .count();
+
+      // 最多尝试所有子进程一轮，某个子进程通道满了就换下一个
+      std::vector<bool> skip(_children.size(), false);
+      for (size_t attempt = 0; attempt < _children.size(); ++attempt)
+      {
+        Child* child = pick_child(skip);
+        if (child == nullptr)
+        {
+          break;
+        }
+        if (ipc::send_fd(child->channel->native_handle(), socket.native_handle(), &msg, sizeof(msg)) >= 0)
+        {
+          ++child->dispatched;
+          // master这一份直接关闭，连接由子进程持有
+          asio::error_code ec;
+          socket.close(ec);
+          return;
+        }
+        LOG_WARN("send fd to child pid {} failed: {}", child->pid, std::strerror(errno));
+        // 本轮不再选它
+        skip[static_cast<size_t>(child - _children.data())] = true;
+      }
+      LOG_ERR("no prefork child available, drop connection from {}", _peer_endpoint.address().to_string());
+      asio::error_code ec;
+      socket.close(ec);
+    }
+
+    void schedule_stats_log()
+    {
+      _stats_timer.expires_after(std::chrono::seconds(10));
+      _stats_timer.async_wait(
+          [this](const asio::error_code& ec)
+          {
+            if (ec)
+            {
+              return;
+            }
+            for (const auto& s : child_stats())
+            {
+              LOG_INFO(
+                  "prefork child {} pid {} alive {} active {} dispatched {} restarts {}",
+                  s.index,
+                  s.pid,
+                  s.alive,
+                  s.active,
+                  s.dispatched,
+                  s.restarts);
+            }
+            schedule_stats_log();
+          });
+    }
+
+   private:
+    io_context _ioc;
+    tcp_acceptor _acceptor;
+    asio::signal_set _child_signals;
+    asio::signal_set _stop_signals;
+    steady_timer _stats_timer;
+    std::chrono::milliseconds _idle_timeout;
+    std::vector<Child> _children;
+    tcp_endpoint _peer_endpoint;
+    bool _stopping = false;
+  };
+}  // namespace asio_learn
+
+#endif  // ASIO_LEARN_TCP_SERVER_PREFORK_HPP
@@ -0,0 +1,38 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 18:00:01
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 18:00:01
+ * @FilePath: \asio-learn-code\include\asio_learn\trace\ticks.hpp
+ * @Description: 读TSC计数器，不依赖asio，asio自己的头文件里也能包含
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_TRACE_TICKS_HPP
+#define ASIO_LEARN_TRACE_TICKS_HPP
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define ASIO_LEARN_TRACE_HAS_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace asio_learn::trace
+{
+  // 没有TSC的平台退回steady_clock纳秒
+  inline std::uint64_t read_ticks()
+  {
+#ifdef ASIO_LEARN_TRACE_HAS_TSC
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+#endif
+  }
+}  // namespace asio_learn::trace
+#endif  // ASIO_LEARN_TRACE_TICKS_HPP
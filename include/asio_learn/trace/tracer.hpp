@@ -0,0 +1,425 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 17:43:42
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 18:00:21
+ * @FilePath: \asio-learn-code\include\asio_learn\trace\tracer.hpp
+ * @Description: 每线程环形缓冲区的轻量追踪，按需导出Chrome trace JSON(可用Perfetto打开)
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_TRACE_TRACER_HPP
+#define ASIO_LEARN_TRACE_TRACER_HPP
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "asio_learn/public.hpp"
+#include "asio_learn/trace/ticks.hpp"
+#include "common/Log.hpp"
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+/**
+ * 记录一个事件 = 读一次TSC + 几次relaxed写，不加锁、不分配内存、不格式化字符串，关闭时只有一次load和分支
+ * 每个线程第一次记录时分到自己的环，只有本线程写; 环满后覆盖最旧的事件，导出的是最近一段时间
+ * 导出在调用线程完成，和写入并发也安全: 可能被覆盖的事件直接丢弃
+ * 事件名必须是字符串字面量这类静态存储期的字符串，环里只存指针
+ * TSC需要是恒定速率的(现代x86都是)，导出时按steady_clock标定成微秒
+ */
+
+namespace asio_learn::trace
+{
+  enum Phase : uint8_t
+  {
+    PHASE_BEGIN = 'B',
+    PHASE_END = 'E',
+    PHASE_INSTANT = 'i',
+  };
+
+  inline long current_pid()
+  {
+#ifdef _WIN32
+    return static_cast<long>(_getpid());
+#else
+    return static_cast<long>(::getpid());
+#endif
+  }
+
+  // 单写者环形缓冲区
+  class ThreadRing
+  {
+   public:
+    struct Event
+    {
+      uint64 ticks;
+      const char* name;
+      uint64 id;
+      Phase phase;
+    };
+
+    ThreadRing(size_t capacity, uint32 tid) : _capacity(round_up(capacity)), _mask(_capacity - 1), _tid(tid)
+    {
+      _slots = std::make_unique<Slot[]>(_capacity);
+    }
+
+    // 只能由所属线程调用
+    void push(const char* name, Phase phase, uint64 id)
+    {
+      auto index = _head.load(std::memory_order_relaxed);
+      // 先声明要覆盖的位置，读者据此丢弃可能被改写的事件(seqlock写端)
+      _reserved.store(index + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      auto& slot = _slots[index & _mask];
+      slot.ticks.store(read_ticks(), std::memory_order_relaxed);
+      slot.name.store(name, std::memory_order_relaxed);
+      slot.id_phase.store((id << 8) | phase, std::memory_order_relaxed);
+      _head.store(index + 1, std::memory_order_release);
+    }
+
+    // 任意线程调用，返回当前环里完整的事件，按时间先后排列
+    std::vector<Event> snapshot() const
+    {
+      auto end = _head.load(std::memory_order_acquire);
+      auto begin = end > _capacity ? end - _capacity : 0;
+      std::vector<Event> events;
+      events.reserve(static_cast<size_t>(end - begin));
+      for (auto index = begin; index < end; ++index)
+      {
+        const auto& slot = _slots[index & _mask];
+        auto id_phase = slot.id_phase.load(std::memory_order_relaxed);
+        events.push_back(Event{ slot.ticks.load(std::memory_order_relaxed),
+                                slot.name.load(std::memory_order_relaxed),
+                                id_phase >> 8,
+                                static_cast<Phase>(id_phase & 0xff) });
+      }
+      // 复制期间写者又前进了多少，被覆盖过的槽位丢掉
+      std::atomic_thread_fence(std::memory_order_acquire);
+      auto reserved = _reserved.load(std::memory_order_relaxed);
+      if (reserved > _capacity && reserved - _capacity > begin)
+      {
+        auto overwritten = std::min<uint64>(reserved - _capacity - begin, events.size());
+        events.erase(events.begin(), events.begin() + static_cast<std::ptrdiff_t>(overwritten));
+      }
+      return events;
+    }
+
+    uint32 tid() const
+    {
+      return _tid;
+    }
+
+   private:
+    struct Slot
+    {
+      std::atomic<uint64> ticks{ 0 };
+      std::atomic<const char*> name{ nullptr };
+      std::atomic<uint64> id_phase{ 0 };  // 高56位id，低8位phase
+    };
+
+    static size_t round_up(size_t capacity)
+    {
+      size_t value = 64;
+      while (value < capacity)
+      {
+        value <<= 1;
+      }
+      return value;
+    }
+
+    size_t _capacity;
+    uint64 _mask;
+    uint32 _tid;
+    std::unique_ptr<Slot[]> _slots;
+    alignas(64) std::atomic<uint64> _head{ 0 };
+    std::atomic<uint64> _reserved{ 0 };
+  };
+
+  class Tracer
+  {
+   public:
+    static Tracer& instance()
+    {
+      static Tracer tracer;
+      return tracer;
+    }
+
+    // 默认关闭; 每个线程的环在第一次记录时按当时的容量创建
+    void enable(size_t events_per_thread = 1 << 16)
+    {
+      _capacity.store(events_per_thread, std::memory_order_relaxed);
+      _enabled.store(true, std::memory_order_relaxed);
+    }
+
+    void disable()
+    {
+      _enabled.store(false, std::memory_order_relaxed);
+    }
+
+    bool enabled() const
+    {
+      return _enabled.load(std::memory_order_relaxed);
+    }
+
+    void record(const char* name, Phase phase, uint64 id)
+    {
+      if (!enabled())
+      {
+        return;
+      }
+      local_ring().push(name, phase, id);
+    }
+
+    // 给当前线程起名，显示在Perfetto的线程轨道上
+    void set_thread_name(std::string name)
+    {
+      auto& ring = local_ring();
+      std::lock_guard<std::mutex> lock(_mutex);
+      for (auto& entry : _rings)
+      {
+        if (entry.ring.get() == &ring)
+        {
+          entry.name = std::move(name);
+        }
+      }
+    }
+
+    // 写出Chrome trace JSON，返回事件数
+    size_t write_chrome_json(std::ostream& out)
+    {
+      std::vector<std::pair<std::shared_ptr<ThreadRing>, std::string>> rings;
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (const auto& entry : _rings)
+        {
+          rings.emplace_back(entry.ring, entry.name);
+        }
+      }
+      double ticks_per_us = calibrate();
+      auto pid = current_pid();
+      size_t written = 0;
+      bool first = true;
+      auto separator = [&]()
+      {
+        out << (first ? "\n" : ",\n");
+        first = false;
+      };
+
+      out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+      for (const auto& [ring, name] : rings)
+      {
+        if (!name.empty())
+        {
+          separator();
+          out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << ring->tid()
+              << ",\"args\":{\"name\":\"" << escape(name) << "\"}}";
+        }
+        for (const auto& event : ring->snapshot())
+        {
+          separator();
+          // 不同核的TSC可能有微小偏差，按有符号数处理
+          double ts = static_cast<double>(static_cast<int64_t>(event.ticks - _origin_ticks)) / ticks_per_us;
+          out << "{\"name\":\"" << escape(event.name ? event.name : "?") << "\",\"ph\":\""
+              << static_cast<char>(event.phase) << "\",\"ts\":" << std::fixed << ts << ",\"pid\":" << pid
+              << ",\"tid\":" << ring->tid();
+          if (event.phase == PHASE_INSTANT)
+          {
+            out << ",\"s\":\"t\"";
+          }
+          out << ",\"args\":{\"id\":" << event.id << "}}";
+          ++written;
+        }
+      }
+      out << "\n]}\n";
+      return written;
+    }
+
+    // 返回写入的事件数，打开文件失败返回0
+    size_t dump(const std::string& path)
+    {
+      std::ofstream out(path, std::ios::trunc);
+      if (!out)
+      {
+        LOG_ERR("failed to open trace file {}", path);
+        return 0;
+      }
+      auto written = write_chrome_json(out);
+      LOG_INFO("trace dumped to {} with {} events", path, written);
+      return written;
+    }
+
+   private:
+    struct RingEntry
+    {
+      std::shared_ptr<ThreadRing> ring;
+      std::string name;
+    };
+
+    Tracer() : _origin_ticks(read_ticks()), _origin_time(std::chrono::steady_clock::now())
+    {
+    }
+
+    ThreadRing& local_ring()
+    {
+      // 线程退出后环仍由注册表持有，导出时还能看到它最后的事件
+      thread_local ThreadRing* ring = nullptr;
+      if (!ring)
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto created = std::make_shared<ThreadRing>(_capacity.load(std::memory_order_relaxed), ++_next_tid);
+        _rings.push_back(RingEntry{ created, {} });
+        ring = created.get();
+      }
+      return *ring;
+    }
+
+    // 每微秒多少tick，至少积累10ms再算，否则误差太大
+    double calibrate() const
+    {
+#ifdef ASIO_LEARN_TRACE_HAS_TSC
+      auto elapsed = std::chrono::steady_clock::now() - _origin_time;
+      if (elapsed < std::chrono::milliseconds(10))
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10) - elapsed);
+      }
+      auto ticks = read_ticks() - _origin_ticks;
+      auto us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - _origin_time).count();
+      return static_cast<double>(ticks) / us;
+#else
+      return 1000.0;
+#endif
+    }
+
+    static std::string escape(const std::string& text)
+    {
+      std::string out;
+      out.reserve(text.size());
+      for (char c : text)
+      {
+        if (c == '"' || c == '\\')
+        {
+          out += '\\';
+        }
+        out += (static_cast<unsigned char>(c) < 0x20) ? ' ' : c;
+      }
+      return out;
+    }
+
+    std::atomic<bool> _enabled{ false };
+    std::atomic<size_t> _capacity{ 1 << 16 };
+    const uint64 _origin_ticks;
+    const std::chrono::steady_clock::time_point _origin_time;
+    std::mutex _mutex;
+    std::vector<RingEntry> _rings;
+    uint32 _next_tid = 0;
+  };
+
+  // 作用域内的一对begin/end事件
+  class Scope
+  {
+   public:
+    Scope(const char* name, uint64 id) : _name(name), _id(id), _active(Tracer::instance().enabled())
+    {
+      if (_active)
+      {
+        Tracer::instance().record(_name, PHASE_BEGIN, _id);
+      }
+    }
+
+    // 只在记录过begin时记录end，中途开关追踪也不会出现不配对的事件
+    ~Scope()
+    {
+      if (_active)
+      {
+        Tracer::instance().record(_name, PHASE_END, _id);
+      }
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+   private:
+    const char* _name;
+    uint64 _id;
+    bool _active;
+  };
+
+  inline void instant(const char* name, uint64 id)
+  {
+    Tracer::instance().record(name, PHASE_INSTANT, id);
+  }
+
+#ifdef SIGUSR2
+  constexpr int DEFAULT_DUMP_SIGNAL = SIGUSR2;
+#else
+  constexpr int DEFAULT_DUMP_SIGNAL = SIGBREAK;
+#endif
+
+  // 收到信号时把所有线程的环导出到 prefix_<pid>_<n>.json; 自带io_context和线程，导出不占用worker线程
+  class SignalDumper
+  {
+   public:
+    explicit SignalDumper(std::string prefix, int signal_number = DEFAULT_DUMP_SIGNAL)
+      : _prefix(std::move(prefix))
+      , _signals(_ioc, signal_number)
+    {
+      wait();
+      _thread = std::thread([this]() { _ioc.run(); });
+      LOG_INFO("send signal {} to pid {} to dump traces", signal_number, current_pid());
+    }
+
+    ~SignalDumper()
+    {
+      _ioc.stop();
+      if (_thread.joinable())
+      {
+        _thread.join();
+      }
+    }
+
+    SignalDumper(const SignalDumper&) = delete;
+    SignalDumper& operator=(const SignalDumper&) = delete;
+
+   private:
+    void wait()
+    {
+      _signals.async_wait(
+          [this](const error_code& ec, int /*signal_number*/)
+          {
+            if (ec)
+            {
+              return;
+            }
+            Tracer::instance().dump(std::format("{}_{}_{}.json", _prefix, current_pid(), ++_dumps));
+            wait();
+          });
+    }
+
+    std::string _prefix;
+    io_context _ioc;
+    asio::signal_set _signals;
+    std::thread _thread;
+    uint64 _dumps = 0;
+  };
+}  // namespace asio_learn::trace
+
+#define ASIO_LEARN_TRACE_CONCAT_INNER(a, b) a##b
+#define ASIO_LEARN_TRACE_CONCAT(a, b) ASIO_LEARN_TRACE_CONCAT_INNER(a, b)
+// 记录所在作用域的begin/end，name必须是字符串字面量
+#define TRACE_SCOPE(name, id) \
+  ::asio_learn::trace::Scope ASIO_LEARN_TRACE_CONCAT(_trace_scope_, __LINE__)((name), static_cast<uint64_t>(id))
+
+#endif  // ASIO_LEARN_TRACE_TRACER_HPP
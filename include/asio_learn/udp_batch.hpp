@@ -0,0 +1,227 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 17:12:07
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:20:52
+ * @FilePath: \asio-learn-code\include\asio_learn\udp_batch.hpp
+ * @Description: UDP批量收发：Linux上一次系统调用收/发多个数据报(recvmmsg/sendmmsg)，其他平台逐个收发
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_UDP_BATCH_HPP
+#define ASIO_LEARN_UDP_BATCH_HPP
+#include <cstring>
+#include <vector>
+
+#include "asio_learn/public.hpp"
+
+#ifdef __linux__
+#include <sys/socket.h>
+#define ASIO_LEARN_HAS_MMSG
+#endif
+
+/**
+ * 小包UDP的瓶颈在系统调用次数上，每个包一次recvfrom/sendto很快就把CPU吃满
+ * UdpBatch 预先分配capacity个槽位，每个槽位一块max_datagram大小的缓冲和一个对端地址
+ * 用法: socket设为非阻塞，async_wait(wait_read)就绪后调用receive()一次收空
+ *   size_t n = batch.receive(socket, ec);
+ *   for (size_t i = 0; i < n; ++i) { batch.data(i); batch.size(i); batch.endpoint(i); }
+ * 超过max_datagram的数据报会被内核截断，receive()直接丢掉，不交给调用方，个数见truncated()
+ * 发送: 填好前count个槽位的数据/长度(未connect的socket还要填地址)，调用send()
+ */
+
+namespace asio_learn
+{
+  class UdpBatch
+  {
+   public:
+    UdpBatch(size_t capacity, size_t max_datagram)
+      : _max_datagram(max_datagram)
+      , _storage(capacity * max_datagram)
+      , _sizes(capacity, 0)
+      , _endpoints(capacity)
+    {
+#ifdef ASIO_LEARN_HAS_MMSG
+      _iovecs.resize(capacity);
+      _headers.resize(capacity);
+#endif
+    }
+
+    size_t capacity() const
+    {
+      return _sizes.size();
+    }
+
+    size_t max_datagram() const
+    {
+      return _max_datagram;
+    }
+
+    char* data(size_t i)
+    {
+      return _storage.data() + i * _max_datagram;
+    }
+
+    size_t size(size_t i) const
+    {
+      return _sizes[i];
+    }
+
+    void set_size(size_t i, size_t size)
+    {
+      _sizes[i] = size;
+    }
+
+    const udp_endpoint& endpoint(size_t i) const
+    {
+      return _endpoints[i];
+    }
+
+    void set_endpoint(size_t i, const udp_endpoint& endpoint)
+    {
+      _endpoints[i] = endpoint;
+    }
+
+    // 上一次receive()因为截断丢掉的数据报个数
+    size_t truncated() const
+    {
+      return _truncated;
+    }
+
+    /**
+     * @brief 非阻塞地尽量收满，返回收到的完整数据报个数；没有数据时返回0，ec为would_block
+     *        全部被截断时也返回0，ec为空，truncated()不为0
+     */
+    size_t receive(udp_socket& socket, error_code& ec)
+    {
+      ec.clear();
+      _truncated = 0;
+#ifdef ASIO_LEARN_HAS_MMSG
+      for (size_t i = 0; i < capacity(); ++i)
+      {
+        prepare(i, _max_datagram, _endpoints[i].capacity());
+      }
+      int n = ::recvmmsg(socket.native_handle(), _headers.data(), static_cast<unsigned>(capacity()), MSG_DONTWAIT, nullptr);
+      if (n < 0)
+      {
+        ec = error_code(errno, asio::error::get_system_category());
+        return 0;
+      }
+      // 截断的跳过，后面的往前挪; 截断很少见，平时不会拷贝
+      size_t kept = 0;
+      for (size_t i = 0; i < static_cast<size_t>(n); ++i)
+      {
+        _endpoints[i].resize(_headers[i].msg_hdr.msg_namelen);
+        if (_headers[i].msg_hdr.msg_flags & MSG_TRUNC)
+        {
+          ++_truncated;
+          continue;
+        }
+        if (kept != i)
+        {
+          std::memcpy(data(kept), data(i), _headers[i].msg_len);
+          _endpoints[kept] = _endpoints[i];
+        }
+        _sizes[kept++] = _headers[i].msg_len;
+      }
+      return kept;
+#else
+      size_t n = 0;
+      while (n < capacity())
+      {
+        size_t bytes = socket.receive_from(asio::buffer(data(n), _max_datagram), _endpoints[n], 0, ec);
+        if (ec == asio::error::message_size)
+        {
+          // Windows上截断的数据报报WSAEMSGSIZE
+          ++_truncated;
+          continue;
+        }
+        if (ec)
+        {
+          break;
+        }
+        _sizes[n++] = bytes;
+      }
+      if (n > 0 || _truncated > 0)
+      {
+        ec.clear();
+      }
+      return n;
+#endif
+    }
+
+    /**
+     * @brief 发送前count个槽位，返回实际发出的个数(发送缓冲满时可能少于count，ec为would_block)
+     * @param connected socket已connect时不带地址
+     */
+    size_t send(udp_socket& socket, size_t count, bool connected, error_code& ec)
+    {
+      ec.clear();
+      size_t sent = 0;
+#ifdef ASIO_LEARN_HAS_MMSG
+      for (size_t i = 0; i < count; ++i)
+      {
+        prepare(i, _sizes[i], connected ? 0 : _endpoints[i].size());
+      }
+      while (sent < count)
+      {
+        int n = ::sendmmsg(
+            socket.native_handle(), _headers.data() + sent, static_cast<unsigned>(count - sent), MSG_DONTWAIT);
+        if (n < 0)
+        {
+          ec = error_code(errno, asio::error::get_system_category());
+          break;
+        }
+        sent += static_cast<size_t>(n);
+      }
+#else
+      for (; sent < count; ++sent)
+      {
+        auto buffer = asio::buffer(data(sent), _sizes[sent]);
+        if (connected)
+        {
+          socket.send(buffer, 0, ec);
+        }
+        else
+        {
+          socket.send_to(buffer, _endpoints[sent], 0, ec);
+        }
+        if (ec)
+        {
+          break;
+        }
+      }
+#endif
+      return sent;
+    }
+
+   private:
+#ifdef ASIO_LEARN_HAS_MMSG
+    // address_len为0表示不带地址
+    void prepare(size_t i, size_t length, size_t address_len)
+    {
+      _iovecs[i].iov_base = data(i);
+      _iovecs[i].iov_len = length;
+      auto& header = _headers[i].msg_hdr;
+      header = {};
+      header.msg_iov = &_iovecs[i];
+      header.msg_iovlen = 1;
+      if (address_len > 0)
+      {
+        header.msg_name = _endpoints[i].data();
+        header.msg_namelen = static_cast<socklen_t>(address_len);
+      }
+      _headers[i].msg_len = 0;
+    }
+
+    std::vector<iovec> _iovecs;
+    std::vector<mmsghdr> _headers;
+#endif
+    size_t _max_datagram;
+    size_t _truncated = 0;
+    std::vector<char> _storage;
+    std::vector<size_t> _sizes;
+    std::vector<udp_endpoint> _endpoints;
+  };
+}  // namespace asio_learn
+
+#endif  // ASIO_LEARN_UDP_BATCH_HPP
@@ -0,0 +1,210 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 17:05:41
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:18:45
+ * @FilePath: \asio-learn-code\include\asio_learn\udp_reflector.hpp
+ * @Description: UDP反射服务器：收到什么原样发回去，配合 tool_udp_benchmark 测RTT
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_UDP_REFLECTOR_HPP
+#define ASIO_LEARN_UDP_REFLECTOR_HPP
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "asio_learn/public.hpp"
+#include "asio_learn/udp_batch.hpp"
+#include "common/Log.hpp"
+
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
+
+/**
+ * 每个线程一个io_context和一个绑定同一端口的socket(Linux上用SO_REUSEPORT，内核按四元组把流量分给各socket)
+ * 读就绪后用UdpBatch一次收空，再原样批量发回；发送缓冲满时丢掉剩下的包(UDP本来就允许丢)，计入dropped
+ * 超过max_datagram被截断的包不回显，计入truncated
+ */
+
+namespace asio_learn
+{
+  struct UdpReflectorOptions
+  {
+    size_t threads = 1;
+    size_t batch = 64;          // 单次recvmmsg/sendmmsg的最大包数
+    size_t max_datagram = 2048;  // 超过这个长度的包被丢弃
+    int socket_buffer = 4 * 1024 * 1024;
+  };
+
+  struct UdpReflectorStats
+  {
+    uint64 received = 0;
+    uint64 sent = 0;
+    uint64 dropped = 0;
+    uint64 truncated = 0;  // 超过max_datagram，没有回显
+    uint64 batches = 0;  // 收包系统调用次数
+  };
+
+  class UdpReflector
+  {
+   public:
+    UdpReflector(const udp_endpoint& endpoint, UdpReflectorOptions options = {}) : _options(options)
+    {
+      if (_options.threads == 0)
+      {
+        _options.threads = 1;
+      }
+#ifndef __linux__
+      // 没有SO_REUSEPORT的负载均衡，多个socket绑同一端口没有意义
+      _options.threads = 1;
+#endif
+      for (size_t i = 0; i < _options.threads; ++i)
+      {
+        _workers.push_back(std::make_unique<Worker>(endpoint, _options, *this));
+      }
+      LOG_INFO("udp reflector listening on {}:{} threads={}", endpoint.address().to_string(), endpoint.port(), _options.threads);
+    }
+
+    ~UdpReflector()
+    {
+      stop();
+    }
+
+    void start()
+    {
+      for (auto& worker : _workers)
+      {
+        auto* w = worker.get();
+        w->start();
+        _threads.emplace_back([w]() { w->ioc.run(); });
+      }
+    }
+
+    void stop()
+    {
+      for (auto& worker : _workers)
+      {
+        worker->ioc.stop();
+      }
+      for (auto& thread : _threads)
+      {
+        if (thread.joinable())
+        {
+          thread.join();
+        }
+      }
+      _threads.clear();
+    }
+
+    UdpReflectorStats stats() const
+    {
+      UdpReflectorStats stats;
+      stats.received = _received.load(std::memory_order_relaxed);
+      stats.sent = _sent.load(std::memory_order_relaxed);
+      stats.dropped = _dropped.load(std::memory_order_relaxed);
+      stats.truncated = _truncated.load(std::memory_order_relaxed);
+      stats.batches = _batches.load(std::memory_order_relaxed);
+      return stats;
+    }
+
+   private:
+    struct Worker
+    {
+      Worker(const udp_endpoint& endpoint, const UdpReflectorOptions& options, UdpReflector& owner)
+        : ioc(1)
+        , socket(ioc)
+        , batch(options.batch, options.max_datagram)
+        , owner(owner)
+      {
+        socket.open(endpoint.protocol());
+#ifdef __linux__
+        if (options.threads > 1)
+        {
+          int on = 1;
+          ::setsockopt(socket.native_handle(), SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+        }
+#endif
+        error_code ec;
+        socket.set_option(asio::socket_base::receive_buffer_size(options.socket_buffer), ec);
+        socket.set_option(asio::socket_base::send_buffer_size(options.socket_buffer), ec);
+        socket.bind(endpoint);
+        socket.non_blocking(true);
+      }
+
+      void start()
+      {
+        socket.async_wait(
+            udp_socket::wait_read,
+            [this](const error_code& ec)
+            {
+              if (ec)
+              {
+                if (ec != asio::error::operation_aborted)
+                {
+                  LOG_ERR("udp reflector wait error: {}", ec.message());
+                }
+                return;
+              }
+              reflect();
+              start();
+            });
+      }
+
+      // 一直收到would_block为止，每批原样发回
+      void reflect()
+      {
+        while (true)
+        {
+          error_code ec;
+          size_t n = batch.receive(socket, ec);
+          if (batch.truncated() > 0)
+          {
+            owner._truncated.fetch_add(batch.truncated(), std::memory_order_relaxed);
+          }
+          if (n == 0 && batch.truncated() > 0)
+          {
+            continue;
+          }
+          if (n == 0)
+          {
+            if (ec && ec != asio::error::would_block && ec != asio::error::try_again)
+            {
+              LOG_ERR("udp reflector receive error: {}", ec.message());
+            }
+            return;
+          }
+          owner._batches.fetch_add(1, std::memory_order_relaxed);
+          owner._received.fetch_add(n, std::memory_order_relaxed);
+          size_t sent = batch.send(socket, n, false, ec);
+          owner._sent.fetch_add(sent, std::memory_order_relaxed);
+          if (sent < n)
+          {
+            owner._dropped.fetch_add(n - sent, std::memory_order_relaxed);
+          }
+          if (n + batch.truncated() < batch.capacity())
+          {
+            return;
+          }
+        }
+      }
+
+      io_context ioc;
+      udp_socket socket;
+      UdpBatch batch;
+      UdpReflector& owner;
+    };
+
+    UdpReflectorOptions _options;
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::vector<std::thread> _threads;
+    std::atomic<uint64> _received{ 0 };
+    std::atomic<uint64> _sent{ 0 };
+    std::atomic<uint64> _dropped{ 0 };
+    std::atomic<uint64> _truncated{ 0 };
+    std::atomic<uint64> _batches{ 0 };
+  };
+}  // namespace asio_learn
+
+#endif  // ASIO_LEARN_UDP_REFLECTOR_HPP
@@ -0,0 +1,145 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 16:57:43
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 16:57:43
+ * @FilePath: \asio-learn-code\include\common\LatencyHistogram.hpp
+ * @Description: HdrHistogram风格的延迟直方图：对数分段+段内线性，固定相对误差，记录O(1)，可合并
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef COMMON_LATENCYHISTOGRAM_HPP
+#define COMMON_LATENCYHISTOGRAM_HPP
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace common
+{
+  /**
+   * @brief 延迟直方图
+   *
+   * 值域按2的幂分段，每段再线性分成 2^SUB_BUCKET_BITS 个桶:
+   * - 小于 2^SUB_BUCKET_BITS 的值精确记录
+   * - 其余值的相对误差不超过 1/2^SUB_BUCKET_BITS (默认7位，<0.8%)
+   * 整个uint64值域只需要约7.5K个计数器，单线程记录，多线程各记各的最后merge
+   * 单位由调用方决定，benchmark里统一用纳秒
+   */
+  class LatencyHistogram
+  {
+   public:
+    static constexpr int SUB_BUCKET_BITS = 7;
+    static constexpr uint64_t SUB_BUCKET_COUNT = uint64_t(1) << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    LatencyHistogram() : _counts(BUCKET_COUNT, 0)
+    {
+    }
+
+    void record(uint64_t value, uint64_t count = 1)
+    {
+      _counts[index_of(value)] += count;
+      _total += count;
+      _sum += static_cast<double>(value) * count;
+      _min = std::min(_min, value);
+      _max = std::max(_max, value);
+    }
+
+    void merge(const LatencyHistogram& other)
+    {
+      for (size_t i = 0; i < BUCKET_COUNT; ++i)
+      {
+        _counts[i] += other._counts[i];
+      }
+      _total += other._total;
+      _sum += other._sum;
+      _min = std::min(_min, other._min);
+      _max = std::max(_max, other._max);
+    }
+
+    void reset()
+    {
+      std::fill(_counts.begin(), _counts.end(), 0);
+      _total = 0;
+      _sum = 0;
+      _min = std::numeric_limits<uint64_t>::max();
+      _max = 0;
+    }
+
+    uint64_t count() const
+    {
+      return _total;
+    }
+
+    uint64_t min() const
+    {
+      return _total ? _min : 0;
+    }
+
+    uint64_t max() const
+    {
+      return _max;
+    }
+
+    double mean() const
+    {
+      return _total ? _sum / static_cast<double>(_total) : 0.0;
+    }
+
+    // 与HdrHistogram一致，返回对应桶里的最大值(不超过实际最大值)
+    uint64_t value_at_percentile(double percentile) const
+    {
+      if (_total == 0)
+      {
+        return 0;
+      }
+      percentile = std::clamp(percentile, 0.0, 100.0);
+      auto target = static_cast<uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(_total)));
+      target = std::max<uint64_t>(target, 1);
+      uint64_t seen = 0;
+      for (size_t i = 0; i < BUCKET_COUNT; ++i)
+      {
+        seen += _counts[i];
+        if (seen >= target)
+        {
+          return std::min(highest_equivalent(i), _max);
+        }
+      }
+      return _max;
+    }
+
+   private:
+    static size_t index_of(uint64_t value)
+    {
+      if (value < SUB_BUCKET_COUNT)
+      {
+        return static_cast<size_t>(value);
+      }
+      int shift = (63 - std::countl_zero(value)) - SUB_BUCKET_BITS;
+      uint64_t top = value >> shift;  // [SUB_BUCKET_COUNT, 2*SUB_BUCKET_COUNT)
+      return static_cast<size_t>((shift + 1) * SUB_BUCKET_COUNT + (top - SUB_BUCKET_COUNT));
+    }
+
+    static uint64_t highest_equivalent(size_t index)
+    {
+      if (index < SUB_BUCKET_COUNT)
+      {
+        return index;
+      }
+      int shift = static_cast<int>(index / SUB_BUCKET_COUNT) - 1;
+      uint64_t top = SUB_BUCKET_COUNT + index % SUB_BUCKET_COUNT;
+      return ((top + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> _counts;
+    uint64_t _total = 0;
+    double _sum = 0;
+    uint64_t _min = std::numeric_limits<uint64_t>::max();
+    uint64_t _max = 0;
+  };
+}  // namespace common
+
+#endif  // COMMON_LATENCYHISTOGRAM_HPP
@@ -0,0 +1,298 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+服务器架构对比脚本 (Linux)
+
+依次在本机回环地址上启动每种服务器，跑同样的三组负载，汇总成一份对比报告:
+  idle : tool_test_client 保持大量几乎不发数据的连接，看每连接内存
+  rps  : tool_benchmark 小包、单请求在途，看请求速率和延迟分位数
+  bulk : tool_benchmark 64KB大包流水线，看吞吐
+
+每组负载期间从 /proc/<pid> 采样服务器的CPU时间和RSS
+服务器在临时目录里启动，使用生成的 log.yaml(warn级别、不输出控制台)，避免逐包日志主导结果
+
+用法:
+  python3 scripts/compare_servers.py --bin-dir build/Release/bin --duration 10 --json compare.json --markdown compare.md
+  python3 scripts/compare_servers.py --servers tcp_server_masterWork,asio_coroutine --workloads rps,bulk
+"""
+
+import argparse
+import json
+import os
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+from pathlib import Path
+
+# 名称 -> 监听端口，端口写死在各示例的 main 里
+SERVERS = {
+    "tcp_server_onethonecli": 9996,   # 每连接一个线程，阻塞读写
+    "tcp_server_threadpool": 9996,    # asio::thread_pool 上跑所有会话
+    "tcp_server_masterWork": 9986,    # 主线程accept，多个worker io_context
+    "tcp_echo_server": 9527,          # 单io_context单线程
+    "asio_coroutine": 9988,           # C++20协程，多线程共享一个io_context
+}
+
+WORKLOADS = ("idle", "rps", "bulk")
+
+LOG_YAML = """log:
+    log_file: "{log_file}"
+    log_level: "warn"
+    max_file_size: 10485760
+    max_files: 2
+    enable_console: false
+    enable_file: true
+    enable_color: false
+    enable_async: false
+"""
+
+CLOCK_TICKS = os.sysconf("SC_CLK_TCK")
+
+
+def read_cpu_seconds(pid):
+    """进程累计的 用户态+内核态 CPU 秒数"""
+    with open(f"/proc/{pid}/stat") as f:
+        # comm 字段可能含空格，从最后一个 ')' 之后开始切分
+        fields = f.read().rsplit(")", 1)[1].split()
+    utime, stime = int(fields[11]), int(fields[12])
+    return (utime + stime) / CLOCK_TICKS
+
+
+def read_rss_kb(pid):
+    with open(f"/proc/{pid}/status") as f:
+        for line in f:
+            if line.startswith("VmRSS:"):
+                return int(line.split()[1])
+    return 0
+
+
+class ResourceSampler:
+    """后台线程定期采样RSS，记录峰值；CPU用开始/结束的差值"""
+
+    def __init__(self, pid, interval=0.2):
+        self.pid = pid
+        self.interval = interval
+        self.peak_rss_kb = 0
+        self._stop = threading.Event()
+        self._thread = threading.Thread(target=self._run, daemon=True)
+
+    def __enter__(self):
+        self._cpu_begin = read_cpu_seconds(self.pid)
+        self._wall_begin = time.monotonic()
+        self._thread.start()
+        return self
+
+    def __exit__(self, *exc):
+        self._stop.set()
+        self._thread.join()
+        self.cpu_seconds = read_cpu_seconds(self.pid) - self._cpu_begin
+        self.wall_seconds = time.monotonic() - self._wall_begin
+        return False
+
+    def _run(self):
+        while not self._stop.is_set():
+            try:
+                self.peak_rss_kb = max(self.peak_rss_kb, read_rss_kb(self.pid))
+            except OSError:
+                return
+            self._stop.wait(self.interval)
+
+
+def wait_for_port(port, timeout=5.0):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        try:
+            with socket.create_connection(("127.0.0.1", port), timeout=0.2):
+                return True
+        except OSError:
+            time.sleep(0.05)
+    return False
+
+
+def port_in_use(port):
+    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
+        return s.connect_ex(("127.0.0.1", port)) == 0
+
+
+def stop_process(proc):
+    if proc.poll() is not None:
+        return
+    proc.send_signal(signal.SIGTERM)
+    try:
+        proc.wait(timeout=3)
+    except subprocess.TimeoutExpired:
+        # 不是所有示例都处理SIGTERM
+        proc.kill()
+        proc.wait()
+
+
+def run_tool(cmd, json_path, timeout):
+    result = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True, timeout=timeout)
+    if not json_path.exists():
+        raise RuntimeError(f"{cmd[0]} exited with {result.returncode} without a report:\n{result.stdout[-2000:]}")
+    with open(json_path) as f:
+        return json.load(f)
+
+
+def workload_command(args, workload, port, pid, json_path):
+    common = ["--host", "127.0.0.1", "--port", str(port), "--json", str(json_path)]
+    if workload == "idle":
+        return [str(args.bin_dir / "tool_test_client"), *common,
+                "--connections", str(args.idle_connections), "--threads", "2",
+                "--min-size", "16", "--max-size", "16", "--interval-ms", "3600000",
+                "--duration", str(args.duration), "--settle", "1", "--pid", str(pid)]
+    if workload == "rps":
+        return [str(args.bin_dir / "tool_benchmark"), *common,
+                "--connections", str(args.rps_connections), "--threads", str(args.client_threads),
+                "--size", "64", "--pipeline", "1", "--duration", str(args.duration), "--warmup", "1"]
+    return [str(args.bin_dir / "tool_benchmark"), *common,
+            "--connections", str(args.bulk_connections), "--threads", str(args.client_threads),
+            "--size", str(args.bulk_size), "--pipeline", "4", "--duration", str(args.duration), "--warmup", "1"]
+
+
+def summarize(server, workload, report, sampler):
+    row = {
+        "server": server,
+        "workload": workload,
+        "cpu_cores": sampler.cpu_seconds / sampler.wall_seconds if sampler.wall_seconds > 0 else 0.0,
+        "peak_rss_mb": sampler.peak_rss_kb / 1024.0,
+    }
+    if workload == "idle":
+        results, server_info = report.get("results", {}), report.get("server", {})
+        row.update({
+            "connections": report["config"]["connections"],
+            "connect_failures": results.get("connect_failures", 0),
+            "unexpected_closes": results.get("unexpected_closes", 0),
+            "bytes_per_connection": server_info.get("bytes_per_connection"),
+            "fds_released": server_info.get("settled_fds", 0) <= server_info.get("baseline_fds", 0),
+        })
+    else:
+        results, latency = report["results"], report["latency_us"]
+        row.update({
+            "msgs_per_sec": results["msgs_per_sec"],
+            "mb_per_sec": results["mb_per_sec"],
+            "p50_us": latency["p50"],
+            "p99_us": latency["p99"],
+            "p999_us": latency["p99.9"],
+            "errors": results["errors"],
+        })
+    return row
+
+
+def run_server(args, name, port):
+    rows = []
+    binary = args.bin_dir / name
+    if not binary.exists():
+        print(f"[skip] {name}: {binary} not found")
+        return rows
+    if port_in_use(port):
+        print(f"[skip] {name}: port {port} already in use")
+        return rows
+
+    workdir = Path(tempfile.mkdtemp(prefix=f"compare_{name}_"))
+    (workdir / "log.yaml").write_text(LOG_YAML.format(log_file=(workdir / "log" / "log.txt").as_posix()))
+    proc = subprocess.Popen([str(binary)], cwd=workdir, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        if not wait_for_port(port):
+            print(f"[fail] {name}: not listening on {port}")
+            return rows
+        print(f"[run ] {name} pid={proc.pid} port={port}")
+        for workload in args.workloads:
+            json_path = workdir / f"{workload}.json"
+            cmd = workload_command(args, workload, port, proc.pid, json_path)
+            try:
+                with ResourceSampler(proc.pid) as sampler:
+                    report = run_tool(cmd, json_path, timeout=args.duration * 3 + 60)
+            except (RuntimeError, subprocess.TimeoutExpired, OSError) as e:
+                print(f"[fail] {name}/{workload}: {e}")
+                if proc.poll() is not None:
+                    print(f"[fail] {name} exited with {proc.returncode}")
+                    break
+                continue
+            row = summarize(name, workload, report, sampler)
+            rows.append(row)
+            print("       " + format_row(row))
+    finally:
+        stop_process(proc)
+        if not args.keep_workdir:
+            shutil.rmtree(workdir, ignore_errors=True)
+    return rows
+
+
+def fmt(value, spec):
+    return "-" if value is None else format(value, spec)
+
+
+def format_row(row):
+    if row["workload"] == "idle":
+        return (f"{row['workload']:<5} conns={row['connections']} "
+                f"bytes/conn={fmt(row['bytes_per_connection'], '.0f')} failures={row['connect_failures']} "
+                f"fds_released={row['fds_released']} cpu={row['cpu_cores']:.2f} rss={row['peak_rss_mb']:.1f}MB")
+    return (f"{row['workload']:<5} {row['msgs_per_sec']:.0f} msgs/s {row['mb_per_sec']:.1f} MB/s "
+            f"p50={row['p50_us']:.0f}us p99={row['p99_us']:.0f}us p99.9={row['p999_us']:.0f}us "
+            f"cpu={row['cpu_cores']:.2f} rss={row['peak_rss_mb']:.1f}MB errors={row['errors']}")
+
+
+def markdown_report(rows):
+    lines = [
+        "| server | workload | msgs/s | MB/s | p50 us | p99 us | p99.9 us | CPU cores | peak RSS MB | bytes/conn |",
+        "|---|---|---:|---:|---:|---:|---:|---:|---:|---:|",
+    ]
+    for r in rows:
+        lines.append("| {} | {} | {} | {} | {} | {} | {} | {:.2f} | {:.1f} | {} |".format(
+            r["server"], r["workload"],
+            fmt(r.get("msgs_per_sec"), ".0f"), fmt(r.get("mb_per_sec"), ".1f"),
+            fmt(r.get("p50_us"), ".0f"), fmt(r.get("p99_us"), ".0f"), fmt(r.get("p999_us"), ".0f"),
+            r["cpu_cores"], r["peak_rss_mb"], fmt(r.get("bytes_per_connection"), ".0f")))
+    return "\n".join(lines) + "\n"
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Compare asio-learn server variants on loopback")
+    parser.add_argument("--bin-dir", type=Path, default=Path("build/Release/bin"))
+    parser.add_argument("--servers", default=",".join(SERVERS), help="comma separated server names")
+    parser.add_argument("--workloads", default=",".join(WORKLOADS), help="comma separated: idle,rps,bulk")
+    parser.add_argument("--duration", type=float, default=10.0, help="seconds per workload")
+    parser.add_argument("--idle-connections", type=int, default=2000)
+    parser.add_argument("--rps-connections", type=int, default=64)
+    parser.add_argument("--bulk-connections", type=int, default=4)
+    parser.add_argument("--bulk-size", type=int, default=65536)
+    parser.add_argument("--client-threads", type=int, default=2)
+    parser.add_argument("--json", type=Path, help="write all rows as JSON")
+    parser.add_argument("--markdown", type=Path, help="write a markdown table")
+    parser.add_argument("--keep-workdir", action="store_true", help="keep server logs and raw reports")
+    args = parser.parse_args()
+    args.servers = [s for s in args.servers.split(",") if s]
+    args.workloads = [w for w in args.workloads.split(",") if w]
+    unknown = [s for s in args.servers if s not in SERVERS] + [w for w in args.workloads if w not in WORKLOADS]
+    if unknown:
+        parser.error(f"unknown server/workload: {', '.join(unknown)}")
+    return args
+
+
+def main():
+    if not sys.platform.startswith("linux"):
+        print("compare_servers.py reads /proc and only runs on Linux")
+        return 1
+    args = parse_args()
+    rows = []
+    for name in args.servers:
+        rows.extend(run_server(args, name, SERVERS[name]))
+        time.sleep(0.5)  # 等端口和TIME_WAIT连接回收
+
+    print()
+    print(markdown_report(rows))
+    if args.json:
+        args.json.write_text(json.dumps({"duration_s": args.duration, "rows": rows}, indent=2))
+    if args.markdown:
+        args.markdown.write_text(markdown_report(rows))
+    return 0 if rows else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
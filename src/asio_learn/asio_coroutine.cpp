@@ -1,10 +1,101 @@
-/** 
+/**
  * @Author: running-code-pp 3320996652@qq.com
  * @Date: 2025-10-18 20:37:45
  * @LastEditors: running-code-pp 3320996652@qq.com
- * @LastEditTime: 2025-10-18 20:37:52
+ * @LastEditTime: 2026-10-18 17:28:33
  * @FilePath: \asio-learn-code\src\asio_learn\asio_coroutine.cpp
- * @Description: asio 和 c++20协程的结合
+ * @Description: asio 和 c++20协程的结合：协程版回显服务器，监听9988
  * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
  */
 
+/**
+ 每个连接一个协程，读写写成顺序代码，不需要 shared_from_this 和回调链
+ 一个io_context跑在多个线程上；同一个协程同一时刻只在一个线程上执行，会话内部不需要strand
+ */
+#include <array>
+#include <thread>
+#include <vector>
+
+#include "asio_learn/public.hpp"
+#include "common/Log.hpp"
+using namespace asio_learn;
+
+namespace
+{
+  constexpr uint16 PORT = 9988;
+
+  asio::awaitable<void> echo_session(tcp_socket socket)
+  {
+    std::array<char, 4096> buffer;
+    error_code ec;
+    for (;;)
+    {
+      size_t bytes = co_await socket.async_read_some(asio::buffer(buffer), asio::redirect_error(asio::use_awaitable, ec));
+      if (ec)
+      {
+        break;
+      }
+      co_await asio::async_write(socket, asio::buffer(buffer, bytes), asio::redirect_error(asio::use_awaitable, ec));
+      if (ec)
+      {
+        break;
+      }
+    }
+    if (ec != asio::error::eof)
+    {
+      LOG_DEBUG("coroutine session finished: {}", ec.message());
+    }
+  }
+
+  asio::awaitable<void> listener(tcp_acceptor acceptor)
+  {
+    auto executor = co_await asio::this_coro::executor;
+    for (;;)
+    {
+      error_code ec;
+      tcp_socket socket = co_await acceptor.async_accept(asio::redirect_error(asio::use_awaitable, ec));
+      if (ec)
+      {
+        if (ec == asio::error::operation_aborted)
+        {
+          co_return;
+        }
+        LOG_ERR("accept error: {}", ec.message());
+        continue;
+      }
+      socket.set_option(asio::ip::tcp::no_delay(true), ec);
+      asio::co_spawn(executor, echo_session(std::move(socket)), asio::detached);
+    }
+  }
+}  // namespace
+
+int main()
+{
+  common::LoggerConfig config;
+  common::loadLogConfig(config, "log.yaml");
+  auto logger = common::create_logger();
+  logger->Init(config);
+  {
+    size_t threads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 4;
+    io_context ioc(static_cast<int>(threads));
+    tcp_acceptor acceptor(ioc, tcp_endpoint(asio::ip::tcp::v4(), PORT));
+    LOG_INFO("coroutine echo server listening on {} with {} threads", PORT, threads);
+    asio::co_spawn(ioc, listener(std::move(acceptor)), asio::detached);
+
+    asio::signal_set signals(ioc, SIGINT, SIGTERM);
+    signals.async_wait([&](const error_code&, int) { ioc.stop(); });
+
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads; ++i)
+    {
+      pool.emplace_back([&ioc]() { ioc.run(); });
+    }
+    ioc.run();
+    for (auto& thread : pool)
+    {
+      thread.join();
+    }
+  }
+  logger->ShutDown();
+  return 0;
+}
@@ -14,12 +14,123 @@
  TLS Transport Layer Security
  SSL/TLS协议是为网络通信提供安全保障的加密协议，广泛应用
  TLS是SSL的继任者，提供更强的安全性和性能
+
+ 默认开启会话缓存和会话票据，对比完整握手的开销:
+   asio_ssl_example --no-session-cache --no-tickets
+   tool_tls_bench --port 4433 --resume off / on
+
+ 多线程: 握手放到独立的线程池，建立好的连接在I/O线程上读写，同时进行的握手数有上限
+   asio_ssl_example --io-threads 2 --handshake-threads 2 --max-handshakes 256
+
+ 内核TLS: 握手后由内核加解密，需要Linux的tls模块(modprobe tls)，不支持时自动退回; tool_ktls_bench对比吞吐
+   asio_ssl_example --ktls
+
+ 会话默认开启SSL_MODE_RELEASE_BUFFERS，空闲连接不占OpenSSL的记录缓冲; --no-release-buffers对比内存
+ --max-send-fragment 4096 限制发送记录大小
+
+ 证书热更新: 替换resources下的证书和私钥后自动生效(每2秒检查修改时间)，或者 kill -HUP <pid> 立即重新加载，
+ 新连接用新证书，已有连接不断开; --reload-interval 0 只响应信号
+
+ 0-RTT和ALPN: 复用会话的客户端把第一条消息放在早期数据里，服务器随握手消息直接回显
+   asio_ssl_example --early-data 16384 --alpn echo/1
+   tool_tls_bench --port 4433 --tls 1.3 --early-data on --alpn echo/1
+ 每张票据的早期数据只接受一次，--no-replay-guard 关闭这个检查(只用于演示重放)
  */
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
 
+#include "asio_learn/metrics/loop_lag_monitor.hpp"
+#include "asio_learn/metrics/metrics_server.hpp"
+#include "asio_learn/ssl/certificate_reloader.hpp"
 #include "asio_learn/ssl/ssl_tcp_server.hpp"
 #include "common/Log.hpp"
 
-int main()
+// 不认识的选项忽略; 数值选项解析失败返回false
+static bool parse_args(
+    int argc,
+    char** argv,
+    asio_learn::ssl::SessionResumptionOptions& resumption,
+    asio_learn::ssl::SslServerOptions& server_options,
+    asio_learn::ssl::CertificateReloadOptions& reload_options)
+{
+  const char* option = "";
+  try
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      option = argv[i];
+      if (std::strcmp(argv[i], "--no-session-cache") == 0)
+      {
+        resumption.enable_cache = false;
+      }
+      else if (std::strcmp(argv[i], "--no-tickets") == 0)
+      {
+        resumption.enable_tickets = false;
+      }
+      else if (std::strcmp(argv[i], "--ktls") == 0)
+      {
+        server_options.session.ktls = true;
+      }
+      else if (std::strcmp(argv[i], "--no-release-buffers") == 0)
+      {
+        server_options.session.release_buffers = false;
+      }
+      else if (std::strcmp(argv[i], "--max-send-fragment") == 0 && i + 1 < argc)
+      {
+        server_options.session.max_send_fragment = std::stoul(argv[++i]);
+      }
+      else if (std::strcmp(argv[i], "--early-data") == 0 && i + 1 < argc)
+      {
+        server_options.early_data.max_early_data = static_cast<uint32_t>(std::stoul(argv[++i]));
+      }
+      else if (std::strcmp(argv[i], "--no-replay-guard") == 0)
+      {
+        server_options.early_data.replay_guard = false;
+      }
+      else if (std::strcmp(argv[i], "--alpn") == 0 && i + 1 < argc)
+      {
+        // 逗号分隔，按优先级排列
+        std::string list = argv[++i];
+        for (size_t begin = 0; begin <= list.size();)
+        {
+          auto end = std::min(list.find(',', begin), list.size());
+          if (end > begin)
+          {
+            server_options.alpn.push_back(list.substr(begin, end - begin));
+          }
+          begin = end + 1;
+        }
+      }
+      else if (std::strcmp(argv[i], "--reload-interval") == 0 && i + 1 < argc)
+      {
+        reload_options.poll_interval = std::chrono::milliseconds(std::stoul(argv[++i]));
+      }
+      else if (std::strcmp(argv[i], "--io-threads") == 0 && i + 1 < argc)
+      {
+        server_options.io_threads = std::stoul(argv[++i]);
+      }
+      else if (std::strcmp(argv[i], "--handshake-threads") == 0 && i + 1 < argc)
+      {
+        server_options.handshake_threads = std::stoul(argv[++i]);
+      }
+      else if (std::strcmp(argv[i], "--max-handshakes") == 0 && i + 1 < argc)
+      {
+        server_options.max_concurrent_handshakes = std::stoul(argv[++i]);
+      }
+    }
+  }
+  catch (const std::logic_error&)
+  {
+    // stoul遇到非数字或越界时抛invalid_argument/out_of_range
+    LOG_ERR("invalid value for {}", option);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv)
 {
   // 初始化日志配置并保持其生命周期
   common::LoggerConfig config;
@@ -27,20 +138,49 @@ int main()
   auto logger = common::create_logger();
   logger->Init(config);
   asio::io_context ioc;
-  // 创建ssl上下文
-  asio::ssl::context ssl_ctx(asio::ssl::context::sslv23);
+  const std::string cert_file = "resources/servercert.pem";
+  const std::string key_file = "resources/serverkey.pem";
+  // 创建ssl上下文，启动时和每次证书热更新时调用
+  auto make_context = [&]()
+  {
+    asio::ssl::context ssl_ctx(asio::ssl::context::sslv23);
 
-  ssl_ctx.set_options(
-      asio::ssl::context::default_workarounds | asio::ssl::context::no_sslv2 | asio::ssl::context::no_sslv3 |
-      asio::ssl::context::no_tlsv1 | asio::ssl::context::no_tlsv1_1 | asio::ssl::context::single_dh_use);
+    ssl_ctx.set_options(
+        asio::ssl::context::default_workarounds | asio::ssl::context::no_sslv2 | asio::ssl::context::no_sslv3 |
+        asio::ssl::context::no_tlsv1 | asio::ssl::context::no_tlsv1_1 | asio::ssl::context::single_dh_use);
 
-  // 加载ca证书和私钥
-  ssl_ctx.use_certificate_chain_file("resources/servercert.pem");
+    // 加载ca证书和私钥
+    ssl_ctx.use_certificate_chain_file(cert_file);
 
-  ssl_ctx.use_private_key_file("resources/serverkey.pem", asio::ssl::context::pem);
+    ssl_ctx.use_private_key_file(key_file, asio::ssl::context::pem);
+    return ssl_ctx;
+  };
 
-  asio_learn::ssl::SslTcpServer server(ioc, 4433, std::move(ssl_ctx));
+  // 指标: curl http://127.0.0.1:5433/metrics，注册表要比服务器活得久
+  asio_learn::metrics::Registry registry;
+  asio_learn::metrics::MetricsServer metrics_server(registry, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), 5433));
+  metrics_server.start();
+  asio_learn::ssl::SessionResumptionOptions resumption;
+  asio_learn::ssl::SslServerOptions server_options;
+  asio_learn::ssl::CertificateReloadOptions reload_options;
+  reload_options.watch_files = { cert_file, key_file };
+  if (!parse_args(argc, argv, resumption, server_options, reload_options))
+  {
+    logger->ShutDown();
+    return 1;
+  }
+  asio_learn::ssl::SslTcpServer server(
+      ioc,
+      4433,
+      make_context(),
+      asio_learn::metrics::ServerMetrics::create(registry, "ssl_tcp_server"),
+      resumption,
+      server_options);
+  asio_learn::ssl::CertificateReloader reloader(server, make_context, reload_options, &registry);
   server.run();
+  // 单线程循环，延迟探针只挂一个定时器
+  asio_learn::metrics::LoopLagMonitor lag_monitor(ioc, "main", {}, &registry);
+  lag_monitor.start();
   ioc.run();
   
   return 0;
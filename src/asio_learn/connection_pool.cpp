@@ -0,0 +1,124 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 16:27:32
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 16:27:32
+ * @FilePath: \asio-learn-code\src\asio_learn\connection_pool.cpp
+ * @Description: 连接池示例：对 tcp_server_masterWork(9986) 发起一批请求，连接被复用而不是每次重新握手
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "asio_learn/client/connection.hpp"
+#include "asio_learn/public.hpp"
+#include "common/Log.hpp"
+using namespace asio_learn;
+
+namespace
+{
+  constexpr int TOTAL_REQUESTS = 1000;
+  constexpr int CONCURRENCY = 16;
+
+  // 借一条连接发送一次请求并等回显，完成后借下一条
+  void run_one(std::shared_ptr<client::ConnectionPool> pool, const tcp_endpoint& endpoint, std::shared_ptr<int> remaining)
+  {
+    if (*remaining <= 0)
+    {
+      return;
+    }
+    --*remaining;
+    pool->async_acquire(
+        endpoint,
+        [pool, endpoint, remaining](const asio::error_code& ec, client::PooledConnection conn)
+        {
+          if (ec)
+          {
+            LOG_ERR("acquire connection failed: {}", ec.message());
+            *remaining = 0;  // 服务端不可用，停止发请求
+            return;
+          }
+          auto lease = std::make_shared<client::PooledConnection>(std::move(conn));
+          auto request = std::make_shared<std::string>("hello pool");
+          asio::async_write(
+              lease->socket(),
+              asio::buffer(*request),
+              [pool, endpoint, remaining, lease, request](const asio::error_code& ec, std::size_t)
+              {
+                if (ec)
+                {
+                  lease->mark_broken();
+                  return;
+                }
+                auto reply = std::make_shared<std::string>(request->size(), '\0');
+                asio::async_read(
+                    lease->socket(),
+                    asio::buffer(*reply),
+                    [pool, endpoint, remaining, lease, reply](const asio::error_code& ec, std::size_t)
+                    {
+                      if (ec)
+                      {
+                        lease->mark_broken();
+                      }
+                      // 先归还，下一次请求就能复用这条连接
+                      lease->release();
+                      run_one(pool, endpoint, remaining);
+                    });
+              });
+        });
+  }
+}  // namespace
+
+int main()
+{
+  common::LoggerConfig config;
+  common::loadLogConfig(config, "log.yaml");
+  auto logger = common::create_logger();
+  logger->Init(config);
+
+  io_context ioc;
+  tcp_endpoint endpoint(asio::ip::make_address_v4("127.0.0.1"), 9986);
+
+  client::ConnectionPoolOptions options;
+  options.max_in_flight_per_endpoint = CONCURRENCY;
+  auto pool = std::make_shared<client::ConnectionPool>(ioc, options);
+  pool->start();
+  pool->warm_up(endpoint, CONCURRENCY / 2);
+
+  auto remaining = std::make_shared<int>(TOTAL_REQUESTS);
+  for (int i = 0; i < CONCURRENCY; ++i)
+  {
+    run_one(pool, endpoint, remaining);
+  }
+
+  // 请求都发完后关闭连接池，健康检查定时器停止，ioc自然退出
+  steady_timer done(ioc);
+  std::function<void()> wait_done = [&]()
+  {
+    done.expires_after(std::chrono::milliseconds(50));
+    done.async_wait(
+        [&](const asio::error_code&)
+        {
+          auto stats = pool->stats();
+          if (*remaining > 0 || stats.in_use > 0 || stats.waiting > 0)
+          {
+            wait_done();
+            return;
+          }
+          LOG_INFO(
+              "pool stats: created={} reused={} connect_failed={} evicted={} discarded={} idle={}",
+              stats.created,
+              stats.reused,
+              stats.connect_failed,
+              stats.evicted,
+              stats.discarded,
+              stats.idle);
+          pool->close();
+        });
+  };
+  wait_done();
+  ioc.run();
+  logger->ShutDown();
+  return 0;
+}
@@ -0,0 +1,101 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 16:33:48
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 16:33:48
+ * @FilePath: \asio-learn-code\src\asio_learn\multiplex_client.cpp
+ * @Description: 多路复用客户端示例：一条连接上同时挂起大量请求，对着 tcp_server_masterWork(9986) 回显
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "asio_learn/client/multiplex_client.hpp"
+#include "asio_learn/public.hpp"
+#include "common/Log.hpp"
+using namespace asio_learn;
+
+namespace
+{
+  constexpr int TOTAL_REQUESTS = 100000;
+  constexpr int WINDOW = 512;  // 同时挂起的请求数
+
+  // 回调风格：每完成一个请求补发一个，保持窗口大小
+  void pump(std::shared_ptr<client::MultiplexClient> client, std::shared_ptr<int> remaining, std::shared_ptr<int> done)
+  {
+    if (*remaining <= 0)
+    {
+      return;
+    }
+    --*remaining;
+    client->async_request(
+        "ping " + std::to_string(*remaining),
+        [client, remaining, done](const asio::error_code& ec, std::string)
+        {
+          if (ec)
+          {
+            LOG_ERR("request failed: {}", ec.message());
+            return;
+          }
+          if (++*done == TOTAL_REQUESTS)
+          {
+            auto stats = client->stats();
+            LOG_INFO(
+                "{} responses, {} writes, avg {:.1f} frames/write, max {}",
+                stats.responses,
+                stats.writes,
+                stats.writes ? double(stats.requests) / stats.writes : 0.0,
+                stats.max_frames_per_write);
+            client->close();
+            return;
+          }
+          pump(client, remaining, done);
+        });
+  }
+
+  // 协程风格：同一个客户端也可以直接co_await
+  asio::awaitable<void> hello(std::shared_ptr<client::MultiplexClient> client)
+  {
+    auto reply = co_await client->async_request("hello from coroutine", asio::use_awaitable);
+    LOG_INFO("coroutine got reply: {}", reply);
+  }
+}  // namespace
+
+int main()
+{
+  common::LoggerConfig config;
+  common::loadLogConfig(config, "log.yaml");
+  auto logger = common::create_logger();
+  logger->Init(config);
+
+  io_context ioc;
+  tcp_socket socket(ioc);
+  asio::error_code ec;
+  socket.connect(tcp_endpoint(asio::ip::make_address_v4("127.0.0.1"), 9986), ec);
+  if (ec)
+  {
+    LOG_ERR("connect to server failed: {}", ec.message());
+    logger->ShutDown();
+    return -1;
+  }
+  socket.set_option(asio::ip::tcp::no_delay(true));
+
+  auto client = std::make_shared<client::MultiplexClient>(std::move(socket));
+  client->start();
+
+  asio::co_spawn(ioc, hello(client), asio::detached);
+
+  auto begin = std::chrono::steady_clock::now();
+  auto remaining = std::make_shared<int>(TOTAL_REQUESTS);
+  auto done = std::make_shared<int>(0);
+  for (int i = 0; i < WINDOW; ++i)
+  {
+    pump(client, remaining, done);
+  }
+  ioc.run();
+  auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  LOG_INFO("{} requests in {:.3f}s, {:.0f} req/s", *done, elapsed, *done / elapsed);
+  logger->ShutDown();
+  return 0;
+}
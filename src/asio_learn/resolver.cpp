@@ -12,50 +12,53 @@
 #include <string>
 #include <memory>
 
+#include "asio_learn/client/caching_resolver.hpp"
+#include "asio_learn/client/happy_eyeballs.hpp"
 #include "asio_learn/public.hpp"
 #include "common/Log.hpp"
 
 using namespace asio_learn;
-void connectToServer(io_context& ioc, const std::string& host, const std::string& service)
+// 解析结果由CachingResolver缓存，同一个名字在TTL内不会重复走getaddrinfo
+void connectToServer(
+    io_context& ioc,
+    std::shared_ptr<client::CachingResolver> resolver,
+    const std::string& host,
+    const std::string& service)
 {
   LOG_INFO("Starting DNS resolution for {}:{}", host, service);
-  
-  // 使用shared_ptr管理resolver，防止在异步操作完成前被销毁
-  auto resolver = std::make_shared<asio::ip::tcp::resolver>(ioc);
+
   resolver->async_resolve(
       host,
       service,
-      [resolver, &ioc](const asio::error_code& ec, asio::ip::tcp::resolver::results_type results)
+      [&ioc](const asio::error_code& ec, client::CachingResolver::Endpoints results)
       {
         if (!ec)
         {
           LOG_INFO("resolve success, found {} endpoints", results.size());
-          for (const auto& entry : results)
+          for (const auto& endpoint : results)
           {
-            LOG_INFO("endpoint: {}:{}", entry.endpoint().address().to_string(), entry.endpoint().port());
-            
-            // 使用shared_ptr管理socket，防止在异步操作完成前被销毁
-            auto socket = std::make_shared<tcp_socket>(ioc);
-            socket->async_connect(
-                entry.endpoint(),
-                [socket](const asio::error_code& ec)
-                {
-                  if (!ec)
-                  {
-                    LOG_INFO("connect to server success");
-                    // 断开连接
-                    socket->close();
-                    LOG_INFO("shutdown socket success");
-                  }
-                  else
-                  {
-                    LOG_ERR("connect to server failed: {}", ec.message());
-                  }
-                });
-            
-            // 只连接第一个可用的endpoint
-            break;
+            LOG_INFO("endpoint: {}:{}", endpoint.address().to_string(), endpoint.port());
           }
+
+          // 所有endpoint错开并行连接，第一个连上的胜出，不会卡在一个不通的地址上
+          client::async_connect_fast(
+              ioc.get_executor(),
+              std::move(results),
+              [](const asio::error_code& ec, client::ConnectResult result)
+              {
+                client::log_connect_attempts(result.attempts);
+                if (!ec)
+                {
+                  LOG_INFO("connect to server success");
+                  // 断开连接
+                  result.socket.close();
+                  LOG_INFO("shutdown socket success");
+                }
+                else
+                {
+                  LOG_ERR("connect to server failed: {}", ec.message());
+                }
+              });
         }
         else
         {
@@ -75,23 +78,33 @@ int main()
   io_context ioc;
   
   LOG_INFO("Starting resolver test...");
+  auto resolver = std::make_shared<client::CachingResolver>(ioc);
   
   // 方式1: 直接使用端口号
-  connectToServer(ioc,"test.pp.com","9527");
+  connectToServer(ioc, resolver, "test.pp.com", "9527");
+  // 并发的第二次查询会合并到第一次里，不会再调用getaddrinfo
+  connectToServer(ioc, resolver, "test.pp.com", "9527");
   
   // 方式2: 使用服务名称（需要系统支持）
-  // connectToServer(ioc,"test.pp.com","http");   // 默认80端口
-  // connectToServer(ioc,"test.pp.com","https");  // 默认443端口
-  // connectToServer(ioc,"test.pp.com","ftp");    // 默认21端口
+  // connectToServer(ioc, resolver, "test.pp.com", "http");   // 默认80端口
+  // connectToServer(ioc, resolver, "test.pp.com", "https");  // 默认443端口
+  // connectToServer(ioc, resolver, "test.pp.com", "ftp");    // 默认21端口
   
   // 方式3: 其他常用端口示例
-  // connectToServer(ioc,"test.pp.com","22");     // SSH
-  // connectToServer(ioc,"test.pp.com","3306");   // MySQL
-  // connectToServer(ioc,"test.pp.com","5432");   // PostgreSQL
-  // connectToServer(ioc,"test.pp.com","6379");   // Redis
+  // connectToServer(ioc, resolver, "test.pp.com", "22");     // SSH
+  // connectToServer(ioc, resolver, "test.pp.com", "3306");   // MySQL
+  // connectToServer(ioc, resolver, "test.pp.com", "5432");   // PostgreSQL
+  // connectToServer(ioc, resolver, "test.pp.com", "6379");   // Redis
   
   LOG_INFO("Starting event loop...");
   ioc.run();
+  auto stats = resolver->stats();
+  LOG_INFO(
+      "resolver stats: backend_lookups={} hits={} coalesced={} negative_hits={}",
+      stats.backend_lookups,
+      stats.hits,
+      stats.coalesced,
+      stats.negative_hits);
   
   LOG_INFO("Event loop completed, program exiting...");
   
@@ -1,5 +1,19 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2025-10-13 15:39:47
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 16:34:56
+ * @FilePath: \asio-learn-code\src\asio_learn\sessionTimeoutTest.cpp
+ * @Description: SessionTimeoutManager 粗粒度tick空闲超时示例
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
 
-#include "asio_learn/sessionTimeoutManager.hpp"
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "asio_learn/SessionTimeoutManager.hpp"
 #include "common/Log.hpp"
 using namespace asio_learn;
 
@@ -10,5 +24,55 @@ int main()
   common::loadLogConfig(config, "log.yaml");
   auto logger = common::create_logger();
   logger->Init(config);
+
+  io_context ioc;
+  // 空闲2秒超时，每200ms清扫一次，每次最多扫描4个槽位
+  SessionTimeoutManager manager(ioc, std::chrono::seconds(2), std::chrono::milliseconds(200), 4);
+  manager.start();
+
+  // 模拟10个会话: 偶数会话每500ms活跃一次，奇数会话从不活跃
+  const int session_count = 10;
+  std::vector<SessionTimeoutManager::SlotId> slots;
+  for (int i = 0; i < session_count; ++i)
+  {
+    slots.push_back(manager.add([i]() { LOG_INFO("session {} idle timeout, close it", i); }));
+  }
+
+  auto heartbeat = std::make_shared<steady_timer>(ioc);
+  std::function<void()> beat = [&]()
+  {
+    heartbeat->expires_after(std::chrono::milliseconds(500));
+    heartbeat->async_wait(
+        [&](const asio::error_code& ec)
+        {
+          if (ec)
+          {
+            return;
+          }
+          for (int i = 0; i < session_count; i += 2)
+          {
+            manager.touch(slots[i]);
+          }
+          beat();
+        });
+  };
+  beat();
+
+  // 5秒后结束示例
+  steady_timer stop_timer(ioc, std::chrono::seconds(5));
+  stop_timer.async_wait(
+      [&](const asio::error_code&)
+      {
+        LOG_INFO("active sessions:{} expired sessions:{}", manager.active_count(), manager.expired_total());
+        heartbeat->cancel();
+        manager.stop();
+      });
+
+  ioc.run();
+  for (auto slot : slots)
+  {
+    manager.remove(slot);
+  }
+  logger->ShutDown();
   return 0;
-}
\ No newline at end of file
+}
@@ -15,6 +15,8 @@
 #include <memory>
 #include <functional>
 #include"asio_learn/tcp_server.hpp"
+#include "asio_learn/metrics/loop_lag_monitor.hpp"
+#include "asio_learn/metrics/metrics_server.hpp"
 
 
 int main(){
@@ -23,7 +25,17 @@ int main(){
   common::loadLogConfig(config, "log.yaml");
   common::create_logger()->Init(config);
   asio::io_context ioc;
-  auto tcp_server = std::make_shared<asio_learn::TcpServer>(ioc, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), 9527));
+  // 指标: curl http://127.0.0.1:10527/metrics，注册表要比服务器活得久
+  asio_learn::metrics::Registry registry;
+  asio_learn::metrics::MetricsServer metrics_server(registry, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), 10527));
+  metrics_server.start();
+  auto tcp_server = std::make_shared<asio_learn::TcpServer>(
+      ioc,
+      asio::ip::tcp::endpoint(asio::ip::tcp::v4(), 9527),
+      asio_learn::metrics::ServerMetrics::create(registry, "tcp_echo_server"));
   tcp_server->start();
+  // 单线程循环，延迟探针只挂一个定时器
+  asio_learn::metrics::LoopLagMonitor lag_monitor(ioc, "main", {}, &registry);
+  lag_monitor.start();
   ioc.run();
 }
\ No newline at end of file
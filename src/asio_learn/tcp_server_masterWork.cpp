@@ -23,14 +23,19 @@
   主线程:负责接受接连和派发会话
   工作线程：维护会话
   */
+#include <cstdlib>
+#include <cstring>
 #include <memory>
+#include <optional>
 #include <sstream>
 #include <thread>
 #include <vector>
 
 #include "asio_learn/public.hpp"
 #include "common/Log.hpp"
+#include "asio_learn/metrics/metrics_server.hpp"
 #include "asio_learn/tcp_server_master_worker.hpp"
+#include "asio_learn/trace/tracer.hpp"
 using namespace asio_learn;
 
 
@@ -41,8 +46,40 @@ int main()
   common::loadLogConfig(config, "log.yaml");
   auto logger = common::create_logger();
   logger->Init(config);
-  MasterWorkerTcpServer server(asio::ip::tcp::endpoint(asio::ip::tcp::v4(), 9986), std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() * 2 : 4);
-  server.run();
+  // 热重启: 直接再启动一个新进程即可，新进程从旧进程继承监听socket和空闲连接，旧进程排空后自动退出
+  HotRestartOptions hot_restart;
+  hot_restart.control_path = "/tmp/asio_learn_masterwork.sock";
+  hot_restart.handoff_idle_connections = true;
+  {
+    // 指标: curl http://127.0.0.1:10986/metrics; 热重启时端口还在旧进程手里，新进程每秒重试，旧进程排空退出后接上
+    metrics::Registry registry;
+    std::unique_ptr<metrics::MetricsServer> metrics_server;
+    try
+    {
+      metrics_server = std::make_unique<metrics::MetricsServer>(
+          registry, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), 10986), std::chrono::seconds(1));
+      metrics_server->start();
+    }
+    catch (const std::exception& e)
+    {
+      LOG_WARN("metrics endpoint disabled: {}", e.what());
+    }
+    // 追踪默认关闭; ASIO_LEARN_TRACE=1 启动后 kill -USR2 <pid> 把各线程最近的事件导出到 trace_<pid>_<n>.json，用 ui.perfetto.dev 打开
+    std::optional<trace::SignalDumper> trace_dumper;
+    if (const char* env = std::getenv("ASIO_LEARN_TRACE"); env && std::strcmp(env, "1") == 0)
+    {
+      trace::Tracer::instance().enable();
+      trace_dumper.emplace("trace");
+    }
+    // 60秒无读写的会话由worker的清扫定时器关闭
+    MasterWorkerTcpServer server(
+        asio::ip::tcp::endpoint(asio::ip::tcp::v4(), 9986),
+        std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() * 2 : 4,
+        std::chrono::seconds(60),
+        hot_restart,
+        metrics::ServerMetrics::create(registry, "master_worker"));
+    server.run();
+  }  // server析构时还会写日志，必须在ShutDown之前
   logger->ShutDown();
   return 0;
 }
\ No newline at end of file
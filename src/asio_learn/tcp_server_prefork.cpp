@@ -0,0 +1,46 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 16:17:39
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 16:17:39
+ * @FilePath: \asio-learn-code\src\asio_learn\tcp_server_prefork.cpp
+ * @Description: tcp_server 多进程(prefork)示例
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+
+/**
+  master进程:负责接受连接，通过SCM_RIGHTS把连接派发给子进程
+  子进程：单线程reactor维护会话，崩溃后由master重新拉起
+  和 tcp_server_masterWork 使用相同的会话实现，方便做吞吐量对比
+  */
+#include <thread>
+
+#include "asio_learn/public.hpp"
+#include "asio_learn/tcp_server_prefork.hpp"
+#include "common/Log.hpp"
+using namespace asio_learn;
+
+int main()
+{
+  // 初始化日志配置并保持其生命周期, 子进程也会走到这里
+  common::LoggerConfig config;
+  common::loadLogConfig(config, "log.yaml");
+  auto logger = common::create_logger();
+  logger->Init(config);
+
+  // 被master拉起的子进程直接进入子进程reactor
+  if (PreforkTcpServer::is_child())
+  {
+    int rc = PreforkTcpServer::run_child();
+    logger->ShutDown();
+    return rc;
+  }
+
+  PreforkTcpServer server(
+      asio::ip::tcp::endpoint(asio::ip::tcp::v4(), 9987),
+      std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 4,
+      std::chrono::seconds(60));
+  server.run();
+  logger->ShutDown();
+  return 0;
+}
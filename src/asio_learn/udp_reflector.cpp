@@ -0,0 +1,67 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 17:10:30
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:20:32
+ * @FilePath: \asio-learn-code\src\asio_learn\udp_reflector.cpp
+ * @Description: UDP反射服务器示例，监听9528，tool_udp_benchmark 的对端
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#include <chrono>
+#include <functional>
+#include <thread>
+
+#include "asio_learn/public.hpp"
+#include "asio_learn/udp_reflector.hpp"
+#include "common/Log.hpp"
+using namespace asio_learn;
+
+int main()
+{
+  common::LoggerConfig config;
+  common::loadLogConfig(config, "log.yaml");
+  auto logger = common::create_logger();
+  logger->Init(config);
+  {
+    UdpReflectorOptions options;
+    options.threads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+    UdpReflector reflector(udp_endpoint(asio::ip::udp::v4(), 9528), options);
+    reflector.start();
+
+    // 主线程只处理退出信号和定期打印统计
+    io_context ioc;
+    asio::signal_set signals(ioc, SIGINT, SIGTERM);
+    steady_timer timer(ioc);
+    std::function<void()> report = [&]()
+    {
+      timer.expires_after(std::chrono::seconds(5));
+      timer.async_wait(
+          [&](const error_code& ec)
+          {
+            if (ec)
+            {
+              return;
+            }
+            auto stats = reflector.stats();
+            LOG_INFO(
+                "received={} sent={} dropped={} truncated={} avg batch={:.1f}",
+                stats.received,
+                stats.sent,
+                stats.dropped,
+                stats.truncated,
+                stats.batches ? double(stats.received) / stats.batches : 0.0);
+            report();
+          });
+    };
+    report();
+    signals.async_wait(
+        [&](const error_code&, int)
+        {
+          timer.cancel();
+          reflector.stop();
+        });
+    ioc.run();
+  }
+  logger->ShutDown();
+  return 0;
+}
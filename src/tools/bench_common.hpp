@@ -0,0 +1,221 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 19:28:38
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:20:05
+ * @FilePath: \asio-learn-code\src\tools\bench_common.hpp
+ * @Description: 压测工具共用的部分: 命令行解析、测量窗口、按线程跑io_context和tick调度、延迟分位数输出、JSON报告
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_TOOLS_BENCH_COMMON_HPP
+#define ASIO_LEARN_TOOLS_BENCH_COMMON_HPP
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <asio.hpp>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "common/LatencyHistogram.hpp"
+
+namespace bench
+{
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * @brief 数值选项: 整个字符串必须是T能表示的数，并且落在[min, max]里，否则抛std::invalid_argument
+   *        不像stoul那样接受"-1"或者把70000截成unsigned short
+   */
+  template<typename T>
+  T parse_number(
+      const std::string& value, T min = std::numeric_limits<T>::lowest(), T max = std::numeric_limits<T>::max())
+  {
+    T result{};
+    const char* end = value.data() + value.size();
+    auto [ptr, ec] = std::from_chars(value.data(), end, result);
+    // 反着比较，nan也会被拒绝
+    if (ec != std::errc() || ptr != end || !(result >= min && result <= max))
+    {
+      throw std::invalid_argument(value);
+    }
+    return result;
+  }
+
+  /**
+   * @brief 解析"--key value"形式的参数，flags里的选项不带值，回调收到空字符串
+   * @param on_option 认识的选项返回true; 数值用parse_number，抛出的异常在这里报成"invalid value for"
+   * @return --help/-h或者参数有误时返回false，调用方打印用法
+   */
+  inline bool parse_options(
+      int argc,
+      char** argv,
+      const std::function<bool(const std::string& key, const std::string& value)>& on_option,
+      const std::vector<std::string>& flags = {})
+  {
+    std::string key;
+    try
+    {
+      for (int i = 1; i < argc; ++i)
+      {
+        key = argv[i];
+        if (key == "--help" || key == "-h")
+        {
+          return false;
+        }
+        bool flag = std::find(flags.begin(), flags.end(), key) != flags.end();
+        if (!flag && i + 1 >= argc)
+        {
+          std::cerr << "missing value for " << key << std::endl;
+          return false;
+        }
+        if (!on_option(key, flag ? std::string() : std::string(argv[++i])))
+        {
+          std::cerr << "unknown option " << key << std::endl;
+          return false;
+        }
+      }
+    }
+    catch (const std::logic_error&)
+    {
+      std::cerr << "invalid value for " << key << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  struct RunWindow
+  {
+    Clock::time_point measure_begin;
+    Clock::time_point measure_end;
+  };
+
+  // 从现在起预热warmup秒，之后测量duration秒
+  inline RunWindow make_run_window(double warmup, double duration)
+  {
+    RunWindow window;
+    window.measure_begin =
+        Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(warmup));
+    window.measure_end =
+        window.measure_begin + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(duration));
+    return window;
+  }
+
+  inline double to_us(uint64_t ns)
+  {
+    return static_cast<double>(ns) / 1000.0;
+  }
+
+  /**
+   * @brief 每个线程跑contexts里的一个io_context，阻塞到全部线程结束
+   * @param tick 为0时不调度on_tick; 否则按绝对时间每tick调用一次on_tick(线程号, now)，处理慢了也不会少排计划，
+   *        过了tick_until不再调度
+   * @param on_stop 到stop_at时在对应线程上调用，之后不会再有on_tick
+   */
+  inline void run_threads(
+      std::vector<std::unique_ptr<asio::io_context>>& contexts,
+      std::chrono::microseconds tick,
+      Clock::time_point tick_until,
+      Clock::time_point stop_at,
+      const std::function<void(size_t, Clock::time_point)>& on_tick,
+      const std::function<void(size_t)>& on_stop)
+  {
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < contexts.size(); ++t)
+    {
+      threads.emplace_back(
+          [&, t]()
+          {
+            asio::steady_timer tick_timer(*contexts[t]);
+            bool stopped = false;  // 已排队的tick回调不受cancel影响，靠这个标志停下
+            std::function<void(Clock::time_point)> schedule = [&](Clock::time_point next)
+            {
+              tick_timer.expires_at(next);
+              tick_timer.async_wait(
+                  [&, next](const asio::error_code& ec)
+                  {
+                    if (ec || stopped)
+                    {
+                      return;
+                    }
+                    auto now = Clock::now();
+                    on_tick(t, now);
+                    if (now < tick_until)
+                    {
+                      schedule(std::max(next + tick, now));
+                    }
+                  });
+            };
+            if (tick.count() > 0)
+            {
+              schedule(Clock::now());
+            }
+
+            asio::steady_timer stop_timer(*contexts[t], stop_at);
+            stop_timer.async_wait(
+                [&](const asio::error_code&)
+                {
+                  stopped = true;
+                  tick_timer.cancel();
+                  on_stop(t);
+                });
+            contexts[t]->run();
+          });
+    }
+    for (auto& thread : threads)
+    {
+      thread.join();
+    }
+  }
+
+  // 一行分位数，label占summary的第一列
+  inline void print_latency(const std::string& label, const common::LatencyHistogram& latency)
+  {
+    std::cout << std::left << std::setw(14) << label << std::right << "min " << to_us(latency.min()) << "  mean "
+              << latency.mean() / 1000.0 << "  p50 " << to_us(latency.value_at_percentile(50)) << "  p99 "
+              << to_us(latency.value_at_percentile(99)) << "  p99.9 " << to_us(latency.value_at_percentile(99.9))
+              << "  max " << to_us(latency.max()) << std::endl;
+  }
+
+  inline nlohmann::ordered_json latency_report(const common::LatencyHistogram& latency)
+  {
+    nlohmann::ordered_json report;
+    report["min"] = to_us(latency.min());
+    report["mean"] = latency.mean() / 1000.0;
+    report["p50"] = to_us(latency.value_at_percentile(50));
+    report["p90"] = to_us(latency.value_at_percentile(90));
+    report["p99"] = to_us(latency.value_at_percentile(99));
+    report["p99.9"] = to_us(latency.value_at_percentile(99.9));
+    report["p99.99"] = to_us(latency.value_at_percentile(99.99));
+    report["max"] = to_us(latency.max());
+    return report;
+  }
+
+  // path为"-"时输出到标准输出
+  inline void write_report(const std::string& path, const nlohmann::ordered_json& report)
+  {
+    auto text = report.dump(2);
+    if (path == "-")
+    {
+      std::cout << text << std::endl;
+      return;
+    }
+    std::ofstream out(path);
+    out << text << std::endl;
+    spdlog::info("report written to {}", path);
+  }
+}  // namespace bench
+
+#endif  // ASIO_LEARN_TOOLS_BENCH_COMMON_HPP
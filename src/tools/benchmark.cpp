@@ -1,20 +1,477 @@
-#include <iostream>
-#include <asio.hpp>
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 23:10:42
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:18:46
+ * @FilePath: \asio-learn-code\src\tools\benchmark.cpp
+ * @Description: TCP回显压测工具：多线程客户端、闭环/开环两种模式，输出延迟分位数和吞吐(可选JSON)
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+
+/**
+ 用法:
+   tool_benchmark --port 9986 --connections 64 --threads 4 --size 64 --pipeline 8 --duration 10 --json result.json
+ 每条连接是一个闭环: 保持pipeline个消息在途，收到一个完整回显就再发一个
+ 回显是按序的字节流，所以发送时间用FIFO记录，第n个收到的消息对应第n个发出的
+ 只统计预热(--warmup)之后、duration之内完成的消息
+
+ 开环模式(--rate N): 按固定速率发送，不管回包，避免闭环压测的 coordinated omission
+   tool_benchmark --port 9986 --connections 64 --threads 4 --rate 1000000 --duration 10
+ - 每条连接分到 rate/connections 的速率，第k个消息的计划发送时间是 begin + k/速率
+ - 每个线程一个tick定时器(--tick-us)，把到期的消息攒成一次写；写没完成就继续攒
+ - 延迟从计划发送时间算起，服务器卡住期间本该发出的消息都会计入卡顿时间
+ - 计划时间落在测量窗口内、结束时还没回来的消息记为outstanding
+ */
 #include <spdlog/spdlog.h>
 
-int main() {
-    spdlog::info("Starting network performance benchmark...");
-    
-    try {
-        // 这里添加您的基准测试逻辑
-        spdlog::info("Running TCP throughput test...");
-        spdlog::info("Running UDP latency test...");
-        spdlog::info("Benchmark completed successfully");
-    }
-    catch (std::exception& e) {
-        spdlog::error("Benchmark error: {}", e.what());
-        return 1;
-    }
-    
-    return 0;
-}
\ No newline at end of file
+#include <asio.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_common.hpp"
+#include "common/LatencyHistogram.hpp"
+
+namespace
+{
+  using bench::Clock;
+  using bench::RunWindow;
+  using bench::to_us;
+
+  struct BenchmarkConfig
+  {
+    std::string host = "127.0.0.1";
+    unsigned short port = 9986;
+    std::string target;  // 写进JSON，区分被测服务器
+    size_t connections = 64;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t message_size = 64;
+    size_t pipeline = 1;
+    double rate = 0;  // 开环模式的总发送速率(msgs/s)，为0表示闭环
+    std::chrono::microseconds tick{ 100 };
+    double duration = 10.0;
+    double warmup = 1.0;
+    std::string json_path;  // "-" 表示输出到标准输出
+  };
+
+  // 每个线程一份，只在本线程写，结束后汇总
+  struct ThreadStats
+  {
+    common::LatencyHistogram latency;  // 纳秒
+    uint64_t messages = 0;
+    uint64_t scheduled = 0;    // 开环: 测量窗口内计划发送的消息
+    uint64_t outstanding = 0;  // 开环: 测量窗口内计划发送但结束时没收到回显的消息
+    uint64_t connected = 0;
+    uint64_t errors = 0;
+  };
+
+  constexpr size_t MAX_WRITE_BYTES = 256 * 1024;
+
+  class Connection : public std::enable_shared_from_this<Connection>
+  {
+   public:
+    Connection(asio::io_context& ioc, ThreadStats& stats, const BenchmarkConfig& config, const RunWindow& window)
+      : _socket(ioc)
+      , _stats(stats)
+      , _config(config)
+      , _window(window)
+      , _send_buffer(config.message_size * config.pipeline, 'x')
+      , _recv_buffer(64 * 1024)
+    {
+      if (config.rate > 0)
+      {
+        _interval = std::chrono::duration<double, std::nano>(
+            1e9 * static_cast<double>(config.connections) / config.rate);
+      }
+    }
+
+    void start(const asio::ip::tcp::endpoint& endpoint)
+    {
+      _socket.async_connect(
+          endpoint,
+          [self = shared_from_this()](const asio::error_code& ec)
+          {
+            if (ec)
+            {
+              ++self->_stats.errors;
+              spdlog::error("connect failed: {}", ec.message());
+              return;
+            }
+            ++self->_stats.connected;
+            self->_socket.set_option(asio::ip::tcp::no_delay(true));
+            if (self->open_loop())
+            {
+              // 从连上的时刻开始排计划，计划时间不受回包快慢影响
+              self->_schedule_begin = Clock::now();
+            }
+            else
+            {
+              self->_unsent = self->_config.pipeline;
+              self->do_write();
+            }
+            self->do_read();
+          });
+    }
+
+    // 开环: 由线程的tick定时器调用，把到now为止该发的消息排进发送队列
+    void schedule(Clock::time_point now)
+    {
+      if (!_socket.is_open() || _schedule_begin == Clock::time_point{})
+      {
+        return;
+      }
+      auto due = static_cast<uint64_t>((now - _schedule_begin) / _interval) + 1;
+      for (; _scheduled < due; ++_scheduled)
+      {
+        auto intended = _schedule_begin + std::chrono::duration_cast<Clock::duration>(_interval * _scheduled);
+        _send_times.push_back(intended);
+        if (intended >= _window.measure_begin && intended < _window.measure_end)
+        {
+          ++_stats.scheduled;
+        }
+        ++_unsent;
+      }
+      do_write();
+    }
+
+    void stop()
+    {
+      if (open_loop())
+      {
+        for (auto intended : _send_times)
+        {
+          if (intended >= _window.measure_begin && intended < _window.measure_end)
+          {
+            ++_stats.outstanding;
+          }
+        }
+        _send_times.clear();
+      }
+      asio::error_code ignored;
+      _socket.close(ignored);
+    }
+
+   private:
+    bool open_loop() const
+    {
+      return _config.rate > 0;
+    }
+
+    // 把攒下的消息一次写出去
+    void do_write()
+    {
+      if (_writing || _unsent == 0 || !_socket.is_open())
+      {
+        return;
+      }
+      size_t count = _unsent;
+      if (open_loop())
+      {
+        // 服务器卡住时积压会很多，单次写最多MAX_WRITE_BYTES，剩下的写完再发
+        count = std::min(count, std::max<size_t>(1, MAX_WRITE_BYTES / _config.message_size));
+        if (_send_buffer.size() < count * _config.message_size)
+        {
+          _send_buffer.resize(count * _config.message_size, 'x');
+        }
+      }
+      _unsent -= count;
+      _writing = true;
+      if (!open_loop())
+      {
+        // 闭环: 发出时刻就是计划时刻
+        auto now = Clock::now();
+        for (size_t i = 0; i < count; ++i)
+        {
+          _send_times.push_back(now);
+        }
+      }
+      asio::async_write(
+          _socket,
+          asio::buffer(_send_buffer.data(), count * _config.message_size),
+          [self = shared_from_this()](const asio::error_code& ec, std::size_t)
+          {
+            self->_writing = false;
+            if (ec)
+            {
+              self->on_error(ec);
+              return;
+            }
+            self->do_write();
+          });
+    }
+
+    void do_read()
+    {
+      _socket.async_read_some(
+          asio::buffer(_recv_buffer),
+          [self = shared_from_this()](const asio::error_code& ec, std::size_t bytes)
+          {
+            if (ec)
+            {
+              self->on_error(ec);
+              return;
+            }
+            self->on_bytes(bytes);
+            if (!self->open_loop())
+            {
+              self->do_write();
+            }
+            self->do_read();
+          });
+    }
+
+    void on_bytes(size_t bytes)
+    {
+      _partial += bytes;
+      auto now = Clock::now();
+      bool measuring = now >= _window.measure_begin && now < _window.measure_end;
+      while (_partial >= _config.message_size && !_send_times.empty())
+      {
+        _partial -= _config.message_size;
+        auto sent = _send_times.front();
+        // 开环按计划发送时间归属测量窗口，闭环按完成时间
+        bool in_window = open_loop() ? (sent >= _window.measure_begin && sent < _window.measure_end) : measuring;
+        if (in_window)
+        {
+          auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(now - sent).count();
+          _stats.latency.record(static_cast<uint64_t>(latency));
+          ++_stats.messages;
+        }
+        _send_times.pop_front();
+        if (!open_loop())
+        {
+          ++_unsent;
+        }
+      }
+    }
+
+    void on_error(const asio::error_code& ec)
+    {
+      // 结束时主动关闭的连接不算错误
+      if (ec != asio::error::operation_aborted && Clock::now() < _window.measure_end)
+      {
+        ++_stats.errors;
+        spdlog::error("connection error: {}", ec.message());
+      }
+      stop();
+    }
+
+    asio::ip::tcp::socket _socket;
+    ThreadStats& _stats;
+    const BenchmarkConfig& _config;
+    const RunWindow& _window;
+    std::string _send_buffer;
+    std::vector<char> _recv_buffer;
+    std::deque<Clock::time_point> _send_times;
+    std::chrono::duration<double, std::nano> _interval{ 0 };
+    Clock::time_point _schedule_begin;
+    uint64_t _scheduled = 0;
+    size_t _partial = 0;
+    size_t _unsent = 0;
+    bool _writing = false;
+  };
+
+  void print_usage()
+  {
+    std::cout << "usage: tool_benchmark [options]\n"
+                 "  --host <ip>            target host (default 127.0.0.1)\n"
+                 "  --port <port>          target port (default 9986)\n"
+                 "  --target <name>        label written into the JSON report\n"
+                 "  --connections <n>      concurrent connections (default 64)\n"
+                 "  --threads <n>          client io_context threads (default hardware_concurrency)\n"
+                 "  --size <bytes>         message size (default 64)\n"
+                 "  --pipeline <n>         in-flight messages per connection (default 1, closed loop)\n"
+                 "  --rate <msgs/s>        open-loop mode: total fixed send rate across all connections\n"
+                 "  --tick-us <us>         open-loop scheduler tick (default 100)\n"
+                 "  --duration <seconds>   measured duration (default 10)\n"
+                 "  --warmup <seconds>     warmup before measuring (default 1)\n"
+                 "  --json <path|->        write JSON report\n";
+  }
+
+  bool parse_args(int argc, char** argv, BenchmarkConfig& config)
+  {
+    bool parsed = bench::parse_options(
+        argc,
+        argv,
+        [&](const std::string& key, const std::string& value)
+        {
+          if (key == "--host")
+            config.host = value;
+          else if (key == "--port")
+            config.port = bench::parse_number<unsigned short>(value, 1);
+          else if (key == "--target")
+            config.target = value;
+          else if (key == "--connections")
+            config.connections = bench::parse_number<size_t>(value);
+          else if (key == "--threads")
+            config.threads = bench::parse_number<size_t>(value);
+          else if (key == "--size")
+            config.message_size = bench::parse_number<size_t>(value);
+          else if (key == "--pipeline")
+            config.pipeline = bench::parse_number<size_t>(value);
+          else if (key == "--rate")
+            config.rate = bench::parse_number<double>(value, 0.0);
+          else if (key == "--tick-us")
+            config.tick = std::chrono::microseconds(bench::parse_number<size_t>(value));
+          else if (key == "--duration")
+            config.duration = bench::parse_number<double>(value, 0.0);
+          else if (key == "--warmup")
+            config.warmup = bench::parse_number<double>(value, 0.0);
+          else if (key == "--json")
+            config.json_path = value;
+          else
+            return false;
+          return true;
+        });
+    if (!parsed)
+    {
+      return false;
+    }
+    config.threads = std::max<size_t>(1, std::min(config.threads, config.connections));
+    config.message_size = std::max<size_t>(1, config.message_size);
+    config.pipeline = std::max<size_t>(1, config.pipeline);
+    config.tick = std::max(config.tick, std::chrono::microseconds(1));
+    return config.connections > 0 && config.duration > 0;
+  }
+
+  nlohmann::ordered_json make_report(const BenchmarkConfig& config, const ThreadStats& total)
+  {
+    double msgs_per_sec = static_cast<double>(total.messages) / config.duration;
+    nlohmann::ordered_json report;
+    report["tool"] = "tool_benchmark";
+    report["config"]["target"] = config.target;
+    report["config"]["host"] = config.host;
+    report["config"]["port"] = config.port;
+    report["config"]["connections"] = config.connections;
+    report["config"]["threads"] = config.threads;
+    report["config"]["message_size"] = config.message_size;
+    report["config"]["mode"] = config.rate > 0 ? "open_loop" : "closed_loop";
+    report["config"]["pipeline"] = config.pipeline;
+    report["config"]["rate"] = config.rate;
+    report["config"]["duration_s"] = config.duration;
+    report["config"]["warmup_s"] = config.warmup;
+    report["results"]["connected"] = total.connected;
+    report["results"]["errors"] = total.errors;
+    report["results"]["messages"] = total.messages;
+    report["results"]["scheduled"] = total.scheduled;
+    report["results"]["outstanding"] = total.outstanding;
+    report["results"]["msgs_per_sec"] = msgs_per_sec;
+    // 单向有效载荷吞吐，MB = 10^6 字节
+    report["results"]["mb_per_sec"] = msgs_per_sec * static_cast<double>(config.message_size) / 1e6;
+    report["latency_us"] = bench::latency_report(total.latency);
+    return report;
+  }
+
+  void print_summary(const BenchmarkConfig& config, const ThreadStats& total)
+  {
+    double msgs_per_sec = static_cast<double>(total.messages) / config.duration;
+    std::cout << "target        " << config.host << ":" << config.port << "\n"
+              << "connections   " << total.connected << "/" << config.connections << " (errors " << total.errors << ")\n"
+              << "messages      " << total.messages << " in " << config.duration << "s\n";
+    if (config.rate > 0)
+    {
+      std::cout << "open loop     target " << config.rate << " msgs/s, scheduled " << total.scheduled
+                << ", outstanding " << total.outstanding << "\n";
+    }
+    std::cout << "throughput    " << msgs_per_sec << " msgs/s, "
+              << msgs_per_sec * static_cast<double>(config.message_size) / 1e6 << " MB/s\n";
+    bench::print_latency("latency(us)", total.latency);
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  BenchmarkConfig config;
+  if (!parse_args(argc, argv, config))
+  {
+    print_usage();
+    return 1;
+  }
+
+  try
+  {
+    asio::io_context resolve_ioc;
+    asio::ip::tcp::resolver resolver(resolve_ioc);
+    auto endpoint = *resolver.resolve(config.host, std::to_string(config.port)).begin();
+
+    spdlog::info(
+        "benchmark {}:{} connections={} threads={} size={} {} duration={}s warmup={}s",
+        config.host,
+        config.port,
+        config.connections,
+        config.threads,
+        config.message_size,
+        config.rate > 0 ? "rate=" + std::to_string(static_cast<uint64_t>(config.rate)) + "/s"
+                        : "pipeline=" + std::to_string(config.pipeline),
+        config.duration,
+        config.warmup);
+
+    auto window = bench::make_run_window(config.warmup, config.duration);
+
+    // 每个线程一个io_context，连接按轮询分到各线程，线程之间没有共享状态
+    std::vector<std::unique_ptr<asio::io_context>> contexts;
+    std::vector<ThreadStats> stats(config.threads);
+    std::vector<std::vector<std::shared_ptr<Connection>>> connections(config.threads);
+    for (size_t t = 0; t < config.threads; ++t)
+    {
+      contexts.push_back(std::make_unique<asio::io_context>(1));
+    }
+    for (size_t i = 0; i < config.connections; ++i)
+    {
+      size_t t = i % config.threads;
+      auto conn = std::make_shared<Connection>(*contexts[t], stats[t], config, window);
+      conn->start(endpoint.endpoint());
+      connections[t].push_back(conn);
+    }
+
+    // 开环: 每个线程的tick把到期的消息排进各连接的发送队列
+    bench::run_threads(
+        contexts,
+        config.rate > 0 ? config.tick : std::chrono::microseconds(0),
+        window.measure_end,
+        window.measure_end,
+        [&](size_t t, Clock::time_point now)
+        {
+          for (auto& conn : connections[t])
+          {
+            conn->schedule(now);
+          }
+        },
+        [&](size_t t)
+        {
+          for (auto& conn : connections[t])
+          {
+            conn->stop();
+          }
+        });
+
+    ThreadStats total;
+    for (const auto& s : stats)
+    {
+      total.latency.merge(s.latency);
+      total.messages += s.messages;
+      total.scheduled += s.scheduled;
+      total.outstanding += s.outstanding;
+      total.connected += s.connected;
+      total.errors += s.errors;
+    }
+
+    print_summary(config, total);
+    if (!config.json_path.empty())
+    {
+      bench::write_report(config.json_path, make_report(config, total));
+    }
+    return total.errors == 0 ? 0 : 2;
+  }
+  catch (std::exception& e)
+  {
+    spdlog::error("Benchmark error: {}", e.what());
+    return 1;
+  }
+}
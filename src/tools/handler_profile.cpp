@@ -0,0 +1,360 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 17:53:06
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:18:33
+ * @FilePath: \asio-learn-code\src\tools\handler_profile.cpp
+ * @Description: 回调剖析工具：在进程内跑主从服务器并压测，按调用点汇总回调执行时间，输出火焰图用的折叠栈
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+
+/**
+ 用法:
+   cmake -DASIO_LEARN_HANDLER_PROFILE=ON ... 之后:
+   tool_handler_profile --duration 10 --workers 2 --connections 16 --folded handler.folded --binary handler.bin
+   tool_handler_profile --connections 0 --duration 30          用外部压测，比如 tool_benchmark --port 9986
+   tool_handler_profile --input handler.bin --folded - --top 20  把保存的二进制结果重新转换
+   flamegraph.pl handler.folded > handler.svg                    或者把.folded拖进speedscope
+
+ 一帧是一个发起异步操作的调用点，父帧是发起它时正在执行的回调; 数值是该栈上回调的自身耗时(纳秒)，
+ 不含嵌套执行的回调。循环的回调链(read -> write -> read)折叠在第一次出现的位置
+ 没有开启编译选项时只能用 --input 转换已有结果
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "asio_learn/profile/handler_profiler.hpp"
+#include "asio_learn/public.hpp"
+#include "asio_learn/tcp_server_master_worker.hpp"
+#include "bench_common.hpp"
+#include "common/Log.hpp"
+
+using namespace asio_learn;
+
+namespace
+{
+  using profile::HandlerProfiler;
+  using profile::Profile;
+
+  struct ProfileConfig
+  {
+    std::string input;
+    uint16_t port = 9986;
+    size_t workers = 2;
+    size_t connections = 8;  // 0 表示不自带压测，等外部客户端
+    size_t message_size = 64;
+    std::chrono::seconds duration{ 10 };
+    std::string log_level = "warn";
+    std::string folded_path = "handler_profile.folded";
+    std::string binary_path;
+    std::string json_path;
+    size_t top = 15;
+  };
+
+  void print_usage()
+  {
+    std::cout << "usage: tool_handler_profile [options]\n"
+                 "  --input <path>         convert a saved binary profile instead of running the server\n"
+                 "  --port <port>          server port (default 9986)\n"
+                 "  --workers <n>          worker threads (default 2)\n"
+                 "  --connections <n>      built-in echo clients, 0 waits for external load (default 8)\n"
+                 "  --size <bytes>         echo message size (default 64)\n"
+                 "  --duration <s>         profiling time (default 10)\n"
+                 "  --log-level <level>    server log level, info includes logging cost (default warn)\n"
+                 "  --folded <path|->      collapsed stacks for flamegraph.pl (default handler_profile.folded)\n"
+                 "  --binary <path>        save the raw profile for later --input\n"
+                 "  --json <path|->        per call site summary as JSON\n"
+                 "  --top <n>              call sites printed to stdout (default 15)\n";
+  }
+
+  bool parse_args(int argc, char** argv, ProfileConfig& config)
+  {
+    return bench::parse_options(
+        argc,
+        argv,
+        [&](const std::string& key, const std::string& value)
+        {
+          if (key == "--input")
+            config.input = value;
+          else if (key == "--port")
+            config.port = bench::parse_number<uint16_t>(value, 1);
+          else if (key == "--workers")
+            config.workers = bench::parse_number<size_t>(value, 1);
+          else if (key == "--connections")
+            config.connections = bench::parse_number<size_t>(value);
+          else if (key == "--size")
+            config.message_size = bench::parse_number<size_t>(value, 1);
+          else if (key == "--duration")
+            config.duration = std::chrono::seconds(bench::parse_number<size_t>(value, 1));
+          else if (key == "--log-level")
+            config.log_level = value;
+          else if (key == "--folded")
+            config.folded_path = value;
+          else if (key == "--binary")
+            config.binary_path = value;
+          else if (key == "--json")
+            config.json_path = value;
+          else if (key == "--top")
+            config.top = bench::parse_number<size_t>(value);
+          else
+            return false;
+          return true;
+        });
+  }
+
+  // 闭环回显客户端: 写一条，读回一条，再写下一条
+  class EchoClient : public std::enable_shared_from_this<EchoClient>
+  {
+   public:
+    EchoClient(io_context& ioc, size_t message_size, std::atomic<uint64_t>& round_trips)
+      : _socket(ioc)
+      , _request(message_size, 'p')
+      , _reply(message_size)
+      , _round_trips(round_trips)
+    {
+    }
+
+    void start(const tcp_endpoint& endpoint)
+    {
+      auto self = shared_from_this();
+      _socket.async_connect(
+          endpoint,
+          [self](const error_code& ec)
+          {
+            if (!ec)
+            {
+              self->_socket.set_option(asio::ip::tcp::no_delay(true));
+              self->round_trip();
+            }
+          });
+    }
+
+   private:
+    void round_trip()
+    {
+      auto self = shared_from_this();
+      asio::async_write(
+          _socket,
+          asio::buffer(_request),
+          [self](const error_code& ec, size_t /*bytes*/)
+          {
+            if (ec)
+            {
+              return;
+            }
+            asio::async_read(
+                self->_socket,
+                asio::buffer(self->_reply),
+                [self](const error_code& ec, size_t /*bytes*/)
+                {
+                  if (ec)
+                  {
+                    return;
+                  }
+                  self->_round_trips.fetch_add(1, std::memory_order_relaxed);
+                  self->round_trip();
+                });
+          });
+    }
+
+    tcp_socket _socket;
+    std::string _request;
+    std::vector<char> _reply;
+    std::atomic<uint64_t>& _round_trips;
+  };
+
+  void print_top(const Profile& profile, size_t top)
+  {
+    auto summary = profile.by_site();
+    double total = 0;
+    for (const auto& entry : summary)
+    {
+      total += entry.self_seconds;
+    }
+    std::cout << std::right << std::setw(10) << "count" << std::setw(12) << "self ms" << std::setw(8) << "self%"
+              << std::setw(10) << "avg us" << std::setw(10) << "max us"
+              << "  call site\n";
+    for (size_t i = 0; i < summary.size() && i < top; ++i)
+    {
+      const auto& entry = summary[i];
+      std::cout << std::fixed << std::setprecision(1) << std::setw(10) << entry.count << std::setw(12)
+                << entry.self_seconds * 1e3 << std::setw(8)
+                << (total > 0 ? entry.self_seconds * 100 / total : 0.0) << std::setprecision(2) << std::setw(10)
+                << entry.self_seconds * 1e6 / static_cast<double>(entry.count) << std::setw(10)
+                << entry.max_seconds * 1e6 << "  " << profile.sites[entry.site].label() << "\n";
+    }
+  }
+
+  nlohmann::ordered_json make_report(const Profile& profile)
+  {
+    nlohmann::ordered_json report;
+    report["tool"] = "tool_handler_profile";
+    report["sites"] = nlohmann::ordered_json::array();
+    for (const auto& entry : profile.by_site())
+    {
+      const auto& site = profile.sites[entry.site];
+      nlohmann::ordered_json item;
+      item["label"] = site.label();
+      item["object_type"] = site.object_type;
+      item["op_name"] = site.op_name;
+      item["file"] = site.file;
+      item["line"] = site.line;
+      item["function"] = site.func;
+      item["count"] = entry.count;
+      item["self_seconds"] = entry.self_seconds;
+      item["max_seconds"] = entry.max_seconds;
+      report["sites"].push_back(item);
+    }
+    return report;
+  }
+
+  bool write_output(const std::string& path, const std::string& what, const std::function<void(std::ostream&)>& write)
+  {
+    if (path == "-")
+    {
+      write(std::cout);
+      return true;
+    }
+    std::ofstream out(path);
+    if (!out)
+    {
+      std::cerr << "cannot write " << path << std::endl;
+      return false;
+    }
+    write(out);
+    std::cout << what << " written to " << path << std::endl;
+    return true;
+  }
+
+  std::optional<Profile> run_server(const ProfileConfig& config)
+  {
+#ifndef ASIO_LEARN_HANDLER_PROFILE
+    (void)config;
+    std::cerr << "tool_handler_profile was built without handler tracking, reconfigure with "
+                 "-DASIO_LEARN_HANDLER_PROFILE=ON and rebuild, or use --input to convert a saved profile"
+              << std::endl;
+    return std::nullopt;
+#else
+    auto& profiler = HandlerProfiler::instance();
+    // 压测客户端的回调不算进服务器的剖析结果
+    io_context load_ioc;
+    profiler.exclude(&load_ioc);
+    profiler.enable();
+
+    tcp_endpoint endpoint(asio::ip::make_address("127.0.0.1"), config.port);
+    MasterWorkerTcpServer server(endpoint, config.workers);
+    std::thread server_thread([&server]() { server.run(); });
+
+    std::atomic<uint64_t> round_trips{ 0 };
+    auto load_guard = asio::make_work_guard(load_ioc);
+    std::thread load_thread([&load_ioc]() { load_ioc.run(); });
+    for (size_t i = 0; i < config.connections; ++i)
+    {
+      std::make_shared<EchoClient>(load_ioc, config.message_size, round_trips)->start(endpoint);
+    }
+    if (config.connections == 0)
+    {
+      std::cout << "waiting for external load on port " << config.port << " for " << config.duration.count() << "s"
+                << std::endl;
+    }
+    std::this_thread::sleep_for(config.duration);
+
+    load_guard.reset();
+    load_ioc.stop();
+    load_thread.join();
+    server.stop();
+    server_thread.join();
+    profiler.disable();
+    if (config.connections > 0)
+    {
+      std::cout << round_trips.load() << " round trips in " << config.duration.count() << "s" << std::endl;
+    }
+    if (profiler.dropped() > 0)
+    {
+      std::cout << profiler.dropped() << " handlers not counted, stack table full" << std::endl;
+    }
+    return profiler.snapshot();
+#endif
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  ProfileConfig config;
+  if (!parse_args(argc, argv, config))
+  {
+    print_usage();
+    return 1;
+  }
+
+  // 日志只写文件，默认warn级别，剖析结果主要反映回调本身
+  common::LoggerConfig log_config;
+  std::filesystem::create_directories("handler_profile_log");
+  log_config.log_file = "handler_profile_log/handler_profile.log";
+  log_config.log_level = common::strToLogLevel(config.log_level);
+  log_config.enable_console = false;
+  log_config.enable_file = true;
+  auto logger = common::create_logger();
+  logger->Init(log_config);
+
+  std::optional<Profile> profile;
+  if (!config.input.empty())
+  {
+    std::string error;
+    profile = Profile::load(config.input, &error);
+    if (!profile)
+    {
+      std::cerr << "cannot load " << config.input << ": " << error << std::endl;
+    }
+  }
+  else
+  {
+    profile = run_server(config);
+  }
+  if (!profile)
+  {
+    logger->ShutDown();
+    return 1;
+  }
+
+  bool ok = true;
+  if (!config.binary_path.empty())
+  {
+    if (profile->save(config.binary_path))
+    {
+      std::cout << "profile written to " << config.binary_path << std::endl;
+    }
+    else
+    {
+      std::cerr << "cannot write " << config.binary_path << std::endl;
+      ok = false;
+    }
+  }
+  if (!config.folded_path.empty())
+  {
+    ok &= write_output(config.folded_path, "collapsed stacks", [&](std::ostream& out) { profile->write_folded(out); });
+  }
+  if (!config.json_path.empty())
+  {
+    ok &= write_output(
+        config.json_path, "report", [&](std::ostream& out) { out << make_report(*profile).dump(2) << std::endl; });
+  }
+  if (config.top > 0)
+  {
+    print_top(*profile, config.top);
+  }
+  logger->ShutDown();
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,524 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 18:19:23
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:20:59
+ * @FilePath: \asio-learn-code\src\tools\ktls_bench.cpp
+ * @Description: kTLS回环吞吐对比：同一条TLS连接上分别用OpenSSL用户态加解密、kTLS明文读写、kTLS+sendfile/splice传输大块数据
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+
+/**
+ 用法(在有resources/servercert.pem的目录下运行，kTLS需要 modprobe tls):
+   tool_ktls_bench --direction send --total-mb 1024 --tls 1.3
+   tool_ktls_bench --direction recv --cipher TLS_CHACHA20_POLY1305_SHA256 --json ktls.json
+ 进程内起一对回环连接，服务端是被测的一方，客户端始终用OpenSSL用户态加解密，顺便校验内核加密的记录
+ send: 服务端发，userspace(SSL_write) / ktls(write明文) / sendfile(文件直接进socket，不经过用户态)
+ recv: 服务端收，userspace(SSL_read) / ktls(recvmsg明文) / splice(socket -> 管道 -> /dev/null)
+ 主要看服务端线程的CPU时间，回环上吞吐受客户端解密速度限制
+ 内核不支持时kTLS的几项报告原因并跳过
+ */
+#include <openssl/ssl.h>
+#include <spdlog/spdlog.h>
+
+#include <asio.hpp>
+#include <asio/ssl.hpp>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#endif
+
+#include "asio_learn/ssl/ktls.hpp"
+#include "bench_common.hpp"
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+  using Stream = asio::ssl::stream<asio::ip::tcp::socket>;
+  using asio_learn::ssl::Ktls;
+  using asio_learn::ssl::KtlsStatus;
+
+  struct KtlsBenchConfig
+  {
+    std::string direction = "send";  // send: 服务端发; recv: 服务端收
+    std::string mode = "all";
+    uint64_t total_bytes = 512ull << 20;
+    size_t chunk = 16384;
+    std::string tls_version = "1.3";
+    std::string cipher;  // 为空用OpenSSL默认
+    std::string cert = "resources/servercert.pem";
+    std::string key = "resources/serverkey.pem";
+    std::string json_path;  // "-" 表示输出到标准输出
+  };
+
+  struct CaseResult
+  {
+    std::string mode;
+    std::string protocol;
+    std::string cipher;
+    KtlsStatus ktls;
+    bool ok = false;
+    std::string error;
+    uint64_t bytes = 0;
+    double seconds = 0;
+    double server_cpu_seconds = 0;
+    double client_cpu_seconds = 0;
+  };
+
+  void print_usage()
+  {
+    std::cout << "usage: tool_ktls_bench [options]\n"
+                 "  --direction <send|recv>  server sends or receives the bulk data (default send)\n"
+                 "  --mode <name|all>        send: userspace, ktls, sendfile; recv: userspace, ktls, splice\n"
+                 "                           (default all)\n"
+                 "  --total-mb <n>           megabytes per case (default 512)\n"
+                 "  --chunk <bytes>          write/read size (default 16384)\n"
+                 "  --tls <1.2|1.3>          protocol version (default 1.3)\n"
+                 "  --cipher <name>          OpenSSL cipher (1.2) or ciphersuite (1.3) name\n"
+                 "  --cert <path>            server certificate chain (default resources/servercert.pem)\n"
+                 "  --key <path>             server private key (default resources/serverkey.pem)\n"
+                 "  --json <path|->          write JSON report\n";
+  }
+
+  bool parse_args(int argc, char** argv, KtlsBenchConfig& config)
+  {
+    bool parsed = bench::parse_options(
+        argc,
+        argv,
+        [&](const std::string& key, const std::string& value)
+        {
+          if (key == "--direction")
+            config.direction = value;
+          else if (key == "--mode")
+            config.mode = value;
+          else if (key == "--total-mb")
+            config.total_bytes = bench::parse_number<uint64_t>(value, 1, std::numeric_limits<uint64_t>::max() >> 20) << 20;
+          else if (key == "--chunk")
+            config.chunk = bench::parse_number<size_t>(value, 1);
+          else if (key == "--tls")
+            config.tls_version = value;
+          else if (key == "--cipher")
+            config.cipher = value;
+          else if (key == "--cert")
+            config.cert = value;
+          else if (key == "--key")
+            config.key = value;
+          else if (key == "--json")
+            config.json_path = value;
+          else
+            return false;
+          return true;
+        });
+    if (!parsed)
+    {
+      return false;
+    }
+    return (config.direction == "send" || config.direction == "recv") &&
+           (config.tls_version == "1.2" || config.tls_version == "1.3");
+  }
+
+  std::vector<std::string> modes_for(const KtlsBenchConfig& config)
+  {
+    if (config.mode != "all")
+    {
+      return { config.mode };
+    }
+    if (config.direction == "send")
+    {
+      return { "userspace", "ktls", "sendfile" };
+    }
+    return { "userspace", "ktls", "splice" };
+  }
+
+  double thread_cpu_seconds()
+  {
+#if defined(__linux__)
+    timespec ts{};
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+#else
+    return 0;
+#endif
+  }
+
+  void configure_version(asio::ssl::context& ctx, const KtlsBenchConfig& config)
+  {
+    int version = config.tls_version == "1.2" ? TLS1_2_VERSION : TLS1_3_VERSION;
+    SSL_CTX_set_min_proto_version(ctx.native_handle(), version);
+    SSL_CTX_set_max_proto_version(ctx.native_handle(), version);
+  }
+
+  // sendfile的数据源，最多64MB，循环发送
+  std::filesystem::path make_source_file(const KtlsBenchConfig& config)
+  {
+    auto path = std::filesystem::temp_directory_path() / "tool_ktls_bench.data";
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    std::string block(1 << 20, 'k');
+    uint64_t size = std::min<uint64_t>(config.total_bytes, 64ull << 20);
+    for (uint64_t written = 0; written < size; written += block.size())
+    {
+      out.write(block.data(), static_cast<std::streamsize>(std::min<uint64_t>(block.size(), size - written)));
+    }
+    return path;
+  }
+
+  // 服务端发送，返回发出的字节数
+  uint64_t server_send(Stream& stream, const std::string& mode, const KtlsBenchConfig& config)
+  {
+    std::vector<char> chunk(config.chunk, 'k');
+    uint64_t sent = 0;
+    if (mode == "sendfile")
+    {
+#if defined(__linux__)
+      auto path = make_source_file(config);
+      int file = ::open(path.c_str(), O_RDONLY);
+      if (file < 0)
+      {
+        throw std::runtime_error("cannot open " + path.string());
+      }
+      auto file_size = static_cast<uint64_t>(std::filesystem::file_size(path));
+      int fd = stream.lowest_layer().native_handle();
+      while (sent < config.total_bytes)
+      {
+        off_t offset = static_cast<off_t>(sent % file_size);
+        auto count = std::min(config.total_bytes - sent, file_size - sent % file_size);
+        auto n = ::sendfile(fd, file, &offset, static_cast<size_t>(count));
+        if (n <= 0)
+        {
+          ::close(file);
+          throw std::runtime_error(std::string("sendfile: ") + std::strerror(errno));
+        }
+        sent += static_cast<uint64_t>(n);
+      }
+      ::close(file);
+      std::filesystem::remove(path);
+#endif
+      return sent;
+    }
+    while (sent < config.total_bytes)
+    {
+      auto size = static_cast<size_t>(std::min<uint64_t>(chunk.size(), config.total_bytes - sent));
+      if (mode == "ktls")
+      {
+        // 明文直接写socket，内核按记录加密
+        sent += asio::write(stream.next_layer(), asio::buffer(chunk.data(), size));
+      }
+      else
+      {
+        sent += asio::write(stream, asio::buffer(chunk.data(), size));
+      }
+    }
+    return sent;
+  }
+
+  // 服务端接收，返回收到的应用数据字节数
+  uint64_t server_receive(Stream& stream, const std::string& mode, const KtlsBenchConfig& config)
+  {
+    std::vector<char> chunk(config.chunk);
+    uint64_t received = 0;
+    int fd = stream.lowest_layer().native_handle();
+    if (mode == "splice")
+    {
+#if defined(__linux__)
+      int pipe_fds[2];
+      int null_fd = ::open("/dev/null", O_WRONLY);
+      if (null_fd < 0 || ::pipe(pipe_fds) != 0)
+      {
+        throw std::runtime_error(std::string("splice setup: ") + std::strerror(errno));
+      }
+      while (received < config.total_bytes)
+      {
+        auto n = ::splice(fd, nullptr, pipe_fds[1], nullptr, config.chunk, SPLICE_F_MOVE);
+        if (n <= 0)
+        {
+          break;
+        }
+        for (auto left = n; left > 0;)
+        {
+          auto moved = ::splice(pipe_fds[0], nullptr, null_fd, nullptr, static_cast<size_t>(left), SPLICE_F_MOVE);
+          if (moved <= 0)
+          {
+            break;
+          }
+          left -= moved;
+        }
+        received += static_cast<uint64_t>(n);
+      }
+      ::close(pipe_fds[0]);
+      ::close(pipe_fds[1]);
+      ::close(null_fd);
+#endif
+      return received;
+    }
+    while (received < config.total_bytes)
+    {
+      if (mode == "ktls")
+      {
+        uint8_t record_type = 0;
+        asio::error_code ec;
+        auto n = Ktls::receive(fd, chunk.data(), chunk.size(), record_type, ec);
+        if (ec == asio::error::would_block)
+        {
+          stream.lowest_layer().wait(asio::socket_base::wait_read);
+          continue;
+        }
+        if (ec)
+        {
+          throw asio::system_error(ec);
+        }
+        if (record_type != Ktls::RECORD_APPLICATION_DATA)
+        {
+          throw std::runtime_error("unexpected record type " + std::to_string(record_type));
+        }
+        received += n;
+      }
+      else
+      {
+        received += stream.read_some(asio::buffer(chunk));
+      }
+    }
+    return received;
+  }
+
+  CaseResult run_case(const KtlsBenchConfig& config, const std::string& mode)
+  {
+    CaseResult result;
+    result.mode = mode;
+    bool use_ktls = mode != "userspace";
+
+    asio::ssl::context server_ctx(asio::ssl::context::tls_server);
+    configure_version(server_ctx, config);
+    server_ctx.use_certificate_chain_file(config.cert);
+    server_ctx.use_private_key_file(config.key, asio::ssl::context::pem);
+    // 不发票据，TLS1.3握手后发送方向的序号从0开始; 开不开都不影响正确性
+    SSL_CTX_set_num_tickets(server_ctx.native_handle(), 0);
+    if (use_ktls)
+    {
+      Ktls::install(server_ctx);
+    }
+
+    asio::ssl::context client_ctx(asio::ssl::context::tls_client);
+    client_ctx.set_verify_mode(asio::ssl::verify_none);
+    configure_version(client_ctx, config);
+    if (!config.cipher.empty())
+    {
+      if (config.tls_version == "1.3")
+        SSL_CTX_set_ciphersuites(client_ctx.native_handle(), config.cipher.c_str());
+      else
+        SSL_CTX_set_cipher_list(client_ctx.native_handle(), config.cipher.c_str());
+    }
+
+    asio::io_context ioc;
+    asio::ip::tcp::acceptor acceptor(ioc, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+    Stream client(ioc, client_ctx);
+    Stream server(ioc, server_ctx);
+
+    // 客户端等服务端开启kTLS之后再开始传输，否则数据可能先被OpenSSL读进缓冲区
+    std::promise<bool> go;
+    auto go_future = go.get_future();
+    std::string client_error;
+    double client_cpu = 0;
+    uint64_t client_bytes = 0;
+    std::thread client_thread(
+        [&]()
+        {
+          try
+          {
+            client.lowest_layer().connect(acceptor.local_endpoint());
+            client.handshake(asio::ssl::stream_base::client);
+            if (!go_future.get())
+            {
+              return;
+            }
+            double cpu_begin = thread_cpu_seconds();
+            std::vector<char> chunk(config.chunk, 'c');
+            while (client_bytes < config.total_bytes)
+            {
+              if (config.direction == "send")
+              {
+                client_bytes += client.read_some(asio::buffer(chunk));
+              }
+              else
+              {
+                auto size = static_cast<size_t>(std::min<uint64_t>(chunk.size(), config.total_bytes - client_bytes));
+                client_bytes += asio::write(client, asio::buffer(chunk.data(), size));
+              }
+            }
+            client_cpu = thread_cpu_seconds() - cpu_begin;
+          }
+          catch (const std::exception& e)
+          {
+            client_error = e.what();
+          }
+        });
+
+    bool released = false;
+    try
+    {
+      acceptor.accept(server.lowest_layer());
+      if (use_ktls)
+      {
+        Ktls::prepare(server.native_handle());
+      }
+      server.handshake(asio::ssl::stream_base::server);
+      result.protocol = SSL_get_version(server.native_handle());
+      result.cipher = SSL_get_cipher_name(server.native_handle());
+      if (use_ktls)
+      {
+        result.ktls = Ktls::enable(server.native_handle(), server.lowest_layer().native_handle());
+        if (!result.ktls.rx)
+        {
+          result.error = "kTLS unavailable: " + result.ktls.reason;
+        }
+      }
+      if (result.error.empty())
+      {
+        auto begin = Clock::now();
+        double cpu_begin = thread_cpu_seconds();
+        released = true;
+        go.set_value(true);
+        result.bytes = config.direction == "send" ? server_send(server, mode, config)
+                                                  : server_receive(server, mode, config);
+        result.server_cpu_seconds = thread_cpu_seconds() - cpu_begin;
+        client_thread.join();
+        result.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+        result.client_cpu_seconds = client_cpu;
+        result.ok = client_error.empty() && result.bytes == config.total_bytes && client_bytes == config.total_bytes;
+        if (!client_error.empty())
+        {
+          result.error = "client: " + client_error;
+        }
+      }
+    }
+    catch (const std::exception& e)
+    {
+      result.error = e.what();
+    }
+    if (!released)
+    {
+      go.set_value(false);
+    }
+    // 先shutdown，阻塞在读写里的客户端线程会返回
+    asio::error_code ignored;
+    server.lowest_layer().shutdown(asio::socket_base::shutdown_both, ignored);
+    server.lowest_layer().close(ignored);
+    client.lowest_layer().close(ignored);
+    if (client_thread.joinable())
+    {
+      client_thread.join();
+    }
+    return result;
+  }
+
+  nlohmann::ordered_json make_report(const KtlsBenchConfig& config, const std::vector<CaseResult>& results)
+  {
+    nlohmann::ordered_json report;
+    report["tool"] = "tool_ktls_bench";
+    report["config"]["direction"] = config.direction;
+    report["config"]["total_bytes"] = config.total_bytes;
+    report["config"]["chunk"] = config.chunk;
+    report["config"]["tls"] = config.tls_version;
+    report["config"]["cipher"] = config.cipher;
+    report["results"] = nlohmann::ordered_json::array();
+    for (const auto& result : results)
+    {
+      nlohmann::ordered_json item;
+      item["mode"] = result.mode;
+      item["ok"] = result.ok;
+      item["error"] = result.error;
+      item["protocol"] = result.protocol;
+      item["cipher"] = result.cipher;
+      item["ktls_tx"] = result.ktls.tx;
+      item["ktls_rx"] = result.ktls.rx;
+      item["ktls_reason"] = result.ktls.reason;
+      item["bytes"] = result.bytes;
+      item["seconds"] = result.seconds;
+      item["mb_per_sec"] = result.seconds > 0 ? static_cast<double>(result.bytes) / (1 << 20) / result.seconds : 0.0;
+      item["server_cpu_seconds"] = result.server_cpu_seconds;
+      item["client_cpu_seconds"] = result.client_cpu_seconds;
+      report["results"].push_back(item);
+    }
+    return report;
+  }
+
+  void print_summary(const KtlsBenchConfig& config, const std::vector<CaseResult>& results)
+  {
+    std::cout << "direction " << config.direction << ", " << (config.total_bytes >> 20) << " MB per case, chunk "
+              << config.chunk << "\n";
+    std::cout << std::left << std::setw(11) << "mode" << std::right << std::setw(10) << "MB/s" << std::setw(14)
+              << "server cpu s" << std::setw(16) << "server cpu s/GB" << std::setw(14) << "client cpu s"
+              << "  protocol / cipher\n";
+    for (const auto& result : results)
+    {
+      std::cout << std::left << std::setw(11) << result.mode << std::right;
+      if (!result.ok)
+      {
+        std::cout << "  skipped: " << result.error << "\n";
+        continue;
+      }
+      double gb = static_cast<double>(result.bytes) / (1ull << 30);
+      std::cout << std::fixed << std::setprecision(1) << std::setw(10)
+                << static_cast<double>(result.bytes) / (1 << 20) / result.seconds << std::setprecision(3)
+                << std::setw(14) << result.server_cpu_seconds << std::setw(16) << result.server_cpu_seconds / gb
+                << std::setw(14) << result.client_cpu_seconds << "  " << result.protocol << " / " << result.cipher
+                << "\n";
+    }
+    std::cout.flush();
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  KtlsBenchConfig config;
+  if (!parse_args(argc, argv, config))
+  {
+    print_usage();
+    return 1;
+  }
+
+  spdlog::info(
+      "ktls bench direction={} mode={} total={}MB chunk={} tls={}",
+      config.direction,
+      config.mode,
+      config.total_bytes >> 20,
+      config.chunk,
+      config.tls_version);
+
+  std::vector<CaseResult> results;
+  for (const auto& mode : modes_for(config))
+  {
+    results.push_back(run_case(config, mode));
+  }
+  print_summary(config, results);
+  if (!config.json_path.empty())
+  {
+    auto report = make_report(config, results).dump(2);
+    if (config.json_path == "-")
+    {
+      std::cout << report << std::endl;
+    }
+    else
+    {
+      std::ofstream out(config.json_path);
+      out << report << std::endl;
+      std::cout << "report written to " << config.json_path << std::endl;
+    }
+  }
+  // 用户态一项失败说明环境有问题; kTLS的几项不支持时只报告不算失败
+  return !results.empty() && results.front().mode == "userspace" && !results.front().ok ? 1 : 0;
+}
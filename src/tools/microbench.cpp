@@ -0,0 +1,445 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 17:01:05
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:22:49
+ * @FilePath: \asio-learn-code\src\tools\microbench.cpp
+ * @Description: 微基准：日志、追踪、UUID、ID生成等热点函数的单次耗时，多次重复取统计量，可输出JSON做跨提交对比
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+
+/**
+ 用法:
+   tool_microbench                              运行全部用例
+   tool_microbench --filter uuid --repetitions 20 --min-time-ms 50 --json bench.json
+   tool_microbench --list
+ 每个用例先校准迭代次数，使单次采样不少于min-time-ms，丢弃一次预热采样后采repetitions次
+ 每次采样得到一个ns/op，报告 mean/median/stddev/min/max 和变异系数cv
+ 对比两次提交时优先看median，cv大于5%说明机器噪声较大，结论要谨慎
+ 日志用例只写文件(默认在系统临时目录的asio_learn_microbench/下，--log-dir可改)，不写控制台
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+#include "asio_learn/UidGenerator.hpp"
+#include "asio_learn/public.hpp"
+#include "asio_learn/trace/tracer.hpp"
+#include "bench_common.hpp"
+#include "common/Log.hpp"
+#include "common/uuid.hpp"
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  // 防止编译器把被测结果优化掉
+  template<typename T>
+  inline void do_not_optimize(const T& value)
+  {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+  }
+
+  struct BenchCase
+  {
+    std::string name;
+    std::function<void(uint64_t iterations)> run;  // 执行iterations次被测操作
+  };
+
+  struct BenchResult
+  {
+    std::string name;
+    uint64_t iterations = 0;  // 每次采样的迭代次数
+    std::vector<double> samples;  // 每次采样的ns/op
+    double mean = 0;
+    double median = 0;
+    double stddev = 0;
+    double min = 0;
+    double max = 0;
+  };
+
+  struct MicrobenchConfig
+  {
+    std::string filter;
+    size_t repetitions = 10;
+    std::chrono::milliseconds min_time{ 20 };
+    std::string json_path;
+    std::string label;  // 写进JSON，比如提交号
+    std::string log_dir;  // 为空时用系统临时目录，不在当前目录(可能是源码树)留下文件
+    bool list = false;
+  };
+
+  double time_ns(const BenchCase& bench, uint64_t iterations)
+  {
+    auto begin = Clock::now();
+    bench.run(iterations);
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count());
+  }
+
+  // 按耗时比例放大迭代次数(每轮2~10倍)，直到单次采样耗时不少于min_time
+  uint64_t calibrate(const BenchCase& bench, std::chrono::milliseconds min_time)
+  {
+    const double target = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(min_time).count());
+    uint64_t iterations = 1;
+    while (true)
+    {
+      double elapsed = time_ns(bench, iterations);
+      if (elapsed >= target || iterations >= (1ull << 40))
+      {
+        return iterations;
+      }
+      double scale = elapsed > 0 ? target / elapsed * 1.2 : 10.0;
+      iterations = static_cast<uint64_t>(static_cast<double>(iterations) * std::clamp(scale, 2.0, 10.0));
+    }
+  }
+
+  BenchResult run_case(const BenchCase& bench, const MicrobenchConfig& config)
+  {
+    BenchResult result;
+    result.name = bench.name;
+    result.iterations = calibrate(bench, config.min_time);
+    time_ns(bench, result.iterations);  // 预热
+    for (size_t i = 0; i < config.repetitions; ++i)
+    {
+      result.samples.push_back(time_ns(bench, result.iterations) / static_cast<double>(result.iterations));
+    }
+
+    auto sorted = result.samples;
+    std::sort(sorted.begin(), sorted.end());
+    size_t n = sorted.size();
+    result.min = sorted.front();
+    result.max = sorted.back();
+    result.median = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2.0;
+    for (double v : sorted)
+    {
+      result.mean += v;
+    }
+    result.mean /= static_cast<double>(n);
+    double variance = 0;
+    for (double v : sorted)
+    {
+      variance += (v - result.mean) * (v - result.mean);
+    }
+    result.stddev = n > 1 ? std::sqrt(variance / static_cast<double>(n - 1)) : 0.0;
+    return result;
+  }
+
+  std::vector<BenchCase> make_cases()
+  {
+    using namespace common;
+    std::vector<BenchCase> cases;
+    auto add = [&](std::string name, std::function<void(uint64_t)> run)
+    { cases.push_back({ std::move(name), std::move(run) }); };
+
+    // UuidHelper
+    add("uuid/generate_system",
+        [](uint64_t n)
+        {
+          for (uint64_t i = 0; i < n; ++i)
+            do_not_optimize(UuidHelper::generate_system());
+        });
+    add("uuid/generate_system_string",
+        [](uint64_t n)
+        {
+          for (uint64_t i = 0; i < n; ++i)
+            do_not_optimize(UuidHelper::generate_system_string());
+        });
+    add("uuid/generate_secure_random",
+        [](uint64_t n)
+        {
+          for (uint64_t i = 0; i < n; ++i)
+            do_not_optimize(UuidHelper::generate_secure_random());
+        });
+    add("uuid/generate_random",
+        [](uint64_t n)
+        {
+          for (uint64_t i = 0; i < n; ++i)
+            do_not_optimize(UuidHelper::generate_random());
+        });
+    add("uuid/generate_random_string",
+        [](uint64_t n)
+        {
+          for (uint64_t i = 0; i < n; ++i)
+            do_not_optimize(UuidHelper::generate_random_string());
+        });
+    add("uuid/generate_time_based",
+        [](uint64_t n)
+        {
+          for (uint64_t i = 0; i < n; ++i)
+            do_not_optimize(UuidHelper::generate_time_based());
+        });
+    add("uuid/generate_compact_string",
+        [](uint64_t n)
+        {
+          for (uint64_t i = 0; i < n; ++i)
+            do_not_optimize(UuidHelper::generate_compact_string());
+        });
+    add("uuid/generate_from_domain",
+        [](uint64_t n)
+        {
+          const std::string domain = "www.example.com";
+          for (uint64_t i = 0; i < n; ++i)
+            do_not_optimize(UuidHelper::generate_from_domain(domain));
+        });
+    add("uuid/is_valid",
+        [](uint64_t n)
+        {
+          const std::string text = "47183823-2574-4bfd-b411-99ed177d3e43";
+          for (uint64_t i = 0; i < n; ++i)
+            do_not_optimize(UuidHelper::is_valid(text));
+        });
+
+    // stduuid 的字符串转换
+    add("uuids/to_string",
+        [](uint64_t n)
+        {
+          auto id = UuidHelper::generate_random();
+          for (uint64_t i = 0; i < n; ++i)
+            do_not_optimize(uuids::to_string(id));
+        });
+    add("uuids/from_string",
+        [](uint64_t n)
+        {
+          const std::string text = "47183823-2574-4bfd-b411-99ed177d3e43";
+          for (uint64_t i = 0; i < n; ++i)
+            do_not_optimize(uuids::uuid::from_string(text));
+        });
+
+    // UidGenerator
+    add("uid/generate_snowflake_id",
+        [](uint64_t n)
+        {
+          for (uint64_t i = 0; i < n; ++i)
+            do_not_optimize(asio_learn::UidGenerator::generate_snowflake_id());
+        });
+    add("uid/generate_uuid_v4",
+        [](uint64_t n)
+        {
+          for (uint64_t i = 0; i < n; ++i)
+            do_not_optimize(asio_learn::UidGenerator::generate_uuid_v4());
+        });
+    add("uid/generate_simple_uid",
+        [](uint64_t n)
+        {
+          for (uint64_t i = 0; i < n; ++i)
+            do_not_optimize(asio_learn::UidGenerator::generate_simple_uid());
+        });
+    add("uid/generate_session_id",
+        [](uint64_t n)
+        {
+          for (uint64_t i = 0; i < n; ++i)
+            do_not_optimize(asio_learn::UidGenerator::generate_session_id());
+        });
+
+    add("public/threadId_to_str",
+        [](uint64_t n)
+        {
+          for (uint64_t i = 0; i < n; ++i)
+            do_not_optimize(asio_learn::threadId_to_str());
+        });
+
+    // 日志: 关闭的级别应该接近零开销，打开的级别包含格式化和写文件
+    auto logger = create_logger();
+    add("log/disabled_no_args",
+        [logger](uint64_t n)
+        {
+          logger->SetLogLevel(LogLevel::WARN);
+          for (uint64_t i = 0; i < n; ++i)
+            logger->logWithFmt(LogLevel::DEBUG, __FILE__, __LINE__, __func__, "disabled message");
+        });
+    add("log/disabled_with_args",
+        [logger](uint64_t n)
+        {
+          logger->SetLogLevel(LogLevel::WARN);
+          std::string peer = "127.0.0.1";
+          for (uint64_t i = 0; i < n; ++i)
+            logger->logWithFmt(LogLevel::DEBUG, __FILE__, __LINE__, __func__, "session {} read {} bytes", peer, i);
+        });
+    add("log/enabled_no_args",
+        [logger](uint64_t n)
+        {
+          logger->SetLogLevel(LogLevel::INFO);
+          for (uint64_t i = 0; i < n; ++i)
+            logger->logWithFmt(LogLevel::INFO, __FILE__, __LINE__, __func__, "enabled message");
+        });
+    add("log/enabled_with_args",
+        [logger](uint64_t n)
+        {
+          logger->SetLogLevel(LogLevel::INFO);
+          std::string peer = "127.0.0.1";
+          for (uint64_t i = 0; i < n; ++i)
+            logger->logWithFmt(LogLevel::INFO, __FILE__, __LINE__, __func__, "session {} read {} bytes", peer, i);
+        });
+
+    // 追踪: 一个scope是begin+end两个事件，关闭时只剩一次load
+    add("trace/disabled_scope",
+        [](uint64_t n)
+        {
+          asio_learn::trace::Tracer::instance().disable();
+          for (uint64_t i = 0; i < n; ++i)
+          {
+            TRACE_SCOPE("bench", i);
+          }
+        });
+    add("trace/enabled_scope",
+        [](uint64_t n)
+        {
+          asio_learn::trace::Tracer::instance().enable();
+          for (uint64_t i = 0; i < n; ++i)
+          {
+            TRACE_SCOPE("bench", i);
+          }
+          asio_learn::trace::Tracer::instance().disable();
+        });
+    return cases;
+  }
+
+  void print_usage()
+  {
+    std::cout << "usage: tool_microbench [options]\n"
+                 "  --filter <text>        only run cases whose name contains text\n"
+                 "  --repetitions <n>      samples per case (default 10)\n"
+                 "  --min-time-ms <ms>     minimum duration of one sample (default 20)\n"
+                 "  --json <path|->        write JSON report\n"
+                 "  --label <text>         label written into the JSON report, e.g. a commit id\n"
+                 "  --log-dir <path>       where the logging cases write (default <tmp>/asio_learn_microbench)\n"
+                 "  --list                 list case names and exit\n";
+  }
+
+  bool parse_args(int argc, char** argv, MicrobenchConfig& config)
+  {
+    return bench::parse_options(
+        argc,
+        argv,
+        [&](const std::string& key, const std::string& value)
+        {
+          if (key == "--list")
+            config.list = true;
+          else if (key == "--filter")
+            config.filter = value;
+          else if (key == "--repetitions")
+            config.repetitions = bench::parse_number<size_t>(value, 1);
+          else if (key == "--min-time-ms")
+            config.min_time = std::chrono::milliseconds(bench::parse_number<size_t>(value, 1));
+          else if (key == "--json")
+            config.json_path = value;
+          else if (key == "--label")
+            config.label = value;
+          else if (key == "--log-dir")
+            config.log_dir = value;
+          else
+            return false;
+          return true;
+        },
+        { "--list" });
+  }
+
+  nlohmann::ordered_json make_report(const MicrobenchConfig& config, const std::vector<BenchResult>& results)
+  {
+    nlohmann::ordered_json report;
+    report["tool"] = "tool_microbench";
+    report["label"] = config.label;
+    report["repetitions"] = config.repetitions;
+    report["min_time_ms"] = config.min_time.count();
+    report["results"] = nlohmann::ordered_json::array();
+    for (const auto& result : results)
+    {
+      nlohmann::ordered_json item;
+      item["name"] = result.name;
+      item["iterations"] = result.iterations;
+      item["ns_per_op"]["mean"] = result.mean;
+      item["ns_per_op"]["median"] = result.median;
+      item["ns_per_op"]["stddev"] = result.stddev;
+      item["ns_per_op"]["min"] = result.min;
+      item["ns_per_op"]["max"] = result.max;
+      item["ns_per_op"]["cv"] = result.mean > 0 ? result.stddev / result.mean : 0.0;
+      item["samples"] = nlohmann::ordered_json::array();
+      for (double sample : result.samples)
+      {
+        item["samples"].push_back(sample);
+      }
+      report["results"].push_back(item);
+    }
+    return report;
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  MicrobenchConfig config;
+  if (!parse_args(argc, argv, config))
+  {
+    print_usage();
+    return 1;
+  }
+
+  // 日志只写文件，避免控制台输出干扰结果
+  common::LoggerConfig log_config;
+  std::filesystem::path log_dir = config.log_dir;
+  if (log_dir.empty())
+  {
+    log_dir = std::filesystem::temp_directory_path() / "asio_learn_microbench";
+  }
+  std::filesystem::create_directories(log_dir);
+  log_config.log_file = (log_dir / "microbench.log").string();
+  log_config.max_file_size = 16 * 1024 * 1024;
+  log_config.max_files = 2;
+  log_config.enable_console = false;
+  log_config.enable_file = true;
+  log_config.enable_async = false;
+  auto logger = common::create_logger();
+  logger->Init(log_config);
+
+  auto cases = make_cases();
+  std::vector<BenchResult> results;
+  for (const auto& bench : cases)
+  {
+    if (!config.filter.empty() && bench.name.find(config.filter) == std::string::npos)
+    {
+      continue;
+    }
+    if (config.list)
+    {
+      std::cout << bench.name << "\n";
+      continue;
+    }
+    auto result = run_case(bench, config);
+    std::cout << std::left << std::setw(32) << result.name << std::right << std::fixed << std::setprecision(1)
+              << " median " << std::setw(9) << result.median << " ns/op  mean " << std::setw(9) << result.mean
+              << "  stddev " << std::setw(7) << result.stddev << "  min " << std::setw(9) << result.min << "  iters "
+              << result.iterations << std::endl;
+    results.push_back(std::move(result));
+  }
+
+  if (!config.json_path.empty() && !config.list)
+  {
+    auto report = make_report(config, results).dump(2);
+    if (config.json_path == "-")
+    {
+      std::cout << report << std::endl;
+    }
+    else
+    {
+      std::ofstream out(config.json_path);
+      out << report << std::endl;
+      std::cout << "report written to " << config.json_path << std::endl;
+    }
+  }
+  logger->ShutDown();
+  return 0;
+}
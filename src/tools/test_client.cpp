@@ -1,24 +1,669 @@
-#include <iostream>
-#include <asio.hpp>
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-19 00:30:44
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:17:24
+ * @FilePath: \asio-learn-code\src\tools\test_client.cpp
+ * @Description: 连接浸泡/抖动测试：保持大量连接、按速率重连、随机长度回显校验，同时采样服务器RSS和fd数
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+
+/**
+ 用法:
+   tool_test_client --port 9986 --connections 5000 --threads 2 --churn 200 --duration 60 --pid $(pidof tcp_server_masterWork) --csv soak.csv
+ 阶段:
+   1. baseline: 还没有连接时采样一次服务器RSS/fd
+   2. ramp: 打开全部连接
+   3. soak: 保持duration秒，每条连接 发随机长度随机内容 -> 读回同样长度 -> 逐字节比对 -> 等interval，循环
+           同时每秒随机挑churn条连接断开重连
+   4. settle: 关闭全部连接，等settle秒再采样一次
+ 结果:
+   每连接内存 = (soak阶段平均RSS - baseline RSS) / 在线连接数
+   settle之后的RSS/fd与baseline比较，fd没回到baseline说明有泄漏，RSS持续偏高值得继续用更长的soak确认
+ */
 #include <spdlog/spdlog.h>
 
-int main() {
-    spdlog::info("Starting test client...");
-    
-    try {
-        asio::io_context io_context;
-        
-        // 测试客户端逻辑
-        spdlog::info("Connecting to test server...");
-        
-        // 这里添加您的测试客户端实现
-        
-        spdlog::info("Test client finished");
-    }
-    catch (std::exception& e) {
-        spdlog::error("Test client error: {}", e.what());
-        return 1;
-    }
-    
-    return 0;
-}
\ No newline at end of file
+#include <asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+#include "bench_common.hpp"
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  struct SoakConfig
+  {
+    std::string host = "127.0.0.1";
+    unsigned short port = 9986;
+    size_t connections = 1000;
+    size_t threads = 2;
+    double churn = 0;  // 每秒重连的连接数
+    size_t min_size = 1;
+    size_t max_size = 4096;
+    std::chrono::milliseconds interval{ 100 };  // 每条连接两次请求之间的间隔
+    double duration = 60.0;
+    double settle = 3.0;
+    std::chrono::milliseconds sample{ 1000 };
+    int pid = 0;  // 被测服务器进程，为0则只统计客户端
+    std::string csv_path;
+    std::string json_path;
+  };
+
+  struct SoakCounters
+  {
+    std::atomic<uint64_t> live{ 0 };
+    std::atomic<uint64_t> connects{ 0 };
+    std::atomic<uint64_t> connect_failures{ 0 };
+    std::atomic<uint64_t> churned{ 0 };
+    std::atomic<uint64_t> unexpected_closes{ 0 };
+    std::atomic<uint64_t> verified{ 0 };
+    std::atomic<uint64_t> mismatches{ 0 };
+    std::atomic<uint64_t> bytes{ 0 };
+  };
+
+  // /proc/<pid> 里读出来的一次采样
+  struct ProcessSample
+  {
+    double elapsed = 0;
+    uint64_t rss_kb = 0;
+    uint64_t fds = 0;
+    uint64_t live = 0;
+  };
+
+  std::optional<ProcessSample> sample_process(int pid)
+  {
+#ifdef __linux__
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    if (!status)
+    {
+      return std::nullopt;
+    }
+    ProcessSample sample;
+    std::string line;
+    while (std::getline(status, line))
+    {
+      if (line.rfind("VmRSS:", 0) == 0)
+      {
+        sample.rss_kb = std::stoull(line.substr(6));
+        break;
+      }
+    }
+    std::error_code ec;
+    for (auto it = std::filesystem::directory_iterator("/proc/" + std::to_string(pid) + "/fd", ec);
+         !ec && it != std::filesystem::directory_iterator();
+         it.increment(ec))
+    {
+      ++sample.fds;
+    }
+    return sample;
+#else
+    (void)pid;
+    return std::nullopt;
+#endif
+  }
+
+  // 几千条连接会超过默认的1024个fd
+  void raise_fd_limit(size_t wanted)
+  {
+#ifdef __linux__
+    rlimit limit{};
+    if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < wanted)
+    {
+      limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, wanted);
+      ::setrlimit(RLIMIT_NOFILE, &limit);
+      spdlog::info("RLIMIT_NOFILE raised to {}", limit.rlim_cur);
+    }
+#else
+    (void)wanted;
+#endif
+  }
+
+  class SoakConnection : public std::enable_shared_from_this<SoakConnection>
+  {
+   public:
+    SoakConnection(
+        asio::io_context& ioc,
+        const asio::ip::tcp::endpoint& endpoint,
+        const SoakConfig& config,
+        SoakCounters& counters,
+        uint64_t seed)
+      : _ioc(ioc)
+      , _timer(ioc)
+      , _endpoint(endpoint)
+      , _config(config)
+      , _counters(counters)
+      , _random(seed)
+    {
+    }
+
+    void start()
+    {
+      connect();
+    }
+
+    // 主动断开并立即重连，连接正在建立中时什么也不做，返回false
+    bool churn()
+    {
+      if (!_live)
+      {
+        return false;
+      }
+      _counters.churned.fetch_add(1, std::memory_order_relaxed);
+      reset();
+      connect();
+      return true;
+    }
+
+    void stop()
+    {
+      _stopped = true;
+      reset();
+    }
+
+   private:
+    // 一次连接的socket和收发缓冲
+    struct Link
+    {
+      explicit Link(asio::io_context& ioc) : socket(ioc)
+      {
+      }
+
+      asio::ip::tcp::socket socket;
+      std::vector<char> payload;
+      std::vector<char> reply;
+    };
+
+    // 作废当前连接上所有挂起的回调
+    void reset()
+    {
+      ++_generation;
+      if (_live)
+      {
+        _live = false;
+        _counters.live.fetch_sub(1, std::memory_order_relaxed);
+      }
+      _timer.cancel();
+      if (_link)
+      {
+        asio::error_code ignored;
+        _link->socket.close(ignored);
+        _link.reset();
+      }
+    }
+
+    void connect()
+    {
+      if (_stopped)
+      {
+        return;
+      }
+      uint64_t generation = ++_generation;
+      // 每次重连用新的Link，旧连接上还没结束的组合操作(async_read等)引用的是旧socket和旧缓冲
+      auto link = std::make_shared<Link>(_ioc);
+      _link = link;
+      link->socket.async_connect(
+          _endpoint,
+          [self = shared_from_this(), link, generation](const asio::error_code& ec)
+          {
+            if (generation != self->_generation)
+            {
+              return;
+            }
+            if (ec)
+            {
+              self->_counters.connect_failures.fetch_add(1, std::memory_order_relaxed);
+              self->retry_later();
+              return;
+            }
+            self->_live = true;
+            self->_counters.live.fetch_add(1, std::memory_order_relaxed);
+            self->_counters.connects.fetch_add(1, std::memory_order_relaxed);
+            self->send_next(link, generation);
+          });
+    }
+
+    void retry_later()
+    {
+      uint64_t generation = _generation;
+      _timer.expires_after(std::chrono::milliseconds(200));
+      _timer.async_wait(
+          [self = shared_from_this(), generation](const asio::error_code& ec)
+          {
+            if (!ec && generation == self->_generation)
+            {
+              self->connect();
+            }
+          });
+    }
+
+    void on_failure(uint64_t generation, const asio::error_code& ec)
+    {
+      if (generation != _generation || _stopped)
+      {
+        return;
+      }
+      _counters.unexpected_closes.fetch_add(1, std::memory_order_relaxed);
+      spdlog::warn("connection closed unexpectedly: {}", ec.message());
+      reset();
+      retry_later();
+    }
+
+    // 随机长度随机内容，服务器必须原样回显
+    void send_next(const std::shared_ptr<Link>& link, uint64_t generation)
+    {
+      std::uniform_int_distribution<size_t> size_dist(_config.min_size, _config.max_size);
+      link->payload.resize(size_dist(_random));
+      for (auto& c : link->payload)
+      {
+        c = static_cast<char>(_random());
+      }
+      link->reply.resize(link->payload.size());
+      asio::async_write(
+          link->socket,
+          asio::buffer(link->payload),
+          [self = shared_from_this(), link, generation](const asio::error_code& ec, std::size_t)
+          {
+            if (ec)
+            {
+              self->on_failure(generation, ec);
+              return;
+            }
+            self->read_reply(link, generation);
+          });
+    }
+
+    void read_reply(const std::shared_ptr<Link>& link, uint64_t generation)
+    {
+      asio::async_read(
+          link->socket,
+          asio::buffer(link->reply),
+          [self = shared_from_this(), link, generation](const asio::error_code& ec, std::size_t bytes)
+          {
+            if (ec)
+            {
+              self->on_failure(generation, ec);
+              return;
+            }
+            if (std::memcmp(link->reply.data(), link->payload.data(), bytes) != 0)
+            {
+              self->_counters.mismatches.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+              self->_counters.verified.fetch_add(1, std::memory_order_relaxed);
+            }
+            self->_counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+            self->_timer.expires_after(self->_config.interval);
+            self->_timer.async_wait(
+                [self, link, generation](const asio::error_code& ec)
+                {
+                  if (!ec && generation == self->_generation)
+                  {
+                    self->send_next(link, generation);
+                  }
+                });
+          });
+    }
+
+    asio::io_context& _ioc;
+    std::shared_ptr<Link> _link;
+    asio::steady_timer _timer;
+    asio::ip::tcp::endpoint _endpoint;
+    const SoakConfig& _config;
+    SoakCounters& _counters;
+    std::mt19937_64 _random;
+    uint64_t _generation = 0;
+    bool _live = false;
+    bool _stopped = false;
+  };
+
+  void print_usage()
+  {
+    std::cout << "usage: tool_test_client [options]\n"
+                 "  --host <ip>            server host (default 127.0.0.1)\n"
+                 "  --port <port>          server port (default 9986)\n"
+                 "  --connections <n>      concurrent connections to hold (default 1000)\n"
+                 "  --threads <n>          client io_context threads (default 2)\n"
+                 "  --churn <n>            connections closed and reopened per second (default 0)\n"
+                 "  --min-size <bytes>     minimum payload size (default 1)\n"
+                 "  --max-size <bytes>     maximum payload size (default 4096)\n"
+                 "  --interval-ms <ms>     delay between requests on one connection (default 100)\n"
+                 "  --duration <seconds>   soak duration (default 60)\n"
+                 "  --settle <seconds>     wait after closing everything before the final sample (default 3)\n"
+                 "  --sample-ms <ms>       /proc sampling period (default 1000)\n"
+                 "  --pid <pid>            server process to sample RSS and fd count from\n"
+                 "  --csv <path>           write samples as csv\n"
+                 "  --json <path|->        write summary as JSON\n";
+  }
+
+  bool parse_args(int argc, char** argv, SoakConfig& config)
+  {
+    bool parsed = bench::parse_options(
+        argc,
+        argv,
+        [&](const std::string& key, const std::string& value)
+        {
+          if (key == "--host")
+            config.host = value;
+          else if (key == "--port")
+            config.port = bench::parse_number<unsigned short>(value, 1);
+          else if (key == "--connections")
+            config.connections = bench::parse_number<size_t>(value);
+          else if (key == "--threads")
+            config.threads = bench::parse_number<size_t>(value);
+          else if (key == "--churn")
+            config.churn = bench::parse_number<double>(value, 0.0);
+          else if (key == "--min-size")
+            config.min_size = bench::parse_number<size_t>(value);
+          else if (key == "--max-size")
+            config.max_size = bench::parse_number<size_t>(value);
+          else if (key == "--interval-ms")
+            config.interval = std::chrono::milliseconds(bench::parse_number<size_t>(value));
+          else if (key == "--duration")
+            config.duration = bench::parse_number<double>(value, 0.0);
+          else if (key == "--settle")
+            config.settle = bench::parse_number<double>(value, 0.0);
+          else if (key == "--sample-ms")
+            config.sample = std::chrono::milliseconds(bench::parse_number<size_t>(value, 1));
+          else if (key == "--pid")
+            config.pid = bench::parse_number<int>(value, 0);
+          else if (key == "--csv")
+            config.csv_path = value;
+          else if (key == "--json")
+            config.json_path = value;
+          else
+            return false;
+          return true;
+        });
+    if (!parsed)
+    {
+      return false;
+    }
+    if (config.connections == 0)
+    {
+      std::cerr << "--connections must be at least 1" << std::endl;
+      return false;
+    }
+    config.threads = std::max<size_t>(1, std::min(config.threads, config.connections));
+    config.min_size = std::max<size_t>(1, config.min_size);
+    config.max_size = std::max(config.min_size, config.max_size);
+    return true;
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  SoakConfig config;
+  if (!parse_args(argc, argv, config))
+  {
+    print_usage();
+    return 1;
+  }
+
+  try
+  {
+    raise_fd_limit(config.connections + 64);
+    asio::io_context resolve_ioc;
+    asio::ip::tcp::resolver resolver(resolve_ioc);
+    auto endpoint = resolver.resolve(config.host, std::to_string(config.port)).begin()->endpoint();
+
+    spdlog::info(
+        "soak {}:{} connections={} threads={} churn={}/s size=[{}, {}] interval={}ms duration={}s pid={}",
+        config.host,
+        config.port,
+        config.connections,
+        config.threads,
+        config.churn,
+        config.min_size,
+        config.max_size,
+        config.interval.count(),
+        config.duration,
+        config.pid);
+
+    std::vector<ProcessSample> samples;
+    auto begin = Clock::now();
+    auto take_sample = [&](uint64_t live)
+    {
+      if (config.pid == 0)
+      {
+        return;
+      }
+      if (auto sample = sample_process(config.pid))
+      {
+        sample->elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+        sample->live = live;
+        samples.push_back(*sample);
+      }
+      else
+      {
+        spdlog::warn("cannot read /proc/{}", config.pid);
+      }
+    };
+
+    take_sample(0);
+    bool has_baseline = !samples.empty();
+    ProcessSample baseline = has_baseline ? samples.front() : ProcessSample{};
+
+    SoakCounters counters;
+    std::vector<std::unique_ptr<asio::io_context>> contexts;
+    std::vector<std::vector<std::shared_ptr<SoakConnection>>> connections(config.threads);
+    std::random_device seed_source;
+    for (size_t t = 0; t < config.threads; ++t)
+    {
+      contexts.push_back(std::make_unique<asio::io_context>(1));
+    }
+    for (size_t i = 0; i < config.connections; ++i)
+    {
+      size_t t = i % config.threads;
+      auto conn = std::make_shared<SoakConnection>(*contexts[t], endpoint, config, counters, seed_source());
+      conn->start();
+      connections[t].push_back(conn);
+    }
+
+    // churn定时器: 每个线程每100ms随机断开一部分自己的连接
+    std::vector<std::unique_ptr<asio::steady_timer>> churn_timers;
+    std::vector<std::function<void()>> churn_loops(config.threads);
+    double churn_per_tick = config.churn / static_cast<double>(config.threads) / 10.0;
+    for (size_t t = 0; t < config.threads; ++t)
+    {
+      churn_timers.push_back(std::make_unique<asio::steady_timer>(*contexts[t]));
+      churn_loops[t] = [&, t, carry = 0.0, random = std::mt19937_64(seed_source())]() mutable
+      {
+        churn_timers[t]->expires_after(std::chrono::milliseconds(100));
+        churn_timers[t]->async_wait(
+            [&, t](const asio::error_code& ec)
+            {
+              if (ec)
+              {
+                return;
+              }
+              churn_loops[t]();
+            });
+        carry += churn_per_tick;
+        // 挑到还没连上的连接不算数，换一条再挑; 最多挑连接数那么多次，剩下的额度留到下个tick，
+        // 但最多留一个tick的量，连接全断时不会攒出一大波重连
+        std::uniform_int_distribution<size_t> pick(0, connections[t].size() - 1);
+        for (size_t attempts = connections[t].size(); carry >= 1.0 && attempts > 0; --attempts)
+        {
+          if (connections[t][pick(random)]->churn())
+          {
+            carry -= 1.0;
+          }
+        }
+        carry = std::min(carry, std::max(churn_per_tick, 1.0));
+      };
+      if (config.churn > 0)
+      {
+        asio::post(*contexts[t], [&, t]() { churn_loops[t](); });
+      }
+    }
+
+    std::vector<std::thread> threads;
+    std::vector<asio::executor_work_guard<asio::io_context::executor_type>> guards;
+    for (size_t t = 0; t < config.threads; ++t)
+    {
+      guards.push_back(asio::make_work_guard(*contexts[t]));
+      threads.emplace_back([&, t]() { contexts[t]->run(); });
+    }
+
+    // 主线程负责采样和打印进度
+    auto soak_end = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(config.duration));
+    uint64_t last_verified = 0;
+    while (Clock::now() < soak_end)
+    {
+      std::this_thread::sleep_for(std::min<Clock::duration>(config.sample, soak_end - Clock::now()));
+      uint64_t live = counters.live.load(std::memory_order_relaxed);
+      uint64_t verified = counters.verified.load(std::memory_order_relaxed);
+      take_sample(live);
+      spdlog::info(
+          "live={} connects={} churned={} failures={} unexpected={} verified={} (+{}) mismatches={}{}",
+          live,
+          counters.connects.load(std::memory_order_relaxed),
+          counters.churned.load(std::memory_order_relaxed),
+          counters.connect_failures.load(std::memory_order_relaxed),
+          counters.unexpected_closes.load(std::memory_order_relaxed),
+          verified,
+          verified - last_verified,
+          counters.mismatches.load(std::memory_order_relaxed),
+          samples.empty() ? std::string()
+                          : " server rss=" + std::to_string(samples.back().rss_kb) + "kB fds=" +
+                                std::to_string(samples.back().fds));
+      last_verified = verified;
+    }
+    size_t soak_samples_end = samples.size();
+
+    // 关闭全部连接后等服务器回收
+    for (size_t t = 0; t < config.threads; ++t)
+    {
+      asio::post(
+          *contexts[t],
+          [&, t]()
+          {
+            churn_timers[t]->cancel();
+            for (auto& conn : connections[t])
+            {
+              conn->stop();
+            }
+          });
+    }
+    guards.clear();
+    for (auto& thread : threads)
+    {
+      thread.join();
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(config.settle));
+    take_sample(0);
+
+    std::cout << "connects " << counters.connects << "  churned " << counters.churned << "  connect failures "
+              << counters.connect_failures << "  unexpected closes " << counters.unexpected_closes << "\n"
+              << "echoes   verified " << counters.verified << "  mismatches " << counters.mismatches << "  bytes "
+              << counters.bytes << std::endl;
+
+    nlohmann::ordered_json report;
+    report["tool"] = "tool_test_client";
+    report["config"]["host"] = config.host;
+    report["config"]["port"] = config.port;
+    report["config"]["connections"] = config.connections;
+    report["config"]["churn"] = config.churn;
+    report["config"]["min_size"] = config.min_size;
+    report["config"]["max_size"] = config.max_size;
+    report["config"]["interval_ms"] = config.interval.count();
+    report["config"]["duration_s"] = config.duration;
+    report["results"]["connects"] = counters.connects.load();
+    report["results"]["churned"] = counters.churned.load();
+    report["results"]["connect_failures"] = counters.connect_failures.load();
+    report["results"]["unexpected_closes"] = counters.unexpected_closes.load();
+    report["results"]["verified"] = counters.verified.load();
+    report["results"]["mismatches"] = counters.mismatches.load();
+    report["results"]["bytes"] = counters.bytes.load();
+
+    if (has_baseline && samples.size() > 1)
+    {
+      // 跳过前1/4的采样，避开ramp阶段
+      uint64_t rss_sum = 0, live_sum = 0, count = 0;
+      uint64_t peak_rss = 0;
+      for (size_t i = 1 + (soak_samples_end - 1) / 4; i < soak_samples_end; ++i)
+      {
+        rss_sum += samples[i].rss_kb;
+        live_sum += samples[i].live;
+        ++count;
+      }
+      for (const auto& sample : samples)
+      {
+        peak_rss = std::max(peak_rss, sample.rss_kb);
+      }
+      const auto& final_sample = samples.back();
+      report["server"]["baseline_rss_kb"] = baseline.rss_kb;
+      report["server"]["baseline_fds"] = baseline.fds;
+      report["server"]["peak_rss_kb"] = peak_rss;
+      report["server"]["settled_rss_kb"] = final_sample.rss_kb;
+      report["server"]["settled_fds"] = final_sample.fds;
+      std::cout << "server   baseline rss " << baseline.rss_kb << "kB fds " << baseline.fds << "  peak rss " << peak_rss
+                << "kB  after settle rss " << final_sample.rss_kb << "kB fds " << final_sample.fds << "\n";
+      if (count > 0 && live_sum > 0)
+      {
+        double avg_rss = static_cast<double>(rss_sum) / count;
+        double avg_live = static_cast<double>(live_sum) / count;
+        double per_connection = (avg_rss - static_cast<double>(baseline.rss_kb)) * 1024.0 / avg_live;
+        std::cout << "memory   " << per_connection << " bytes per connection (avg over " << count << " samples, "
+                  << avg_live << " live)\n";
+        report["server"]["avg_live_connections"] = avg_live;
+        report["server"]["bytes_per_connection"] = per_connection;
+      }
+      if (final_sample.fds > baseline.fds)
+      {
+        std::cout << "leak?    " << final_sample.fds - baseline.fds << " fds not released after settle\n";
+      }
+      std::cout.flush();
+    }
+
+    if (!config.csv_path.empty())
+    {
+      std::ofstream csv(config.csv_path);
+      csv << "elapsed_s,live_connections,rss_kb,fds\n";
+      for (const auto& sample : samples)
+      {
+        csv << sample.elapsed << "," << sample.live << "," << sample.rss_kb << "," << sample.fds << "\n";
+      }
+      spdlog::info("samples written to {}", config.csv_path);
+    }
+    if (!config.json_path.empty())
+    {
+      auto text = report.dump(2);
+      if (config.json_path == "-")
+      {
+        std::cout << text << std::endl;
+      }
+      else
+      {
+        std::ofstream out(config.json_path);
+        out << text << std::endl;
+        spdlog::info("report written to {}", config.json_path);
+      }
+    }
+    return counters.mismatches == 0 ? 0 : 2;
+  }
+  catch (std::exception& e)
+  {
+    spdlog::error("Test client error: {}", e.what());
+    return 1;
+  }
+}
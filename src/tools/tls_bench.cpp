@@ -0,0 +1,610 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 18:02:38
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:18:06
+ * @FilePath: \asio-learn-code\src\tools\tls_bench.cpp
+ * @Description: TLS握手压测：每条连接反复 建连->握手->回显一次->关闭，统计每秒握手数、复用比例和握手延迟
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+
+/**
+ 用法:
+   asio_ssl_example                               (或 --no-session-cache --no-tickets 关闭服务器侧复用)
+   tool_tls_bench --port 4433 --connections 16 --duration 10 --resume on  --json resumed.json
+   tool_tls_bench --port 4433 --connections 16 --duration 10 --resume off --json full.json
+ --resume on 时每条连接保存上一次的会话，下一次握手带上它; off 时每次都是完整握手
+ TLS1.3的票据在握手之后才发，所以每次握手后回显一条消息，读回显时顺便收下票据，再保存会话
+ 关闭时双向发送close_notify，否则服务器会把会话从缓存里删掉
+ 延迟从发起TCP连接算到握手完成，只统计预热(--warmup)之后、duration之内完成的握手
+
+ 0-RTT: asio_ssl_example --early-data 16384
+   tool_tls_bench --port 4433 --tls 1.3 --early-data on --alpn echo/1
+ --early-data on 时复用的会话允许的话，回显请求作为早期数据和ClientHello一起发出，被拒绝时握手后重发;
+ 首个回复延迟(建连到收完回显)对比 --early-data off 可以看到省下的往返
+ */
+#include <openssl/ssl.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <asio.hpp>
+#include <asio/ssl.hpp>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+#include "asio_learn/ssl/alpn.hpp"
+#include "asio_learn/ssl/early_data.hpp"
+#include "bench_common.hpp"
+#include "common/LatencyHistogram.hpp"
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  struct TlsBenchConfig
+  {
+    std::string host = "127.0.0.1";
+    unsigned short port = 4433;
+    std::string target;  // 写进JSON，区分被测配置
+    size_t connections = 16;
+    size_t threads = 1;
+    size_t message_size = 32;
+    bool resume = true;
+    std::string tls_version = "any";  // 1.2 / 1.3 / any
+    bool early_data = false;
+    std::vector<std::string> alpn;
+    double duration = 10.0;
+    double warmup = 1.0;
+    std::chrono::milliseconds timeout{ 5000 };  // 单次握手+回显+关闭的上限
+    std::string json_path;  // "-" 表示输出到标准输出
+  };
+
+  // 每个线程一份，只在本线程写，结束后汇总
+  struct ThreadStats
+  {
+    common::LatencyHistogram latency;  // 纳秒，建连到握手完成
+    common::LatencyHistogram first_reply;  // 纳秒，建连到收完回显
+    uint64_t handshakes = 0;
+    uint64_t resumed = 0;
+    uint64_t early_accepted = 0;
+    uint64_t early_rejected = 0;
+    uint64_t errors = 0;
+  };
+
+  class HandshakeLoop : public std::enable_shared_from_this<HandshakeLoop>
+  {
+   public:
+    HandshakeLoop(
+        asio::io_context& ioc,
+        asio::ssl::context& ctx,
+        ThreadStats& stats,
+        const TlsBenchConfig& config,
+        const bench::RunWindow& window,
+        const asio::ip::tcp::endpoint& endpoint)
+      : _ioc(ioc)
+      , _ctx(ctx)
+      , _stats(stats)
+      , _config(config)
+      , _window(window)
+      , _endpoint(endpoint)
+      , _timer(ioc)
+      , _request(config.message_size, 'h')
+      , _reply(config.message_size)
+    {
+    }
+
+    ~HandshakeLoop()
+    {
+      if (_session)
+      {
+        SSL_SESSION_free(_session);
+      }
+    }
+
+    void start()
+    {
+      next();
+    }
+
+    // --early-data on 时用新会话回调保存票据: 早期数据被接受时回显随服务器的握手消息先到，
+    // 读完回显还没收到新票据，要到关闭时等对端close_notify的过程中才处理，读回显后再取会话拿到的还是旧票据
+    static void keep_new_sessions(asio::ssl::context& ctx)
+    {
+      SSL_CTX_set_session_cache_mode(ctx.native_handle(), SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+      SSL_CTX_sess_set_new_cb(ctx.native_handle(), &HandshakeLoop::on_new_session);
+    }
+
+    void stop()
+    {
+      _stopped = true;
+      _timer.cancel();
+      if (_stream)
+      {
+        asio::error_code ignored;
+        _stream->lowest_layer().close(ignored);
+      }
+    }
+
+   private:
+    void next()
+    {
+      if (_stopped)
+      {
+        return;
+      }
+      _stream = std::make_unique<asio::ssl::stream<asio::ip::tcp::socket>>(_ioc, _ctx);
+      SSL_set_ex_data(_stream->native_handle(), loop_index(), this);
+      _begin = Clock::now();
+      // 超时直接关socket，挂着的异步操作都会带错误返回
+      _timer.expires_after(_config.timeout);
+      _timer.async_wait(
+          [self = shared_from_this(), stream = _stream.get()](const asio::error_code& ec)
+          {
+            if (!ec && self->_stream.get() == stream)
+            {
+              asio::error_code ignored;
+              stream->lowest_layer().close(ignored);
+            }
+          });
+      _stream->lowest_layer().async_connect(
+          _endpoint,
+          [self = shared_from_this()](const asio::error_code& ec)
+          {
+            if (ec)
+            {
+              return self->fail("connect", ec);
+            }
+            self->_stream->lowest_layer().set_option(asio::ip::tcp::no_delay(true));
+            if (self->_config.resume && self->_session)
+            {
+              SSL_set_session(self->_stream->native_handle(), self->_session);
+            }
+            self->handshake();
+          });
+    }
+
+    void handshake()
+    {
+      if (_config.early_data)
+      {
+        handshake_early_data();
+        return;
+      }
+      _early = EarlyResult::none;
+      _stream->async_handshake(
+          asio::ssl::stream_base::client,
+          [self = shared_from_this()](const asio::error_code& ec)
+          {
+            if (ec)
+            {
+              return self->fail("handshake", ec);
+            }
+            self->_handshake_done = Clock::now();
+            self->echo();
+          });
+    }
+
+    // 会话允许时回显请求作为早期数据发出; 被服务器接受时回显随握手消息回来，直接读
+    void handshake_early_data()
+    {
+      auto* session = SSL_get_session(_stream->native_handle());
+      bool offer = _config.resume && session && SSL_SESSION_get_max_early_data(session) >= _request.size();
+      auto handshake = std::make_shared<asio_learn::ssl::EarlyDataHandshake>(*_stream, _ioc.get_executor());
+      handshake->async_connect(
+          offer ? _request : std::string(),
+          [self = shared_from_this(), stream = _stream, offer](const asio::error_code& ec)
+          {
+            if (ec)
+            {
+              return self->fail("handshake", ec);
+            }
+            self->_handshake_done = Clock::now();
+            self->_early = EarlyResult::none;
+            if (offer && SSL_get_early_data_status(stream->native_handle()) == SSL_EARLY_DATA_ACCEPTED)
+            {
+              self->_early = EarlyResult::accepted;
+              self->read_reply();
+              return;
+            }
+            if (offer)
+            {
+              self->_early = EarlyResult::rejected;
+            }
+            self->echo();
+          });
+    }
+
+    void echo()
+    {
+      asio::async_write(
+          *_stream,
+          asio::buffer(_request),
+          [self = shared_from_this()](const asio::error_code& ec, size_t /*bytes*/)
+          {
+            if (ec)
+            {
+              return self->fail("write", ec);
+            }
+            self->read_reply();
+          });
+    }
+
+    void read_reply()
+    {
+      asio::async_read(
+          *_stream,
+          asio::buffer(_reply),
+          [self = shared_from_this()](const asio::error_code& ec, size_t /*bytes*/)
+          {
+            if (ec)
+            {
+              return self->fail("read", ec);
+            }
+            self->_reply_done = Clock::now();
+            self->finish();
+          });
+    }
+
+    void finish()
+    {
+      auto* ssl = _stream->native_handle();
+      if (_handshake_done >= _window.measure_begin && _handshake_done < _window.measure_end)
+      {
+        ++_stats.handshakes;
+        if (SSL_session_reused(ssl))
+        {
+          ++_stats.resumed;
+        }
+        _stats.latency.record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(_handshake_done - _begin).count()));
+        _stats.first_reply.record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(_reply_done - _begin).count()));
+        if (_early == EarlyResult::accepted)
+        {
+          ++_stats.early_accepted;
+        }
+        else if (_early == EarlyResult::rejected)
+        {
+          ++_stats.early_rejected;
+        }
+      }
+      if (_config.resume && !_config.early_data)
+      {
+        if (auto* session = SSL_get1_session(ssl))
+        {
+          keep_session(session);
+        }
+      }
+      _stream->async_shutdown(
+          [self = shared_from_this()](const asio::error_code& /*ec*/)
+          {
+            self->close();
+            self->next();
+          });
+    }
+
+    void keep_session(SSL_SESSION* session)
+    {
+      if (_session)
+      {
+        SSL_SESSION_free(_session);
+      }
+      _session = session;
+    }
+
+    static int loop_index()
+    {
+      static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+      return index;
+    }
+
+    // 返回1表示接管了会话的引用
+    static int on_new_session(SSL* ssl, SSL_SESSION* session)
+    {
+      auto* self = static_cast<HandshakeLoop*>(SSL_get_ex_data(ssl, loop_index()));
+      if (!self || !self->_config.resume)
+      {
+        return 0;
+      }
+      self->keep_session(session);
+      return 1;
+    }
+
+    void fail(const char* step, const asio::error_code& ec)
+    {
+      if (!_stopped)
+      {
+        ++_stats.errors;
+        spdlog::debug("{} failed: {}", step, ec.message());
+      }
+      close();
+      // 服务器不可用时不要空转
+      _timer.expires_after(std::chrono::milliseconds(100));
+      _timer.async_wait(
+          [self = shared_from_this()](const asio::error_code& ec)
+          {
+            if (!ec)
+            {
+              self->next();
+            }
+          });
+    }
+
+    void close()
+    {
+      _timer.cancel();
+      asio::error_code ignored;
+      _stream->lowest_layer().close(ignored);
+    }
+
+    enum class EarlyResult
+    {
+      none,
+      accepted,
+      rejected,
+    };
+
+    asio::io_context& _ioc;
+    asio::ssl::context& _ctx;
+    ThreadStats& _stats;
+    const TlsBenchConfig& _config;
+    const bench::RunWindow& _window;
+    asio::ip::tcp::endpoint _endpoint;
+    asio::steady_timer _timer;
+    // 每次握手一个新的stream，旧的随最后一个回调释放
+    std::shared_ptr<asio::ssl::stream<asio::ip::tcp::socket>> _stream;
+    SSL_SESSION* _session = nullptr;
+    std::string _request;
+    std::vector<char> _reply;
+    Clock::time_point _begin;
+    Clock::time_point _handshake_done;
+    Clock::time_point _reply_done;
+    EarlyResult _early = EarlyResult::none;
+    bool _stopped = false;
+  };
+
+  void print_usage()
+  {
+    std::cout << "usage: tool_tls_bench [options]\n"
+                 "  --host <host>          server host (default 127.0.0.1)\n"
+                 "  --port <port>          server port (default 4433)\n"
+                 "  --target <name>        label written into the JSON report\n"
+                 "  --connections <n>      concurrent handshake loops (default 16)\n"
+                 "  --threads <n>          client threads (default 1)\n"
+                 "  --size <bytes>         echo message size after each handshake (default 32)\n"
+                 "  --resume <on|off>      offer the previous session on reconnect (default on)\n"
+                 "  --tls <1.2|1.3|any>    protocol version (default any)\n"
+                 "  --early-data <on|off>  send the echo request as TLS 1.3 early data when resuming (default off)\n"
+                 "  --alpn <p1,p2>         offer ALPN protocols\n"
+                 "  --duration <s>         measured seconds (default 10)\n"
+                 "  --warmup <s>           seconds before measuring (default 1)\n"
+                 "  --timeout-ms <ms>      limit for one connect/handshake/echo/close cycle (default 5000)\n"
+                 "  --json <path|->        write JSON report\n";
+  }
+
+  bool parse_args(int argc, char** argv, TlsBenchConfig& config)
+  {
+    bool parsed = bench::parse_options(
+        argc,
+        argv,
+        [&](const std::string& key, const std::string& value)
+        {
+          if (key == "--host")
+            config.host = value;
+          else if (key == "--port")
+            config.port = bench::parse_number<unsigned short>(value, 1);
+          else if (key == "--target")
+            config.target = value;
+          else if (key == "--connections")
+            config.connections = bench::parse_number<size_t>(value);
+          else if (key == "--threads")
+            config.threads = bench::parse_number<size_t>(value);
+          else if (key == "--size")
+            config.message_size = bench::parse_number<size_t>(value);
+          else if (key == "--resume")
+            config.resume = value == "on";
+          else if (key == "--tls")
+            config.tls_version = value;
+          else if (key == "--early-data")
+            config.early_data = value == "on";
+          else if (key == "--alpn")
+          {
+            for (size_t begin = 0; begin <= value.size();)
+            {
+              auto end = std::min(value.find(',', begin), value.size());
+              if (end > begin)
+              {
+                config.alpn.push_back(value.substr(begin, end - begin));
+              }
+              begin = end + 1;
+            }
+          }
+          else if (key == "--duration")
+            config.duration = bench::parse_number<double>(value, 0.0);
+          else if (key == "--warmup")
+            config.warmup = bench::parse_number<double>(value, 0.0);
+          else if (key == "--timeout-ms")
+            config.timeout = std::chrono::milliseconds(bench::parse_number<size_t>(value));
+          else if (key == "--json")
+            config.json_path = value;
+          else
+            return false;
+          return true;
+        });
+    if (!parsed)
+    {
+      return false;
+    }
+    config.threads = std::max<size_t>(1, std::min(config.threads, config.connections));
+    config.message_size = std::max<size_t>(1, config.message_size);
+    return config.connections > 0 && config.duration > 0 &&
+           (config.tls_version == "1.2" || config.tls_version == "1.3" || config.tls_version == "any");
+  }
+
+  nlohmann::ordered_json make_report(const TlsBenchConfig& config, const ThreadStats& total)
+  {
+    const auto& latency = total.latency;
+    nlohmann::ordered_json report;
+    report["tool"] = "tool_tls_bench";
+    report["config"]["target"] = config.target;
+    report["config"]["host"] = config.host;
+    report["config"]["port"] = config.port;
+    report["config"]["connections"] = config.connections;
+    report["config"]["threads"] = config.threads;
+    report["config"]["resume"] = config.resume;
+    report["config"]["tls"] = config.tls_version;
+    report["config"]["early_data"] = config.early_data;
+    report["config"]["duration_s"] = config.duration;
+    report["config"]["warmup_s"] = config.warmup;
+    report["results"]["handshakes"] = total.handshakes;
+    report["results"]["resumed"] = total.resumed;
+    report["results"]["early_data_accepted"] = total.early_accepted;
+    report["results"]["early_data_rejected"] = total.early_rejected;
+    report["results"]["errors"] = total.errors;
+    report["results"]["handshakes_per_sec"] = static_cast<double>(total.handshakes) / config.duration;
+    report["results"]["resumption_rate"] =
+        total.handshakes ? static_cast<double>(total.resumed) / static_cast<double>(total.handshakes) : 0.0;
+    report["latency_us"]["min"] = bench::to_us(latency.min());
+    report["latency_us"]["mean"] = latency.mean() / 1000.0;
+    report["latency_us"]["p50"] = bench::to_us(latency.value_at_percentile(50));
+    report["latency_us"]["p90"] = bench::to_us(latency.value_at_percentile(90));
+    report["latency_us"]["p99"] = bench::to_us(latency.value_at_percentile(99));
+    report["latency_us"]["max"] = bench::to_us(latency.max());
+    const auto& first_reply = total.first_reply;
+    report["first_reply_us"]["mean"] = first_reply.mean() / 1000.0;
+    report["first_reply_us"]["p50"] = bench::to_us(first_reply.value_at_percentile(50));
+    report["first_reply_us"]["p99"] = bench::to_us(first_reply.value_at_percentile(99));
+    return report;
+  }
+
+  void print_summary(const TlsBenchConfig& config, const ThreadStats& total)
+  {
+    const auto& latency = total.latency;
+    double per_sec = static_cast<double>(total.handshakes) / config.duration;
+    double rate = total.handshakes ? 100.0 * static_cast<double>(total.resumed) / static_cast<double>(total.handshakes)
+                                   : 0.0;
+    std::cout << "target        " << config.host << ":" << config.port << " tls " << config.tls_version << " resume "
+              << (config.resume ? "on" : "off") << "\n"
+              << "handshakes    " << total.handshakes << " in " << config.duration << "s (errors " << total.errors
+              << ")\n"
+              << "throughput    " << per_sec << " handshakes/s, " << rate << "% resumed\n"
+              << "latency(us)   min " << bench::to_us(latency.min()) << "  mean " << latency.mean() / 1000.0 << "  p50 "
+              << bench::to_us(latency.value_at_percentile(50)) << "  p99 " << bench::to_us(latency.value_at_percentile(99))
+              << "  max " << bench::to_us(latency.max()) << "\n"
+              << "first reply   mean " << total.first_reply.mean() / 1000.0 << "  p50 "
+              << bench::to_us(total.first_reply.value_at_percentile(50)) << "  p99 "
+              << bench::to_us(total.first_reply.value_at_percentile(99)) << " (us, connect to echo received)" << std::endl;
+    if (config.early_data)
+    {
+      std::cout << "early data    accepted " << total.early_accepted << "  rejected " << total.early_rejected
+                << std::endl;
+    }
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  TlsBenchConfig config;
+  if (!parse_args(argc, argv, config))
+  {
+    print_usage();
+    return 1;
+  }
+
+  try
+  {
+    asio::io_context resolve_ioc;
+    asio::ip::tcp::resolver resolver(resolve_ioc);
+    auto endpoint = resolver.resolve(config.host, std::to_string(config.port)).begin()->endpoint();
+
+    // 压测只关心握手开销，不校验服务器证书
+    asio::ssl::context ctx(asio::ssl::context::tls_client);
+    ctx.set_verify_mode(asio::ssl::verify_none);
+    if (config.tls_version == "1.2")
+    {
+      SSL_CTX_set_max_proto_version(ctx.native_handle(), TLS1_2_VERSION);
+    }
+    else if (config.tls_version == "1.3")
+    {
+      SSL_CTX_set_min_proto_version(ctx.native_handle(), TLS1_3_VERSION);
+    }
+    asio_learn::ssl::Alpn::offer(ctx, config.alpn);
+    if (config.early_data)
+    {
+      HandshakeLoop::keep_new_sessions(ctx);
+    }
+
+    spdlog::info(
+        "tls bench {}:{} connections={} threads={} resume={} tls={} early_data={} duration={}s warmup={}s",
+        config.host,
+        config.port,
+        config.connections,
+        config.threads,
+        config.resume ? "on" : "off",
+        config.tls_version,
+        config.early_data ? "on" : "off",
+        config.duration,
+        config.warmup);
+
+    auto window = bench::make_run_window(config.warmup, config.duration);
+
+    // 每个线程一个io_context，连接按轮询分到各线程; ssl::context只读，可以共享
+    std::vector<std::unique_ptr<asio::io_context>> contexts;
+    std::vector<ThreadStats> stats(config.threads);
+    std::vector<std::vector<std::shared_ptr<HandshakeLoop>>> loops(config.threads);
+    for (size_t t = 0; t < config.threads; ++t)
+    {
+      contexts.push_back(std::make_unique<asio::io_context>(1));
+    }
+    for (size_t i = 0; i < config.connections; ++i)
+    {
+      size_t t = i % config.threads;
+      auto loop = std::make_shared<HandshakeLoop>(*contexts[t], ctx, stats[t], config, window, endpoint);
+      loop->start();
+      loops[t].push_back(loop);
+    }
+
+    // 握手循环自己驱动，不需要tick
+    bench::run_threads(
+        contexts,
+        std::chrono::microseconds(0),
+        window.measure_end,
+        window.measure_end,
+        [](size_t, Clock::time_point) {},
+        [&](size_t t)
+        {
+          for (auto& loop : loops[t])
+          {
+            loop->stop();
+          }
+        });
+
+    ThreadStats total;
+    for (const auto& s : stats)
+    {
+      total.latency.merge(s.latency);
+      total.first_reply.merge(s.first_reply);
+      total.handshakes += s.handshakes;
+      total.resumed += s.resumed;
+      total.early_accepted += s.early_accepted;
+      total.early_rejected += s.early_rejected;
+      total.errors += s.errors;
+    }
+
+    print_summary(config, total);
+    if (!config.json_path.empty())
+    {
+      bench::write_report(config.json_path, make_report(config, total));
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << "tls bench failed: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
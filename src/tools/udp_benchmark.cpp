@@ -0,0 +1,499 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 17:08:05
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:19:00
+ * @FilePath: \asio-learn-code\src\tools\udp_benchmark.cpp
+ * @Description: UDP延迟压测工具：按固定包速率发给 udp_reflector，统计RTT分位数、丢包和乱序
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+
+/**
+ 用法:
+   tool_udp_benchmark --port 9528 --sockets 16 --threads 2 --rate 200000 --size 64 --duration 10 --json result.json
+ - 每个socket是一条流(connect到反射服务器)，分到 rate/sockets 的包速率，开环发送
+ - 包头带流内序号和计划发送时间，回来的包直接算RTT，不需要在客户端保存在途的包
+ - 收发都用UdpBatch(Linux上是recvmmsg/sendmmsg)，一次系统调用处理一批
+ - 计划发送时间落在测量窗口内的包参与统计；duration结束后再等--drain-ms收尾，之后还没回来的算丢包
+ - 序号小于本流已收到的最大序号算乱序，同一序号收到多次算重复
+ */
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+#include "asio_learn/udp_batch.hpp"
+#include "bench_common.hpp"
+#include "common/LatencyHistogram.hpp"
+
+namespace
+{
+  using bench::Clock;
+  using bench::RunWindow;
+
+  constexpr uint32_t PACKET_MAGIC = 0x55445042;  // "UDPB"
+
+  // 网络上传的包头，只在本机收发，用主机字节序
+  struct PacketHeader
+  {
+    uint64_t seq;
+    int64_t intended_ns;  // 计划发送时间(steady_clock)
+    uint32_t flow;
+    uint32_t magic;
+  };
+
+  struct UdpBenchmarkConfig
+  {
+    std::string host = "127.0.0.1";
+    unsigned short port = 9528;
+    std::string target = "udp_reflector";
+    size_t sockets = 16;
+    size_t threads = 2;
+    size_t packet_size = 64;
+    double rate = 100000;
+    size_t batch = 64;
+    std::chrono::microseconds tick{ 100 };
+    double duration = 10.0;
+    double warmup = 1.0;
+    std::chrono::milliseconds drain{ 200 };
+    std::string json_path;
+  };
+
+  struct ThreadStats
+  {
+    common::LatencyHistogram rtt;  // 纳秒
+    uint64_t sent = 0;             // 测量窗口内发出的包
+    uint64_t received = 0;         // 测量窗口内发出且收到的包(去重后)
+    uint64_t duplicates = 0;
+    uint64_t reordered = 0;
+    uint64_t send_calls = 0;
+    uint64_t recv_calls = 0;
+    uint64_t send_blocked = 0;  // 发送缓冲满，积压到下一个tick
+    uint64_t errors = 0;
+  };
+
+  int64_t to_ns(Clock::time_point tp)
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(tp.time_since_epoch()).count();
+  }
+
+  class Flow
+  {
+   public:
+    Flow(asio::io_context& ioc,
+         uint32_t id,
+         ThreadStats& stats,
+         const UdpBenchmarkConfig& config,
+         const RunWindow& window)
+      : _socket(ioc)
+      , _id(id)
+      , _stats(stats)
+      , _config(config)
+      , _window(window)
+      , _send_batch(config.batch, config.packet_size)
+      , _recv_batch(config.batch, config.packet_size)
+      , _interval(1e9 * static_cast<double>(config.sockets) / config.rate)
+    {
+      for (size_t i = 0; i < config.batch; ++i)
+      {
+        std::memset(_send_batch.data(i), 'x', config.packet_size);
+        _send_batch.set_size(i, config.packet_size);
+      }
+    }
+
+    void start(const asio::ip::udp::endpoint& endpoint)
+    {
+      _socket.open(endpoint.protocol());
+      asio::error_code ec;
+      _socket.set_option(asio::socket_base::receive_buffer_size(4 * 1024 * 1024), ec);
+      _socket.set_option(asio::socket_base::send_buffer_size(4 * 1024 * 1024), ec);
+      _socket.connect(endpoint);
+      _socket.non_blocking(true);
+      _begin = Clock::now();
+      do_receive();
+    }
+
+    // 由线程的tick定时器调用，发出到now为止计划好的包
+    void schedule(Clock::time_point now)
+    {
+      if (!_socket.is_open() || now >= _window.measure_end)
+      {
+        return;
+      }
+      auto due = static_cast<uint64_t>((now - _begin) / _interval) + 1;
+      while (_next_seq < due)
+      {
+        size_t count = std::min<uint64_t>(due - _next_seq, _send_batch.capacity());
+        for (size_t i = 0; i < count; ++i)
+        {
+          PacketHeader header{};
+          header.seq = _next_seq + i;
+          header.intended_ns = to_ns(intended_time(header.seq));
+          header.flow = _id;
+          header.magic = PACKET_MAGIC;
+          std::memcpy(_send_batch.data(i), &header, sizeof(header));
+        }
+        asio::error_code ec;
+        size_t sent = _send_batch.send(_socket, count, true, ec);
+        ++_stats.send_calls;
+        for (size_t i = 0; i < sent; ++i)
+        {
+          if (in_window(intended_time(_next_seq + i)))
+          {
+            ++_stats.sent;
+          }
+        }
+        _next_seq += sent;
+        if (sent < count)
+        {
+          if (ec == asio::error::would_block || ec == asio::error::try_again || ec == asio::error::no_buffer_space)
+          {
+            // 没发出去的包保留原计划时间，下个tick再发，客户端自己的积压也算进延迟
+            ++_stats.send_blocked;
+          }
+          else if (ec)
+          {
+            ++_stats.errors;
+            spdlog::error("flow {} send error: {}", _id, ec.message());
+          }
+          return;
+        }
+      }
+    }
+
+    void stop()
+    {
+      asio::error_code ignored;
+      _socket.close(ignored);
+    }
+
+   private:
+    Clock::time_point intended_time(uint64_t seq) const
+    {
+      return _begin + std::chrono::duration_cast<Clock::duration>(_interval * static_cast<double>(seq));
+    }
+
+    bool in_window(Clock::time_point tp) const
+    {
+      return tp >= _window.measure_begin && tp < _window.measure_end;
+    }
+
+    void do_receive()
+    {
+      _socket.async_wait(
+          asio::ip::udp::socket::wait_read,
+          [this](const asio::error_code& ec)
+          {
+            if (ec)
+            {
+              return;
+            }
+            drain_socket();
+            do_receive();
+          });
+    }
+
+    void drain_socket()
+    {
+      while (true)
+      {
+        asio::error_code ec;
+        size_t n = _recv_batch.receive(_socket, ec);
+        // 回显比发出的包长，不是我们的包
+        _stats.errors += _recv_batch.truncated();
+        if (n == 0 && _recv_batch.truncated() > 0)
+        {
+          continue;
+        }
+        if (n == 0)
+        {
+          // 反射端没开时connect过的UDP socket会收到connection_refused
+          if (ec && ec != asio::error::would_block && ec != asio::error::try_again)
+          {
+            ++_stats.errors;
+            spdlog::error("flow {} receive error: {}", _id, ec.message());
+          }
+          return;
+        }
+        ++_stats.recv_calls;
+        auto now = Clock::now();
+        for (size_t i = 0; i < n; ++i)
+        {
+          on_packet(_recv_batch.data(i), _recv_batch.size(i), now);
+        }
+        if (n + _recv_batch.truncated() < _recv_batch.capacity())
+        {
+          return;
+        }
+      }
+    }
+
+    void on_packet(const char* data, size_t size, Clock::time_point now)
+    {
+      PacketHeader header;
+      if (size < sizeof(header))
+      {
+        return;
+      }
+      std::memcpy(&header, data, sizeof(header));
+      if (header.magic != PACKET_MAGIC || header.flow != _id)
+      {
+        return;
+      }
+      if (header.seq >= _seen.size())
+      {
+        _seen.resize(std::max<size_t>(header.seq + 1, _seen.size() * 2));
+      }
+      if (_seen[header.seq])
+      {
+        ++_stats.duplicates;
+        return;
+      }
+      _seen[header.seq] = true;
+      if (_has_received && header.seq < _max_seq)
+      {
+        ++_stats.reordered;
+      }
+      _max_seq = std::max(_max_seq, header.seq);
+      _has_received = true;
+
+      auto intended = Clock::time_point(std::chrono::nanoseconds(header.intended_ns));
+      if (in_window(intended))
+      {
+        ++_stats.received;
+        _stats.rtt.record(static_cast<uint64_t>(std::max<int64_t>(0, to_ns(now) - header.intended_ns)));
+      }
+    }
+
+    asio::ip::udp::socket _socket;
+    uint32_t _id;
+    ThreadStats& _stats;
+    const UdpBenchmarkConfig& _config;
+    const RunWindow& _window;
+    asio_learn::UdpBatch _send_batch;
+    asio_learn::UdpBatch _recv_batch;
+    std::chrono::duration<double, std::nano> _interval;
+    Clock::time_point _begin;
+    uint64_t _next_seq = 0;
+    uint64_t _max_seq = 0;
+    bool _has_received = false;
+    std::vector<bool> _seen;
+  };
+
+  void print_usage()
+  {
+    std::cout << "usage: tool_udp_benchmark [options]\n"
+                 "  --host <ip>            reflector host (default 127.0.0.1)\n"
+                 "  --port <port>          reflector port (default 9528)\n"
+                 "  --target <name>        label written into the JSON report\n"
+                 "  --sockets <n>          concurrent flows (default 16)\n"
+                 "  --threads <n>          client io_context threads (default 2)\n"
+                 "  --size <bytes>         packet size, at least 24 (default 64)\n"
+                 "  --rate <pps>           total packets per second across flows (default 100000)\n"
+                 "  --batch <n>            packets per sendmmsg/recvmmsg (default 64)\n"
+                 "  --tick-us <us>         send scheduler tick (default 100)\n"
+                 "  --duration <seconds>   measured duration (default 10)\n"
+                 "  --warmup <seconds>     warmup before measuring (default 1)\n"
+                 "  --drain-ms <ms>        wait for late replies after the run (default 200)\n"
+                 "  --json <path|->        write JSON report\n";
+  }
+
+  bool parse_args(int argc, char** argv, UdpBenchmarkConfig& config)
+  {
+    bool parsed = bench::parse_options(
+        argc,
+        argv,
+        [&](const std::string& key, const std::string& value)
+        {
+          if (key == "--host")
+            config.host = value;
+          else if (key == "--port")
+            config.port = bench::parse_number<unsigned short>(value, 1);
+          else if (key == "--target")
+            config.target = value;
+          else if (key == "--sockets")
+            config.sockets = bench::parse_number<size_t>(value);
+          else if (key == "--threads")
+            config.threads = bench::parse_number<size_t>(value);
+          else if (key == "--size")
+            config.packet_size = bench::parse_number<size_t>(value);
+          else if (key == "--rate")
+            config.rate = bench::parse_number<double>(value, 0.0);
+          else if (key == "--batch")
+            config.batch = bench::parse_number<size_t>(value);
+          else if (key == "--tick-us")
+            config.tick = std::chrono::microseconds(bench::parse_number<size_t>(value));
+          else if (key == "--duration")
+            config.duration = bench::parse_number<double>(value, 0.0);
+          else if (key == "--warmup")
+            config.warmup = bench::parse_number<double>(value, 0.0);
+          else if (key == "--drain-ms")
+            config.drain = std::chrono::milliseconds(bench::parse_number<size_t>(value));
+          else if (key == "--json")
+            config.json_path = value;
+          else
+            return false;
+          return true;
+        });
+    if (!parsed)
+    {
+      return false;
+    }
+    if (config.packet_size < sizeof(PacketHeader) || config.packet_size > 65507)
+    {
+      std::cerr << "--size must be between " << sizeof(PacketHeader) << " and 65507" << std::endl;
+      return false;
+    }
+    config.threads = std::max<size_t>(1, std::min(config.threads, config.sockets));
+    config.batch = std::max<size_t>(1, config.batch);
+    config.tick = std::max(config.tick, std::chrono::microseconds(1));
+    return config.sockets > 0 && config.rate > 0 && config.duration > 0;
+  }
+
+  double loss_ratio(const ThreadStats& total)
+  {
+    return total.sent ? static_cast<double>(total.sent - std::min(total.sent, total.received)) / total.sent : 0.0;
+  }
+
+  nlohmann::ordered_json make_report(const UdpBenchmarkConfig& config, const ThreadStats& total)
+  {
+    nlohmann::ordered_json report;
+    report["tool"] = "tool_udp_benchmark";
+    report["config"]["target"] = config.target;
+    report["config"]["host"] = config.host;
+    report["config"]["port"] = config.port;
+    report["config"]["sockets"] = config.sockets;
+    report["config"]["threads"] = config.threads;
+    report["config"]["packet_size"] = config.packet_size;
+    report["config"]["rate"] = config.rate;
+    report["config"]["batch"] = config.batch;
+    report["config"]["duration_s"] = config.duration;
+    report["config"]["warmup_s"] = config.warmup;
+    report["results"]["sent"] = total.sent;
+    report["results"]["received"] = total.received;
+    report["results"]["lost"] = total.sent - std::min(total.sent, total.received);
+    report["results"]["loss_ratio"] = loss_ratio(total);
+    report["results"]["duplicates"] = total.duplicates;
+    report["results"]["reordered"] = total.reordered;
+    report["results"]["pps"] = static_cast<double>(total.received) / config.duration;
+    report["results"]["mb_per_sec"] =
+        static_cast<double>(total.received) * static_cast<double>(config.packet_size) / config.duration / 1e6;
+    report["results"]["send_calls"] = total.send_calls;
+    report["results"]["recv_calls"] = total.recv_calls;
+    report["results"]["send_blocked"] = total.send_blocked;
+    report["results"]["errors"] = total.errors;
+    report["rtt_us"] = bench::latency_report(total.rtt);
+    return report;
+  }
+
+  void print_summary(const UdpBenchmarkConfig& config, const ThreadStats& total)
+  {
+    std::cout << "target        " << config.host << ":" << config.port << "\n"
+              << "packets       sent " << total.sent << "  received " << total.received << "  loss "
+              << loss_ratio(total) * 100.0 << "%  reordered " << total.reordered << "  duplicates "
+              << total.duplicates << "\n"
+              << "throughput    " << static_cast<double>(total.received) / config.duration << " pps (target "
+              << config.rate << "), avg batch send "
+              << (total.send_calls ? double(total.sent) / total.send_calls : 0.0) << " recv "
+              << (total.recv_calls ? double(total.received) / total.recv_calls : 0.0) << "\n";
+    bench::print_latency("rtt(us)", total.rtt);
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  UdpBenchmarkConfig config;
+  if (!parse_args(argc, argv, config))
+  {
+    print_usage();
+    return 1;
+  }
+
+  try
+  {
+    asio::io_context resolve_ioc;
+    asio::ip::udp::resolver resolver(resolve_ioc);
+    auto endpoint = resolver.resolve(config.host, std::to_string(config.port)).begin()->endpoint();
+
+    spdlog::info(
+        "udp benchmark {}:{} sockets={} threads={} size={} rate={}pps batch={} duration={}s warmup={}s",
+        config.host,
+        config.port,
+        config.sockets,
+        config.threads,
+        config.packet_size,
+        config.rate,
+        config.batch,
+        config.duration,
+        config.warmup);
+
+    auto window = bench::make_run_window(config.warmup, config.duration);
+
+    std::vector<std::unique_ptr<asio::io_context>> contexts;
+    std::vector<ThreadStats> stats(config.threads);
+    std::vector<std::vector<std::unique_ptr<Flow>>> flows(config.threads);
+    for (size_t t = 0; t < config.threads; ++t)
+    {
+      contexts.push_back(std::make_unique<asio::io_context>(1));
+    }
+    for (size_t i = 0; i < config.sockets; ++i)
+    {
+      size_t t = i % config.threads;
+      flows[t].push_back(std::make_unique<Flow>(*contexts[t], static_cast<uint32_t>(i), stats[t], config, window));
+      flows[t].back()->start(endpoint);
+    }
+
+    // 发送在measure_end停止，再等drain收迟到的回包
+    bench::run_threads(
+        contexts,
+        config.tick,
+        window.measure_end,
+        window.measure_end + config.drain,
+        [&](size_t t, Clock::time_point now)
+        {
+          for (auto& flow : flows[t])
+          {
+            flow->schedule(now);
+          }
+        },
+        [&](size_t t)
+        {
+          for (auto& flow : flows[t])
+          {
+            flow->stop();
+          }
+        });
+
+    ThreadStats total;
+    for (const auto& s : stats)
+    {
+      total.rtt.merge(s.rtt);
+      total.sent += s.sent;
+      total.received += s.received;
+      total.duplicates += s.duplicates;
+      total.reordered += s.reordered;
+      total.send_calls += s.send_calls;
+      total.recv_calls += s.recv_calls;
+      total.send_blocked += s.send_blocked;
+      total.errors += s.errors;
+    }
+
+    print_summary(config, total);
+    if (!config.json_path.empty())
+    {
+      bench::write_report(config.json_path, make_report(config, total));
+    }
+    return total.errors == 0 ? 0 : 2;
+  }
+  catch (std::exception& e)
+  {
+    spdlog::error("UDP benchmark error: {}", e.what());
+    return 1;
+  }
+}
@@ -1,4 +1,4 @@
-#include"common/log.hpp"
+#include "common/Log.hpp"
 
 int main(){
     common::LoggerConfig config;
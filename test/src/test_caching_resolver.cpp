@@ -0,0 +1,218 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 16:38:12
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:25:36
+ * @FilePath: \asio-learn-code\test\src\test_caching_resolver.cpp
+ * @Description: CachingResolver 测试，后端换成计数的假解析器
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "asio_learn/client/caching_resolver.hpp"
+#include "test_common.hpp"
+
+using namespace asio_learn;
+using namespace std::chrono_literals;
+
+/**
+ * @brief 假解析器: 延迟delay后返回预设结果，记录每个名字被查询的次数
+ */
+struct FakeBackend
+{
+  explicit FakeBackend(io_context& ioc) : ioc(ioc)
+  {
+  }
+
+  io_context& ioc;
+  std::chrono::milliseconds delay{ 20 };
+  std::map<std::string, std::string> addresses;  // host -> ip，没有则返回host_not_found
+  std::map<std::string, int> calls;
+
+  client::CachingResolver::Backend backend()
+  {
+    return [this](const std::string& host, const std::string& service, client::CachingResolver::BackendHandler handler)
+    {
+      ++calls[host];
+      auto timer = std::make_shared<steady_timer>(ioc, delay);
+      timer->async_wait(
+          [this, timer, host, service, handler](const asio::error_code&)
+          {
+            auto it = addresses.find(host);
+            if (it == addresses.end())
+            {
+              handler(asio::error::host_not_found, {});
+              return;
+            }
+            handler({}, { tcp_endpoint(asio::ip::make_address(it->second), static_cast<uint16>(std::stoi(service))) });
+          });
+    };
+  }
+};
+
+struct Result
+{
+  bool done = false;
+  error_code ec;
+  client::CachingResolver::Endpoints endpoints;
+};
+
+static std::shared_ptr<Result> resolve(client::CachingResolver& resolver, const std::string& host)
+{
+  auto result = std::make_shared<Result>();
+  resolver.async_resolve(
+      host,
+      "80",
+      [result](error_code ec, client::CachingResolver::Endpoints endpoints)
+      {
+        result->done = true;
+        result->ec = ec;
+        result->endpoints = std::move(endpoints);
+      });
+  return result;
+}
+
+static void run_until(io_context& ioc, const std::shared_ptr<Result>& result)
+{
+  ioc.restart();
+  while (!result->done && ioc.run_one_for(1s) > 0)
+  {
+  }
+}
+
+static void sleep_for(std::chrono::milliseconds ms)
+{
+  std::this_thread::sleep_for(ms);
+}
+
+// 并发查询同一名字只查一次，之后命中缓存
+static void test_coalesce_and_hit()
+{
+  io_context ioc;
+  FakeBackend fake(ioc);
+  fake.addresses["svc.test"] = "10.0.0.1";
+  auto resolver = std::make_shared<client::CachingResolver>(ioc, client::CachingResolverOptions{}, fake.backend());
+
+  auto a = resolve(*resolver, "svc.test");
+  auto b = resolve(*resolver, "SVC.test");
+  auto c = resolve(*resolver, "svc.test");
+  run_until(ioc, a);
+  run_until(ioc, b);
+  run_until(ioc, c);
+  EXPECT(fake.calls["svc.test"] == 1);
+  EXPECT(!a->ec && !b->ec && !c->ec);
+  EXPECT(b->endpoints.size() == 1 && b->endpoints[0].address().to_string() == "10.0.0.1");
+  EXPECT(b->endpoints[0].port() == 80);
+  EXPECT(resolver->stats().coalesced == 2);
+
+  auto d = resolve(*resolver, "svc.test");
+  run_until(ioc, d);
+  EXPECT(fake.calls["svc.test"] == 1);
+  EXPECT(!d->ec && d->endpoints.size() == 1);
+  EXPECT(resolver->stats().hits == 1);
+}
+
+// 失败结果在negative_ttl内直接返回，过期后重新查询
+static void test_negative_ttl()
+{
+  io_context ioc;
+  FakeBackend fake(ioc);
+  client::CachingResolverOptions options;
+  options.negative_ttl = 100ms;
+  auto resolver = std::make_shared<client::CachingResolver>(ioc, options, fake.backend());
+
+  auto a = resolve(*resolver, "missing.test");
+  run_until(ioc, a);
+  EXPECT(a->ec == asio::error::host_not_found);
+
+  auto b = resolve(*resolver, "missing.test");
+  run_until(ioc, b);
+  EXPECT(b->ec == asio::error::host_not_found);
+  EXPECT(fake.calls["missing.test"] == 1);
+  EXPECT(resolver->stats().negative_hits == 1);
+
+  sleep_for(150ms);
+  fake.addresses["missing.test"] = "10.0.0.2";
+  auto c = resolve(*resolver, "missing.test");
+  run_until(ioc, c);
+  EXPECT(!c->ec);
+  EXPECT(fake.calls["missing.test"] == 2);
+}
+
+// 过了刷新点的命中立即返回旧结果，后台刷新后换成新结果
+static void test_refresh_ahead()
+{
+  io_context ioc;
+  FakeBackend fake(ioc);
+  fake.addresses["refresh.test"] = "10.0.0.3";
+  client::CachingResolverOptions options;
+  options.positive_ttl = 400ms;
+  options.refresh_ahead = 0.5;
+  auto resolver = std::make_shared<client::CachingResolver>(ioc, options, fake.backend());
+
+  auto a = resolve(*resolver, "refresh.test");
+  run_until(ioc, a);
+  EXPECT(fake.calls["refresh.test"] == 1);
+
+  sleep_for(250ms);
+  fake.addresses["refresh.test"] = "10.0.0.4";
+  auto b = resolve(*resolver, "refresh.test");
+  run_until(ioc, b);
+  EXPECT(!b->ec && b->endpoints[0].address().to_string() == "10.0.0.3");
+  EXPECT(fake.calls["refresh.test"] == 1 || fake.calls["refresh.test"] == 2);
+
+  // 等后台刷新完成
+  ioc.restart();
+  ioc.run_for(100ms);
+  EXPECT(fake.calls["refresh.test"] == 2);
+  EXPECT(resolver->stats().refreshes == 1);
+
+  auto c = resolve(*resolver, "refresh.test");
+  run_until(ioc, c);
+  EXPECT(!c->ec && c->endpoints[0].address().to_string() == "10.0.0.4");
+  EXPECT(fake.calls["refresh.test"] == 2);
+}
+
+// hosts文件里的名字不走后端
+static void test_hosts_file()
+{
+  const char* path = "test_caching_resolver.hosts";
+  {
+    std::ofstream out(path);
+    out << "# comment line\n";
+    out << "10.1.1.1   db.test   db-alias.test  # trailing comment\n";
+    out << "::1        v6.test\n";
+  }
+  io_context ioc;
+  FakeBackend fake(ioc);
+  client::CachingResolverOptions options;
+  options.hosts_file = path;
+  auto resolver = std::make_shared<client::CachingResolver>(ioc, options, fake.backend());
+
+  auto a = resolve(*resolver, "db-alias.test");
+  run_until(ioc, a);
+  EXPECT(!a->ec && a->endpoints.size() == 1 && a->endpoints[0].address().to_string() == "10.1.1.1");
+  auto b = resolve(*resolver, "v6.test");
+  run_until(ioc, b);
+  EXPECT(!b->ec && b->endpoints.size() == 1 && b->endpoints[0].address().is_v6());
+  EXPECT(fake.calls.empty());
+  EXPECT(resolver->stats().overrides == 2);
+  std::remove(path);
+}
+
+int main()
+{
+  return run_tests("caching resolver", []
+  {
+    test_coalesce_and_hit();
+    test_negative_ttl();
+    test_refresh_ahead();
+    test_hosts_file();
+  });
+}
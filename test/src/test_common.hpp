@@ -0,0 +1,57 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 20:28:17
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:28:17
+ * @FilePath: \asio-learn-code\test\src\test_common.hpp
+ * @Description: 测试公共部分: EXPECT断言、失败计数，以及初始化日志并汇总结果的main模板
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef ASIO_LEARN_TEST_COMMON_HPP
+#define ASIO_LEARN_TEST_COMMON_HPP
+#include <functional>
+#include <iostream>
+
+#include "common/Log.hpp"
+
+// 每个测试文件单独生成可执行文件，失败计数在进程内共享
+inline int g_failures = 0;
+
+// 失败时只记录位置并计数，不中断后续用例
+#define EXPECT(cond)                                                          \
+  do                                                                          \
+  {                                                                           \
+    if (!(cond))                                                              \
+    {                                                                         \
+      std::cerr << __FILE__ << ":" << __LINE__ << " EXPECT(" #cond ") failed" \
+                << std::endl;                                                 \
+      ++g_failures;                                                           \
+    }                                                                         \
+  } while (0)
+
+/**
+ * @brief 按工作目录下的 log.yaml 初始化日志，执行用例，关闭日志后汇总结果
+ * @param suite 测试集名称，全部通过时输出 "<suite> tests passed"
+ * @param body 依次调用各个用例
+ * @return 进程退出码，有失败的断言时返回1
+ */
+inline int run_tests(const char* suite, const std::function<void()>& body)
+{
+  common::LoggerConfig config;
+  common::loadLogConfig(config, "log.yaml");
+  auto logger = common::create_logger();
+  logger->Init(config);
+
+  body();
+
+  logger->ShutDown();
+  if (g_failures)
+  {
+    std::cerr << g_failures << " expectation(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << suite << " tests passed" << std::endl;
+  return 0;
+}
+
+#endif  // ASIO_LEARN_TEST_COMMON_HPP
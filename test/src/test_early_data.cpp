@@ -0,0 +1,293 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 20:38:56
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:38:56
+ * @FilePath: \asio-learn-code\test\src\test_early_data.cpp
+ * @Description: 0-RTT防重放测试: 同一张票据第二次带早期数据被拒绝并计为重放，记录满时只拒绝不计重放
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#include <openssl/ssl.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "asio_learn/ssl/early_data.hpp"
+#include "test_common.hpp"
+
+using namespace asio_learn;
+using asio_learn::ssl::EarlyData;
+using asio_learn::ssl::EarlyDataOptions;
+using asio_learn::ssl::ReplayGuard;
+using namespace std::chrono_literals;
+
+static void test_replay_guard()
+{
+  ReplayGuard guard(2, 300s);
+  EXPECT(guard.first_use("a") == ReplayGuard::Use::first);
+  EXPECT(guard.first_use("a") == ReplayGuard::Use::replay);
+  EXPECT(guard.first_use("b") == ReplayGuard::Use::first);
+  // 满了以后新票据拒绝，已记录的照样认出是重放
+  EXPECT(guard.first_use("c") == ReplayGuard::Use::full);
+  EXPECT(guard.first_use("b") == ReplayGuard::Use::replay);
+
+  // 窗口为0时记录立即过期，同一张票据又算第一次
+  ReplayGuard expiring(1, 0s);
+  EXPECT(expiring.first_use("a") == ReplayGuard::Use::first);
+  EXPECT(expiring.first_use("a") == ReplayGuard::Use::first);
+}
+
+// 内存BIO上的一端
+struct Endpoint
+{
+  Endpoint(SSL_CTX* ctx, bool server) : ssl(SSL_new(ctx))
+  {
+    SSL_set_bio(ssl, BIO_new(BIO_s_mem()), BIO_new(BIO_s_mem()));
+    server ? SSL_set_accept_state(ssl) : SSL_set_connect_state(ssl);
+  }
+
+  // 没有关闭就释放的连接，OpenSSL会把它当前的会话标成不可复用，票据也跟着作废; 这里当作已经正常关闭
+  ~Endpoint()
+  {
+    SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    SSL_free(ssl);
+  }
+
+  // 取出这一端写出的全部字节
+  std::string take_output()
+  {
+    std::string out(BIO_ctrl_pending(SSL_get_wbio(ssl)), '\0');
+    if (!out.empty())
+    {
+      BIO_read(SSL_get_wbio(ssl), out.data(), static_cast<int>(out.size()));
+    }
+    return out;
+  }
+
+  void give_input(const std::string& data)
+  {
+    if (!data.empty())
+    {
+      BIO_write(SSL_get_rbio(ssl), data.data(), static_cast<int>(data.size()));
+    }
+  }
+
+  SSL* ssl;
+};
+
+// 客户端收到的票据，按到达顺序
+static std::vector<SSL_SESSION*> g_tickets;
+
+static int on_new_ticket(SSL* /*ssl*/, SSL_SESSION* session)
+{
+  g_tickets.push_back(session);
+  return 1;  // 接管引用
+}
+
+static void free_tickets()
+{
+  for (auto* session : g_tickets)
+  {
+    SSL_SESSION_free(session);
+  }
+  g_tickets.clear();
+}
+
+struct Contexts
+{
+  explicit Contexts(EarlyData& early_data)
+    : server(asio::ssl::context::tls_server)
+    , client(asio::ssl::context::tls_client)
+  {
+    for (auto* ctx : { server.native_handle(), client.native_handle() })
+    {
+      SSL_CTX_set_min_proto_version(ctx, TLS1_3_VERSION);
+      SSL_CTX_set_max_proto_version(ctx, TLS1_3_VERSION);
+    }
+    server.use_certificate_chain_file("resources/servercert.pem");
+    server.use_private_key_file("resources/serverkey.pem", asio::ssl::context::pem);
+    early_data.install(server);
+    SSL_CTX_set_session_cache_mode(client.native_handle(), SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(client.native_handle(), &on_new_ticket);
+  }
+
+  asio::ssl::context server;
+  asio::ssl::context client;
+};
+
+// 完整握手，之后客户端读一次把服务器发来的票据都收进g_tickets
+static bool full_handshake(Contexts& contexts)
+{
+  Endpoint client(contexts.client.native_handle(), false);
+  Endpoint server(contexts.server.native_handle(), true);
+  bool client_done = false;
+  bool server_done = false;
+  for (int round = 0; round < 20 && !(client_done && server_done); ++round)
+  {
+    if (!client_done)
+    {
+      client_done = SSL_do_handshake(client.ssl) == 1;
+    }
+    server.give_input(client.take_output());
+    if (!server_done)
+    {
+      server_done = SSL_do_handshake(server.ssl) == 1;
+    }
+    client.give_input(server.take_output());
+  }
+  char byte;
+  SSL_read(client.ssl, &byte, 1);
+  return client_done && server_done;
+}
+
+struct Resumption
+{
+  bool completed = false;
+  bool reused = false;
+  int server_status = SSL_EARLY_DATA_NOT_SENT;
+  int client_status = SSL_EARLY_DATA_NOT_SENT;
+  std::string received;  // 服务器收到的早期数据
+};
+
+// 用票据复用会话，早期数据和ClientHello一起发出; 服务器按EarlyDataHandshake的顺序先读早期数据再完成握手
+static Resumption resume_with_early_data(
+    Contexts& contexts, EarlyData& early_data, SSL_SESSION* ticket, const std::string& data)
+{
+  Resumption result;
+  Endpoint client(contexts.client.native_handle(), false);
+  Endpoint server(contexts.server.native_handle(), true);
+  SSL_set_session(client.ssl, ticket);
+  size_t written = 0;
+  if (SSL_write_early_data(client.ssl, data.data(), data.size(), &written) != 1 || written != data.size())
+  {
+    return result;
+  }
+
+  bool early_done = false;
+  bool client_done = false;
+  bool server_done = false;
+  char buffer[256];
+  for (int round = 0; round < 20 && !(client_done && server_done); ++round)
+  {
+    server.give_input(client.take_output());
+    while (!early_done)
+    {
+      size_t size = 0;
+      int ret = SSL_read_early_data(server.ssl, buffer, sizeof(buffer), &size);
+      if (ret == SSL_READ_EARLY_DATA_SUCCESS)
+      {
+        result.received.append(buffer, size);
+        continue;
+      }
+      if (ret == SSL_READ_EARLY_DATA_FINISH)
+      {
+        early_done = true;
+      }
+      else if (SSL_get_error(server.ssl, ret) != SSL_ERROR_WANT_READ)
+      {
+        return result;
+      }
+      break;
+    }
+    if (early_done && !server_done)
+    {
+      server_done = SSL_do_handshake(server.ssl) == 1;
+    }
+    client.give_input(server.take_output());
+    if (!client_done)
+    {
+      client_done = SSL_do_handshake(client.ssl) == 1;
+    }
+  }
+  if (!(client_done && server_done))
+  {
+    return result;
+  }
+  early_data.record_handshake(server.ssl);
+  result.completed = true;
+  result.reused = SSL_session_reused(server.ssl) == 1;
+  result.server_status = SSL_get_early_data_status(server.ssl);
+  result.client_status = SSL_get_early_data_status(client.ssl);
+  return result;
+}
+
+// 同一张票据复用两次: 第一次早期数据被接受，第二次会话照常复用，早期数据被拒绝并计为重放
+static void test_replayed_ticket_rejected()
+{
+  EarlyDataOptions options;
+  options.max_early_data = 1024;
+  EarlyData early_data(options);
+  Contexts contexts(early_data);
+  EXPECT(full_handshake(contexts));
+  EXPECT(!g_tickets.empty());
+  if (g_tickets.empty())
+  {
+    return;
+  }
+  SSL_SESSION* ticket = g_tickets.front();
+  EXPECT(SSL_SESSION_get_max_early_data(ticket) == 1024);
+  // OpenSSL客户端用过一次的TLS1.3票据就标成不可复用，先复制一份，模拟拿同一张票据再来一次的客户端
+  SSL_SESSION* copy = SSL_SESSION_dup(ticket);
+
+  auto first = resume_with_early_data(contexts, early_data, ticket, "GET /first");
+  EXPECT(first.completed && first.reused);
+  EXPECT(first.server_status == SSL_EARLY_DATA_ACCEPTED);
+  EXPECT(first.client_status == SSL_EARLY_DATA_ACCEPTED);
+  EXPECT(first.received == "GET /first");
+
+  auto replay = resume_with_early_data(contexts, early_data, copy, "GET /first");
+  SSL_SESSION_free(copy);
+  EXPECT(replay.completed && replay.reused);
+  EXPECT(replay.server_status == SSL_EARLY_DATA_REJECTED);
+  EXPECT(replay.client_status == SSL_EARLY_DATA_REJECTED);
+  EXPECT(replay.received.empty());
+
+  auto stats = early_data.stats();
+  EXPECT(stats.accepted == 1);
+  EXPECT(stats.rejected == 1);
+  EXPECT(stats.replays == 1);
+  free_tickets();
+}
+
+// 记录只容得下一张票据: 另一张没用过的票据被拒绝，但不算重放
+static void test_full_guard_rejects_without_replay()
+{
+  EarlyDataOptions options;
+  options.max_early_data = 1024;
+  options.replay_guard_capacity = 1;
+  EarlyData early_data(options);
+  Contexts contexts(early_data);
+  EXPECT(full_handshake(contexts));
+  // 服务器默认一次签发两张票据，各带自己的随机数
+  EXPECT(g_tickets.size() >= 2);
+  if (g_tickets.size() < 2)
+  {
+    free_tickets();
+    return;
+  }
+
+  auto first = resume_with_early_data(contexts, early_data, g_tickets[0], "GET /a");
+  EXPECT(first.completed && first.server_status == SSL_EARLY_DATA_ACCEPTED);
+
+  auto second = resume_with_early_data(contexts, early_data, g_tickets[1], "GET /b");
+  EXPECT(second.completed && second.reused);
+  EXPECT(second.server_status == SSL_EARLY_DATA_REJECTED);
+  EXPECT(second.received.empty());
+
+  auto stats = early_data.stats();
+  EXPECT(stats.accepted == 1);
+  EXPECT(stats.rejected == 1);
+  EXPECT(stats.replays == 0);
+  free_tickets();
+}
+
+int main()
+{
+  return run_tests("early data", []
+  {
+    test_replay_guard();
+    test_replayed_ticket_rejected();
+    test_full_guard_rejects_without_replay();
+  });
+}
@@ -0,0 +1,204 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 19:19:53
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:28:23
+ * @FilePath: \asio-learn-code\test\src\test_hot_restart.cpp
+ * @Description: 热重启测试: worker交出空闲会话，以及同一进程内新旧两个服务器之间的完整交接
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#ifndef __linux__
+#error "hot restart is only supported on Linux"
+#endif
+
+#include <unistd.h>
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "asio_learn/tcp_server_master_worker.hpp"
+#include "test_common.hpp"
+
+using namespace asio_learn;
+using namespace std::chrono_literals;
+
+static const tcp_endpoint LOOPBACK(asio::ip::make_address("127.0.0.1"), 0);
+
+// 在ioc上读满expected.size()字节并比较，超时返回false
+static bool read_echo(io_context& ioc, tcp_socket& socket, const std::string& expected)
+{
+  std::string buffer(expected.size(), '\0');
+  bool done = false;
+  error_code result;
+  asio::async_read(
+      socket,
+      asio::buffer(buffer),
+      [&](const error_code& ec, std::size_t)
+      {
+        done = true;
+        result = ec;
+      });
+  ioc.restart();
+  ioc.run_for(3s);
+  if (!done)
+  {
+    error_code ignored;
+    socket.cancel(ignored);
+    ioc.restart();
+    ioc.run();
+    return false;
+  }
+  return !result && buffer == expected;
+}
+
+static bool echo(io_context& ioc, tcp_socket& socket, const std::string& message)
+{
+  asio::write(socket, asio::buffer(message));
+  return read_echo(ioc, socket, message);
+}
+
+// 在worker的ioc上accept一个连接并交给worker
+static void add_session(tcp_acceptor& acceptor, details::Worker& worker, tcp_socket& client)
+{
+  client.connect(acceptor.local_endpoint());
+  tcp_endpoint peer;
+  tcp_socket accepted(worker.get_io_context());
+  acceptor.accept(accepted, peer);
+  worker.handle_new_connection(std::move(accepted), peer);
+}
+
+// 读已经完成、回调还在排队的会话不能交出，读到的数据照常处理; 真正空闲的会话交出句柄，未读的数据留在内核里
+static void test_release_skips_completed_read()
+{
+  io_context client_ioc;
+  tcp_acceptor acceptor(client_ioc, LOOPBACK);
+  details::Worker worker(0);
+  std::thread worker_thread([&]() { worker.run(); });
+
+  tcp_socket idle(client_ioc);
+  add_session(acceptor, worker, idle);
+  EXPECT(echo(client_ioc, idle, "hello"));
+  std::this_thread::sleep_for(50ms);
+
+  // 占住worker线程，期间busy连上并发出数据，然后排入释放请求:
+  // worker取出busy时首次读直接读到数据，读回调排在释放请求之后
+  std::promise<void> blocked;
+  asio::post(
+      worker.get_io_context(),
+      [&]()
+      {
+        blocked.set_value();
+        std::this_thread::sleep_for(200ms);
+      });
+  blocked.get_future().wait();
+  tcp_socket busy(client_ioc);
+  add_session(acceptor, worker, busy);
+  asio::write(busy, asio::buffer(std::string("late")));
+  std::this_thread::sleep_for(50ms);
+
+  std::promise<details::Worker::ReleasedConnections> released;
+  asio::post(
+      worker.get_io_context(),
+      [&]()
+      {
+        worker.release_idle_sessions([&](details::Worker::ReleasedConnections connections)
+                                     { released.set_value(std::move(connections)); });
+      });
+  auto connections = released.get_future().get();
+
+  // busy的数据不能丢: 要么留在worker上被回显，要么还在内核里随句柄交出
+  bool idle_released = false;
+  bool busy_released = false;
+  asio::write(idle, asio::buffer(std::string("kept")));
+  std::this_thread::sleep_for(50ms);
+  for (auto& [handle, peer] : connections)
+  {
+    tcp_socket adopted(client_ioc, asio::ip::tcp::v4(), handle);
+    if (peer.port() == idle.local_endpoint().port())
+    {
+      idle_released = true;
+      EXPECT(adopted.available() == 4);
+    }
+    else if (peer.port() == busy.local_endpoint().port())
+    {
+      busy_released = true;
+      EXPECT(adopted.available() == 4);
+    }
+  }
+  EXPECT(idle_released);
+  EXPECT(connections.size() == (busy_released ? 2u : 1u));
+  if (!busy_released)
+  {
+    EXPECT(read_echo(client_ioc, busy, "late"));
+    EXPECT(echo(client_ioc, busy, "still here"));
+  }
+
+  worker.stop();
+  worker_thread.join();
+}
+
+// 新服务器在同一进程内从旧服务器继承监听socket和空闲连接，旧服务器排空后自己退出
+static void test_restart_hands_over_listener_and_idle_connection()
+{
+  std::string control_path = "/tmp/asio_learn_test_hot_restart_" + std::to_string(::getpid()) + ".sock";
+  HotRestartOptions options;
+  options.control_path = control_path;
+  options.handoff_idle_connections = true;
+  options.drain_timeout = 3000ms;
+
+  // 先占一个空闲端口
+  tcp_endpoint endpoint;
+  {
+    io_context ioc;
+    tcp_acceptor probe(ioc, LOOPBACK);
+    endpoint = probe.local_endpoint();
+  }
+
+  auto old_server = std::make_unique<MasterWorkerTcpServer>(endpoint, 2, 0ms, options);
+  std::promise<void> old_exited;
+  std::thread old_thread(
+      [&]()
+      {
+        old_server->run();
+        old_exited.set_value();
+      });
+  std::this_thread::sleep_for(100ms);
+
+  io_context client_ioc;
+  tcp_socket client(client_ioc);
+  client.connect(endpoint);
+  EXPECT(echo(client_ioc, client, "before restart"));
+  // 客户端收到回显时写回调可能还没执行，等会话回到读上才算空闲
+  std::this_thread::sleep_for(50ms);
+
+  // 构造时阻塞到交接完成
+  auto new_server = std::make_unique<MasterWorkerTcpServer>(endpoint, 2, 0ms, options);
+  std::thread new_thread([&]() { new_server->run(); });
+
+  // 唯一的会话已经交出去，旧服务器不需要等它
+  EXPECT(old_exited.get_future().wait_for(2s) == std::future_status::ready);
+  EXPECT(echo(client_ioc, client, "after restart"));
+
+  tcp_socket fresh(client_ioc);
+  fresh.connect(endpoint);
+  EXPECT(echo(client_ioc, fresh, "new connection"));
+
+  old_thread.join();
+  old_server.reset();
+  new_server->stop();
+  new_thread.join();
+  new_server.reset();
+  ::unlink(control_path.c_str());
+}
+
+int main()
+{
+  return run_tests("hot restart", []
+  {
+    test_release_skips_completed_read();
+    test_restart_hands_over_listener_and_idle_connection();
+  });
+}
@@ -0,0 +1,313 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 19:39:22
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:26:57
+ * @FilePath: \asio-learn-code\test\src\test_ktls_keys.cpp
+ * @Description: kTLS密钥推导测试: RFC 8448和TLS1.2 PRF的已知向量，以及用导出的密钥和序号解开OpenSSL实际发出的记录
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "asio_learn/ssl/ktls.hpp"
+#include "test_common.hpp"
+
+using namespace asio_learn;
+using asio_learn::ssl::Ktls;
+
+static std::vector<unsigned char> from_hex(const std::string& hex)
+{
+  std::vector<unsigned char> out;
+  std::string digits;
+  for (char c : hex)
+  {
+    if (c != ' ')
+    {
+      digits.push_back(c);
+    }
+  }
+  for (size_t i = 0; i + 1 < digits.size(); i += 2)
+  {
+    out.push_back(static_cast<unsigned char>(std::stoul(digits.substr(i, 2), nullptr, 16)));
+  }
+  return out;
+}
+
+static std::vector<unsigned char> expand_label(const std::vector<unsigned char>& secret, const std::string& label, size_t size)
+{
+  std::vector<unsigned char> out(size);
+  if (!Ktls::hkdf_expand_label(EVP_sha256(), secret.data(), secret.size(), label, out.data(), out.size()))
+  {
+    out.clear();
+  }
+  return out;
+}
+
+// RFC 8448 3. Simple 1-RTT Handshake: 握手和应用流量密钥推导出的key和iv
+static void test_hkdf_expand_label_rfc8448()
+{
+  struct Case
+  {
+    const char* secret;
+    const char* key;
+    const char* iv;
+  };
+  const Case cases[] = {
+    // server_handshake_traffic_secret
+    { "b6 7b 7d 69 0c c1 6c 4e 75 e5 42 13 cb 2d 37 b4 e9 c9 12 bc de d9 10 5d 42 be fd 59 d3 91 ad 38",
+      "3f ce 51 60 09 c2 17 27 d0 f2 e4 e8 6e e4 03 bc",
+      "5d 31 3e b2 67 12 76 ee 13 00 0b 30" },
+    // client_handshake_traffic_secret
+    { "b3 ed db 12 6e 06 7f 35 a7 80 b3 ab f4 5e 2d 8f 3b 1a 95 07 38 f5 2e 96 00 74 6a 0e 27 a5 5a 21",
+      "db fa a6 93 d1 76 2c 5b 66 6a f5 d9 50 25 8d 01",
+      "5b d3 c7 1b 83 6e 0b 76 bb 73 26 5f" },
+    // server_application_traffic_secret_0
+    { "a1 1a f9 f0 55 31 f8 56 ad 47 11 6b 45 a9 50 32 82 04 b4 f4 4b fb 6b 3a 4b 4f 1f 3f cb 63 16 43",
+      "9f 02 28 3b 6c 9c 07 ef c2 6b b9 f2 ac 92 e3 56",
+      "cf 78 2b 88 dd 83 54 9a ad f1 e9 84" },
+  };
+  for (const auto& c : cases)
+  {
+    auto secret = from_hex(c.secret);
+    EXPECT(expand_label(secret, "key", 16) == from_hex(c.key));
+    EXPECT(expand_label(secret, "iv", 12) == from_hex(c.iv));
+  }
+}
+
+// RFC 5246没有附测试向量，这里用IETF TLS工作组流传的TLS1.2 PRF(SHA-256)向量
+static void test_tls12_prf()
+{
+  auto secret = from_hex("9b be 43 6b a9 40 f0 17 b1 76 52 84 9a 71 db 35");
+  auto seed = from_hex("a0 ba 9f 93 6c da 31 18 27 a6 f7 96 ff d5 19 8c");
+  auto expected = from_hex(
+      "e3 f2 29 ba 72 7b e1 7b 8d 12 26 20 55 7c d4 53 c2 aa b2 1d 07 c3 d4 95 32 9b 52 d4 e6 1e db 5a"
+      "6b 30 17 91 e9 0d 35 c9 c9 a4 6b 4e 14 ba f9 af 0f a0 22 f7 07 7d ef 17 ab fd 37 97 c0 56 4b ab"
+      "4f bc 91 66 6e 9d ef 9b 97 fc e3 4f 79 67 89 ba a4 80 82 d1 22 ee 42 c5 a7 2e 5a 51 10 ff f7 01"
+      "87 34 7b 66");
+  std::vector<unsigned char> out(expected.size());
+  EXPECT(Ktls::tls12_prf(
+      EVP_sha256(), secret.data(), secret.size(), "test label", seed.data(), seed.size(), out.data(), out.size()));
+  EXPECT(out == expected);
+}
+
+// 内存BIO上的一端
+struct Endpoint
+{
+  explicit Endpoint(SSL_CTX* ctx, bool server) : ssl(SSL_new(ctx))
+  {
+    SSL_set_bio(ssl, BIO_new(BIO_s_mem()), BIO_new(BIO_s_mem()));
+    server ? SSL_set_accept_state(ssl) : SSL_set_connect_state(ssl);
+    Ktls::prepare(ssl);
+  }
+
+  ~Endpoint()
+  {
+    SSL_free(ssl);
+  }
+
+  // 取出这一端写出的全部字节
+  std::string take_output()
+  {
+    std::string out(BIO_ctrl_pending(SSL_get_wbio(ssl)), '\0');
+    if (!out.empty())
+    {
+      BIO_read(SSL_get_wbio(ssl), out.data(), static_cast<int>(out.size()));
+    }
+    return out;
+  }
+
+  void give_input(const std::string& data)
+  {
+    if (!data.empty())
+    {
+      BIO_write(SSL_get_rbio(ssl), data.data(), static_cast<int>(data.size()));
+    }
+  }
+
+  SSL* ssl;
+};
+
+// 握手，之后双方各读一次把会话票据等握手后消息消费掉，两边的读序号都停在下一条记录上
+static bool handshake(Endpoint& client, Endpoint& server)
+{
+  bool client_done = false;
+  bool server_done = false;
+  for (int round = 0; round < 20; ++round)
+  {
+    if (!client_done)
+    {
+      client_done = SSL_do_handshake(client.ssl) == 1;
+    }
+    server.give_input(client.take_output());
+    if (!server_done)
+    {
+      server_done = SSL_do_handshake(server.ssl) == 1;
+    }
+    client.give_input(server.take_output());
+    if (client_done && server_done)
+    {
+      char byte;
+      SSL_read(client.ssl, &byte, 1);
+      SSL_read(server.ssl, &byte, 1);
+      return BIO_ctrl_pending(SSL_get_rbio(client.ssl)) == 0 && BIO_ctrl_pending(SSL_get_rbio(server.ssl)) == 0;
+    }
+  }
+  return false;
+}
+
+// 用一个方向的密钥和序号解开一条应用数据记录，和内核做的事情一样
+static bool open_record(const std::string& record, const Ktls::Keys& keys, uint64 seq, bool tls13, std::string& plain)
+{
+  constexpr size_t HEADER = 5;
+  constexpr size_t TAG = 16;
+  constexpr size_t EXPLICIT_NONCE = 8;
+  if (record.size() < HEADER + TAG || static_cast<uint8_t>(record[0]) != Ktls::RECORD_APPLICATION_DATA)
+  {
+    return false;
+  }
+  size_t length = static_cast<uint8_t>(record[3]) << 8 | static_cast<uint8_t>(record[4]);
+  if (record.size() != HEADER + length)
+  {
+    return false;
+  }
+  const auto* body = reinterpret_cast<const unsigned char*>(record.data()) + HEADER;
+  unsigned char nonce[12];
+  std::vector<unsigned char> aad;
+  const unsigned char* ciphertext = body;
+  size_t ciphertext_size = length - TAG;
+  if (tls13)
+  {
+    // iv和左补零的序号异或; 附加数据是记录头
+    std::memcpy(nonce, keys.iv.data(), sizeof(nonce));
+    for (int i = 0; i < 8; ++i)
+    {
+      nonce[4 + i] ^= static_cast<unsigned char>(seq >> (8 * (7 - i)));
+    }
+    aad.assign(record.begin(), record.begin() + HEADER);
+  }
+  else
+  {
+    // 4字节盐加记录里的8字节显式nonce; 附加数据是序号、类型、版本和明文长度
+    if (length < EXPLICIT_NONCE + TAG)
+    {
+      return false;
+    }
+    std::memcpy(nonce, keys.iv.data(), 4);
+    std::memcpy(nonce + 4, body, EXPLICIT_NONCE);
+    ciphertext += EXPLICIT_NONCE;
+    ciphertext_size -= EXPLICIT_NONCE;
+    for (int i = 0; i < 8; ++i)
+    {
+      aad.push_back(static_cast<unsigned char>(seq >> (8 * (7 - i))));
+    }
+    aad.insert(aad.end(), record.begin(), record.begin() + 3);
+    aad.push_back(static_cast<unsigned char>(ciphertext_size >> 8));
+    aad.push_back(static_cast<unsigned char>(ciphertext_size & 0xff));
+  }
+
+  const EVP_CIPHER* cipher = keys.key_size == 16 ? EVP_aes_128_gcm() : EVP_aes_256_gcm();
+  EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+  std::vector<unsigned char> out(ciphertext_size + 16);
+  int size = 0;
+  int final_size = 0;
+  bool ok = EVP_DecryptInit_ex(ctx, cipher, nullptr, keys.key.data(), nonce) == 1 &&
+            EVP_DecryptUpdate(ctx, nullptr, &size, aad.data(), static_cast<int>(aad.size())) == 1 &&
+            EVP_DecryptUpdate(ctx, out.data(), &size, ciphertext, static_cast<int>(ciphertext_size)) == 1 &&
+            EVP_CIPHER_CTX_ctrl(
+                ctx, EVP_CTRL_GCM_SET_TAG, TAG, const_cast<unsigned char*>(ciphertext + ciphertext_size)) == 1 &&
+            EVP_DecryptFinal_ex(ctx, out.data() + size, &final_size) == 1;
+  EVP_CIPHER_CTX_free(ctx);
+  if (!ok)
+  {
+    return false;
+  }
+  out.resize(static_cast<size_t>(size + final_size));
+  if (tls13)
+  {
+    // 明文后面是真实的记录类型和可选的填充0
+    while (!out.empty() && out.back() == 0)
+    {
+      out.pop_back();
+    }
+    if (out.empty() || out.back() != Ktls::RECORD_APPLICATION_DATA)
+    {
+      return false;
+    }
+    out.pop_back();
+  }
+  plain.assign(out.begin(), out.end());
+  return true;
+}
+
+// 真实握手后导出的密钥和序号能解开对端随后发出的记录; TLS1.3服务端握手后先发了票据，发送序号不是0
+static void test_exported_keys_open_records(const char* version, const char* cipher)
+{
+  bool tls13 = std::string(version) == "1.3";
+  asio::ssl::context server_ctx(asio::ssl::context::tls_server);
+  asio::ssl::context client_ctx(asio::ssl::context::tls_client);
+  for (auto* ctx : { server_ctx.native_handle(), client_ctx.native_handle() })
+  {
+    int v = tls13 ? TLS1_3_VERSION : TLS1_2_VERSION;
+    SSL_CTX_set_min_proto_version(ctx, v);
+    SSL_CTX_set_max_proto_version(ctx, v);
+    tls13 ? SSL_CTX_set_ciphersuites(ctx, cipher) : SSL_CTX_set_cipher_list(ctx, cipher);
+  }
+  server_ctx.use_certificate_chain_file("resources/servercert.pem");
+  server_ctx.use_private_key_file("resources/serverkey.pem", asio::ssl::context::pem);
+  Ktls::install(server_ctx);
+  Ktls::install(client_ctx);
+
+  Endpoint client(client_ctx.native_handle(), false);
+  Endpoint server(server_ctx.native_handle(), true);
+  EXPECT(handshake(client, server));
+
+  Ktls::Keys client_tx, client_rx, server_tx, server_rx;
+  uint64 client_tx_seq = 0, client_rx_seq = 0, server_tx_seq = 0, server_rx_seq = 0;
+  std::string reason;
+  EXPECT(Ktls::export_keys(client.ssl, client_tx, client_tx_seq, client_rx, client_rx_seq, reason));
+  EXPECT(Ktls::export_keys(server.ssl, server_tx, server_tx_seq, server_rx, server_rx_seq, reason));
+  EXPECT(client_tx_seq == server_rx_seq);
+  EXPECT(server_tx_seq == client_rx_seq);
+  if (tls13)
+  {
+    EXPECT(server_tx_seq > 0);
+  }
+
+  std::string plain;
+  EXPECT(SSL_write(client.ssl, "ping", 4) == 4);
+  auto record = client.take_output();
+  EXPECT(open_record(record, client_tx, client_tx_seq, tls13, plain) && plain == "ping");
+  EXPECT(open_record(record, server_rx, server_rx_seq, tls13, plain) && plain == "ping");
+  // 序号错一位就解不开
+  EXPECT(!open_record(record, server_rx, server_rx_seq + 1, tls13, plain));
+
+  EXPECT(SSL_write(server.ssl, "pong", 4) == 4);
+  record = server.take_output();
+  EXPECT(open_record(record, server_tx, server_tx_seq, tls13, plain) && plain == "pong");
+  EXPECT(open_record(record, client_rx, client_rx_seq, tls13, plain) && plain == "pong");
+
+#ifdef ASIO_LEARN_HAS_KTLS
+  // OpenSSL缓冲里还有没读的记录时两个方向都不开，不会碰socket
+  client.give_input(record);
+  auto status = Ktls::enable(client.ssl, -1);
+  EXPECT(!status.tx && !status.rx && status.reason == "pending_input");
+#endif
+}
+
+int main()
+{
+  return run_tests("ktls key", []
+  {
+    test_hkdf_expand_label_rfc8448();
+    test_tls12_prf();
+    test_exported_keys_open_records("1.2", "ECDHE-RSA-AES128-GCM-SHA256");
+    test_exported_keys_open_records("1.2", "ECDHE-RSA-AES256-GCM-SHA384");
+    test_exported_keys_open_records("1.3", "TLS_AES_128_GCM_SHA256");
+    test_exported_keys_open_records("1.3", "TLS_AES_256_GCM_SHA384");
+  });
+}
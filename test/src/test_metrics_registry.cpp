@@ -0,0 +1,214 @@
+/**
+ * @Author: running-code-pp 3320996652@qq.com
+ * @Date: 2026-10-18 17:32:51
+ * @LastEditors: running-code-pp 3320996652@qq.com
+ * @LastEditTime: 2026-10-18 20:34:15
+ * @FilePath: \asio-learn-code\test\src\test_metrics_registry.cpp
+ * @Description: 指标注册表、/metrics 端点和循环延迟探针测试
+ * @Copyright: Copyright (c) 2025 by ${git_name}, All Rights Reserved.
+ */
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "asio_learn/metrics/loop_lag_monitor.hpp"
+#include "asio_learn/metrics/metrics_server.hpp"
+#include "asio_learn/metrics/server_metrics.hpp"
+#include "test_common.hpp"
+
+using namespace asio_learn;
+using namespace std::chrono_literals;
+
+static bool contains(const std::string& text, const std::string& needle)
+{
+  return text.find(needle) != std::string::npos;
+}
+
+// 多线程写同一个指标，分片求和后不丢计数
+static void test_sharded_counts()
+{
+  metrics::Registry registry;
+  auto& counter = registry.counter("test_events_total", "events");
+  auto& gauge = registry.gauge("test_inflight", "inflight");
+  constexpr int THREADS = 8;
+  constexpr int PER_THREAD = 100000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREADS; ++t)
+  {
+    threads.emplace_back(
+        [&]()
+        {
+          for (int i = 0; i < PER_THREAD; ++i)
+          {
+            counter.inc();
+            gauge.inc();
+          }
+          for (int i = 0; i < PER_THREAD / 2; ++i)
+          {
+            gauge.dec();
+          }
+        });
+  }
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+  EXPECT(counter.value() == static_cast<uint64_t>(THREADS) * PER_THREAD);
+  EXPECT(gauge.value() == static_cast<int64_t>(THREADS) * PER_THREAD / 2);
+  gauge.set(7);
+  EXPECT(gauge.value() == 7);
+  // 同名同标签返回同一个对象
+  EXPECT(&registry.counter("test_events_total", "events") == &counter);
+}
+
+static void test_histogram_and_scrape()
+{
+  metrics::Registry registry;
+  auto& histogram = registry.histogram("test_latency_seconds", "latency", { 0.001, 0.01 }, { { "server", "a\"b" } });
+  histogram.observe(500us);
+  histogram.observe(1ms);  // 等于上界的落在该桶
+  histogram.observe(5ms);
+  histogram.observe(2s);
+  auto snap = histogram.snapshot();
+  EXPECT(snap.count == 4);
+  EXPECT(snap.cumulative.size() == 3);
+  EXPECT(snap.cumulative[0] == 2 && snap.cumulative[1] == 3 && snap.cumulative[2] == 4);
+
+  auto text = registry.scrape();
+  EXPECT(contains(text, "# TYPE test_latency_seconds histogram\n"));
+  EXPECT(contains(text, "test_latency_seconds_bucket{server=\"a\\\"b\",le=\"0.001\"} 2\n"));
+  EXPECT(contains(text, "test_latency_seconds_bucket{server=\"a\\\"b\",le=\"+Inf\"} 4\n"));
+  EXPECT(contains(text, "test_latency_seconds_count{server=\"a\\\"b\"} 4\n"));
+
+  bool threw = false;
+  try
+  {
+    registry.counter("test_latency_seconds", "wrong type");
+  }
+  catch (const std::invalid_argument&)
+  {
+    threw = true;
+  }
+  EXPECT(threw);
+}
+
+static std::string http_get(uint16 port, const std::string& target)
+{
+  io_context ioc;
+  tcp_socket socket(ioc);
+  socket.connect(tcp_endpoint(asio::ip::make_address("127.0.0.1"), port));
+  std::string request = "GET " + target + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  asio::write(socket, asio::buffer(request));
+  std::string response;
+  error_code ec;
+  asio::read(socket, asio::dynamic_buffer(response), ec);
+  return response;
+}
+
+static void test_endpoint()
+{
+  metrics::Registry registry;
+  auto server_metrics = metrics::ServerMetrics::create(registry, "test");
+  server_metrics->accepts.inc(3);
+  metrics::MetricsServer server(registry, tcp_endpoint(asio::ip::make_address("127.0.0.1"), 0));
+  server.start();
+
+  auto ok = http_get(server.port(), "/metrics");
+  EXPECT(ok.starts_with("HTTP/1.1 200 OK\r\n"));
+  EXPECT(contains(ok, "asio_learn_accepts_total{server=\"test\"} 3\n"));
+  EXPECT(contains(ok, "asio_learn_handler_duration_seconds_count{server=\"test\"} 0\n"));
+  auto missing = http_get(server.port(), "/");
+  EXPECT(missing.starts_with("HTTP/1.1 404"));
+  server.stop();
+}
+
+// 热重启时端口还被旧进程占着: 不抛异常，旧监听关掉后接上
+static void test_endpoint_waits_for_port()
+{
+  metrics::Registry registry;
+  io_context ioc;
+  auto blocker = std::make_unique<tcp_acceptor>(ioc, tcp_endpoint(asio::ip::make_address("127.0.0.1"), 0));
+  auto endpoint = blocker->local_endpoint();
+
+  bool threw = false;
+  try
+  {
+    metrics::MetricsServer strict(registry, endpoint);
+  }
+  catch (const asio::system_error&)
+  {
+    threw = true;
+  }
+  EXPECT(threw);
+
+  metrics::MetricsServer server(registry, endpoint, 20ms);
+  server.start();
+  std::this_thread::sleep_for(60ms);
+  EXPECT(server.port() == 0);
+  blocker.reset();
+  for (int i = 0; i < 100 && server.port() == 0; ++i)
+  {
+    std::this_thread::sleep_for(10ms);
+  }
+  EXPECT(server.port() == endpoint.port());
+  EXPECT(http_get(endpoint.port(), "/metrics").starts_with("HTTP/1.1 200 OK\r\n"));
+  server.stop();
+}
+
+// 阻塞循环的回调让探针迟到; 几条不断重新post自己的回调链模拟饱和的循环，标记前面应该排着这几条链
+static void test_loop_lag()
+{
+  metrics::Registry registry;
+  io_context ioc;
+  metrics::LoopLagOptions options;
+  options.interval = 20ms;
+  options.warn_threshold = 30ms;
+  options.count_handlers = true;
+  metrics::LoopLagMonitor monitor(ioc, "test-loop", options, &registry);
+  monitor.start();
+
+  steady_timer block(ioc, 10ms);
+  block.async_wait([&](const error_code&) { std::this_thread::sleep_for(80ms); });
+
+  constexpr int CHAINS = 5;
+  auto busy_until = std::chrono::steady_clock::now() + 300ms;  // 一直忙到循环停止
+  std::function<void()> spin = [&]()
+  {
+    std::this_thread::sleep_for(100us);
+    if (std::chrono::steady_clock::now() < busy_until)
+    {
+      asio::post(ioc, spin);
+    }
+  };
+  for (int i = 0; i < CHAINS; ++i)
+  {
+    asio::post(ioc, spin);
+  }
+  steady_timer done(ioc, 200ms);
+  done.async_wait([&](const error_code&) { ioc.stop(); });
+  monitor.run();
+
+  auto stats = monitor.stats();
+  EXPECT(stats.samples >= 2);
+  EXPECT(stats.lag_ns_max >= 30'000'000);
+  EXPECT(stats.warnings >= 1);
+  EXPECT(stats.pending_handlers_last >= CHAINS - 1);
+  auto text = registry.scrape();
+  EXPECT(contains(text, "asio_learn_loop_lag_warnings_total{loop=\"test-loop\"}"));
+  EXPECT(contains(text, "asio_learn_loop_lag_seconds_bucket{loop=\"test-loop\",le=\"0.05\"}"));
+}
+
+int main()
+{
+  return run_tests("metrics registry", []
+  {
+    test_sharded_counts();
+    test_histogram_and_scrape();
+    test_endpoint();
+    test_endpoint_waits_for_port();
+    test_loop_lag();
+  });
+}